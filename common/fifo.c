@@ -49,6 +49,13 @@ fifo_delete(FIFO *self)
     if (!self)
         return;
 
+    while (self->spare)
+    {
+        udp = self->spare;
+        self->spare = udp->next;
+        g_free(udp);
+    }
+
      if (!self->head)
      {
          /* FIFO is empty */
@@ -82,6 +89,23 @@ fifo_delete(FIFO *self)
     g_free(self);
 }
 
+/**
+ * Give a removed node back for reuse by fifo_add_item
+ *****************************************************************************/
+
+static void
+fifo_free_node(FIFO *self, USER_DATA *udp)
+{
+    if (self->num_spare < FIFO_MAX_SPARE)
+    {
+        udp->next = self->spare;
+        self->spare = udp;
+        self->num_spare++;
+        return;
+    }
+    g_free(udp);
+}
+
 /**
  * Add an item to the specified FIFO
  *
@@ -99,7 +123,13 @@ fifo_add_item(FIFO *self, void *item)
     if (!self || !item)
         return -1;
 
-    if ((udp = (USER_DATA *) g_malloc(sizeof(USER_DATA), 0)) == 0)
+    if (self->spare)
+    {
+        udp = self->spare;
+        self->spare = udp->next;
+        self->num_spare--;
+    }
+    else if ((udp = (USER_DATA *) g_malloc(sizeof(USER_DATA), 0)) == 0)
         return -1;
 
     udp->item = item;
@@ -141,7 +171,7 @@ fifo_remove_item(FIFO *self)
     {
         /* only one item in FIFO */
         item = self->head->item;
-        g_free(self->head);
+        fifo_free_node(self, self->head);
         self->head = 0;
         self->tail = 0;
         return item;
@@ -151,7 +181,7 @@ fifo_remove_item(FIFO *self)
     udp = self->head;
     item = self->head->item;
     self->head = self->head->next;
-    g_free(udp);
+    fifo_free_node(self, udp);
     return item;
 }
 
@@ -36,8 +36,12 @@ typedef struct fifo
     USER_DATA *head;
     USER_DATA *tail;
     int        auto_free;
+    USER_DATA *spare; /* removed nodes kept for reuse */
+    int        num_spare;
 } FIFO;
 
+#define FIFO_MAX_SPARE 64
+
 FIFO * fifo_create(void);
 void   fifo_delete(FIFO *self);
 int    fifo_add_item(FIFO *self, void *item);
@@ -52,6 +52,7 @@
 #include <sys/stat.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
+#include <sys/mman.h>
 #include <dlfcn.h>
 #include <arpa/inet.h>
 #include <netdb.h>
@@ -87,6 +88,9 @@ extern char **environ;
 
 #if defined(__linux__)
 #include <linux/unistd.h>
+/* file sealing from linux/fcntl.h, glibc only has it with _GNU_SOURCE */
+#define G_F_GET_SEALS (1024 + 10)
+#define G_F_SEAL_SHRINK 0x0002
 #endif
 
 /* sys/ucred.h needs to be included to use struct xucred
@@ -585,6 +589,19 @@ g_sck_local_socket(void)
 #endif
 }
 
+/*****************************************************************************/
+/* a connected pair of local stream sockets
+   returns error */
+int
+g_sck_local_socketpair(int sck[2])
+{
+#if defined(_WIN32)
+    return 1;
+#else
+    return socketpair(PF_LOCAL, SOCK_STREAM, 0, sck) != 0;
+#endif
+}
+
 /*****************************************************************************/
 int
 g_sck_vsock_socket(void)
@@ -1477,6 +1494,75 @@ g_sck_recv(int sck, void *ptr, int len, int flags)
 #endif
 }
 
+/*****************************************************************************/
+/* like g_sck_recv but also collects file descriptors passed with
+   SCM_RIGHTS, on entry *num_fds is the size of fds, on return it is the
+   number of descriptors received */
+int
+g_sck_recv_fds(int sck, void *ptr, int len, int *fds, int *num_fds)
+{
+#if defined(_WIN32)
+    *num_fds = 0;
+    return recv(sck, (char *)ptr, len, 0);
+#else
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    char control[CMSG_SPACE(sizeof(int) * 8)];
+    int max_fds;
+    int count;
+    int index;
+    int rv;
+
+    max_fds = *num_fds;
+    *num_fds = 0;
+    g_memset(&msg, 0, sizeof(msg));
+    iov.iov_base = ptr;
+    iov.iov_len = len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+#if defined(MSG_CMSG_CLOEXEC)
+    rv = recvmsg(sck, &msg, MSG_CMSG_CLOEXEC);
+#else
+    rv = recvmsg(sck, &msg, 0);
+#endif
+    if (rv < 0)
+    {
+        return rv;
+    }
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != 0;
+         cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+        {
+            continue;
+        }
+        count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (index = 0; index < count; index++)
+        {
+            if (*num_fds < max_fds)
+            {
+                g_memcpy(fds + *num_fds,
+                         CMSG_DATA(cmsg) + index * sizeof(int), sizeof(int));
+                *num_fds += 1;
+            }
+            else
+            {
+                /* no room, do not leak it */
+                int fd;
+
+                g_memcpy(&fd, CMSG_DATA(cmsg) + index * sizeof(int),
+                         sizeof(int));
+                close(fd);
+            }
+        }
+    }
+    return rv;
+#endif
+}
+
 /*****************************************************************************/
 int
 g_sck_send(int sck, const void *ptr, int len, int flags)
@@ -3192,6 +3278,53 @@ g_fork(void)
 #endif
 }
 
+/*****************************************************************************/
+/* forks and execs path with fd as child_fd in the child, every other
+   descriptor above 2 closed and no signal blocked, nothing but async
+   signal safe calls are made
+   between the fork and the exec so other threads can hold any lock
+   returns the pid of the child or -1
+   does not work in win32 */
+int
+g_spawn_with_fd(const char *path, char *args[], int fd, int child_fd)
+{
+#if defined(_WIN32)
+    return -1;
+#else
+    long max_fd;
+    int index;
+    int rv;
+    sigset_t set;
+
+    sigemptyset(&set);
+    max_fd = sysconf(_SC_OPEN_MAX);
+    if ((max_fd < 0) || (max_fd > 65536))
+    {
+        max_fd = 65536;
+    }
+    rv = fork();
+    if (rv == 0)
+    {
+        if ((fd != child_fd) && (dup2(fd, child_fd) == -1))
+        {
+            _exit(1);
+        }
+        for (index = 3; index < max_fd; index++)
+        {
+            if (index != child_fd)
+            {
+                close(index);
+            }
+        }
+        /* the mask of the forking thread survives the exec */
+        sigprocmask(SIG_SETMASK, &set, 0);
+        execv(path, args);
+        _exit(1);
+    }
+    return rv;
+#endif
+}
+
 /*****************************************************************************/
 /* does not work in win32 */
 int
@@ -3406,6 +3539,13 @@ g_sigterm(int pid)
 #endif
 }
 
+/*****************************************************************************/
+/* the passwd and group lookups run on several threads at once so only the
+   reentrant calls are used, the entry is copied into a buffer that grows
+   until it fits */
+#define G_PWGR_BUF_START 1024
+#define G_PWGR_BUF_MAX (1024 * 1024)
+
 /*****************************************************************************/
 /* returns 0 if ok */
 /* the caller is responsible to free the buffs */
@@ -3417,11 +3557,28 @@ g_getuser_info(const char *username, int *gid, int *uid, char **shell,
 #if defined(_WIN32)
     return 1;
 #else
+    struct passwd pwd;
     struct passwd *pwd_1;
+    char *buf;
+    int bytes;
+    int error;
 
-    pwd_1 = getpwnam(username);
+    pwd_1 = 0;
+    buf = 0;
+    error = ERANGE;
+    for (bytes = G_PWGR_BUF_START;
+         (error == ERANGE) && (bytes <= G_PWGR_BUF_MAX); bytes *= 2)
+    {
+        g_free(buf);
+        buf = (char *) g_malloc(bytes, 0);
+        if (buf == 0)
+        {
+            return 1;
+        }
+        error = getpwnam_r(username, &pwd, buf, bytes, &pwd_1);
+    }
 
-    if (pwd_1 != 0)
+    if ((error == 0) && (pwd_1 != 0))
     {
         if (gid != 0)
         {
@@ -3448,9 +3605,11 @@ g_getuser_info(const char *username, int *gid, int *uid, char **shell,
             *gecos = g_strdup(pwd_1->pw_gecos);
         }
 
+        g_free(buf);
         return 0;
     }
 
+    g_free(buf);
     return 1;
 #endif
 }
@@ -3464,20 +3623,39 @@ g_getgroup_info(const char *groupname, int *gid)
 #if defined(_WIN32)
     return 1;
 #else
+    struct group grp;
     struct group *g;
+    char *buf;
+    int bytes;
+    int error;
 
-    g = getgrnam(groupname);
+    g = 0;
+    buf = 0;
+    error = ERANGE;
+    for (bytes = G_PWGR_BUF_START;
+         (error == ERANGE) && (bytes <= G_PWGR_BUF_MAX); bytes *= 2)
+    {
+        g_free(buf);
+        buf = (char *) g_malloc(bytes, 0);
+        if (buf == 0)
+        {
+            return 1;
+        }
+        error = getgrnam_r(groupname, &grp, buf, bytes, &g);
+    }
 
-    if (g != 0)
+    if ((error == 0) && (g != 0))
     {
         if (gid != 0)
         {
             *gid = g->gr_gid;
         }
 
+        g_free(buf);
         return 0;
     }
 
+    g_free(buf);
     return 1;
 #endif
 }
@@ -3492,13 +3670,31 @@ g_check_user_in_group(const char *username, int gid, int *ok)
 #if defined(_WIN32)
     return 1;
 #else
+    struct group grp;
     struct group *groups;
+    char *buf;
+    int bytes;
+    int error;
     int i;
 
-    groups = getgrgid(gid);
+    groups = 0;
+    buf = 0;
+    error = ERANGE;
+    for (bytes = G_PWGR_BUF_START;
+         (error == ERANGE) && (bytes <= G_PWGR_BUF_MAX); bytes *= 2)
+    {
+        g_free(buf);
+        buf = (char *) g_malloc(bytes, 0);
+        if (buf == 0)
+        {
+            return 1;
+        }
+        error = getgrgid_r(gid, &grp, buf, bytes, &groups);
+    }
 
-    if (groups == 0)
+    if ((error != 0) || (groups == 0))
     {
+        g_free(buf);
         return 1;
     }
 
@@ -3516,6 +3712,7 @@ g_check_user_in_group(const char *username, int gid, int *ok)
         i++;
     }
 
+    g_free(buf);
     return 0;
 #endif
 }
@@ -3759,6 +3956,55 @@ g_shmdt(const void *shmaddr)
 #endif
 }
 
+/*****************************************************************************/
+/* maps bytes of the file fd shared, returns pointer or nil on error
+   the file comes from another process, touching pages past its end raises
+   SIGBUS, so it must be big enough and, on linux, sealed against shrinking */
+void *
+g_mmap_fd(int fd, int bytes)
+{
+#if defined(_WIN32)
+    return 0;
+#else
+    void *ptr;
+    struct stat st;
+
+    if ((bytes < 1) || (fstat(fd, &st) != 0) || (st.st_size < bytes))
+    {
+        return 0;
+    }
+#if defined(__linux__)
+    {
+        int seals;
+
+        seals = fcntl(fd, G_F_GET_SEALS);
+        if ((seals == -1) || !(seals & G_F_SEAL_SHRINK))
+        {
+            return 0;
+        }
+    }
+#endif
+    ptr = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED)
+    {
+        return 0;
+    }
+    return ptr;
+#endif
+}
+
+/*****************************************************************************/
+/* returns -1 on error 0 on success */
+int
+g_munmap(void *ptr, int bytes)
+{
+#if defined(_WIN32)
+    return -1;
+#else
+    return munmap(ptr, bytes);
+#endif
+}
+
 /*****************************************************************************/
 /* returns -1 on error 0 on success */
 int
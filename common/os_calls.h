@@ -62,6 +62,7 @@ int      g_sck_get_send_buffer_bytes(int sck, int *bytes);
 int      g_sck_set_recv_buffer_bytes(int sck, int bytes);
 int      g_sck_get_recv_buffer_bytes(int sck, int *bytes);
 int      g_sck_local_socket(void);
+int      g_sck_local_socketpair(int sck[2]);
 int      g_sck_vsock_socket(void);
 int      g_sck_get_peer_cred(int sck, int *pid, int *uid, int *gid);
 void     g_sck_close(int sck);
@@ -78,6 +79,7 @@ int      g_sck_accept(int sck, char *addr, int addr_bytes,
                              char *port, int port_bytes);
 int      g_sck_recv(int sck, void* ptr, int len, int flags);
 int      g_sck_send(int sck, const void* ptr, int len, int flags);
+int      g_sck_recv_fds(int sck, void* ptr, int len, int* fds, int* num_fds);
 int      g_sck_last_error_would_block(int sck);
 int      g_sck_socket_ok(int sck);
 int      g_sck_can_send(int sck, int millis);
@@ -154,6 +156,7 @@ void     g_signal_terminate(void (*func)(int));
 void     g_signal_pipe(void (*func)(int));
 void     g_signal_usr1(void (*func)(int));
 int      g_fork(void);
+int      g_spawn_with_fd(const char* path, char* args[], int fd, int child_fd);
 int      g_setgid(int pid);
 int      g_initgroups(const char* user, int gid);
 int      g_getuid(void);
@@ -181,6 +184,8 @@ int      g_save_to_bmp(const char* filename, char* data, int stride_bytes,
 int      g_text2bool(const char *s);
 void *   g_shmat(int shmid);
 int      g_shmdt(const void *shmaddr);
+void *   g_mmap_fd(int fd, int bytes);
+int      g_munmap(void *ptr, int bytes);
 int      g_gethostname(char *name, int len);
 int      g_mirror_memcpy(void *dst, const void *src, int len);
 
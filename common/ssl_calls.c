@@ -34,15 +34,39 @@
 #include <openssl/rsa.h>
 #include <openssl/dh.h>
 #include <openssl/crypto.h>
+#include <openssl/rand.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#endif
 
 #include "os_calls.h"
 #include "arch.h"
 #include "ssl_calls.h"
 #include "trans.h"
+#include "thread_calls.h"
 #include "log.h"
 
 #define SSL_WANT_READ_WRITE_TIMEOUT 100
 
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+#define XRDP_KTLS
+#endif
+
+/* session ticket keys, created and rotated by the listener and inherited
+   by the forked connection processes so any of them can resume a session
+   started by another, index 0 is current, index 1 is previous */
+struct ssl_ticket_key
+{
+    int valid;
+    unsigned char name[16];
+    unsigned char aes_key[32];
+    unsigned char hmac_key[32];
+};
+
+static struct ssl_ticket_key g_ticket_keys[2];
+static int g_ticket_key_lifetime = 0;
+static tbus g_ticket_key_mutex = 0;
+
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
 static inline HMAC_CTX *
 HMAC_CTX_new(void)
@@ -111,6 +135,7 @@ ssl_init(void)
 {
     SSL_load_error_strings();
     SSL_library_init();
+    g_ticket_key_mutex = tc_mutex_create();
     return 0;
 }
 
@@ -118,6 +143,9 @@ ssl_init(void)
 int
 ssl_finish(void)
 {
+    g_memset(g_ticket_keys, 0, sizeof(g_ticket_keys));
+    tc_mutex_delete(g_ticket_key_mutex);
+    g_ticket_key_mutex = 0;
     return 0;
 }
 
@@ -589,6 +617,172 @@ static DH *ssl_get_dh2236()
     return dh;
 }
 
+/*****************************************************************************/
+/* generates a new current session ticket key, the old one is kept to
+   decrypt tickets issued before the rotation
+   lifetime is in seconds, returns error */
+int
+ssl_tls_ticket_keys_rotate(int lifetime)
+{
+    struct ssl_ticket_key key;
+
+    if (RAND_bytes(key.name, sizeof(key.name)) != 1 ||
+        RAND_bytes(key.aes_key, sizeof(key.aes_key)) != 1 ||
+        RAND_bytes(key.hmac_key, sizeof(key.hmac_key)) != 1)
+    {
+        log_message(LOG_LEVEL_ERROR, "ssl_tls_ticket_keys_rotate: "
+                    "RAND_bytes failed");
+        return 1;
+    }
+    key.valid = 1;
+    tc_mutex_lock(g_ticket_key_mutex);
+    g_ticket_keys[1] = g_ticket_keys[0];
+    g_ticket_keys[0] = key;
+    g_ticket_key_lifetime = lifetime;
+    tc_mutex_unlock(g_ticket_key_mutex);
+    g_memset(&key, 0, sizeof(key));
+    log_message(LOG_LEVEL_DEBUG, "ssl_tls_ticket_keys_rotate: new session "
+                "ticket key, lifetime %d seconds", lifetime);
+    return 0;
+}
+
+/*****************************************************************************/
+/* finds the key for a ticket, returns 0 not found, 1 current, 2 previous */
+static int
+ssl_tls_ticket_key_find(const unsigned char *key_name,
+                        struct ssl_ticket_key *key, int enc)
+{
+    int index;
+    int rv;
+
+    rv = 0;
+    tc_mutex_lock(g_ticket_key_mutex);
+    for (index = 0; index < 2; index++)
+    {
+        if (!g_ticket_keys[index].valid)
+        {
+            continue;
+        }
+        if (enc || g_memcmp(key_name, g_ticket_keys[index].name,
+                            sizeof(g_ticket_keys[index].name)) == 0)
+        {
+            *key = g_ticket_keys[index];
+            rv = index + 1;
+            break;
+        }
+    }
+    tc_mutex_unlock(g_ticket_key_mutex);
+    return rv;
+}
+
+/*****************************************************************************/
+/* OpenSSL ticket key callback
+   returns -1 error, 0 no key (full handshake), 1 ok, 2 ok and renew ticket */
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+static int
+ssl_tls_ticket_key_cb(SSL *ssl, unsigned char *key_name, unsigned char *iv,
+                      EVP_CIPHER_CTX *cipher_ctx, EVP_MAC_CTX *hmac_ctx,
+                      int enc)
+#else
+static int
+ssl_tls_ticket_key_cb(SSL *ssl, unsigned char *key_name, unsigned char *iv,
+                      EVP_CIPHER_CTX *cipher_ctx, HMAC_CTX *hmac_ctx,
+                      int enc)
+#endif
+{
+    struct ssl_ticket_key key;
+    int found;
+    int rv;
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    OSSL_PARAM params[2];
+    char digest[] = "SHA256"; /* the param takes a non const pointer */
+#endif
+
+    found = ssl_tls_ticket_key_find(key_name, &key, enc);
+    if (found == 0)
+    {
+        return enc ? -1 : 0;
+    }
+    rv = 1;
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    params[0] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+                                                 digest, 0);
+    params[1] = OSSL_PARAM_construct_end();
+    if (EVP_MAC_init(hmac_ctx, key.hmac_key, sizeof(key.hmac_key),
+                     params) != 1)
+    {
+        rv = -1;
+    }
+#else
+    if (HMAC_Init_ex(hmac_ctx, key.hmac_key, sizeof(key.hmac_key),
+                     EVP_sha256(), NULL) != 1)
+    {
+        rv = -1;
+    }
+#endif
+    if (rv == 1 && enc)
+    {
+        g_memcpy(key_name, key.name, sizeof(key.name));
+        if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1 ||
+            EVP_EncryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), NULL,
+                               key.aes_key, iv) != 1)
+        {
+            rv = -1;
+        }
+    }
+    else if (rv == 1)
+    {
+        if (EVP_DecryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), NULL,
+                               key.aes_key, iv) != 1)
+        {
+            rv = -1;
+        }
+        else if (found == 2)
+        {
+            /* ticket from before the last rotation, issue a fresh one */
+            rv = 2;
+        }
+    }
+    g_memset(&key, 0, sizeof(key));
+    return rv;
+}
+
+/*****************************************************************************/
+/* set up resumption with the shared ticket keys if the listener made any */
+static int
+ssl_tls_setup_tickets(SSL_CTX *ctx)
+{
+    static const unsigned char sid_ctx[] = "xrdp";
+    int lifetime;
+
+    tc_mutex_lock(g_ticket_key_mutex);
+    lifetime = g_ticket_keys[0].valid ? g_ticket_key_lifetime : 0;
+    tc_mutex_unlock(g_ticket_key_mutex);
+    if (lifetime < 1)
+    {
+        return 0;
+    }
+    if (SSL_CTX_set_session_id_context(ctx, sid_ctx,
+                                       sizeof(sid_ctx) - 1) != 1)
+    {
+        return 1;
+    }
+    /* the per process session cache is no use with forked children */
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER |
+                                   SSL_SESS_CACHE_NO_INTERNAL);
+    /* a ticket stays usable until its key has been rotated out twice */
+    SSL_CTX_set_timeout(ctx, lifetime * 2);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    if (SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, ssl_tls_ticket_key_cb) != 1)
+#else
+    if (SSL_CTX_set_tlsext_ticket_key_cb(ctx, ssl_tls_ticket_key_cb) != 1)
+#endif
+    {
+        return 1;
+    }
+    return 0;
+}
+
 /*****************************************************************************/
 struct ssl_tls *
 ssl_tls_create(struct trans *trans, const char *key, const char *cert)
@@ -644,7 +838,7 @@ ssl_tls_print_error(const char *func, SSL *connection, int value)
 /*****************************************************************************/
 int
 ssl_tls_accept(struct ssl_tls *self, long ssl_protocols,
-               const char *tls_ciphers)
+               const char *tls_ciphers, int ktls)
 {
     int connection_status;
     long options = 0;
@@ -690,6 +884,23 @@ ssl_tls_accept(struct ssl_tls *self, long ssl_protocols,
      */
     options |= SSL_OP_DONT_INSERT_EMPTY_FRAGMENTS;
 
+    /**
+     * SSL_OP_ENABLE_KTLS:
+     *
+     * Hand record encryption over to the kernel tls module after the
+     * handshake. OpenSSL silently falls back to user space when the
+     * negotiated cipher or the kernel does not support it.
+     */
+    if (ktls)
+    {
+#if defined(XRDP_KTLS)
+        options |= SSL_OP_ENABLE_KTLS;
+#else
+        log_message(LOG_LEVEL_WARNING, "ssl_tls_accept: kernel TLS enabled "
+                    "by config, but not supported by system OpenSSL");
+#endif
+    }
+
     self->ctx = SSL_CTX_new(SSLv23_server_method());
     if (self->ctx == NULL)
     {
@@ -736,6 +947,12 @@ ssl_tls_accept(struct ssl_tls *self, long ssl_protocols,
 
     SSL_CTX_set_read_ahead(self->ctx, 0);
 
+    if (ssl_tls_setup_tickets(self->ctx) != 0)
+    {
+        log_message(LOG_LEVEL_WARNING, "ssl_tls_accept: session ticket "
+                    "setup failed, resumption disabled");
+    }
+
     if (SSL_CTX_use_RSAPrivateKey_file(self->ctx, self->key, SSL_FILETYPE_PEM)
             <= 0)
     {
@@ -793,7 +1010,21 @@ ssl_tls_accept(struct ssl_tls *self, long ssl_protocols,
         }
     }
 
-    g_writeln("ssl_tls_accept: TLS connection accepted");
+    g_writeln("ssl_tls_accept: TLS connection accepted%s",
+              SSL_session_reused(self->ssl) ? " (session resumed)" : "");
+
+#if defined(XRDP_KTLS)
+    if (ktls)
+    {
+        self->ktls_send = BIO_get_ktls_send(SSL_get_wbio(self->ssl)) > 0;
+        self->ktls_recv = BIO_get_ktls_recv(SSL_get_rbio(self->ssl)) > 0;
+        log_message(LOG_LEVEL_INFO, "ssl_tls_accept: kernel TLS send %s, "
+                    "recv %s (%s)",
+                    self->ktls_send ? "on" : "off",
+                    self->ktls_recv ? "on" : "off",
+                    SSL_get_cipher_name(self->ssl));
+    }
+#endif
 
     return 0;
 }
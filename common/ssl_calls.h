@@ -90,14 +90,18 @@ struct ssl_tls
     char *key;
     struct trans *trans;
     tintptr rwo; /* wait obj */
+    int ktls_send; /* records are encrypted by the kernel on send */
+    int ktls_recv; /* records are decrypted by the kernel on recv */
 };
 
 /* xrdp_tls.c */
+int
+ssl_tls_ticket_keys_rotate(int lifetime);
 struct ssl_tls *
 ssl_tls_create(struct trans *trans, const char *key, const char *cert);
 int
 ssl_tls_accept(struct ssl_tls *self, long ssl_protocols,
-               const char *tls_ciphers);
+               const char *tls_ciphers, int ktls);
 int
 ssl_tls_disconnect(struct ssl_tls *self);
 void
@@ -28,6 +28,9 @@
 #include "parse.h"
 #include "ssl_calls.h"
 
+static int
+trans_cork_flush(struct trans *self);
+
 #define MAX_SBYTES 0
 
 /*****************************************************************************/
@@ -84,6 +87,34 @@ trans_tcp_can_recv(struct trans *self, int sck, int millis)
     return g_sck_can_recv(sck, millis);
 }
 
+/*****************************************************************************/
+/* unix socket recv that keeps any passed file descriptors */
+static int
+trans_unix_fd_recv(struct trans *self, char *ptr, int len)
+{
+    int fds[TRANS_MAX_FDS];
+    int num_fds;
+    int index;
+    int rv;
+
+    num_fds = TRANS_MAX_FDS;
+    rv = g_sck_recv_fds(self->sck, ptr, len, fds, &num_fds);
+    for (index = 0; index < num_fds; index++)
+    {
+        if (self->num_recv_fds < TRANS_MAX_FDS)
+        {
+            self->recv_fds[self->num_recv_fds] = fds[index];
+            self->num_recv_fds++;
+        }
+        else
+        {
+            g_writeln("trans_unix_fd_recv: too many fds, dropping");
+            g_file_close(fds[index]);
+        }
+    }
+    return rv;
+}
+
 /*****************************************************************************/
 struct trans *
 trans_create(int mode, int in_size, int out_size)
@@ -120,6 +151,13 @@ trans_delete(struct trans *self)
 
     free_stream(self->in_s);
     free_stream(self->out_s);
+    free_stream(self->cork_s);
+
+    while (self->num_recv_fds > 0)
+    {
+        self->num_recv_fds--;
+        g_file_close(self->recv_fds[self->num_recv_fds]);
+    }
 
     if (self->sck > 0)
     {
@@ -525,6 +563,12 @@ trans_force_write_s(struct trans *self, struct stream *out_s)
     }
     size = (int) (out_s->end - out_s->data);
     total = 0;
+    /* anything held back by trans_cork goes first */
+    if (trans_cork_flush(self) != 0)
+    {
+        self->status = TRANS_STATUS_DOWN;
+        return 1;
+    }
     if (trans_send_waiting(self, 1) != 0)
     {
         self->status = TRANS_STATUS_DOWN;
@@ -580,8 +624,8 @@ trans_force_write(struct trans *self)
 }
 
 /*****************************************************************************/
-int
-trans_write_copy_s(struct trans *self, struct stream *out_s)
+static int
+trans_write_copy_s_now(struct trans *self, struct stream *out_s)
 {
     int size;
     int sent;
@@ -662,6 +706,144 @@ trans_write_copy_s(struct trans *self, struct stream *out_s)
     return 0;
 }
 
+/*****************************************************************************/
+/* send what was gathered while corked, returns error */
+static int
+trans_cork_flush(struct trans *self)
+{
+    struct stream *cork_s;
+    int hold_source;
+    int rv;
+
+    cork_s = self->cork_s;
+    if ((cork_s == 0) || (cork_s->end == cork_s->data))
+    {
+        return 0;
+    }
+    /* account it to the source that wrote it */
+    hold_source = 0;
+    if (self->si != 0)
+    {
+        hold_source = self->si->cur_source;
+        self->si->cur_source = self->cork_source;
+    }
+    rv = trans_write_copy_s_now(self, cork_s);
+    if (self->si != 0)
+    {
+        self->si->cur_source = hold_source;
+    }
+    cork_s->p = cork_s->data;
+    cork_s->end = cork_s->data;
+    return rv;
+}
+
+/*****************************************************************************/
+int
+trans_write_copy_s(struct trans *self, struct stream *out_s)
+{
+    struct stream *cork_s;
+    int size;
+    int source;
+
+    if (self->cork_level < 1)
+    {
+        return trans_write_copy_s_now(self, out_s);
+    }
+    if (self->status != TRANS_STATUS_UP)
+    {
+        return 1;
+    }
+    cork_s = self->cork_s;
+    if (cork_s == 0)
+    {
+        make_stream(cork_s);
+        init_stream(cork_s, TRANS_CORK_BYTES);
+        self->cork_s = cork_s;
+    }
+    source = (self->si != 0) ? self->si->cur_source : 0;
+    size = (int) (out_s->end - out_s->data);
+    if ((source != self->cork_source) ||
+        ((int) (cork_s->end - cork_s->data) + size > cork_s->size))
+    {
+        if (trans_cork_flush(self) != 0)
+        {
+            return 1;
+        }
+    }
+    self->cork_source = source;
+    if (size > cork_s->size)
+    {
+        return trans_write_copy_s_now(self, out_s);
+    }
+    g_memcpy(cork_s->end, out_s->data, size);
+    cork_s->end += size;
+    return 0;
+}
+
+/*****************************************************************************/
+/* hold back writes so a burst of small PDUs goes out in one write,
+   calls nest, returns error */
+int
+trans_cork(struct trans *self)
+{
+    self->cork_level++;
+    return 0;
+}
+
+/*****************************************************************************/
+/* returns error */
+int
+trans_uncork(struct trans *self)
+{
+    if (self->cork_level < 1)
+    {
+        return 0;
+    }
+    self->cork_level--;
+    if (self->cork_level > 0)
+    {
+        return 0;
+    }
+    return trans_cork_flush(self);
+}
+
+/*****************************************************************************/
+/* unix socket only, file descriptors sent along with the data are queued
+   and can be taken in order with trans_get_recv_fd
+   returns error */
+int
+trans_enable_fd_recv(struct trans *self)
+{
+    if (self->mode != TRANS_MODE_UNIX)
+    {
+        return 1;
+    }
+    self->trans_recv = trans_unix_fd_recv;
+    return 0;
+}
+
+/*****************************************************************************/
+/* returns the oldest received file descriptor, the caller owns it,
+   or -1 if there is none */
+int
+trans_get_recv_fd(struct trans *self)
+{
+    int fd;
+    int index;
+
+    if (self->num_recv_fds < 1)
+    {
+        return -1;
+    }
+    fd = self->recv_fds[0];
+    self->num_recv_fds--;
+    for (index = 0; index < self->num_recv_fds; index++)
+    {
+        self->recv_fds[index] = self->recv_fds[index + 1];
+    }
+    return fd;
+}
+
 /*****************************************************************************/
 int
 trans_write_copy(struct trans* self)
@@ -921,7 +1103,7 @@ trans_get_out_s(struct trans *self, int size)
 /* returns error */
 int
 trans_set_tls_mode(struct trans *self, const char *key, const char *cert,
-                   long ssl_protocols, const char *tls_ciphers)
+                   long ssl_protocols, const char *tls_ciphers, int ktls)
 {
     self->tls = ssl_tls_create(self, key, cert);
     if (self->tls == NULL)
@@ -930,7 +1112,7 @@ trans_set_tls_mode(struct trans *self, const char *key, const char *cert,
         return 1;
     }
 
-    if (ssl_tls_accept(self->tls, ssl_protocols, tls_ciphers) != 0)
+    if (ssl_tls_accept(self->tls, ssl_protocols, tls_ciphers, ktls) != 0)
     {
         g_writeln("trans_set_tls_mode: ssl_tls_accept failed");
         return 1;
@@ -941,6 +1123,14 @@ trans_set_tls_mode(struct trans *self, const char *key, const char *cert,
     self->trans_send = trans_tls_send;
     self->trans_can_recv = trans_tls_can_recv;
 
+    /* the kernel frames and encrypts plain writes on a kTLS socket so
+       skip the extra trip through SSL_write, reads still go through
+       OpenSSL so non application data records are handled */
+    if (self->tls->ktls_send)
+    {
+        self->trans_send = trans_tcp_send;
+    }
+
     self->ssl_protocol = ssl_get_version(self->tls->ssl);
     self->cipher_name = ssl_get_cipher_name(self->tls->ssl);
 
@@ -35,6 +35,12 @@
 #define TRANS_STATUS_DOWN 0
 #define TRANS_STATUS_UP 1
 
+/* writes gathered while corked are sent once this much is pending */
+#define TRANS_CORK_BYTES (128 * 1024)
+
+/* file descriptors passed over a unix socket waiting for trans_get_recv_fd */
+#define TRANS_MAX_FDS 8
+
 struct trans; /* forward declaration */
 struct xrdp_tls;
 
@@ -87,6 +93,11 @@ struct trans
     trans_can_recv_proc trans_can_recv;
     struct source_info *si;
     int my_source;
+    int cork_level; /* inc for every call to trans_cork */
+    struct stream *cork_s; /* writes gathered while corked */
+    int cork_source;
+    int recv_fds[TRANS_MAX_FDS]; /* see trans_enable_fd_recv */
+    int num_recv_fds;
 };
 
 struct trans*
@@ -116,6 +127,14 @@ trans_write_copy(struct trans* self);
 int
 trans_write_copy_s(struct trans* self, struct stream* out_s);
 int
+trans_cork(struct trans *self);
+int
+trans_uncork(struct trans *self);
+int
+trans_enable_fd_recv(struct trans *self);
+int
+trans_get_recv_fd(struct trans *self);
+int
 trans_connect(struct trans* self, const char* server, const char* port,
               int timeout);
 int
@@ -128,7 +147,7 @@ struct stream*
 trans_get_out_s(struct trans* self, int size);
 int
 trans_set_tls_mode(struct trans *self, const char *key, const char *cert,
-                   long ssl_protocols, const char *tls_ciphers);
+                   long ssl_protocols, const char *tls_ciphers, int ktls);
 int
 trans_shutdown_tls_mode(struct trans *self);
 int
@@ -156,6 +156,27 @@ struct xrdp_client_info
   int no_orders_supported;
   int use_cache_glyph_v2;
   int rail_enable;
+
+  int tls_ktls; /* use kernel TLS offload when available */
+
+  /* network auto-detect, MS-RDPBCGR 2.2.14 */
+  int network_autodetect; /* from xrdp.ini */
+  int net_rtt; /* last measured round trip, ms */
+  int net_base_rtt; /* lowest round trip seen, ms */
+  int net_average_rtt; /* ms */
+  int net_rtt_count;
+  int net_bandwidth; /* kbit/s */
+  int net_bw_count;
+  int net_connection_type; /* CONNECTION_TYPE_* from measurement, 0 if none */
+
+  int large_pointer_flags; /* LARGE_POINTER_FLAG_* from the client caps */
+
+  /* glyph cache caps, MS-RDPBCGR 2.2.7.1.8 */
+  int glyph_support_level; /* GLYPH_SUPPORT_* */
+  int glyph_cache_entries[10];
+  int glyph_cache_cell_size[10];
+  int frag_cache_entries;
+  int frag_cache_max_bytes;
 };
 
 #endif
@@ -101,6 +101,10 @@
 #define CONNECTION_TYPE_LAN            0x06
 #define CONNECTION_TYPE_AUTODETECT     0x07
 
+/* Client Core Data: earlyCapabilityFlags (MS-RDPBCGR 2.2.1.3.2) */
+#define RNS_UD_CS_SUPPORT_NETCHAR_AUTODETECT 0x0080
+#define RNS_UD_CS_SUPPORT_DYNVC_GFX_PROTOCOL 0x0100
+
 /* Client Core Data: colorDepth, postBeta2ColorDepth (MS-RDPBCGR 2.2.1.3.2) */
 #define RNS_UD_COLOR_4BPP              0xCA00
 #define RNS_UD_COLOR_8BPP              0xCA01
@@ -154,6 +158,7 @@
 #define FASTPATH_UPDATETYPE_COLOR         0x9
 #define FASTPATH_UPDATETYPE_CACHED        0xA
 #define FASTPATH_UPDATETYPE_POINTER       0xB
+#define FASTPATH_UPDATETYPE_LARGE_POINTER 0xC
 
 /* Fast-Path Update: fragmentation (MS-RDPBCGR 2.2.9.1.2.1) */
 #define FASTPATH_FRAGMENT_SINGLE          0x0
@@ -339,6 +344,56 @@
 #define XR_CODEC_GUID_PNG \
   "\x8D\x85\x0C\x0E\xE0\x28\xDB\x45\xAD\xAA\x0F\x83\xE5\x7C\xC5\x60"
 
+/* Graphics Pipeline Extension (MS-RDPEGFX) */
+#define XR_RDPGFX_CHANNEL_NAME "Microsoft::Windows::RDS::Graphics"
+
+/* RDPGFX_HEADER: cmdId (MS-RDPEGFX 2.2.1.5) */
+#define XR_RDPGFX_CMDID_WIRETOSURFACE_1       0x0001
+#define XR_RDPGFX_CMDID_WIRETOSURFACE_2       0x0002
+#define XR_RDPGFX_CMDID_DELETEENCODINGCONTEXT 0x0003
+#define XR_RDPGFX_CMDID_SOLIDFILL             0x0004
+#define XR_RDPGFX_CMDID_SURFACETOSURFACE      0x0005
+#define XR_RDPGFX_CMDID_SURFACETOCACHE        0x0006
+#define XR_RDPGFX_CMDID_CACHETOSURFACE        0x0007
+#define XR_RDPGFX_CMDID_EVICTCACHEENTRY       0x0008
+#define XR_RDPGFX_CMDID_CREATESURFACE         0x0009
+#define XR_RDPGFX_CMDID_DELETESURFACE         0x000A
+#define XR_RDPGFX_CMDID_STARTFRAME            0x000B
+#define XR_RDPGFX_CMDID_ENDFRAME              0x000C
+#define XR_RDPGFX_CMDID_FRAMEACKNOWLEDGE      0x000D
+#define XR_RDPGFX_CMDID_RESETGRAPHICS         0x000E
+#define XR_RDPGFX_CMDID_MAPSURFACETOOUTPUT    0x000F
+#define XR_RDPGFX_CMDID_CACHEIMPORTOFFER      0x0010
+#define XR_RDPGFX_CMDID_CACHEIMPORTREPLY      0x0011
+#define XR_RDPGFX_CMDID_CAPSADVERTISE         0x0012
+#define XR_RDPGFX_CMDID_CAPSCONFIRM           0x0013
+#define XR_RDPGFX_CMDID_QOEFRAMEACKNOWLEDGE   0x0016
+
+/* RDPGFX_CAPSET: version (MS-RDPEGFX 2.2.1.6) */
+#define XR_RDPGFX_CAPVERSION_8                0x00080004
+#define XR_RDPGFX_CAPVERSION_81               0x00080105
+
+/* RDPGFX_CAPSET_VERSION8/81: flags (MS-RDPEGFX 2.2.3.1) */
+#define XR_RDPGFX_CAPS_FLAG_THINCLIENT        0x00000001
+#define XR_RDPGFX_CAPS_FLAG_SMALL_CACHE       0x00000002
+#define XR_RDPGFX_CAPS_FLAG_AVC420_ENABLED    0x00000010
+
+/* RDPGFX_WIRE_TO_SURFACE_PDU_1: codecId (MS-RDPEGFX 2.2.2.1) */
+#define XR_RDPGFX_CODECID_UNCOMPRESSED        0x0000
+#define XR_RDPGFX_CODECID_CAVIDEO             0x0003
+#define XR_RDPGFX_CODECID_CLEARCODEC          0x0008
+#define XR_RDPGFX_CODECID_PLANAR              0x000A
+#define XR_RDPGFX_CODECID_AVC420              0x000B
+#define XR_RDPGFX_CODECID_ALPHA               0x000C
+#define XR_RDPGFX_CODECID_AVC444              0x000E
+
+/* RDPGFX_PIXELFORMAT (MS-RDPEGFX 2.2.1.4) */
+#define XR_PIXEL_FORMAT_XRGB_8888             0x20
+#define XR_PIXEL_FORMAT_ARGB_8888             0x21
+
+/* RDPGFX_FRAME_ACKNOWLEDGE_PDU: queueDepth (MS-RDPEGFX 2.2.2.13) */
+#define XR_SUSPEND_FRAME_ACKNOWLEDGEMENT      0xFFFFFFFF
+
 /* Surface Command Type (MS-RDPBCGR 2.2.9.1.2.1.10.1) */
 #define CMDTYPE_SET_SURFACE_BITS       0x0001
 #define CMDTYPE_FRAME_MARKER           0x0004
@@ -490,6 +545,10 @@
 #define CAPSETTYPE_LARGE_POINTER                0x001B
 #define CAPSETTYPE_LARGE_POINTER_LEN            0x06
 
+/* Large Pointer Capability Set: largePointerSupportFlags */
+#define LARGE_POINTER_FLAG_96x96                0x00000001
+#define LARGE_POINTER_FLAG_384x384              0x00000002
+
 #define CAPSETTYPE_SURFACE_COMMANDS             0x001C
 #define CAPSETTYPE_SURFACE_COMMANDS_LEN         0x0C
 
@@ -505,10 +564,13 @@
 #define SEC_ENCRYPT                    0x0008
 #define SEC_LOGON_INFO                 0x0040 /* SEC_INFO_PKT */
 #define SEC_LICENCE_NEG                0x0080 /* SEC_LICENSE_PKT */
+#define SEC_AUTODETECT_REQ             0x1000
+#define SEC_AUTODETECT_RSP             0x2000
 
 #define SEC_TAG_SRV_INFO               0x0c01 /* SC_CORE */
 #define SEC_TAG_SRV_CRYPT              0x0c02 /* SC_SECURITY */
 #define SEC_TAG_SRV_CHANNELS           0x0c03 /* SC_NET? */
+#define SEC_TAG_SRV_MSGCHANNEL         0x0c04 /* SC_MCS_MSGCHANNEL */
 
 /* TS_UD_HEADER: type (MS-RDPBCGR (2.2.1.3.1) */
 /* TODO: to be renamed */
@@ -517,6 +579,23 @@
 #define SEC_TAG_CLI_CHANNELS           0xc003 /* CS_CHANNELS? */
 #define SEC_TAG_CLI_4                  0xc004 /* CS_CLUSTER? */
 #define SEC_TAG_CLI_MONITOR            0xc005 /* CS_MONITOR */
+#define SEC_TAG_CLI_MSGCHANNEL         0xc006 /* CS_MCS_MSGCHANNEL */
+
+/* Auto-Detect Request/Response PDU (MS-RDPBCGR 2.2.14) */
+#define TYPE_ID_AUTODETECT_REQUEST                0x00
+#define TYPE_ID_AUTODETECT_RESPONSE               0x01
+#define RDP_RTT_REQUEST_TYPE_CONTINUOUS           0x0001
+#define RDP_RTT_REQUEST_TYPE_CONNECTTIME          0x1001
+#define RDP_BW_START_REQUEST_TYPE_CONTINUOUS      0x0014
+#define RDP_BW_START_REQUEST_TYPE_CONNECTTIME     0x1014
+#define RDP_BW_PAYLOAD_REQUEST_TYPE               0x0002
+#define RDP_BW_STOP_REQUEST_TYPE_CONTINUOUS       0x0429
+#define RDP_BW_STOP_REQUEST_TYPE_CONNECTTIME      0x002B
+#define RDP_NETCHAR_RESULT_ALL                    0x08C0
+#define RDP_RTT_RESPONSE_TYPE                     0x0000
+#define RDP_BW_RESULTS_RESPONSE_TYPE_CONNECTTIME  0x0003
+#define RDP_BW_RESULTS_RESPONSE_TYPE_CONTINUOUS   0x000B
+#define RDP_NETCHAR_SYNC_RESPONSE_TYPE            0x0018
 
 /* Server Proprietary Certificate (MS-RDPBCGR 2.2.1.4.3.1.1) */
 /* TODO: to be renamed */
@@ -812,6 +891,8 @@
 #define WM_BUTTON7UP   113
 #define WM_BUTTON7DOWN 114
 #define WM_INVALIDATE  200
+#define WM_INPUT_BEGIN 400 /* events until WM_INPUT_END can be sent as one */
+#define WM_INPUT_END   401
 
 #define CB_ITEMCHANGE  300
 
@@ -831,6 +831,94 @@ libxrdp_send_pointer(struct xrdp_session *session, int cache_idx,
     return 0;
 }
 
+/*****************************************************************************/
+/* pointer bigger than 32x32, MS-RDPBCGR 2.2.9.1.2.1.11, fastpath only
+   data is width * height pixels and mask has rows of
+   ((width + 15) / 16) * 2 bytes, both bottom up like libxrdp_send_pointer
+   returns error, the client must have the large pointer capability */
+int EXPORT_CC
+libxrdp_send_pointer_large(struct xrdp_session *session, int cache_idx,
+                           char *data, char *mask, int x, int y, int bpp,
+                           int width, int height)
+{
+    struct stream *s;
+    int src_line_bytes;
+    int xor_line_bytes;
+    int xor_bytes;
+    int and_bytes;
+    int max_size;
+    int index;
+
+    if (width <= 32 && height <= 32)
+    {
+        return libxrdp_send_pointer(session, cache_idx, data, mask,
+                                    x, y, bpp);
+    }
+    if (bpp == 0)
+    {
+        bpp = 24;
+    }
+    max_size = 0;
+    if (session->client_info->large_pointer_flags & LARGE_POINTER_FLAG_96x96)
+    {
+        max_size = 96;
+    }
+    if (session->client_info->large_pointer_flags &
+        LARGE_POINTER_FLAG_384x384)
+    {
+        max_size = 384;
+    }
+    if ((session->client_info->use_fast_path & 1) == 0 ||
+        (session->client_info->pointer_flags & 1) == 0 ||
+        width > max_size || height > max_size)
+    {
+        g_writeln("libxrdp_send_pointer_large: error client does not "
+                  "support %dx%d cursors", width, height);
+        return 1;
+    }
+    if ((bpp != 16) && (bpp != 24) && (bpp != 32))
+    {
+        g_writeln("libxrdp_send_pointer_large: error bpp %d", bpp);
+        return 1;
+    }
+    /* xor rows are padded to 2 bytes */
+    src_line_bytes = ((bpp + 7) / 8) * width;
+    xor_line_bytes = (src_line_bytes + 1) & ~1;
+    xor_bytes = xor_line_bytes * height;
+    and_bytes = ((width + 15) / 16) * 2 * height;
+
+    make_stream(s);
+    init_stream(s, xor_bytes + and_bytes + 8192);
+    if (xrdp_rdp_init_fastpath((struct xrdp_rdp *)session->rdp, s) != 0)
+    {
+        free_stream(s);
+        return 1;
+    }
+    out_uint16_le(s, bpp);
+    out_uint16_le(s, cache_idx);
+    out_uint16_le(s, x);
+    out_uint16_le(s, y);
+    out_uint16_le(s, width);
+    out_uint16_le(s, height);
+    out_uint32_le(s, and_bytes);
+    out_uint32_le(s, xor_bytes);
+    for (index = 0; index < height; index++)
+    {
+        out_uint8a(s, data + index * src_line_bytes, src_line_bytes);
+        out_uint8s(s, xor_line_bytes - src_line_bytes);
+    }
+    out_uint8a(s, mask, and_bytes);
+    s_mark_end(s);
+    if (xrdp_rdp_send_fastpath((struct xrdp_rdp *)session->rdp, s,
+                               FASTPATH_UPDATETYPE_LARGE_POINTER) != 0)
+    {
+        free_stream(s);
+        return 1;
+    }
+    free_stream(s);
+    return 0;
+}
+
 /*****************************************************************************/
 int EXPORT_CC
 libxrdp_set_pointer(struct xrdp_session *session, int cache_idx)
@@ -1485,6 +1573,34 @@ libxrdp_codec_jpeg_compress(struct xrdp_session *session,
                                     cx, cy, quality, out_data, io_len);
 }
 
+/*****************************************************************************/
+/* NSCodec state is per encoder, not per session, so it can live on the
+   encoder thread */
+void *EXPORT_CC
+libxrdp_codec_nsc_create(void)
+{
+    return xrdp_nsc_init();
+}
+
+/*****************************************************************************/
+int EXPORT_CC
+libxrdp_codec_nsc_delete(void *handle)
+{
+    return xrdp_nsc_deinit(handle);
+}
+
+/*****************************************************************************/
+int EXPORT_CC
+libxrdp_codec_nsc_compress(void *handle, char *inp_data, int stride,
+                           int x, int y, int cx, int cy,
+                           int color_loss_level, int subsampling,
+                           char *out_data, int *io_len)
+{
+    return xrdp_codec_nsc_compress(handle, inp_data, stride, x, y, cx, cy,
+                                   color_loss_level, subsampling,
+                                   out_data, io_len);
+}
+
 /*****************************************************************************/
 int EXPORT_CC
 libxrdp_fastpath_send_surface(struct xrdp_session *session,
@@ -1600,3 +1716,41 @@ libxrdp_send_session_info(struct xrdp_session *session, const char *data,
     return xrdp_rdp_send_session_info(rdp, data, data_bytes);
 }
 
+
+/*****************************************************************************/
+/* lowers *timeout, in milliseconds, to when the next network auto-detect
+   request is due */
+int EXPORT_CC
+libxrdp_autodetect_get_timeout(struct xrdp_session *session, int *timeout)
+{
+    struct xrdp_rdp *rdp;
+
+    rdp = (struct xrdp_rdp *) (session->rdp);
+    return xrdp_autodetect_get_timeout(rdp->sec_layer->autodetect_layer,
+                                       timeout);
+}
+
+/*****************************************************************************/
+/* sends any network auto-detect requests that are due and the demand
+   active when the connect-time results do not come, returns error */
+int EXPORT_CC
+libxrdp_autodetect_check(struct xrdp_session *session)
+{
+    struct xrdp_rdp *rdp;
+    struct xrdp_autodetect *autodetect;
+    int rv;
+
+    rdp = (struct xrdp_rdp *) (session->rdp);
+    autodetect = rdp->sec_layer->autodetect_layer;
+    if (!session->up_and_running &&
+        (autodetect->state != AUTODETECT_STATE_CONNECT))
+    {
+        return 0;
+    }
+    rv = xrdp_autodetect_check(autodetect);
+    if (rv == -1)
+    {
+        return xrdp_caps_send_demand_active(rdp);
+    }
+    return rv;
+}
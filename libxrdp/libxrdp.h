@@ -65,6 +65,7 @@ struct xrdp_mcs
     struct stream *client_mcs_data;
     struct stream *server_mcs_data;
     struct list *channel_list;
+    int msgchanid; /* MCS message channel, 0 if not used */
 };
 
 /* fastpath */
@@ -77,6 +78,27 @@ struct xrdp_fastpath
     int secFlags;
 };
 
+#define AUTODETECT_STATE_IDLE    0
+#define AUTODETECT_STATE_CONNECT 1
+#define AUTODETECT_STATE_SESSION 2
+
+/* network auto-detect */
+struct xrdp_autodetect
+{
+    struct xrdp_sec *sec_layer; /* owner */
+    struct xrdp_client_info *client_info;
+    int state;
+    int seq;
+    int rtt_seq; /* outstanding RTT request, -1 if none */
+    int rtt_time;
+    int bw_seq; /* outstanding bandwidth measure, -1 if none */
+    int bw_time;
+    int bw_stop_time; /* when the continuous stop is due, 0 once sent */
+    int next_rtt_time;
+    int next_bw_time;
+    int connect_deadline; /* demand active goes out by then regardless */
+};
+
 /* Encryption Methods */
 #define CRYPT_METHOD_NONE              0x00000000
 #define CRYPT_METHOD_40BIT             0x00000001
@@ -99,6 +121,7 @@ struct xrdp_sec
     struct xrdp_mcs *mcs_layer;
     struct xrdp_fastpath *fastpath_layer;
     struct xrdp_channel *chan_layer;
+    struct xrdp_autodetect *autodetect_layer;
     char server_random[32];
     char client_random[256];
     char client_crypt_random[256 + 8]; /* 64 + 8, 256 + 8 */
@@ -376,6 +399,11 @@ xrdp_sec_recv(struct xrdp_sec *self, struct stream *s, int *chan);
 int
 xrdp_sec_send(struct xrdp_sec *self, struct stream *s, int chan);
 int
+xrdp_sec_init_msgchannel(struct xrdp_sec *self, struct stream *s);
+int
+xrdp_sec_send_msgchannel(struct xrdp_sec *self, struct stream *s,
+                         int flags);
+int
 xrdp_sec_process_mcs_data(struct xrdp_sec *self);
 int
 xrdp_sec_incoming(struct xrdp_sec *self);
@@ -557,6 +585,17 @@ xrdp_jpeg_init(void);
 int
 xrdp_jpeg_deinit(void *handle);
 
+/* xrdp_nsc_compress.c */
+void *
+xrdp_nsc_init(void);
+int
+xrdp_nsc_deinit(void *handle);
+int
+xrdp_codec_nsc_compress(void *handle, char *inp_data, int stride,
+                        int x, int y, int cx, int cy,
+                        int color_loss_level, int subsampling,
+                        char *out_data, int *io_len);
+
 /* xrdp_channel.c */
 struct xrdp_channel*
 xrdp_channel_create(struct xrdp_sec *owner, struct xrdp_mcs *mcs_layer);
@@ -600,6 +639,20 @@ xrdp_fastpath_init(struct xrdp_fastpath *self, struct stream *s);
 int
 xrdp_fastpath_send(struct xrdp_fastpath *self, struct stream *s);
 
+/* xrdp_autodetect.c */
+struct xrdp_autodetect *
+xrdp_autodetect_create(struct xrdp_sec *owner);
+void
+xrdp_autodetect_delete(struct xrdp_autodetect *self);
+int
+xrdp_autodetect_start(struct xrdp_autodetect *self);
+int
+xrdp_autodetect_process(struct xrdp_autodetect *self, struct stream *s);
+int
+xrdp_autodetect_get_timeout(struct xrdp_autodetect *self, int *timeout);
+int
+xrdp_autodetect_check(struct xrdp_autodetect *self);
+
 /* xrdp_caps.c */
 int
 xrdp_caps_send_demand_active(struct xrdp_rdp *self);
@@ -109,6 +109,10 @@ int
 libxrdp_send_pointer(struct xrdp_session *session, int cache_idx,
                      char *data, char *mask, int x, int y, int bpp);
 int
+libxrdp_send_pointer_large(struct xrdp_session *session, int cache_idx,
+                           char *data, char *mask, int x, int y, int bpp,
+                           int width, int height);
+int
 libxrdp_set_pointer(struct xrdp_session *session, int cache_idx);
 int
 libxrdp_orders_init(struct xrdp_session *session);
@@ -261,6 +265,15 @@ libxrdp_codec_jpeg_compress(struct xrdp_session *session,
                             int stride, int x, int y,
                             int cx, int cy, int quality,
                             char *out_data, int *io_len);
+void *
+libxrdp_codec_nsc_create(void);
+int
+libxrdp_codec_nsc_delete(void *handle);
+int
+libxrdp_codec_nsc_compress(void *handle, char *inp_data, int stride,
+                           int x, int y, int cx, int cy,
+                           int color_loss_level, int subsampling,
+                           char *out_data, int *io_len);
 int
 libxrdp_fastpath_send_surface(struct xrdp_session *session,
                               char *data_pad, int pad_bytes,
@@ -274,5 +287,9 @@ libxrdp_fastpath_send_frame_marker(struct xrdp_session *session,
 int EXPORT_CC
 libxrdp_send_session_info(struct xrdp_session *session, const char *data,
                           int data_bytes);
+int EXPORT_CC
+libxrdp_autodetect_get_timeout(struct xrdp_session *session, int *timeout);
+int EXPORT_CC
+libxrdp_autodetect_check(struct xrdp_session *session);
 
 #endif
@@ -0,0 +1,521 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Copyright (C) Jay Sorg 2004-2014
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * network auto-detect, MS-RDPBCGR 2.2.14
+ * RTT and bandwidth measurements over the MCS message channel
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include <config_ac.h>
+#endif
+
+#include "libxrdp.h"
+#include "log.h"
+
+#define LOG_LEVEL 1
+#define LLOG(_level, _args) \
+    do { if (_level < LOG_LEVEL) { g_write _args ; } } while (0)
+#define LLOGLN(_level, _args) \
+    do { if (_level < LOG_LEVEL) { g_writeln _args ; } } while (0)
+
+/* connect-time bandwidth payload, sent as this many PDUs of
+   AUTODETECT_PAYLOAD_BYTES each */
+#define AUTODETECT_PAYLOAD_BYTES (15 * 1024)
+#define AUTODETECT_PAYLOAD_PDUS  4
+/* the connection goes on without results after this many milliseconds */
+#define AUTODETECT_CONNECT_TIMEOUT 5000
+
+/* session-time schedule, in milliseconds */
+#define AUTODETECT_RTT_INTERVAL  5000
+#define AUTODETECT_BW_INTERVAL   30000
+#define AUTODETECT_BW_WINDOW     1000
+
+/* a continuous bandwidth window with less traffic than this says nothing
+   about the link, only the RTT part of it is kept */
+#define AUTODETECT_BW_MIN_BYTES  (64 * 1024)
+
+/*****************************************************************************/
+struct xrdp_autodetect *
+xrdp_autodetect_create(struct xrdp_sec *owner)
+{
+    struct xrdp_autodetect *self;
+
+    DEBUG(("  in xrdp_autodetect_create"));
+    self = (struct xrdp_autodetect *)
+           g_malloc(sizeof(struct xrdp_autodetect), 1);
+    self->sec_layer = owner;
+    self->client_info = &(owner->rdp_layer->client_info);
+    self->state = AUTODETECT_STATE_IDLE;
+    self->rtt_seq = -1;
+    self->bw_seq = -1;
+    DEBUG(("  out xrdp_autodetect_create"));
+    return self;
+}
+
+/*****************************************************************************/
+void
+xrdp_autodetect_delete(struct xrdp_autodetect *self)
+{
+    if (self == 0)
+    {
+        return;
+    }
+    g_free(self);
+}
+
+/*****************************************************************************/
+/* returns boolean */
+static int
+xrdp_autodetect_supported(struct xrdp_autodetect *self)
+{
+    struct xrdp_client_info *ci;
+
+    ci = self->client_info;
+    if (!ci->network_autodetect)
+    {
+        return 0;
+    }
+    if (self->sec_layer->mcs_layer->msgchanid == 0)
+    {
+        return 0;
+    }
+    return (ci->mcs_early_capability_flags &
+            RNS_UD_CS_SUPPORT_NETCHAR_AUTODETECT) != 0;
+}
+
+/*****************************************************************************/
+/* returns error
+   writes a request header, the caller adds any fields past requestType */
+static int
+xrdp_autodetect_send_request(struct xrdp_autodetect *self, int seq,
+                             int request_type, int header_length,
+                             const char *payload, int payload_bytes)
+{
+    struct stream *s;
+    int rv;
+
+    make_stream(s);
+    init_stream(s, 8192 + payload_bytes);
+    if (xrdp_sec_init_msgchannel(self->sec_layer, s) != 0)
+    {
+        free_stream(s);
+        return 1;
+    }
+    out_uint8(s, header_length);
+    out_uint8(s, TYPE_ID_AUTODETECT_REQUEST);
+    out_uint16_le(s, seq);
+    out_uint16_le(s, request_type);
+    if (header_length > 6)
+    {
+        out_uint16_le(s, payload_bytes);
+        if (payload != 0)
+        {
+            out_uint8a(s, payload, payload_bytes);
+        }
+        else
+        {
+            out_uint8s(s, payload_bytes);
+        }
+    }
+    s_mark_end(s);
+    rv = xrdp_sec_send_msgchannel(self->sec_layer, s, SEC_AUTODETECT_REQ);
+    free_stream(s);
+    return rv;
+}
+
+/*****************************************************************************/
+/* returns error */
+static int
+xrdp_autodetect_send_rtt(struct xrdp_autodetect *self, int request_type)
+{
+    self->rtt_seq = self->seq++ & 0xffff;
+    self->rtt_time = g_time3();
+    LLOGLN(10, ("xrdp_autodetect_send_rtt: seq %d", self->rtt_seq));
+    return xrdp_autodetect_send_request(self, self->rtt_seq, request_type,
+                                        6, 0, 0);
+}
+
+/*****************************************************************************/
+/* returns error */
+static int
+xrdp_autodetect_send_netchar_result(struct xrdp_autodetect *self)
+{
+    struct stream *s;
+    struct xrdp_client_info *ci;
+    int rv;
+
+    ci = self->client_info;
+    make_stream(s);
+    init_stream(s, 8192);
+    if (xrdp_sec_init_msgchannel(self->sec_layer, s) != 0)
+    {
+        free_stream(s);
+        return 1;
+    }
+    out_uint8(s, 0x12); /* headerLength */
+    out_uint8(s, TYPE_ID_AUTODETECT_REQUEST);
+    out_uint16_le(s, self->seq++ & 0xffff);
+    out_uint16_le(s, RDP_NETCHAR_RESULT_ALL);
+    out_uint32_le(s, ci->net_base_rtt);
+    out_uint32_le(s, ci->net_bandwidth);
+    out_uint32_le(s, ci->net_average_rtt);
+    s_mark_end(s);
+    rv = xrdp_sec_send_msgchannel(self->sec_layer, s, SEC_AUTODETECT_REQ);
+    free_stream(s);
+    return rv;
+}
+
+/*****************************************************************************/
+/* map what was measured onto the connection types the client could have
+   sent in CS_CORE so the rest of xrdp can keep using them */
+static void
+xrdp_autodetect_classify(struct xrdp_client_info *ci)
+{
+    int bw;
+    int rtt;
+
+    bw = ci->net_bandwidth;
+    rtt = ci->net_average_rtt;
+    if (bw >= 10000)
+    {
+        ci->net_connection_type = rtt < 20 ? CONNECTION_TYPE_LAN :
+                                  CONNECTION_TYPE_WAN;
+    }
+    else if (bw >= 2000)
+    {
+        ci->net_connection_type = rtt >= 300 ? CONNECTION_TYPE_SATELLITE :
+                                  CONNECTION_TYPE_BROADBAND_HIGH;
+    }
+    else if (bw >= 256)
+    {
+        ci->net_connection_type = CONNECTION_TYPE_BROADBAND_LOW;
+    }
+    else
+    {
+        ci->net_connection_type = CONNECTION_TYPE_MODEM;
+    }
+}
+
+/*****************************************************************************/
+static void
+xrdp_autodetect_add_rtt(struct xrdp_autodetect *self, int rtt)
+{
+    struct xrdp_client_info *ci;
+
+    ci = self->client_info;
+    if (rtt < 0)
+    {
+        rtt = 0;
+    }
+    ci->net_rtt = rtt;
+    if (ci->net_rtt_count == 0)
+    {
+        ci->net_base_rtt = rtt;
+        ci->net_average_rtt = rtt;
+    }
+    else
+    {
+        if (rtt < ci->net_base_rtt)
+        {
+            ci->net_base_rtt = rtt;
+        }
+        ci->net_average_rtt = (ci->net_average_rtt * 7 + rtt) / 8;
+    }
+    ci->net_rtt_count++;
+}
+
+/*****************************************************************************/
+/* returns error */
+int
+xrdp_autodetect_start(struct xrdp_autodetect *self)
+{
+    char *payload;
+    int index;
+
+    if (!xrdp_autodetect_supported(self))
+    {
+        return 0;
+    }
+    LLOGLN(0, ("xrdp_autodetect_start: connect-time auto-detect"));
+    self->state = AUTODETECT_STATE_CONNECT;
+    self->connect_deadline = g_time3() + AUTODETECT_CONNECT_TIMEOUT;
+    if (xrdp_autodetect_send_rtt(self, RDP_RTT_REQUEST_TYPE_CONNECTTIME) != 0)
+    {
+        return 1;
+    }
+    self->bw_seq = self->seq++ & 0xffff;
+    self->bw_time = g_time3();
+    if (xrdp_autodetect_send_request(self, self->bw_seq,
+                                     RDP_BW_START_REQUEST_TYPE_CONNECTTIME,
+                                     6, 0, 0) != 0)
+    {
+        return 1;
+    }
+    /* the payload content does not matter, random data keeps it from being
+       squeezed by anything along the way */
+    payload = (char *) g_malloc(AUTODETECT_PAYLOAD_BYTES, 0);
+    g_random(payload, AUTODETECT_PAYLOAD_BYTES);
+    for (index = 0; index < AUTODETECT_PAYLOAD_PDUS - 1; index++)
+    {
+        if (xrdp_autodetect_send_request(self, self->bw_seq,
+                                         RDP_BW_PAYLOAD_REQUEST_TYPE,
+                                         8, payload,
+                                         AUTODETECT_PAYLOAD_BYTES) != 0)
+        {
+            g_free(payload);
+            return 1;
+        }
+    }
+    if (xrdp_autodetect_send_request(self, self->bw_seq,
+                                     RDP_BW_STOP_REQUEST_TYPE_CONNECTTIME,
+                                     8, payload,
+                                     AUTODETECT_PAYLOAD_BYTES) != 0)
+    {
+        g_free(payload);
+        return 1;
+    }
+    g_free(payload);
+    return 0;
+}
+
+/*****************************************************************************/
+/* returns error, -1 when the connect-time sequence is complete and the
+   demand active should be sent */
+static int
+xrdp_autodetect_process_bw_results(struct xrdp_autodetect *self,
+                                   struct stream *s, int seq)
+{
+    struct xrdp_client_info *ci;
+    unsigned int time_delta;
+    unsigned int byte_count;
+
+    if (!s_check_rem(s, 8))
+    {
+        return 1;
+    }
+    in_uint32_le(s, time_delta);
+    in_uint32_le(s, byte_count);
+    if (seq != self->bw_seq)
+    {
+        LLOGLN(0, ("xrdp_autodetect_process_bw_results: unexpected "
+               "sequence %d", seq));
+        return 0;
+    }
+    self->bw_seq = -1;
+    ci = self->client_info;
+    LLOGLN(10, ("xrdp_autodetect_process_bw_results: time_delta %u "
+           "byte_count %u", time_delta, byte_count));
+    if ((self->state == AUTODETECT_STATE_CONNECT) ||
+        (byte_count >= AUTODETECT_BW_MIN_BYTES))
+    {
+        if (time_delta == 0)
+        {
+            /* faster than the client timer can tell */
+            time_delta = 1;
+        }
+        /* kilobits per second */
+        ci->net_bandwidth = (int) (((tui64) byte_count * 8) / time_delta);
+        ci->net_bw_count++;
+        xrdp_autodetect_classify(ci);
+    }
+    if (self->state == AUTODETECT_STATE_CONNECT)
+    {
+        log_message(LOG_LEVEL_INFO, "network auto-detect: rtt %d ms, "
+                    "bandwidth %d kbit/s, connection type %d",
+                    ci->net_average_rtt, ci->net_bandwidth,
+                    ci->net_connection_type);
+        if (xrdp_autodetect_send_netchar_result(self) != 0)
+        {
+            return 1;
+        }
+        self->state = AUTODETECT_STATE_SESSION;
+        self->next_rtt_time = g_time3() + AUTODETECT_RTT_INTERVAL;
+        self->next_bw_time = g_time3() + AUTODETECT_BW_INTERVAL;
+        return -1;
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+/* process a SEC_AUTODETECT_RSP PDU from the message channel
+   returns error, -1 when the connect-time sequence is complete and the
+   demand active should be sent */
+int
+xrdp_autodetect_process(struct xrdp_autodetect *self, struct stream *s)
+{
+    int header_length;
+    int header_type_id;
+    int seq;
+    int response_type;
+    int rtt;
+
+    if (!s_check_rem(s, 6))
+    {
+        return 1;
+    }
+    in_uint8(s, header_length);
+    in_uint8(s, header_type_id);
+    in_uint16_le(s, seq);
+    in_uint16_le(s, response_type);
+    if ((header_type_id != TYPE_ID_AUTODETECT_RESPONSE) ||
+        (header_length < 6))
+    {
+        LLOGLN(0, ("xrdp_autodetect_process: bad header"));
+        return 1;
+    }
+    LLOGLN(10, ("xrdp_autodetect_process: seq %d response_type 0x%4.4x",
+           seq, response_type));
+    switch (response_type)
+    {
+        case RDP_RTT_RESPONSE_TYPE:
+            if (seq == self->rtt_seq)
+            {
+                rtt = g_time3() - self->rtt_time;
+                self->rtt_seq = -1;
+                xrdp_autodetect_add_rtt(self, rtt);
+                LLOGLN(10, ("xrdp_autodetect_process: rtt %d ms avg %d ms",
+                       rtt, self->client_info->net_average_rtt));
+            }
+            break;
+        case RDP_BW_RESULTS_RESPONSE_TYPE_CONNECTTIME:
+        case RDP_BW_RESULTS_RESPONSE_TYPE_CONTINUOUS:
+            return xrdp_autodetect_process_bw_results(self, s, seq);
+        case RDP_NETCHAR_SYNC_RESPONSE_TYPE:
+            /* client reconnected and offers its old results, we measure
+               again anyway */
+            break;
+        default:
+            LLOGLN(0, ("xrdp_autodetect_process: unknown response type "
+                   "0x%4.4x", response_type));
+            break;
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+/* lowers *timeout to when the next session-time request is due */
+int
+xrdp_autodetect_get_timeout(struct xrdp_autodetect *self, int *timeout)
+{
+    int now;
+    int next;
+    int ms;
+
+    now = g_time3();
+    if (self->state == AUTODETECT_STATE_CONNECT)
+    {
+        next = self->connect_deadline;
+    }
+    else if (self->state != AUTODETECT_STATE_SESSION)
+    {
+        return 0;
+    }
+    else
+    {
+        next = self->next_rtt_time;
+    }
+    if ((self->state == AUTODETECT_STATE_SESSION) &&
+        (self->next_bw_time - next < 0))
+    {
+        next = self->next_bw_time;
+    }
+    if ((self->state == AUTODETECT_STATE_SESSION) &&
+        (self->bw_seq >= 0) && (self->bw_stop_time != 0) &&
+        (self->bw_stop_time - next < 0))
+    {
+        next = self->bw_stop_time;
+    }
+    ms = next - now;
+    if (ms < 0)
+    {
+        ms = 0;
+    }
+    if ((*timeout < 0) || (ms < *timeout))
+    {
+        *timeout = ms;
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+/* send any session-time requests that are due
+   returns error, -1 when the connect-time results did not come in time and
+   the demand active should be sent */
+int
+xrdp_autodetect_check(struct xrdp_autodetect *self)
+{
+    int now;
+
+    now = g_time3();
+    if (self->state == AUTODETECT_STATE_CONNECT)
+    {
+        if (now - self->connect_deadline < 0)
+        {
+            return 0;
+        }
+        /* the client keeps its declared connection type */
+        log_message(LOG_LEVEL_INFO, "network auto-detect: no results from "
+                    "the client after %d ms, going on without",
+                    AUTODETECT_CONNECT_TIMEOUT);
+        self->rtt_seq = -1;
+        self->bw_seq = -1;
+        self->state = AUTODETECT_STATE_SESSION;
+        self->next_rtt_time = now + AUTODETECT_RTT_INTERVAL;
+        self->next_bw_time = now + AUTODETECT_BW_INTERVAL;
+        return -1;
+    }
+    if (self->state != AUTODETECT_STATE_SESSION)
+    {
+        return 0;
+    }
+    if (now - self->next_rtt_time >= 0)
+    {
+        self->next_rtt_time = now + AUTODETECT_RTT_INTERVAL;
+        /* an unanswered request is just dropped, the new one replaces it */
+        if (xrdp_autodetect_send_rtt(self,
+                                     RDP_RTT_REQUEST_TYPE_CONTINUOUS) != 0)
+        {
+            return 1;
+        }
+    }
+    if (now - self->next_bw_time >= 0)
+    {
+        /* a measurement the client never answered is given up on here */
+        self->next_bw_time = now + AUTODETECT_BW_INTERVAL;
+        self->bw_seq = self->seq++ & 0xffff;
+        self->bw_stop_time = now + AUTODETECT_BW_WINDOW;
+        if (xrdp_autodetect_send_request(self, self->bw_seq,
+                                         RDP_BW_START_REQUEST_TYPE_CONTINUOUS,
+                                         6, 0, 0) != 0)
+        {
+            return 1;
+        }
+    }
+    else if ((self->bw_seq >= 0) && (self->bw_stop_time != 0) &&
+             (now - self->bw_stop_time >= 0))
+    {
+        /* the client answers with the bytes it saw between start and stop */
+        self->bw_stop_time = 0;
+        if (xrdp_autodetect_send_request(self, self->bw_seq,
+                                         RDP_BW_STOP_REQUEST_TYPE_CONTINUOUS,
+                                         6, 0, 0) != 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -366,6 +366,8 @@ xrdp_caps_process_glyphcache(struct xrdp_rdp *self, struct stream *s,
                              int len)
 {
     int glyph_support_level;
+    int index;
+    struct xrdp_client_info *ci;
 
     if (len < 40 + 4 + 2 + 2) /* MS-RDPBCGR 2.2.7.1.8 */
     {
@@ -373,10 +375,17 @@ xrdp_caps_process_glyphcache(struct xrdp_rdp *self, struct stream *s,
         return 1;
     }
 
-    in_uint8s(s, 40);  /* glyph cache */
-    in_uint8s(s, 4);   /* frag cache */
+    ci = &(self->client_info);
+    for (index = 0; index < 10; index++) /* TS_CACHE_DEFINITION */
+    {
+        in_uint16_le(s, ci->glyph_cache_entries[index]);
+        in_uint16_le(s, ci->glyph_cache_cell_size[index]);
+    }
+    in_uint16_le(s, ci->frag_cache_entries);
+    in_uint16_le(s, ci->frag_cache_max_bytes);
     in_uint16_le(s, glyph_support_level);
     in_uint8s(s, 2);   /* pad */
+    ci->glyph_support_level = glyph_support_level;
 
     if (glyph_support_level == GLYPH_SUPPORT_ENCODE)
     {
@@ -563,6 +572,24 @@ xrdp_caps_process_multifragmentupdate(struct xrdp_rdp *self, struct stream *s,
     return 0;
 }
 
+/*****************************************************************************/
+static int
+xrdp_caps_process_large_pointer(struct xrdp_rdp *self, struct stream *s,
+                                int len)
+{
+    int flags;
+
+    if (len < 2)
+    {
+        g_writeln("xrdp_caps_process_large_pointer: error");
+        return 1;
+    }
+    in_uint16_le(s, flags);
+    self->client_info.large_pointer_flags = flags;
+    g_writeln("xrdp_caps_process_large_pointer: flags 0x%4.4x", flags);
+    return 0;
+}
+
  /*****************************************************************************/
 static int
 xrdp_caps_process_frame_ack(struct xrdp_rdp *self, struct stream *s, int len)
@@ -713,6 +740,9 @@ xrdp_caps_process_confirm_active(struct xrdp_rdp *self, struct stream *s)
             case CAPSSETTYPE_MULTIFRAGMENTUPDATE:
                 xrdp_caps_process_multifragmentupdate(self, s, len);
                 break;
+            case CAPSETTYPE_LARGE_POINTER:
+                xrdp_caps_process_large_pointer(self, s, len);
+                break;
             case CAPSETTYPE_SURFACE_COMMANDS:
                 xrdp_caps_process_surface_cmds(self, s, len);
                 break;
@@ -995,6 +1025,13 @@ xrdp_caps_send_demand_active(struct xrdp_rdp *self)
         out_uint16_le(s, CAPSSETTYPE_MULTIFRAGMENTUPDATE_LEN);
         out_uint32_le(s, 3 * 1024 * 1024); /* 3MB */
 
+        /* large pointers, sent as fastpath updates only */
+        caps_count++;
+        out_uint16_le(s, CAPSETTYPE_LARGE_POINTER);
+        out_uint16_le(s, CAPSETTYPE_LARGE_POINTER_LEN);
+        out_uint16_le(s, LARGE_POINTER_FLAG_96x96 |
+                         LARGE_POINTER_FLAG_384x384);
+
         /* frame acks */
         caps_count++;
         out_uint16_le(s, CAPSTYPE_FRAME_ACKNOWLEDGE);
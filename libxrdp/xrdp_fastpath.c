@@ -297,9 +297,9 @@ xrdp_fastpath_process_EVENT_UNICODE(struct xrdp_fastpath *self,
 
 /*****************************************************************************/
 /* FASTPATH_INPUT_EVENT */
-int
-xrdp_fastpath_process_input_event(struct xrdp_fastpath *self,
-                                  struct stream *s)
+static int
+xrdp_fastpath_process_input_events(struct xrdp_fastpath *self,
+                                   struct stream *s)
 {
     int i;
     int eventHeader;
@@ -368,3 +368,17 @@ xrdp_fastpath_process_input_event(struct xrdp_fastpath *self,
     }
     return 0;
 }
+
+/*****************************************************************************/
+/* the events of one PDU are bracketed so xrdp can merge and batch them */
+int
+xrdp_fastpath_process_input_event(struct xrdp_fastpath *self,
+                                  struct stream *s)
+{
+    int rv;
+
+    xrdp_fastpath_session_callback(self, 0x5559, 0, 0, 0, 0);
+    rv = xrdp_fastpath_process_input_events(self, s);
+    xrdp_fastpath_session_callback(self, 0x555a, 0, 0, 0, 0);
+    return rv;
+}
@@ -859,6 +859,12 @@ xrdp_mcs_out_gcc_data(struct xrdp_sec *self)
         g_writeln("xrdp_sec_out_mcs_data: error");
     }
     /* end certificate */
+    if (self->mcs_layer->msgchanid != 0)
+    {
+        out_uint16_le(s, SEC_TAG_SRV_MSGCHANNEL);
+        out_uint16_le(s, 6); /* len */
+        out_uint16_le(s, self->mcs_layer->msgchanid);
+    }
     s_mark_end(s);
 
     gcc_size = (int)(s->end - ud_ptr) | 0x8000;
@@ -911,6 +917,7 @@ int
 xrdp_mcs_incoming(struct xrdp_mcs *self)
 {
     int index;
+    int count;
 
     DEBUG(("  in xrdp_mcs_incoming"));
 
@@ -950,7 +957,14 @@ xrdp_mcs_incoming(struct xrdp_mcs *self)
         return 1;
     }
 
-    for (index = 0; index < self->channel_list->count + 2; index++)
+    /* user channel, global channel, static channels and the message
+       channel when one was handed out */
+    count = self->channel_list->count + 2;
+    if (self->msgchanid != 0)
+    {
+        count++;
+    }
+    for (index = 0; index < count; index++)
     {
         if (xrdp_mcs_recv_cjrq(self) != 0)
         {
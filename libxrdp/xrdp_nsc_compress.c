@@ -0,0 +1,311 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Copyright (C) Jay Sorg 2004-2014
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * NSCodec compressor, MS-RDPNSC
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include <config_ac.h>
+#endif
+
+#include "libxrdp.h"
+
+/* NSCODEC_BITMAP_STREAM header, 4 plane byte counts, ColorLossLevel,
+   ChromaSubsamplingLevel and 2 reserved */
+#define NSC_HEADER_BYTES 20
+
+struct xrdp_nsc
+{
+    tui8 *planes; /* luma, orange chroma, green chroma then alpha */
+    int planes_bytes;
+};
+
+/*****************************************************************************/
+void *
+xrdp_nsc_init(void)
+{
+    struct xrdp_nsc *self;
+
+    self = (struct xrdp_nsc *) g_malloc(sizeof(struct xrdp_nsc), 1);
+    return self;
+}
+
+/*****************************************************************************/
+int
+xrdp_nsc_deinit(void *handle)
+{
+    struct xrdp_nsc *self;
+
+    self = (struct xrdp_nsc *) handle;
+    if (self == 0)
+    {
+        return 0;
+    }
+    g_free(self->planes);
+    g_free(self);
+    return 0;
+}
+
+/*****************************************************************************/
+/* the last 4 bytes of a plane are always raw, runs are the value twice
+   then the length less 2, or 0xff and a 32 bit length
+   returns the encoded size, org_bytes if that is not smaller */
+static int
+xrdp_nsc_rle_encode(const tui8 *in, tui8 *out, int org_bytes)
+{
+    int index;
+    int end;
+    int run;
+    int out_bytes;
+    tui8 value;
+
+    if (org_bytes < 5)
+    {
+        return org_bytes;
+    }
+    end = org_bytes - 4;
+    index = 0;
+    out_bytes = 0;
+    while (index < end)
+    {
+        value = in[index];
+        run = 1;
+        while ((index + run < end) && (in[index + run] == value))
+        {
+            run++;
+        }
+        if (run == 1)
+        {
+            if (out_bytes + 1 > end)
+            {
+                return org_bytes;
+            }
+            out[out_bytes++] = value;
+        }
+        else if (run < 257)
+        {
+            if (out_bytes + 3 > end)
+            {
+                return org_bytes;
+            }
+            out[out_bytes++] = value;
+            out[out_bytes++] = value;
+            out[out_bytes++] = run - 2;
+        }
+        else
+        {
+            if (out_bytes + 7 > end)
+            {
+                return org_bytes;
+            }
+            out[out_bytes++] = value;
+            out[out_bytes++] = value;
+            out[out_bytes++] = 0xff;
+            out[out_bytes++] = run;
+            out[out_bytes++] = run >> 8;
+            out[out_bytes++] = run >> 16;
+            out[out_bytes++] = run >> 24;
+        }
+        index += run;
+    }
+    if (out_bytes + 4 >= org_bytes)
+    {
+        return org_bytes;
+    }
+    g_memcpy(out + out_bytes, in + end, 4);
+    return out_bytes + 4;
+}
+
+/*****************************************************************************/
+/* 2x2 average of the chroma planes, done in place */
+static void
+xrdp_nsc_subsample(tui8 *plane, int rw, int rh)
+{
+    int x;
+    int y;
+    tui8 *dst;
+    const signed char *src0;
+    const signed char *src1;
+
+    for (y = 0; y < rh / 2; y++)
+    {
+        dst = plane + y * (rw / 2);
+        src0 = (const signed char *) (plane + (y * 2) * rw);
+        src1 = src0 + rw;
+        for (x = 0; x < rw / 2; x++)
+        {
+            dst[x] = (src0[x * 2] + src0[x * 2 + 1] +
+                      src1[x * 2] + src1[x * 2 + 1]) >> 2;
+        }
+    }
+}
+
+/*****************************************************************************/
+/* inp_data is a8r8g8b8, the rect x, y, cx, cy is encoded to a
+   NSCODEC_BITMAP_STREAM in out_data, io_len is the size of out_data on
+   entry and the stream size on return
+   returns error */
+int
+xrdp_codec_nsc_compress(void *handle, char *inp_data, int stride,
+                        int x, int y, int cx, int cy,
+                        int color_loss_level, int subsampling,
+                        char *out_data, int *io_len)
+{
+    struct xrdp_nsc *self;
+    struct stream ls;
+    struct stream *s;
+    const tui32 *src;
+    tui8 *planes[4];
+    tui8 *yp;
+    tui8 *cop;
+    tui8 *cgp;
+    char *counts_ptr;
+    int org_bytes[4];
+    int plane_bytes;
+    int bytes;
+    int index;
+    int row;
+    int col;
+    int rw;
+    int rh;
+    int r;
+    int g;
+    int b;
+    tui32 pixel;
+
+    self = (struct xrdp_nsc *) handle;
+    if ((self == 0) || (cx < 1) || (cy < 1))
+    {
+        return 1;
+    }
+    color_loss_level = MAX(color_loss_level, 1);
+    color_loss_level = MIN(color_loss_level, 7);
+    subsampling = subsampling ? 1 : 0;
+    if (subsampling)
+    {
+        /* the decoder works on 8 pixel wide, 2 line high luma */
+        rw = (cx + 7) & ~7;
+        rh = (cy + 1) & ~1;
+        org_bytes[0] = rw * cy;
+        org_bytes[1] = (rw / 2) * (rh / 2);
+        org_bytes[2] = org_bytes[1];
+    }
+    else
+    {
+        rw = cx;
+        rh = cy;
+        org_bytes[0] = cx * cy;
+        org_bytes[1] = org_bytes[0];
+        org_bytes[2] = org_bytes[0];
+    }
+    org_bytes[3] = cx * cy;
+
+    if (*io_len < NSC_HEADER_BYTES + org_bytes[0] + org_bytes[1] +
+                  org_bytes[2] + org_bytes[3])
+    {
+        return 1;
+    }
+
+    plane_bytes = rw * rh;
+    bytes = plane_bytes * 3 + org_bytes[3];
+    if (bytes > self->planes_bytes)
+    {
+        g_free(self->planes);
+        self->planes = (tui8 *) g_malloc(bytes, 0);
+        if (self->planes == 0)
+        {
+            self->planes_bytes = 0;
+            return 1;
+        }
+        self->planes_bytes = bytes;
+    }
+    planes[0] = self->planes;
+    planes[1] = planes[0] + plane_bytes;
+    planes[2] = planes[1] + plane_bytes;
+    planes[3] = planes[2] + plane_bytes;
+
+    /* RGB to YCoCg, kept branch free so the compiler can vectorize it */
+    for (row = 0; row < cy; row++)
+    {
+        src = (const tui32 *) (inp_data + (y + row) * stride + x * 4);
+        yp = planes[0] + row * rw;
+        cop = planes[1] + row * rw;
+        cgp = planes[2] + row * rw;
+        for (col = 0; col < cx; col++)
+        {
+            pixel = src[col];
+            r = (pixel >> 16) & 0xff;
+            g = (pixel >> 8) & 0xff;
+            b = pixel & 0xff;
+            yp[col] = (r >> 2) + (g >> 1) + (b >> 2);
+            cop[col] = (r - b) >> color_loss_level;
+            cgp[col] = (g - (r >> 1) - (b >> 1)) >> color_loss_level;
+        }
+        /* pad to the subsampled width with the last pixel */
+        for (col = cx; col < rw; col++)
+        {
+            yp[col] = yp[cx - 1];
+            cop[col] = cop[cx - 1];
+            cgp[col] = cgp[cx - 1];
+        }
+    }
+    if (rh > cy)
+    {
+        /* and to the subsampled height with the last line */
+        for (index = 0; index < 3; index++)
+        {
+            g_memcpy(planes[index] + cy * rw,
+                     planes[index] + (cy - 1) * rw, rw);
+        }
+    }
+    if (subsampling)
+    {
+        xrdp_nsc_subsample(planes[1], rw, rh);
+        xrdp_nsc_subsample(planes[2], rw, rh);
+    }
+    /* the desktop is opaque */
+    g_memset(planes[3], 0xff, org_bytes[3]);
+
+    g_memset(&ls, 0, sizeof(ls));
+    s = &ls;
+    s->data = out_data;
+    s->p = s->data;
+    s->end = s->data + *io_len;
+    counts_ptr = s->p;
+    out_uint8s(s, 16); /* plane byte counts set later */
+    out_uint8(s, color_loss_level);
+    out_uint8(s, subsampling);
+    out_uint16_le(s, 0); /* reserved */
+    for (index = 0; index < 4; index++)
+    {
+        bytes = xrdp_nsc_rle_encode(planes[index], (tui8 *) (s->p),
+                                    org_bytes[index]);
+        if (bytes >= org_bytes[index])
+        {
+            /* raw when run length does not help */
+            bytes = org_bytes[index];
+            g_memcpy(s->p, planes[index], bytes);
+        }
+        s->p += bytes;
+        counts_ptr[index * 4 + 0] = bytes;
+        counts_ptr[index * 4 + 1] = bytes >> 8;
+        counts_ptr[index * 4 + 2] = bytes >> 16;
+        counts_ptr[index * 4 + 3] = bytes >> 24;
+    }
+    *io_len = (int) (s->p - s->data);
+    return 0;
+}
@@ -101,6 +101,67 @@ xrdp_orders_reset(struct xrdp_orders *self)
     return 0;
 }
 
+/*****************************************************************************/
+/* start a new orders PDU in out_s, returns error */
+static int
+xrdp_orders_init_pdu(struct xrdp_orders *self)
+{
+    self->order_count = 0;
+    if (self->rdp_layer->client_info.use_fast_path & 1)
+    {
+        LLOGLN(10, ("xrdp_orders_init_pdu: fastpath"));
+        if (xrdp_rdp_init_fastpath(self->rdp_layer, self->out_s) != 0)
+        {
+            return 1;
+        }
+        self->order_count_ptr = self->out_s->p;
+        out_uint8s(self->out_s, 2); /* number of orders, set later */
+    }
+    else
+    {
+        LLOGLN(10, ("xrdp_orders_init_pdu: slowpath"));
+        if (xrdp_rdp_init_data(self->rdp_layer, self->out_s) != 0)
+        {
+            return 1;
+        }
+        out_uint16_le(self->out_s, RDP_UPDATE_ORDERS);
+        out_uint8s(self->out_s, 2); /* pad */
+        self->order_count_ptr = self->out_s->p;
+        out_uint8s(self->out_s, 2); /* number of orders, set later */
+        out_uint8s(self->out_s, 2); /* pad */
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+/* send the orders PDU in out_s, returns error */
+static int
+xrdp_orders_send_pdu(struct xrdp_orders *self)
+{
+    s_mark_end(self->out_s);
+    DEBUG(("xrdp_orders_send_pdu sending %d orders", self->order_count));
+    self->order_count_ptr[0] = self->order_count;
+    self->order_count_ptr[1] = self->order_count >> 8;
+    self->order_count = 0;
+    if (self->rdp_layer->client_info.use_fast_path & 1)
+    {
+        if (xrdp_rdp_send_fastpath(self->rdp_layer, self->out_s,
+                                   FASTPATH_UPDATETYPE_ORDERS) != 0)
+        {
+            return 1;
+        }
+    }
+    else
+    {
+        if (xrdp_rdp_send_data(self->rdp_layer, self->out_s,
+                               RDP_DATA_PDU_UPDATE) != 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 /*****************************************************************************/
 /* returns error */
 int
@@ -109,30 +170,10 @@ xrdp_orders_init(struct xrdp_orders *self)
     self->order_level++;
     if (self->order_level == 1)
     {
-        self->order_count = 0;
-        if (self->rdp_layer->client_info.use_fast_path & 1)
-        {
-            LLOGLN(10, ("xrdp_orders_init: fastpath"));
-            if (xrdp_rdp_init_fastpath(self->rdp_layer, self->out_s) != 0)
-            {
-                return 1;
-            }
-            self->order_count_ptr = self->out_s->p;
-            out_uint8s(self->out_s, 2); /* number of orders, set later */
-        }
-        else
-        {
-            LLOGLN(10, ("xrdp_orders_init: slowpath"));
-            if (xrdp_rdp_init_data(self->rdp_layer, self->out_s) != 0)
-            {
-                return 1;
-            }
-            out_uint16_le(self->out_s, RDP_UPDATE_ORDERS);
-            out_uint8s(self->out_s, 2); /* pad */
-            self->order_count_ptr = self->out_s->p;
-            out_uint8s(self->out_s, 2); /* number of orders, set later */
-            out_uint8s(self->out_s, 2); /* pad */
-        }
+        /* everything sent until the matching xrdp_orders_send, orders PDUs
+           that filled up included, leaves in one write */
+        trans_cork(self->session->trans);
+        return xrdp_orders_init_pdu(self);
     }
     return 0;
 }
@@ -148,28 +189,15 @@ xrdp_orders_send(struct xrdp_orders *self)
     if (self->order_level > 0)
     {
         self->order_level--;
-        if ((self->order_level == 0) && (self->order_count > 0))
-        {
-            s_mark_end(self->out_s);
-            DEBUG(("xrdp_orders_send sending %d orders", self->order_count));
-            self->order_count_ptr[0] = self->order_count;
-            self->order_count_ptr[1] = self->order_count >> 8;
-            self->order_count = 0;
-            if (self->rdp_layer->client_info.use_fast_path & 1)
+        if (self->order_level == 0)
+        {
+            if (self->order_count > 0)
             {
-                if (xrdp_rdp_send_fastpath(self->rdp_layer,
-                                           self->out_s, 0) != 0)
-                {
-                    rv = 1;
-                }
+                rv = xrdp_orders_send_pdu(self);
             }
-            else
+            if (trans_uncork(self->session->trans) != 0)
             {
-                if (xrdp_rdp_send_data(self->rdp_layer, self->out_s,
-                                       RDP_DATA_PDU_UPDATE) != 0)
-                {
-                    rv = 1;
-                }
+                rv = 1;
             }
         }
     }
@@ -181,41 +209,32 @@ xrdp_orders_send(struct xrdp_orders *self)
 int
 xrdp_orders_force_send(struct xrdp_orders *self)
 {
+    int rv;
+
     if (self == 0)
     {
         return 1;
     }
-    if ((self->order_level > 0) && (self->order_count > 0))
+    rv = 0;
+    if (self->order_level > 0)
     {
-        s_mark_end(self->out_s);
-        DEBUG(("xrdp_orders_force_send sending %d orders", self->order_count));
-        self->order_count_ptr[0] = self->order_count;
-        self->order_count_ptr[1] = self->order_count >> 8;
-        if (self->rdp_layer->client_info.use_fast_path & 1)
+        if (self->order_count > 0)
         {
-            if (xrdp_rdp_send_fastpath(self->rdp_layer,
-                                       self->out_s, FASTPATH_UPDATETYPE_ORDERS) != 0)
-            {
-                return 1;
-            }
+            rv = xrdp_orders_send_pdu(self);
         }
-        else
+        if (trans_uncork(self->session->trans) != 0)
         {
-            if (xrdp_rdp_send_data(self->rdp_layer, self->out_s,
-                                   RDP_DATA_PDU_UPDATE) != 0)
-            {
-                return 1;
-            }
+            rv = 1;
         }
     }
     self->order_count = 0;
     self->order_level = 0;
-    return 0;
+    return rv;
 }
 
 /*****************************************************************************/
 /* check if the current order will fit in packet size of 16384, if not */
-/* send what we got and init a new one */
+/* send what we got and start a new one */
 /* returns error */
 int
 xrdp_orders_check(struct xrdp_orders *self, int max_size)
@@ -263,8 +282,18 @@ xrdp_orders_check(struct xrdp_orders *self, int max_size)
 
     if ((size + max_size + 100) > max_order_size)
     {
-        xrdp_orders_force_send(self);
-        xrdp_orders_init(self);
+        /* the transport stays corked, this PDU joins the batch */
+        if (self->order_count > 0)
+        {
+            if (xrdp_orders_send_pdu(self) != 0)
+            {
+                return 1;
+            }
+        }
+        if (xrdp_orders_init_pdu(self) != 0)
+        {
+            return 1;
+        }
     }
 
     return 0;
@@ -187,6 +187,14 @@ xrdp_rdp_read_config(struct xrdp_client_info *client_info)
         {
             client_info->tls_ciphers = g_strdup(value);
         }
+        else if (g_strcasecmp(item, "tls_ktls") == 0)
+        {
+            client_info->tls_ktls = g_text2bool(value);
+        }
+        else if (g_strcasecmp(item, "network_autodetect") == 0)
+        {
+            client_info->network_autodetect = g_text2bool(value);
+        }
         else if (g_strcasecmp(item, "security_layer") == 0)
         {
             if (g_strcasecmp(value, "rdp") == 0)
@@ -907,6 +915,7 @@ xrdp_rdp_process_data_input(struct xrdp_rdp *self, struct stream *s)
     int param1;
     int param2;
     int time;
+    int rv;
 
     if (!s_check_rem(s, 4))
     {
@@ -916,11 +925,18 @@ xrdp_rdp_process_data_input(struct xrdp_rdp *self, struct stream *s)
     in_uint8s(s, 2); /* pad */
     DEBUG(("in xrdp_rdp_process_data_input %d events", num_events));
 
+    if (self->session->callback != 0)
+    {
+        /* start of events that can be merged, see xrdp_wm.c */
+        self->session->callback(self->session->id, 0x5559, 0, 0, 0, 0);
+    }
+    rv = 0;
     for (index = 0; index < num_events; index++)
     {
         if (!s_check_rem(s, 12))
         {
-            return 1;
+            rv = 1;
+            break;
         }
         in_uint32_le(s, time);
         in_uint16_le(s, msg_type);
@@ -942,9 +958,13 @@ xrdp_rdp_process_data_input(struct xrdp_rdp *self, struct stream *s)
                                     device_flags, time);
         }
     }
+    if (self->session->callback != 0)
+    {
+        self->session->callback(self->session->id, 0x555a, 0, 0, 0, 0);
+    }
 
     DEBUG(("out xrdp_rdp_process_data_input"));
-    return 0;
+    return rv;
 }
 
 /*****************************************************************************/
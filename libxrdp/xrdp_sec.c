@@ -454,6 +454,7 @@ xrdp_sec_create(struct xrdp_rdp *owner, struct trans *trans)
                                       &(self->server_mcs_data));
     self->fastpath_layer = xrdp_fastpath_create(self, trans);
     self->chan_layer = xrdp_channel_create(self, self->mcs_layer);
+    self->autodetect_layer = xrdp_autodetect_create(self);
     self->is_security_header_present = 1;
     DEBUG((" out xrdp_sec_create"));
 
@@ -470,6 +471,7 @@ xrdp_sec_delete(struct xrdp_sec *self)
         return;
     }
 
+    xrdp_autodetect_delete(self->autodetect_layer);
     xrdp_channel_delete(self->chan_layer);
     xrdp_mcs_delete(self->mcs_layer);
     xrdp_fastpath_delete(self->fastpath_layer);
@@ -1242,7 +1244,10 @@ xrdp_sec_recv(struct xrdp_sec *self, struct stream *s, int *chan)
     }
 
 
-    if (!(self->is_security_header_present))
+    /* the message channel always carries a security header */
+    if (!(self->is_security_header_present) &&
+        ((self->mcs_layer->msgchanid == 0) ||
+         (*chan != self->mcs_layer->msgchanid)))
     {
         return 0;
     }
@@ -1282,6 +1287,14 @@ xrdp_sec_recv(struct xrdp_sec *self, struct stream *s, int *chan)
         }
     }
 
+    if (flags & SEC_AUTODETECT_RSP) /* 0x2000 */
+    {
+        *chan = 1; /* just set a non existing channel and exit */
+        DEBUG((" out xrdp_sec_recv"));
+        /* -1 once connect-time detection is done, send demand active */
+        return xrdp_autodetect_process(self->autodetect_layer, s);
+    }
+
     if (flags & SEC_CLIENT_RANDOM) /* 0x01 */
     {
         if (!s_check_rem(s, 4))
@@ -1363,10 +1376,33 @@ xrdp_sec_recv(struct xrdp_sec *self, struct stream *s, int *chan)
             self->is_security_header_present = 0;
         }
 
+        if (self->autodetect_layer->state == AUTODETECT_STATE_IDLE)
+        {
+            if (xrdp_autodetect_start(self->autodetect_layer) != 0)
+            {
+                DEBUG((" out xrdp_sec_recv error"));
+                return 1;
+            }
+            if (self->autodetect_layer->state == AUTODETECT_STATE_CONNECT)
+            {
+                /* demand active goes out when the results are in */
+                *chan = 1; /* just set a non existing channel and exit */
+                DEBUG((" out xrdp_sec_recv"));
+                return 0;
+            }
+        }
+
         DEBUG((" out xrdp_sec_recv"));
         return -1; /* special error that means send demand active */
     }
 
+    if ((self->mcs_layer->msgchanid != 0) &&
+        (*chan == self->mcs_layer->msgchanid))
+    {
+        /* nothing else on the message channel is handled */
+        *chan = 1;
+    }
+
     DEBUG((" out xrdp_sec_recv"));
     return 0;
 }
@@ -1431,44 +1467,53 @@ xrdp_sec_sign(struct xrdp_sec *self, char *out, int out_len,
 }
 
 /*****************************************************************************/
-/* returns error */
-int
-xrdp_sec_send(struct xrdp_sec *self, struct stream *s, int chan)
+/* writes the security header at s->p, signing and encrypting what
+   follows it as the crypt level requires */
+static void
+xrdp_sec_out_header(struct xrdp_sec *self, struct stream *s, int flags)
 {
     int datalen;
     int pad;
 
+    if (self->crypt_level == CRYPT_LEVEL_FIPS)
+    {
+        LLOGLN(10, ("xrdp_sec_out_header: fips"));
+        out_uint32_le(s, flags | SEC_ENCRYPT);
+        datalen = (int)((s->end - s->p) - 12);
+        out_uint16_le(s, 16); /* crypto header size */
+        out_uint8(s, 1); /* fips version */
+        pad = (8 - (datalen % 8)) & 7;
+        g_memset(s->end, 0, pad);
+        s->end += pad;
+        out_uint8(s, pad); /* fips pad */
+        xrdp_sec_fips_sign(self, s->p, 8, s->p + 8, datalen);
+        xrdp_sec_fips_encrypt(self, s->p + 8, datalen + pad);
+    }
+    else if (self->crypt_level > CRYPT_LEVEL_LOW)
+    {
+        out_uint32_le(s, flags | SEC_ENCRYPT);
+        datalen = (int)((s->end - s->p) - 8);
+        xrdp_sec_sign(self, s->p, 8, s->p + 8, datalen);
+        xrdp_sec_encrypt(self, s->p + 8, datalen);
+    }
+    else
+    {
+        out_uint32_le(s, flags);
+    }
+}
+
+/*****************************************************************************/
+/* returns error */
+int
+xrdp_sec_send(struct xrdp_sec *self, struct stream *s, int chan)
+{
     LLOGLN(10, ("xrdp_sec_send:"));
     DEBUG((" in xrdp_sec_send"));
     s_pop_layer(s, sec_hdr);
 
     if (self->crypt_level > CRYPT_LEVEL_NONE)
     {
-        if (self->crypt_level == CRYPT_LEVEL_FIPS)
-        {
-            LLOGLN(10, ("xrdp_sec_send: fips"));
-            out_uint32_le(s, SEC_ENCRYPT);
-            datalen = (int)((s->end - s->p) - 12);
-            out_uint16_le(s, 16); /* crypto header size */
-            out_uint8(s, 1); /* fips version */
-            pad = (8 - (datalen % 8)) & 7;
-            g_memset(s->end, 0, pad);
-            s->end += pad;
-            out_uint8(s, pad); /* fips pad */
-            xrdp_sec_fips_sign(self, s->p, 8, s->p + 8, datalen);
-            xrdp_sec_fips_encrypt(self, s->p + 8, datalen + pad);
-        }
-        else if (self->crypt_level > CRYPT_LEVEL_LOW)
-        {
-            out_uint32_le(s, SEC_ENCRYPT);
-            datalen = (int)((s->end - s->p) - 8);
-            xrdp_sec_sign(self, s->p, 8, s->p + 8, datalen);
-            xrdp_sec_encrypt(self, s->p + 8, datalen);
-        }
-        else
-        {
-            out_uint32_le(s, 0);
-        }
+        xrdp_sec_out_header(self, s, 0);
     }
 
     if (xrdp_mcs_send(self->mcs_layer, s, chan) != 0)
@@ -1480,6 +1525,51 @@ xrdp_sec_send(struct xrdp_sec *self, struct stream *s, int chan)
     return 0;
 }
 
+/*****************************************************************************/
+/* returns error
+   like xrdp_sec_init but for the MCS message channel where the security
+   header is present even when there is no RDP encryption */
+int
+xrdp_sec_init_msgchannel(struct xrdp_sec *self, struct stream *s)
+{
+    if (xrdp_mcs_init(self->mcs_layer, s) != 0)
+    {
+        return 1;
+    }
+
+    if (self->crypt_level == CRYPT_LEVEL_FIPS)
+    {
+        s_push_layer(s, sec_hdr, 4 + 4 + 8);
+    }
+    else if (self->crypt_level > CRYPT_LEVEL_LOW)
+    {
+        s_push_layer(s, sec_hdr, 4 + 8);
+    }
+    else
+    {
+        s_push_layer(s, sec_hdr, 4);
+    }
+
+    return 0;
+}
+
+/*****************************************************************************/
+/* returns error */
+int
+xrdp_sec_send_msgchannel(struct xrdp_sec *self, struct stream *s, int flags)
+{
+    LLOGLN(10, ("xrdp_sec_send_msgchannel: flags 0x%4.4x", flags));
+    s_pop_layer(s, sec_hdr);
+    xrdp_sec_out_header(self, s, flags);
+
+    if (xrdp_mcs_send(self->mcs_layer, s, self->mcs_layer->msgchanid) != 0)
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
 /*****************************************************************************/
 /* returns the fastpath sec byte count */
 int
@@ -2036,6 +2126,7 @@ xrdp_sec_process_mcs_data(struct xrdp_sec *self)
     char *hold_p = (char *)NULL;
     int tag = 0;
     int size = 0;
+    int got_msgchannel = 0;
 
     s = &(self->client_mcs_data);
     /* set p to beginning */
@@ -2089,8 +2180,11 @@ xrdp_sec_process_mcs_data(struct xrdp_sec *self)
                     return 1;
                 }
                 break;
-                                       /* CS_MCS_MSGCHANNEL 0xC006
-                                          CS_MONITOR_EX     0xC008
+            case SEC_TAG_CLI_MSGCHANNEL: /* CS_MCS_MSGCHANNEL 0xC006 */
+                /* flags(4), no flags are defined */
+                got_msgchannel = 1;
+                break;
+                                       /* CS_MONITOR_EX     0xC008
                                           CS_MULTITRANSPORT 0xC00A
                                           SC_CORE           0x0C01
                                           SC_SECURITY       0x0C02
@@ -2106,6 +2200,15 @@ xrdp_sec_process_mcs_data(struct xrdp_sec *self)
         s->p = hold_p + size;
     }
 
+    if (got_msgchannel && self->rdp_layer->client_info.network_autodetect)
+    {
+        /* the message channel comes right after the static channels */
+        self->mcs_layer->msgchanid = MCS_GLOBAL_CHANNEL +
+                                     self->mcs_layer->channel_list->count + 1;
+        LLOGLN(10, ("xrdp_sec_process_mcs_data: message channel %d",
+               self->mcs_layer->msgchanid));
+    }
+
     if (self->rdp_layer->client_info.max_bpp > 0)
     {
         if (self->rdp_layer->client_info.bpp >
@@ -2274,7 +2377,8 @@ xrdp_sec_incoming(struct xrdp_sec *self)
                 self->rdp_layer->client_info.key_file,
                 self->rdp_layer->client_info.certificate,
                 self->rdp_layer->client_info.ssl_protocols,
-                self->rdp_layer->client_info.tls_ciphers) != 0)
+                self->rdp_layer->client_info.tls_ciphers,
+                self->rdp_layer->client_info.tls_ktls) != 0)
         {
             g_writeln("xrdp_sec_incoming: trans_set_tls_mode failed");
             return 1;
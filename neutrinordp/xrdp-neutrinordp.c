@@ -329,6 +329,11 @@ lxrdp_event(struct mod *mod, int msg, long param1, long param2,
             mod->inst->SendInvalidate(mod->inst, -1, x, y, cx, cy);
             break;
 
+        case 400: /* WM_INPUT_BEGIN */
+        case 401: /* WM_INPUT_END */
+            /* input goes out as it comes, nothing to batch */
+            break;
+
         case 0x5555:
             chanid = LOWORD(param1);
             flags = HIWORD(param1);
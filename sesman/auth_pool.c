@@ -0,0 +1,370 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Copyright (C) Jay Sorg 2004-2014
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ *
+ * @file auth_pool.c
+ * @brief Authentication with a deadline, in a login process of its own
+ * @author Jay Sorg
+ *
+ * sesman is multithreaded and a fork can catch another thread inside PAM
+ * or NSS, the child then waits for locks no one will release. Each login
+ * is xrdp-sesman executed again instead, it authenticates, and if that
+ * works it becomes the session process when sesman sends it the command.
+ * The handle auth_userpass returns never leaves the login process.
+ *
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include <config_ac.h>
+#endif
+
+#include <sys/socket.h>
+
+#include "sesman.h"
+
+extern struct config_sesman *g_cfg; /* in sesman.c */
+
+/* authentications slower than this are logged */
+#define AUTH_POOL_SLOW_MS 2000
+
+/* sesman does not ignore SIGPIPE, a login process that died must not take
+   it down */
+#if defined(MSG_NOSIGNAL)
+#define AUTH_POOL_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define AUTH_POOL_SEND_FLAGS 0
+#endif
+
+struct auth_request
+{
+    char user[256];
+    char pass[256];
+};
+
+struct auth_reply
+{
+    int ok;
+    int errorcode;
+};
+
+struct auth_login
+{
+    int pid;
+    int sck;
+};
+
+static tbus g_auth_mutex = 0;
+static struct auth_pool_stats g_stats;
+static long g_total_ms = 0;
+static int g_finished = 0;
+
+/******************************************************************************/
+void
+auth_pool_init(void)
+{
+    g_auth_mutex = tc_mutex_create();
+    g_memset(&g_stats, 0, sizeof(g_stats));
+}
+
+/******************************************************************************/
+/* returns error */
+static int
+auth_pool_send(int sck, const void *data, int bytes)
+{
+    const char *ptr;
+    int sent;
+
+    ptr = (const char *) data;
+    while (bytes > 0)
+    {
+        sent = g_sck_send(sck, ptr, bytes, AUTH_POOL_SEND_FLAGS);
+        if (sent <= 0)
+        {
+            return 1;
+        }
+        ptr += sent;
+        bytes -= sent;
+    }
+    return 0;
+}
+
+/******************************************************************************/
+/* returns error */
+static int
+auth_pool_recv(int sck, void *data, int bytes)
+{
+    char *ptr;
+    int rcvd;
+
+    ptr = (char *) data;
+    while (bytes > 0)
+    {
+        rcvd = g_sck_recv(sck, ptr, bytes, 0);
+        if (rcvd <= 0)
+        {
+            return 1;
+        }
+        ptr += rcvd;
+        bytes -= rcvd;
+    }
+    return 0;
+}
+
+/******************************************************************************/
+/* starts the login process, returns its pid or -1 */
+static int
+auth_pool_spawn(int *sck)
+{
+    char path[256];
+    char *args[3];
+    int scks[2];
+    int pid;
+
+    if (g_sck_local_socketpair(scks) != 0)
+    {
+        return -1;
+    }
+    g_snprintf(path, sizeof(path), "%s/xrdp-sesman", XRDP_SBIN_PATH);
+    args[0] = "xrdp-sesman";
+    args[1] = AUTH_POOL_LOGIN_ARG;
+    args[2] = 0;
+    pid = g_spawn_with_fd(path, args, scks[1], AUTH_POOL_LOGIN_FD);
+    g_sck_close(scks[1]);
+    if (pid == -1)
+    {
+        g_sck_close(scks[0]);
+        return -1;
+    }
+    *sck = scks[0];
+    return pid;
+}
+
+/******************************************************************************/
+static void
+auth_pool_finished(int ms, int ok)
+{
+    tc_mutex_lock(g_auth_mutex);
+    g_stats.active--;
+    g_stats.last_ms = ms;
+    if (ms > g_stats.max_ms)
+    {
+        g_stats.max_ms = ms;
+    }
+    g_total_ms += ms;
+    g_finished++;
+    g_stats.avg_ms = (int) (g_total_ms / g_finished);
+    if (!ok)
+    {
+        g_stats.failures++;
+    }
+    tc_mutex_unlock(g_auth_mutex);
+}
+
+/******************************************************************************/
+long
+auth_pool_userpass(const char *user, const char *pass, int *errorcode)
+{
+    struct auth_request req;
+    struct auth_reply reply;
+    struct auth_login *login;
+    int start_ms;
+    int timeout;
+    int error;
+    int ms;
+    int pid;
+    int sck;
+
+    tc_mutex_lock(g_auth_mutex);
+    g_stats.requests++;
+    if (g_stats.active >= g_cfg->sec.max_auth)
+    {
+        /* the backend is hung or very slow, do not pile up more logins */
+        g_stats.rejected++;
+        tc_mutex_unlock(g_auth_mutex);
+        log_message(LOG_LEVEL_WARNING, "%d authentications running already, "
+                    "login for user %s denied", g_cfg->sec.max_auth, user);
+        return 0;
+    }
+    g_stats.active++;
+    tc_mutex_unlock(g_auth_mutex);
+
+    start_ms = g_time3();
+    pid = auth_pool_spawn(&sck);
+
+    if (pid == -1)
+    {
+        log_message(LOG_LEVEL_ERROR, "error starting login process");
+        tc_mutex_lock(g_auth_mutex);
+        g_stats.active--;
+        tc_mutex_unlock(g_auth_mutex);
+        return 0;
+    }
+
+    g_memset(&req, 0, sizeof(req));
+    g_strncpy(req.user, user, 255);
+    g_strncpy(req.pass, pass, 255);
+    error = auth_pool_send(sck, &req, sizeof(req));
+    g_memset(req.pass, 0, sizeof(req.pass));
+
+    timeout = g_cfg->sec.auth_timeout * 1000;
+    if ((error == 0) && (timeout > 0) && !g_sck_can_recv(sck, timeout))
+    {
+        /* killed and not waited for, the main loop reaps it */
+        g_sigterm(pid);
+        g_sck_close(sck);
+        tc_mutex_lock(g_auth_mutex);
+        g_stats.active--;
+        g_stats.timeouts++;
+        tc_mutex_unlock(g_auth_mutex);
+        log_message(LOG_LEVEL_ERROR, "authentication of user %s timed out "
+                    "after %d seconds", user, g_cfg->sec.auth_timeout);
+        if (errorcode != NULL)
+        {
+            *errorcode = AUTH_POOL_ERROR_TIMEOUT;
+        }
+        return 0;
+    }
+
+    g_memset(&reply, 0, sizeof(reply));
+    if (error == 0)
+    {
+        error = auth_pool_recv(sck, &reply, sizeof(reply));
+    }
+    ms = g_time3() - start_ms;
+    if (ms > AUTH_POOL_SLOW_MS)
+    {
+        log_message(LOG_LEVEL_WARNING, "authentication of user %s took %d ms",
+                    user, ms);
+    }
+    auth_pool_finished(ms, (error == 0) && reply.ok);
+
+    if (error != 0)
+    {
+        log_message(LOG_LEVEL_ERROR, "login process %d for user %s ended "
+                    "before it replied", pid, user);
+    }
+    if (errorcode != NULL)
+    {
+        *errorcode = reply.errorcode;
+    }
+    if ((error != 0) || !reply.ok)
+    {
+        g_sck_close(sck);
+        return 0;
+    }
+
+    login = g_new0(struct auth_login, 1);
+    if (login == 0)
+    {
+        g_sck_close(sck);
+        return 0;
+    }
+    login->pid = pid;
+    login->sck = sck;
+    return (long) login;
+}
+
+/******************************************************************************/
+int
+auth_pool_login_pid(long data)
+{
+    return ((struct auth_login *) data)->pid;
+}
+
+/******************************************************************************/
+int
+auth_pool_send_cmd(long data, const struct auth_pool_cmd *cmd)
+{
+    return auth_pool_send(((struct auth_login *) data)->sck, cmd,
+                          sizeof(struct auth_pool_cmd));
+}
+
+/******************************************************************************/
+void
+auth_pool_end(long data)
+{
+    struct auth_login *login;
+
+    login = (struct auth_login *) data;
+    if (login != 0)
+    {
+        g_sck_close(login->sck);
+        g_free(login);
+    }
+}
+
+/******************************************************************************/
+int
+auth_pool_login_main(int sck)
+{
+    struct auth_request req;
+    struct auth_reply reply;
+    struct auth_pool_cmd cmd;
+    long data;
+
+    if (auth_pool_recv(sck, &req, sizeof(req)) != 0)
+    {
+        return 1;
+    }
+    req.user[255] = 0;
+    req.pass[255] = 0;
+    g_memset(&reply, 0, sizeof(reply));
+    data = auth_userpass(req.user, req.pass, &reply.errorcode);
+    g_memset(req.pass, 0, sizeof(req.pass));
+    reply.ok = data != 0;
+
+    if ((auth_pool_send(sck, &reply, sizeof(reply)) != 0) || (data == 0) ||
+        (auth_pool_recv(sck, &cmd, sizeof(cmd)) != 0))
+    {
+        /* failed, or sesman is done with the login */
+        if (data != 0)
+        {
+            auth_end(data);
+        }
+        return data == 0;
+    }
+
+    g_sck_close(sck);
+    cmd.username[255] = 0;
+    cmd.directory[511] = 0;
+    cmd.program[511] = 0;
+
+    if (cmd.cmd == AUTH_POOL_CMD_START)
+    {
+        session_run(data, &cmd);
+    }
+    else if (cmd.cmd == AUTH_POOL_CMD_RECONNECT)
+    {
+        session_run_reconnect(data, &cmd);
+    }
+
+    /* only for an unknown command, the session functions exit */
+    log_message(LOG_LEVEL_ERROR, "bad login command %d", cmd.cmd);
+    auth_end(data);
+    return 1;
+}
+
+/******************************************************************************/
+void
+auth_pool_get_stats(struct auth_pool_stats *stats)
+{
+    tc_mutex_lock(g_auth_mutex);
+    g_memcpy(stats, &g_stats, sizeof(struct auth_pool_stats));
+    tc_mutex_unlock(g_auth_mutex);
+}
@@ -0,0 +1,134 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Copyright (C) Jay Sorg 2004-2014
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ *
+ * @file auth_pool.h
+ * @brief Authentication with a deadline, in a login process of its own
+ * @author Jay Sorg
+ *
+ */
+
+#ifndef AUTH_POOL_H
+#define AUTH_POOL_H
+
+/* scp v0 reply when the deadline passed, see getPAMError in xrdp */
+#define AUTH_POOL_ERROR_TIMEOUT (32 + 4)
+
+struct auth_pool_stats
+{
+  int requests;
+  int failures; /* refused by the backend */
+  int timeouts; /* given up on after AuthTimeout */
+  int rejected; /* MaxConcurrentAuth were running already */
+  int active; /* running now */
+  int last_ms; /* latency of the last one that finished */
+  int max_ms;
+  int avg_ms;
+};
+
+/* the login process is xrdp-sesman run again with this argument and the
+   socket to sesman as this descriptor */
+#define AUTH_POOL_LOGIN_ARG "--login"
+#define AUTH_POOL_LOGIN_FD 3
+
+#define AUTH_POOL_CMD_START 1
+#define AUTH_POOL_CMD_RECONNECT 2
+
+/* sent to the login process once it is authenticated, it closes the
+   socket and becomes the session process, closing the socket instead
+   ends the login */
+struct auth_pool_cmd
+{
+  int cmd;
+  int type;
+  int display;
+  int width;
+  int height;
+  int bpp;
+  int notify; /* signal sesman_pid when X is up */
+  int sesman_pid;
+  char guid[16];
+  char username[256];
+  char directory[512];
+  char program[512];
+};
+
+/**
+ *
+ * @brief initializes the authentication pool, called before any scp
+ *        thread is started
+ *
+ */
+void
+auth_pool_init(void);
+
+/**
+ *
+ * @brief starts a login process and has it run auth_userpass, kills it
+ *        after AuthTimeout seconds
+ * @return handle of the login process, 0 on failure
+ *
+ */
+long
+auth_pool_userpass(const char *user, const char *pass, int *errorcode);
+
+/**
+ *
+ * @return pid of the login process
+ *
+ */
+int
+auth_pool_login_pid(long data);
+
+/**
+ *
+ * @brief hands the login process what it is to run
+ * @return 0 on success
+ *
+ */
+int
+auth_pool_send_cmd(long data, const struct auth_pool_cmd *cmd);
+
+/**
+ *
+ * @brief closes the socket to the login process and frees the handle, a
+ *        login process that got no command calls auth_end and exits
+ *
+ */
+void
+auth_pool_end(long data);
+
+/**
+ *
+ * @brief main of the login process
+ * @return exit code
+ *
+ */
+int
+auth_pool_login_main(int sck);
+
+/**
+ *
+ * @brief copies the authentication counters
+ *
+ */
+void
+auth_pool_get_stats(struct auth_pool_stats *stats);
+
+#endif
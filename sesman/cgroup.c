@@ -0,0 +1,401 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Copyright (C) Jay Sorg 2004-2014
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ *
+ * @file cgroup.c
+ * @brief cgroup v2 per session resource limits and accounting
+ * @author Jay Sorg
+ *
+ * Each session gets CgroupPath/session-<nonce>-<id>. Sessions outlive a
+ * sesman restart and ids start over, so the nonce is made at startup. The
+ * login process is moved there before it is told to start the session, so
+ * the X server, window manager and chansrv it starts are all in there. That
+ * is before PAM, a logind session scope pam_systemd moves it to is not
+ * touched.
+ *
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include <config_ac.h>
+#endif
+
+#include "sesman.h"
+
+extern struct config_sesman *g_cfg; /* in sesman.c */
+
+/* empty when cgroups are not used, set once at startup */
+static char g_cgroup_path[256] = "";
+/* start time and pid of this sesman, see cgroup_file_path */
+static char g_cgroup_nonce[32] = "";
+
+/******************************************************************************/
+static void
+cgroup_file_path(char *path, int bytes, int id, const char *file)
+{
+    if (id == 0)
+    {
+        g_snprintf(path, bytes, "%s/%s", g_cgroup_path, file);
+    }
+    else
+    {
+        g_snprintf(path, bytes, "%s/session-%s-%d/%s", g_cgroup_path,
+                   g_cgroup_nonce, id, file);
+    }
+}
+
+/******************************************************************************/
+/* id 0 is CgroupPath itself
+   returns error */
+static int
+cgroup_write(int id, const char *file, const char *value)
+{
+    char path[512];
+    int fd;
+    int len;
+    int rv;
+
+    cgroup_file_path(path, sizeof(path), id, file);
+    fd = g_file_open_ex(path, 0, 1, 0, 0);
+    if (fd < 0)
+    {
+        return 1;
+    }
+    len = g_strlen(value);
+    rv = g_file_write(fd, value, len) != len;
+    g_file_close(fd);
+    return rv;
+}
+
+/******************************************************************************/
+/* reads a whole cgroup file, they are small
+   returns error */
+static int
+cgroup_read(int id, const char *file, char *text, int bytes)
+{
+    char path[512];
+    int fd;
+    int len;
+
+    cgroup_file_path(path, sizeof(path), id, file);
+    fd = g_file_open_ex(path, 1, 0, 0, 0);
+    if (fd < 0)
+    {
+        return 1;
+    }
+    len = g_file_read(fd, text, bytes - 1);
+    g_file_close(fd);
+    if (len < 0)
+    {
+        return 1;
+    }
+    text[len] = 0;
+    return 0;
+}
+
+/******************************************************************************/
+static tui64
+cgroup_atou64(const char *text)
+{
+    tui64 rv;
+
+    rv = 0;
+    while ((*text >= '0') && (*text <= '9'))
+    {
+        rv = rv * 10 + (*text - '0');
+        text++;
+    }
+    return rv;
+}
+
+/******************************************************************************/
+/* returns boolean, true if there are processes in the cgroup or below it,
+   also when that can not be read */
+static int
+cgroup_populated(int id)
+{
+    char text[256];
+    const char *line;
+
+    if (cgroup_read(id, "cgroup.events", text, sizeof(text)) != 0)
+    {
+        return 1;
+    }
+    line = text;
+    while (line != 0)
+    {
+        if (g_strncmp(line, "populated ", 10) == 0)
+        {
+            return line[10] != '0';
+        }
+        line = g_strchr(line, '\n');
+        if (line != 0)
+        {
+            line++;
+        }
+    }
+    return 1;
+}
+
+/******************************************************************************/
+/* returns boolean, true if a swap area is active, also when that can not
+   be read */
+static int
+cgroup_have_swap(void)
+{
+    char text[256];
+    const char *line;
+    int fd;
+    int len;
+
+    fd = g_file_open_ex("/proc/swaps", 1, 0, 0, 0);
+    if (fd < 0)
+    {
+        return 1;
+    }
+    len = g_file_read(fd, text, sizeof(text) - 1);
+    g_file_close(fd);
+    if (len < 0)
+    {
+        return 1;
+    }
+    text[len] = 0;
+    /* a header and a line per swap area */
+    line = g_strchr(text, '\n');
+    return (line != 0) && (line[1] != 0);
+}
+
+/******************************************************************************/
+/* controllers must be enabled in CgroupPath for the session cgroups to get
+   the interface files, cpu.stat is there without any */
+static void
+cgroup_enable(const char *controller)
+{
+    if (cgroup_write(0, "cgroup.subtree_control", controller) != 0)
+    {
+        log_message(LOG_LEVEL_WARNING, "cannot enable %s in %s, is the "
+                    "controller delegated to sesman?", controller + 1,
+                    g_cgroup_path);
+    }
+}
+
+/******************************************************************************/
+int
+cgroup_init(void)
+{
+    if (g_cfg->sess.cgroup[0] == 0)
+    {
+        if (g_cfg->sess.hibernate_time > 0)
+        {
+            log_message(LOG_LEVEL_WARNING, "HibernateTimeLimit needs "
+                        "CgroupPath, sessions will not be hibernated");
+        }
+        return 0;
+    }
+    if (!g_directory_exist(g_cfg->sess.cgroup) &&
+        !g_create_dir(g_cfg->sess.cgroup))
+    {
+        log_message(LOG_LEVEL_ERROR, "cannot create cgroup %s, sessions "
+                    "will not be put in cgroups", g_cfg->sess.cgroup);
+        return 1;
+    }
+    g_strncpy(g_cgroup_path, g_cfg->sess.cgroup, 255);
+    g_snprintf(g_cgroup_nonce, sizeof(g_cgroup_nonce), "%x.%x", g_time1(),
+               g_getpid());
+    cgroup_enable("+memory");
+    if (g_cfg->sess.cpu_weight > 0)
+    {
+        cgroup_enable("+cpu");
+    }
+    if (g_cfg->sess.io_weight > 0)
+    {
+        cgroup_enable("+io");
+    }
+    log_message(LOG_LEVEL_INFO, "sessions are put in cgroups below %s",
+                g_cgroup_path);
+    if ((g_cfg->sess.hibernate_time > 0) && !cgroup_have_swap())
+    {
+        log_message(LOG_LEVEL_WARNING, "HibernateTimeLimit is set but there "
+                    "is no swap, only the page cache of sessions is reclaimed");
+    }
+    return 0;
+}
+
+/******************************************************************************/
+int
+cgroup_session_create(int id)
+{
+    char path[512];
+    char text[64];
+
+    if (g_cgroup_path[0] == 0)
+    {
+        return 0;
+    }
+    cgroup_file_path(path, sizeof(path), id, "");
+    if (!g_create_dir(path))
+    {
+        if (!g_directory_exist(path))
+        {
+            log_message(LOG_LEVEL_ERROR, "cannot create cgroup %s", path);
+            return 1;
+        }
+        /* an empty one left over is fine, one with processes in it belongs
+           to a live session and cgroup_session_remove would kill it */
+        if (cgroup_populated(id))
+        {
+            log_message(LOG_LEVEL_ERROR, "cgroup %s is in use, session %d "
+                        "is not put in a cgroup", path, id);
+            return 1;
+        }
+    }
+    if (g_cfg->sess.cpu_weight > 0)
+    {
+        g_snprintf(text, sizeof(text), "%d", g_cfg->sess.cpu_weight);
+        if (cgroup_write(id, "cpu.weight", text) != 0)
+        {
+            log_message(LOG_LEVEL_WARNING, "cannot set cpu.weight of %s",
+                        path);
+        }
+    }
+    if (g_cfg->sess.memory_max[0] != 0)
+    {
+        if (cgroup_write(id, "memory.max", g_cfg->sess.memory_max) != 0)
+        {
+            log_message(LOG_LEVEL_WARNING, "cannot set memory.max of %s",
+                        path);
+        }
+    }
+    if (g_cfg->sess.io_weight > 0)
+    {
+        g_snprintf(text, sizeof(text), "default %d", g_cfg->sess.io_weight);
+        if (cgroup_write(id, "io.weight", text) != 0)
+        {
+            log_message(LOG_LEVEL_WARNING, "cannot set io.weight of %s",
+                        path);
+        }
+    }
+    return 0;
+}
+
+/******************************************************************************/
+int
+cgroup_session_attach(int id, int pid)
+{
+    char text[32];
+
+    if ((g_cgroup_path[0] == 0) || (id == 0))
+    {
+        return 0;
+    }
+    g_snprintf(text, sizeof(text), "%d", pid);
+    if (cgroup_write(id, "cgroup.procs", text) != 0)
+    {
+        log_message(LOG_LEVEL_WARNING, "cannot move pid %d to the cgroup "
+                    "of session %d", pid, id);
+        return 1;
+    }
+    return 0;
+}
+
+/******************************************************************************/
+void
+cgroup_session_remove(int id)
+{
+    char path[512];
+
+    if ((g_cgroup_path[0] == 0) || (id == 0))
+    {
+        return;
+    }
+    /* cgroup.kill needs linux 5.14, without it processes the user left
+       running keep the cgroup */
+    cgroup_write(id, "cgroup.kill", "1");
+    cgroup_file_path(path, sizeof(path), id, "");
+    if (!g_remove_dir(path))
+    {
+        log_message(LOG_LEVEL_DEBUG, "cgroup %s not removed, still in use",
+                    path);
+    }
+}
+
+/******************************************************************************/
+int
+cgroup_session_usage(int id, tui64 *cpu_usec, tui64 *mem_bytes)
+{
+    char text[1024];
+    const char *line;
+
+    *cpu_usec = 0;
+    *mem_bytes = 0;
+    if ((g_cgroup_path[0] == 0) || (id == 0))
+    {
+        return 1;
+    }
+    if (cgroup_read(id, "cpu.stat", text, sizeof(text)) != 0)
+    {
+        return 1;
+    }
+    /* usage_usec is the first line but do not count on it */
+    line = text;
+    while (line != 0)
+    {
+        if (g_strncmp(line, "usage_usec ", 11) == 0)
+        {
+            *cpu_usec = cgroup_atou64(line + 11);
+            break;
+        }
+        line = g_strchr(line, '\n');
+        if (line != 0)
+        {
+            line++;
+        }
+    }
+    if (cgroup_read(id, "memory.current", text, sizeof(text)) == 0)
+    {
+        *mem_bytes = cgroup_atou64(text);
+    }
+    return 0;
+}
+
+/******************************************************************************/
+int
+cgroup_session_reclaim(int id, tui64 *before, tui64 *after)
+{
+    char text[64];
+
+    if ((g_cgroup_path[0] == 0) || (id == 0))
+    {
+        return 1;
+    }
+    if (cgroup_read(id, "memory.current", text, sizeof(text)) != 0)
+    {
+        return 1;
+    }
+    *before = cgroup_atou64(text);
+    /* memory.reclaim needs linux 5.19, it fails with EAGAIN when less than
+       asked for could be reclaimed which is the usual case */
+    g_snprintf(text, sizeof(text), "%llu", (unsigned long long) *before);
+    cgroup_write(id, "memory.reclaim", text);
+    *after = *before;
+    if (cgroup_read(id, "memory.current", text, sizeof(text)) == 0)
+    {
+        *after = cgroup_atou64(text);
+    }
+    return 0;
+}
@@ -0,0 +1,94 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Copyright (C) Jay Sorg 2004-2014
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ *
+ * @file cgroup.h
+ * @brief cgroup v2 per session resource limits and accounting
+ * @author Jay Sorg
+ *
+ */
+
+#ifndef CGROUP_H
+#define CGROUP_H
+
+#include "arch.h"
+
+/**
+ *
+ * @brief takes CgroupPath from the config and enables the controllers
+ *        below it, a CgroupPath changed on reload is not used
+ * @return 0 on success or when cgroups are not configured
+ *
+ */
+int
+cgroup_init(void);
+
+/**
+ *
+ * @brief creates the cgroup of a session and sets its limits, one that
+ *        is there already is only used when it is empty
+ * @param id session id, the other calls take it too, 0 for a session
+ *        without a cgroup makes them do nothing
+ * @return 0 on success
+ *
+ */
+int
+cgroup_session_create(int id);
+
+/**
+ *
+ * @brief moves a process to the cgroup of a session, its children
+ *        started afterwards stay there too
+ * @return 0 on success
+ *
+ */
+int
+cgroup_session_attach(int id, int pid);
+
+/**
+ *
+ * @brief kills whatever is left in the cgroup of a session and removes it
+ *
+ */
+void
+cgroup_session_remove(int id);
+
+/**
+ *
+ * @brief reads the cpu time and memory use of a session
+ * @param cpu_usec cpu time used by the session so far
+ * @param mem_bytes memory charged to the session now
+ * @return 0 on success
+ *
+ */
+int
+cgroup_session_usage(int id, tui64 *cpu_usec, tui64 *mem_bytes);
+
+/**
+ *
+ * @brief reclaims the memory of a session, this can take a while
+ * @param before memory charged to the session before
+ * @param after memory charged to the session after
+ * @return 0 on success
+ *
+ */
+int
+cgroup_session_reclaim(int id, tui64 *before, tui64 *after);
+
+#endif
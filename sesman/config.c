@@ -119,6 +119,7 @@ config_read_globals(int file, struct config_sesman *cf, struct list *param_n,
     cf->default_wm = 0;
     cf->auth_file_path = 0;
     cf->reconnect_sh = 0;
+    cf->mng_socket[0] = '\0';
 
     file_read_section(file, SESMAN_CFG_GLOBALS, param_n, param_v);
 
@@ -154,6 +155,10 @@ config_read_globals(int file, struct config_sesman *cf, struct list *param_n,
         {
             cf->reconnect_sh = g_strdup((char *)list_get_item(param_v, i));
         }
+        else if (g_strcasecmp(buf, SESMAN_CFG_MNG_SOCKET) == 0)
+        {
+            g_strncpy(cf->mng_socket, (char *)list_get_item(param_v, i), 255);
+        }
     }
 
     /* checking for missing required parameters */
@@ -233,6 +238,8 @@ config_read_security(int file, struct config_security *sc,
     /* setting defaults */
     sc->allow_root = 0;
     sc->login_retry = 3;
+    sc->auth_timeout = 30;
+    sc->max_auth = 16;
     sc->ts_users_enable = 0;
     sc->ts_admins_enable = 0;
 
@@ -273,6 +280,22 @@ config_read_security(int file, struct config_security *sc,
         {
             sc->ts_always_group_check = g_text2bool((char *)list_get_item(param_v, i));
         }
+
+        if (0 == g_strcasecmp(buf, SESMAN_CFG_SEC_AUTH_TIMEOUT))
+        {
+            sc->auth_timeout = g_atoi((char *)list_get_item(param_v, i));
+        }
+
+        if (0 == g_strcasecmp(buf, SESMAN_CFG_SEC_MAX_AUTH))
+        {
+            sc->max_auth = g_atoi((char *)list_get_item(param_v, i));
+        }
+    }
+
+    if (sc->max_auth < 1)
+    {
+        /* 0 would refuse every login */
+        sc->max_auth = 16;
     }
 
     return 0;
@@ -292,8 +315,14 @@ config_read_sessions(int file, struct config_sessions *se, struct list *param_n,
     /* setting defaults */
     se->x11_display_offset = 10;
     se->max_sessions = 0;
+    se->max_logins = 16;
+    se->cgroup[0] = '\0';
+    se->cpu_weight = 0;
+    se->memory_max[0] = '\0';
+    se->io_weight = 0;
     se->max_idle_time = 0;
     se->max_disc_time = 0;
+    se->hibernate_time = 0;
     se->kill_disconnected = 0;
     se->policy = SESMAN_CFG_SESS_POLICY_DFLT;
 
@@ -313,6 +342,31 @@ config_read_sessions(int file, struct config_sessions *se, struct list *param_n,
             se->max_sessions = g_atoi((char *)list_get_item(param_v, i));
         }
 
+        if (0 == g_strcasecmp(buf, SESMAN_CFG_SESS_MAX_LOGINS))
+        {
+            se->max_logins = g_atoi((char *)list_get_item(param_v, i));
+        }
+
+        if (0 == g_strcasecmp(buf, SESMAN_CFG_SESS_CGROUP))
+        {
+            g_strncpy(se->cgroup, (char *)list_get_item(param_v, i), 255);
+        }
+
+        if (0 == g_strcasecmp(buf, SESMAN_CFG_SESS_CPU_WEIGHT))
+        {
+            se->cpu_weight = g_atoi((char *)list_get_item(param_v, i));
+        }
+
+        if (0 == g_strcasecmp(buf, SESMAN_CFG_SESS_MEMORY_MAX))
+        {
+            g_strncpy(se->memory_max, (char *)list_get_item(param_v, i), 31);
+        }
+
+        if (0 == g_strcasecmp(buf, SESMAN_CFG_SESS_IO_WEIGHT))
+        {
+            se->io_weight = g_atoi((char *)list_get_item(param_v, i));
+        }
+
         if (0 == g_strcasecmp(buf, SESMAN_CFG_SESS_KILL_DISC))
         {
             se->kill_disconnected = g_text2bool((char *)list_get_item(param_v, i));
@@ -328,6 +382,11 @@ config_read_sessions(int file, struct config_sessions *se, struct list *param_n,
             se->max_disc_time = g_atoi((char *)list_get_item(param_v, i));
         }
 
+        if (0 == g_strcasecmp(buf, SESMAN_CFG_SESS_HIBERNATE))
+        {
+            se->hibernate_time = g_atoi((char *)list_get_item(param_v, i));
+        }
+
         if (0 == g_strcasecmp(buf, SESMAN_CFG_SESS_POLICY_S))
         {
             char *value = (char *)list_get_item(param_v, i);
@@ -480,16 +539,23 @@ config_dump(struct config_sesman *config)
     g_writeln("    UserWindowManager:        %s", config->user_wm);
     g_writeln("    DefaultWindowManager:     %s", config->default_wm);
     g_writeln("    ReconnectScript:          %s", config->reconnect_sh);
+    g_writeln("    ManagementSocket:         %s", config->mng_socket);
     g_writeln("    AuthFilePath:             %s",
              ((config->auth_file_path) ? (config->auth_file_path) : ("disabled")));
 
     /* Session configuration */
     g_writeln("Session configuration:");
     g_writeln("    MaxSessions:              %d", se->max_sessions);
+    g_writeln("    MaxConcurrentLogins:      %d", se->max_logins);
+    g_writeln("    CgroupPath:               %s", se->cgroup);
+    g_writeln("    CgroupCpuWeight:          %d", se->cpu_weight);
+    g_writeln("    CgroupMemoryMax:          %s", se->memory_max);
+    g_writeln("    CgroupIoWeight:           %d", se->io_weight);
     g_writeln("    X11DisplayOffset:         %d", se->x11_display_offset);
     g_writeln("    KillDisconnected:         %d", se->kill_disconnected);
     g_writeln("    IdleTimeLimit:            %d", se->max_idle_time);
     g_writeln("    DisconnectedTimeLimit:    %d", se->max_disc_time);
+    g_writeln("    HibernateTimeLimit:       %d", se->hibernate_time);
     g_writeln("    Policy:                   %d", se->policy);
 
     /* Security configuration */
@@ -497,6 +563,8 @@ config_dump(struct config_sesman *config)
     g_writeln("    AllowRootLogin:           %d", sc->allow_root);
     g_writeln("    MaxLoginRetry:            %d", sc->login_retry);
     g_writeln("    AlwaysGroupCheck:         %d", sc->ts_always_group_check);
+    g_writeln("    AuthTimeout:              %d", sc->auth_timeout);
+    g_writeln("    MaxConcurrentAuth:        %d", sc->max_auth);
 
     g_printf( "    TSUsersGroup:             ");
     if (sc->ts_users_enable)
@@ -40,6 +40,7 @@
 #define SESMAN_CFG_MAX_SESSION       "MaxSessions"
 #define SESMAN_CFG_AUTH_FILE_PATH    "AuthFilePath"
 #define SESMAN_CFG_RECONNECT_SH      "ReconnectScript"
+#define SESMAN_CFG_MNG_SOCKET        "ManagementSocket"
 
 #define SESMAN_CFG_RDP_PARAMS        "X11rdp"
 #define SESMAN_CFG_XORG_PARAMS       "Xorg"
@@ -60,13 +61,21 @@
 #define SESMAN_CFG_SEC_USR_GROUP     "TerminalServerUsers"
 #define SESMAN_CFG_SEC_ADM_GROUP     "TerminalServerAdmins"
 #define SESMAN_CFG_SEC_ALWAYSGROUPCHECK "AlwaysGroupCheck"
+#define SESMAN_CFG_SEC_AUTH_TIMEOUT  "AuthTimeout"
+#define SESMAN_CFG_SEC_MAX_AUTH      "MaxConcurrentAuth"
 
 #define SESMAN_CFG_SESSIONS          "Sessions"
 #define SESMAN_CFG_SESS_MAX          "MaxSessions"
 #define SESMAN_CFG_SESS_KILL_DISC    "KillDisconnected"
 #define SESMAN_CFG_SESS_IDLE_LIMIT   "IdleTimeLimit"
 #define SESMAN_CFG_SESS_DISC_LIMIT   "DisconnectedTimeLimit"
+#define SESMAN_CFG_SESS_HIBERNATE    "HibernateTimeLimit"
 #define SESMAN_CFG_SESS_X11DISPLAYOFFSET "X11DisplayOffset"
+#define SESMAN_CFG_SESS_MAX_LOGINS   "MaxConcurrentLogins"
+#define SESMAN_CFG_SESS_CGROUP       "CgroupPath"
+#define SESMAN_CFG_SESS_CPU_WEIGHT   "CgroupCpuWeight"
+#define SESMAN_CFG_SESS_MEMORY_MAX   "CgroupMemoryMax"
+#define SESMAN_CFG_SESS_IO_WEIGHT    "CgroupIoWeight"
 
 #define SESMAN_CFG_SESS_POLICY_S "Policy"
 #define SESMAN_CFG_SESS_POLICY_DFLT_S "Default"
@@ -126,6 +135,16 @@ struct config_security
    * @brief if the Groups are not found deny access
    */
   int ts_always_group_check;
+  /**
+   * @var auth_timeout
+   * @brief seconds a login waits for the authentication backend. 0 for ever
+   */
+  int auth_timeout;
+  /**
+   * @var max_auth
+   * @brief authentications running at the same time, timed out ones included
+   */
+  int max_auth;
 };
 
 /**
@@ -146,6 +165,31 @@ struct config_sessions
    * @brief maximum number of allowed sessions. 0 for unlimited
    */
   int max_sessions;
+  /**
+   * @var max_logins
+   * @brief number of logins handled at the same time. each one gets a thread
+   */
+  int max_logins;
+  /**
+   * @var cgroup
+   * @brief cgroup v2 directory the per session cgroups go in. empty for none
+   */
+  char cgroup[256];
+  /**
+   * @var cpu_weight
+   * @brief cpu.weight of each session, 1 to 10000. 0 leaves the default
+   */
+  int cpu_weight;
+  /**
+   * @var memory_max
+   * @brief memory.max of each session, bytes with an optional K, M or G
+   */
+  char memory_max[32];
+  /**
+   * @var io_weight
+   * @brief io.weight of each session, 1 to 10000. 0 leaves the default
+   */
+  int io_weight;
   /**
    * @var max_idle_time
    * @brief maximum idle time for each session
@@ -156,6 +200,11 @@ struct config_sessions
    * @brief maximum disconnected time for each session
    */
   int max_disc_time;
+  /**
+   * @var hibernate_time
+   * @brief seconds disconnected before the memory of a session is reclaimed
+   */
+  int hibernate_time;
   /**
    * @var kill_disconnected
    * @brief enables automatic killing of disconnected session
@@ -210,6 +259,11 @@ struct config_sesman
    * @brief Script executed when reconnected
    */
   char *reconnect_sh;
+  /**
+   * @var mng_socket
+   * @brief unix socket serving session snapshots and counters. empty for none
+   */
+  char mng_socket[256];
   /**
    * @var auth_file_path
    * @brief Auth file path
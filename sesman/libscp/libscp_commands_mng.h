@@ -34,5 +34,7 @@
 #define SCP_CMD_MNG_LIST_REQ     0x0005
 #define SCP_CMD_MNG_LIST         0x0006
 #define SCP_CMD_MNG_ACTION       0x0007
+#define SCP_CMD_MNG_USAGE_REQ    0x0008
+#define SCP_CMD_MNG_USAGE        0x0009
 
 #endif
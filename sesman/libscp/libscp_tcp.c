@@ -32,46 +32,61 @@
 
 extern struct log_config *s_log;
 
+/* a peer that sends or reads nothing for this long is dropped */
+#define SCP_TCP_TIMEOUT 60000
+
 /*****************************************************************************/
+/* the wait is done outside the fork critical section so a slow peer does
+   not hold up the session starts of the other scp threads */
 int
 scp_tcp_force_recv(int sck, char *data, int len)
 {
     int rcvd;
     int block;
+    int waited;
 
     LOG_DBG("scp_tcp_force_recv()");
-    block = scp_lock_fork_critical_section_start();
+    waited = 0;
 
     while (len > 0)
     {
+        if (!g_sck_can_recv(sck, 100))
+        {
+            waited += 100;
+
+            if (waited >= SCP_TCP_TIMEOUT)
+            {
+                log_message(LOG_LEVEL_WARNING, "[tcp:%d] recv timed out",
+                            __LINE__);
+                return 1;
+            }
+
+            continue;
+        }
+
+        block = scp_lock_fork_critical_section_start();
         rcvd = g_tcp_recv(sck, data, len, 0);
+        scp_lock_fork_critical_section_end(block);
 
         if (rcvd == -1)
         {
-            if (g_tcp_last_error_would_block(sck))
+            if (!g_tcp_last_error_would_block(sck))
             {
-                g_sleep(1);
-            }
-            else
-            {
-                scp_lock_fork_critical_section_end(block);
                 return 1;
             }
         }
         else if (rcvd == 0)
         {
-            scp_lock_fork_critical_section_end(block);
             return 1;
         }
         else
         {
             data += rcvd;
             len -= rcvd;
+            waited = 0;
         }
     }
 
-    scp_lock_fork_critical_section_end(block);
-
     return 0;
 }
 
@@ -81,40 +96,50 @@ scp_tcp_force_send(int sck, char *data, int len)
 {
     int sent;
     int block;
+    int waited;
 
     LOG_DBG("scp_tcp_force_send()");
-    block = scp_lock_fork_critical_section_start();
+    waited = 0;
 
     while (len > 0)
     {
+        if (!g_sck_can_send(sck, 100))
+        {
+            waited += 100;
+
+            if (waited >= SCP_TCP_TIMEOUT)
+            {
+                log_message(LOG_LEVEL_WARNING, "[tcp:%d] send timed out",
+                            __LINE__);
+                return 1;
+            }
+
+            continue;
+        }
+
+        block = scp_lock_fork_critical_section_start();
         sent = g_tcp_send(sck, data, len, 0);
+        scp_lock_fork_critical_section_end(block);
 
         if (sent == -1)
         {
-            if (g_tcp_last_error_would_block(sck))
+            if (!g_tcp_last_error_would_block(sck))
             {
-                g_sleep(1);
-            }
-            else
-            {
-                scp_lock_fork_critical_section_end(block);
                 return 1;
             }
         }
         else if (sent == 0)
         {
-            scp_lock_fork_critical_section_end(block);
             return 1;
         }
         else
         {
             data += sent;
             len -= sent;
+            waited = 0;
         }
     }
 
-    scp_lock_fork_critical_section_end(block);
-
     return 0;
 }
 
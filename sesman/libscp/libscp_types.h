@@ -112,6 +112,14 @@ struct SCP_DISCONNECTED_SESSION
   tui8  ipv6addr[16];
 };
 
+/* resources used by a session, from its cgroup */
+struct SCP_SESSION_USAGE
+{
+  tui32 SID;
+  tui64 cpu_usec;
+  tui64 mem_bytes;
+};
+
 enum SCP_CLIENT_STATES_E
 {
   SCP_CLIENT_STATE_OK,
@@ -122,6 +130,7 @@ enum SCP_CLIENT_STATES_E
   SCP_CLIENT_STATE_INTERNAL_ERR,
   SCP_CLIENT_STATE_SESSION_LIST,
   SCP_CLIENT_STATE_LIST_OK,
+  SCP_CLIENT_STATE_USAGE_OK,
   SCP_CLIENT_STATE_RESEND_CREDENTIALS,
   SCP_CLIENT_STATE_CONNECTION_DENIED,
   SCP_CLIENT_STATE_PWD_CHANGE_REQ,
@@ -144,6 +153,7 @@ enum SCP_SERVER_STATES_E
   SCP_SERVER_STATE_START_MANAGE,
   SCP_SERVER_STATE_MNG_LISTREQ,
   SCP_SERVER_STATE_MNG_ACTION,
+  SCP_SERVER_STATE_MNG_USAGEREQ,
   SCP_SERVER_STATE_END
 };
 
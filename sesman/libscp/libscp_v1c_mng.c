@@ -266,6 +266,148 @@ scp_v1c_mng_get_session_list(struct SCP_CONNECTION *c, int *scount,
     return SCP_CLIENT_STATE_LIST_OK;
 }
 
+/* 008 */
+enum SCP_CLIENT_STATES_E
+scp_v1c_mng_get_session_usage(struct SCP_CONNECTION *c, int *scount,
+                              struct SCP_SESSION_USAGE **u)
+{
+    tui32 version = 1;
+    tui32 size = 12;
+    tui16 cmd = SCP_CMD_MNG_USAGE_REQ;
+    tui32 sescnt = 0;    /* total session number */
+    tui8 pktcnt = 0;     /* packet session count */
+    tui32 totalcnt = 0;  /* session counter */
+    tui8 continued = 0;  /* continue flag */
+    int firstpkt = 1;    /* "first packet" flag */
+    int idx;
+    tui32 hi;
+    tui32 lo;
+    struct SCP_SESSION_USAGE *us = 0;
+
+    init_stream(c->out_s, c->out_s->size);
+
+    out_uint32_be(c->out_s, version);                 /* version */
+    out_uint32_be(c->out_s, size);                    /* size    */
+    out_uint16_be(c->out_s, SCP_COMMAND_SET_MANAGE); /* cmdset  */
+    out_uint16_be(c->out_s, cmd);                     /* cmd     */
+
+    if (0 != scp_tcp_force_send(c->in_sck, c->out_s->data, size))
+    {
+        log_message(LOG_LEVEL_WARNING, "[v1c_mng:%d] connection aborted: network error", __LINE__);
+        return SCP_CLIENT_STATE_NETWORK_ERR;
+    }
+
+    do
+    {
+        init_stream(c->in_s, c->in_s->size);
+
+        if (0 != scp_tcp_force_recv(c->in_sck, c->in_s->data, 8))
+        {
+            log_message(LOG_LEVEL_WARNING, "[v1c_mng:%d] connection aborted: network error", __LINE__);
+            g_free(us);
+            return SCP_CLIENT_STATE_NETWORK_ERR;
+        }
+
+        in_uint32_be(c->in_s, version);
+
+        if (version != 1)
+        {
+            log_message(LOG_LEVEL_WARNING, "[v1c_mng:%d] connection aborted: version error", __LINE__);
+            g_free(us);
+            return SCP_CLIENT_STATE_VERSION_ERR;
+        }
+
+        in_uint32_be(c->in_s, size);
+
+        if ((size < 12) || (size > (tui32) c->in_s->size))
+        {
+            log_message(LOG_LEVEL_WARNING, "[v1c_mng:%d] connection aborted: size error", __LINE__);
+            g_free(us);
+            return SCP_CLIENT_STATE_SIZE_ERR;
+        }
+
+        init_stream(c->in_s, c->in_s->size);
+
+        if (0 != scp_tcp_force_recv(c->in_sck, c->in_s->data, size - 8))
+        {
+            log_message(LOG_LEVEL_WARNING, "[v1c_mng:%d] connection aborted: network error", __LINE__);
+            g_free(us);
+            return SCP_CLIENT_STATE_NETWORK_ERR;
+        }
+
+        in_uint16_be(c->in_s, cmd);
+
+        if (cmd != SCP_COMMAND_SET_MANAGE)
+        {
+            log_message(LOG_LEVEL_WARNING, "[v1c_mng:%d] connection aborted: sequence error", __LINE__);
+            g_free(us);
+            return SCP_CLIENT_STATE_SEQUENCE_ERR;
+        }
+
+        in_uint16_be(c->in_s, cmd);
+
+        if (cmd != SCP_CMD_MNG_USAGE)
+        {
+            log_message(LOG_LEVEL_WARNING, "[v1c_mng:%d] connection aborted: sequence error", __LINE__);
+            g_free(us);
+            return SCP_CLIENT_STATE_SEQUENCE_ERR;
+        }
+
+        if (firstpkt)
+        {
+            firstpkt = 0;
+            in_uint32_be(c->in_s, sescnt);
+
+            if (0 == sescnt)
+            {
+                (*scount) = 0;
+                (*u) = NULL;
+                return SCP_CLIENT_STATE_USAGE_OK;
+            }
+
+            us = g_new(struct SCP_SESSION_USAGE, sescnt);
+
+            if (us == 0)
+            {
+                log_message(LOG_LEVEL_WARNING, "[v1c_mng:%d] connection aborted: internal error", __LINE__);
+                return SCP_CLIENT_STATE_INTERNAL_ERR;
+            }
+        }
+        else
+        {
+            in_uint8s(c->in_s, 4);
+        }
+
+        in_uint8(c->in_s, continued);
+        in_uint8(c->in_s, pktcnt);
+
+        if (totalcnt + pktcnt > sescnt)
+        {
+            log_message(LOG_LEVEL_WARNING, "[v1c_mng:%d] connection aborted: size error", __LINE__);
+            g_free(us);
+            return SCP_CLIENT_STATE_SIZE_ERR;
+        }
+
+        for (idx = 0; idx < pktcnt; idx++)
+        {
+            in_uint32_be(c->in_s, (us[totalcnt]).SID);
+            in_uint32_be(c->in_s, hi);
+            in_uint32_be(c->in_s, lo);
+            (us[totalcnt]).cpu_usec = ((tui64) hi << 32) | lo;
+            in_uint32_be(c->in_s, hi);
+            in_uint32_be(c->in_s, lo);
+            (us[totalcnt]).mem_bytes = ((tui64) hi << 32) | lo;
+            totalcnt++;
+        }
+    }
+    while (continued);
+
+    (*scount) = totalcnt;
+    (*u) = us;
+
+    return SCP_CLIENT_STATE_USAGE_OK;
+}
+
 /* 043 * /
 enum SCP_CLIENT_STATES_E
 scp_v1c_select_session(struct SCP_CONNECTION* c, struct SCP_SESSION* s,
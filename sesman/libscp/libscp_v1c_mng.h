@@ -52,4 +52,9 @@ enum SCP_CLIENT_STATES_E
 scp_v1c_mng_get_session_list(struct SCP_CONNECTION* c, int* scount,
                          struct SCP_DISCONNECTED_SESSION** s);
 
+/* 008 */
+enum SCP_CLIENT_STATES_E
+scp_v1c_mng_get_session_usage(struct SCP_CONNECTION* c, int* scount,
+                              struct SCP_SESSION_USAGE** u);
+
 #endif
@@ -285,6 +285,79 @@ scp_v1s_mng_list_sessions(struct SCP_CONNECTION *c, struct SCP_SESSION *s,
     return _scp_v1s_mng_check_response(c, s);
 }
 
+/* 009 */
+enum SCP_SERVER_STATES_E
+scp_v1s_mng_session_usage(struct SCP_CONNECTION *c, struct SCP_SESSION *s,
+                          int sescnt, struct SCP_SESSION_USAGE *us)
+{
+    tui32 version = 1;
+    tui32 size;
+    int pktcnt;
+    int idx;
+    int sidx;
+    int pidx;
+    struct SCP_SESSION_USAGE *cus;
+
+    /* same paging as the session list */
+    pktcnt = (sescnt + SCP_SERVER_MAX_LIST_SIZE - 1) / SCP_SERVER_MAX_LIST_SIZE;
+
+    if (pktcnt == 0)
+    {
+        pktcnt = 1;
+    }
+
+    for (idx = 0; idx < pktcnt; idx++)
+    {
+        init_stream(c->out_s, c->out_s->size);
+
+        /* size: ver+size+cmdset+cmd+sescnt+continue+count */
+        size = 4 + 4 + 2 + 2 + 4 + 1 + 1;
+
+        s_push_layer(c->out_s, channel_hdr, 8);
+        out_uint16_be(c->out_s, SCP_COMMAND_SET_MANAGE);
+        out_uint16_be(c->out_s, SCP_CMD_MNG_USAGE);
+        out_uint32_be(c->out_s, sescnt);
+
+        if ((idx + 1) * SCP_SERVER_MAX_LIST_SIZE >= sescnt)
+        {
+            out_uint8(c->out_s, 0);
+            pidx = sescnt - (idx * SCP_SERVER_MAX_LIST_SIZE);
+        }
+        else
+        {
+            out_uint8(c->out_s, 1);
+            pidx = SCP_SERVER_MAX_LIST_SIZE;
+        }
+
+        out_uint8(c->out_s, pidx);
+
+        for (sidx = 0; sidx < pidx; sidx++)
+        {
+            cus = us + (idx * SCP_SERVER_MAX_LIST_SIZE) + sidx;
+
+            /* 64 bit values go high word first */
+            out_uint32_be(c->out_s, cus->SID);
+            out_uint32_be(c->out_s, (tui32) (cus->cpu_usec >> 32));
+            out_uint32_be(c->out_s, (tui32) cus->cpu_usec);
+            out_uint32_be(c->out_s, (tui32) (cus->mem_bytes >> 32));
+            out_uint32_be(c->out_s, (tui32) cus->mem_bytes);
+            size += 20;
+        }
+
+        s_pop_layer(c->out_s, channel_hdr);
+        out_uint32_be(c->out_s, version);
+        out_uint32_be(c->out_s, size);
+
+        if (0 != scp_tcp_force_send(c->in_sck, c->out_s->data, size))
+        {
+            log_message(LOG_LEVEL_WARNING, "[v1s_mng:%d] connection aborted: network error", __LINE__);
+            return SCP_SERVER_STATE_NETWORK_ERR;
+        }
+    }
+
+    return _scp_v1s_mng_check_response(c, s);
+}
+
 static enum SCP_SERVER_STATES_E
 _scp_v1s_mng_check_response(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
 {
@@ -336,6 +409,11 @@ _scp_v1s_mng_check_response(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
         log_message(LOG_LEVEL_INFO, "[v1s_mng:%d] request session list", __LINE__);
         return SCP_SERVER_STATE_MNG_LISTREQ;
     }
+    else if (cmd == SCP_CMD_MNG_USAGE_REQ) /* request session usage */
+    {
+        log_message(LOG_LEVEL_INFO, "[v1s_mng:%d] request session usage", __LINE__);
+        return SCP_SERVER_STATE_MNG_USAGEREQ;
+    }
     else if (cmd == SCP_CMD_MNG_ACTION) /* execute an action */
     {
         /*in_uint8(c->in_s, dim);
@@ -75,4 +75,15 @@ scp_v1s_mng_list_sessions(struct SCP_CONNECTION* c, struct SCP_SESSION* s,
                           int sescnt, struct SCP_DISCONNECTED_SESSION* ds);
 //                           SCP_SID* sid);
 
+/**
+ *
+ * @brief sends the cpu and memory use of the sessions
+ * @param c connection descriptor
+ *
+ */
+/* 009 */
+enum SCP_SERVER_STATES_E
+scp_v1s_mng_session_usage(struct SCP_CONNECTION* c, struct SCP_SESSION* s,
+                          int sescnt, struct SCP_SESSION_USAGE* us);
+
 #endif
@@ -0,0 +1,112 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Copyright (C) Jay Sorg 2004-2014
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ *
+ * @file lock.c
+ * @brief Locks used by the scp threads and the main thread
+ * @author Jay Sorg
+ *
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include <config_ac.h>
+#endif
+
+#include "sesman.h"
+
+static tbus g_lock_chain = 0;
+static tbus g_lock_socket = 0;
+static tbus g_sync_mutex = 0;
+static tbus g_sync_sem = 0;
+
+/******************************************************************************/
+void
+lock_init(void)
+{
+    g_lock_chain = tc_mutex_create();
+    g_lock_socket = tc_mutex_create();
+    g_sync_mutex = tc_mutex_create();
+    g_sync_sem = tc_sem_create(0);
+}
+
+/******************************************************************************/
+void
+lock_deinit(void)
+{
+    tc_mutex_delete(g_lock_chain);
+    tc_mutex_delete(g_lock_socket);
+    tc_mutex_delete(g_sync_mutex);
+    tc_sem_delete(g_sync_sem);
+}
+
+/******************************************************************************/
+void
+lock_chain_acquire(void)
+{
+    tc_mutex_lock(g_lock_chain);
+}
+
+/******************************************************************************/
+void
+lock_chain_release(void)
+{
+    tc_mutex_unlock(g_lock_chain);
+}
+
+/******************************************************************************/
+void
+lock_socket_acquire(void)
+{
+    tc_mutex_lock(g_lock_socket);
+}
+
+/******************************************************************************/
+void
+lock_socket_release(void)
+{
+    tc_mutex_unlock(g_lock_socket);
+}
+
+/******************************************************************************/
+void
+lock_sync_acquire(void)
+{
+    tc_mutex_lock(g_sync_mutex);
+}
+
+/******************************************************************************/
+void
+lock_sync_release(void)
+{
+    tc_mutex_unlock(g_sync_mutex);
+}
+
+/******************************************************************************/
+void
+lock_sync_sem_acquire(void)
+{
+    tc_sem_dec(g_sync_sem);
+}
+
+/******************************************************************************/
+void
+lock_sync_sem_release(void)
+{
+    tc_sem_inc(g_sync_sem);
+}
@@ -0,0 +1,111 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Copyright (C) Jay Sorg 2004-2014
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ *
+ * @file lock.h
+ * @brief Locks used by the scp threads and the main thread
+ * @author Jay Sorg
+ *
+ */
+
+#ifndef LOCK_H
+#define LOCK_H
+
+/**
+ *
+ * @brief initializes all the locks
+ *
+ */
+void
+lock_init(void);
+
+/**
+ *
+ * @brief cleanup all the locks
+ *
+ */
+void
+lock_deinit(void);
+
+/**
+ *
+ * @brief acquires the lock on the session list
+ *
+ */
+void
+lock_chain_acquire(void);
+
+/**
+ *
+ * @brief releases the session list lock
+ *
+ */
+void
+lock_chain_release(void);
+
+/**
+ *
+ * @brief acquires the lock on the login socket list
+ *
+ */
+void
+lock_socket_acquire(void);
+
+/**
+ *
+ * @brief releases the login socket list lock
+ *
+ */
+void
+lock_socket_release(void);
+
+/**
+ *
+ * @brief acquires the lock on the session start request, only one
+ *        scp thread at a time hands a request to the main thread
+ *
+ */
+void
+lock_sync_acquire(void);
+
+/**
+ *
+ * @brief releases the session start request lock
+ *
+ */
+void
+lock_sync_release(void);
+
+/**
+ *
+ * @brief waits for the main thread to finish a session start request
+ *
+ */
+void
+lock_sync_sem_acquire(void);
+
+/**
+ *
+ * @brief tells the scp thread its session start request is done
+ *
+ */
+void
+lock_sync_sem_release(void);
+
+#endif
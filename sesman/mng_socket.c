@@ -0,0 +1,518 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Copyright (C) Jay Sorg 2004-2014
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ *
+ * @file mng_socket.c
+ * @brief local management socket, session snapshots and logon counters
+ * @author Jay Sorg
+ *
+ * Every connection to ManagementSocket gets one line of JSON and is closed,
+ * so a monitoring agent needs nothing more than a unix socket client. The
+ * answer is built and sent on a short lived thread.
+ *
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include <config_ac.h>
+#endif
+
+#include "sesman.h"
+
+extern struct config_sesman *g_cfg; /* in sesman.c */
+
+/* connections answered at the same time, more are closed right away */
+#define MNG_SOCKET_MAX_CLIENTS 4
+
+/* logon latency histogram bounds in ms, one more bucket above the last */
+static const int g_bounds[] =
+{
+    100, 250, 500, 1000, 2500, 5000, 10000, 30000
+};
+#define MNG_SOCKET_BUCKETS ((int) (sizeof(g_bounds) / sizeof(g_bounds[0])))
+
+struct mng_counters
+{
+    int logons[3]; /* by MNG_LOGON_* */
+    int buckets[MNG_SOCKET_BUCKETS + 1];
+    tui64 sum_ms;
+};
+
+/* snapshot text being built */
+struct mng_text
+{
+    char *data;
+    int size;
+    int used;
+};
+
+static char g_path[256] = "";
+static int g_sck = -1;
+static tbus g_sck_obj = 0;
+static struct list *g_client_scks = 0; /* guarded by lock_socket_acquire */
+static tbus g_counters_mutex = 0;
+static struct mng_counters g_counters;
+
+/******************************************************************************/
+/* returns error */
+static int
+mng_text_add(struct mng_text *text, const char *str)
+{
+    char *data;
+    int len;
+    int size;
+
+    len = g_strlen(str);
+
+    if (text->used + len + 1 > text->size)
+    {
+        size = text->size * 2;
+
+        if (size < text->used + len + 1)
+        {
+            size = text->used + len + 1;
+        }
+
+        data = (char *) g_malloc(size, 0);
+
+        if (data == 0)
+        {
+            return 1;
+        }
+
+        g_memcpy(data, text->data, text->used);
+        g_free(text->data);
+        text->data = data;
+        text->size = size;
+    }
+
+    g_memcpy(text->data + text->used, str, len + 1);
+    text->used += len;
+    return 0;
+}
+
+/******************************************************************************/
+/* copies str into out as the inside of a JSON string, out must hold
+   6 times str */
+static void
+mng_json_escape(const char *str, char *out)
+{
+    const char *hex = "0123456789abcdef";
+    unsigned char c;
+
+    while (*str != 0)
+    {
+        c = (unsigned char) *str;
+
+        if ((c == '"') || (c == '\\'))
+        {
+            *(out++) = '\\';
+            *(out++) = c;
+        }
+        else if (c < 0x20)
+        {
+            *(out++) = '\\';
+            *(out++) = 'u';
+            *(out++) = '0';
+            *(out++) = '0';
+            *(out++) = hex[c >> 4];
+            *(out++) = hex[c & 15];
+        }
+        else
+        {
+            *(out++) = c;
+        }
+
+        str++;
+    }
+
+    *out = 0;
+}
+
+/******************************************************************************/
+/* the X server writes its pid to its lock file, read it from there so
+   sessions that started their own server have it too */
+static int
+mng_xserver_pid(int display)
+{
+    char text[64];
+    int fd;
+    int len;
+
+    g_snprintf(text, sizeof(text), "/tmp/.X%d-lock", display);
+    fd = g_file_open_ex(text, 1, 0, 0, 0);
+
+    if (fd < 0)
+    {
+        return 0;
+    }
+
+    len = g_file_read(fd, text, sizeof(text) - 1);
+    g_file_close(fd);
+
+    if (len <= 0)
+    {
+        return 0;
+    }
+
+    text[len] = 0;
+    return g_atoi(text);
+}
+
+/******************************************************************************/
+static const char *
+mng_state_name(int state)
+{
+    switch (state)
+    {
+        case SESMAN_SESSION_STATE_STARTING:
+            return "starting";
+        case SESMAN_SESSION_STATE_RUNNING:
+            return "running";
+        case SESMAN_SESSION_STATE_DISCONNECTED:
+            return "disconnected";
+        case SESMAN_SESSION_STATE_TERMINATING:
+            return "terminating";
+    }
+
+    return "unknown";
+}
+
+/******************************************************************************/
+static const char *
+mng_type_name(int type)
+{
+    switch (type)
+    {
+        case SESMAN_SESSION_TYPE_XRDP:
+            return "x11rdp";
+        case SESMAN_SESSION_TYPE_XVNC:
+            return "xvnc";
+        case SESMAN_SESSION_TYPE_XORG:
+            return "xorg";
+    }
+
+    return "unknown";
+}
+
+/******************************************************************************/
+/* returns error */
+static int
+mng_add_session(struct mng_text *text, const struct session_item *item,
+                int now, int first)
+{
+    char line[4096];
+    char name[256 * 6];
+    char ip[256 * 6];
+    char latency[32];
+    char usage[128];
+    tui64 cpu_usec;
+    tui64 mem_bytes;
+
+    mng_json_escape(item->name, name);
+    mng_json_escape(item->client_ip, ip);
+
+    if (item->start_latency < 0)
+    {
+        g_strcpy(latency, "null");
+    }
+    else
+    {
+        g_snprintf(latency, sizeof(latency), "%d", item->start_latency);
+    }
+
+    if (cgroup_session_usage(item->id, &cpu_usec, &mem_bytes) == 0)
+    {
+        g_snprintf(usage, sizeof(usage),
+                   "\"cpu_usec\":%llu,\"mem_bytes\":%llu",
+                   (unsigned long long) cpu_usec,
+                   (unsigned long long) mem_bytes);
+    }
+    else
+    {
+        g_strcpy(usage, "\"cpu_usec\":null,\"mem_bytes\":null");
+    }
+
+    g_snprintf(line, sizeof(line),
+               "%s{\"id\":%d,\"pid\":%d,\"user\":\"%s\",\"display\":%d,"
+               "\"type\":\"%s\",\"state\":\"%s\",\"state_secs\":%d,"
+               "\"hibernated\":%s,"
+               "\"client_ip\":\"%s\",\"width\":%d,\"height\":%d,\"bpp\":%d,"
+               "\"xserver_pid\":%d,\"start_ms\":%s,%s}",
+               first ? "" : ",", item->id, item->pid, name, item->display,
+               mng_type_name(item->type), mng_state_name(item->state),
+               now - item->state_time, item->hibernated ? "true" : "false",
+               ip, item->width, item->height, item->bpp,
+               mng_xserver_pid(item->display), latency, usage);
+    return mng_text_add(text, line);
+}
+
+/******************************************************************************/
+/* returns error */
+static int
+mng_add_counters(struct mng_text *text)
+{
+    struct mng_counters counters;
+    struct auth_pool_stats auth;
+    char line[1024];
+    char *p;
+    char *end;
+    int index;
+    int count;
+
+    tc_mutex_lock(g_counters_mutex);
+    g_memcpy(&counters, &g_counters, sizeof(counters));
+    tc_mutex_unlock(g_counters_mutex);
+    auth_pool_get_stats(&auth);
+
+    /* cumulative like a prometheus histogram, the last count is all */
+    p = line;
+    end = line + sizeof(line);
+    p += g_snprintf(p, end - p, "],\"logons\":{\"new\":%d,\"reconnect\":%d,"
+                    "\"failed\":%d,", counters.logons[MNG_LOGON_NEW],
+                    counters.logons[MNG_LOGON_RECONNECT],
+                    counters.logons[MNG_LOGON_FAILED]);
+    p += g_snprintf(p, end - p, "\"latency_ms\":{\"le\":[");
+
+    for (index = 0; index < MNG_SOCKET_BUCKETS; index++)
+    {
+        p += g_snprintf(p, end - p, "%s%d", index ? "," : "", g_bounds[index]);
+    }
+
+    p += g_snprintf(p, end - p, "],\"buckets\":[");
+    count = 0;
+
+    for (index = 0; index <= MNG_SOCKET_BUCKETS; index++)
+    {
+        count += counters.buckets[index];
+        p += g_snprintf(p, end - p, "%s%d", index ? "," : "", count);
+    }
+
+    g_snprintf(p, end - p, "],\"sum\":%llu}},\"auth\":{\"requests\":%d,"
+               "\"failures\":%d,\"timeouts\":%d,\"rejected\":%d,"
+               "\"active\":%d,\"last_ms\":%d,\"max_ms\":%d,\"avg_ms\":%d}}\n",
+               (unsigned long long) counters.sum_ms, auth.requests,
+               auth.failures, auth.timeouts, auth.rejected, auth.active,
+               auth.last_ms, auth.max_ms, auth.avg_ms);
+    return mng_text_add(text, line);
+}
+
+/******************************************************************************/
+/* returns error */
+static int
+mng_snapshot(struct mng_text *text)
+{
+    struct session_item *items;
+    char line[64];
+    int count;
+    int index;
+    int now;
+    int rv;
+
+    text->size = 4096;
+    text->used = 0;
+    text->data = (char *) g_malloc(text->size, 0);
+
+    if (text->data == 0)
+    {
+        return 1;
+    }
+
+    now = g_time1();
+    g_snprintf(line, sizeof(line), "{\"time\":%d,\"sessions\":[", now);
+    rv = mng_text_add(text, line);
+    /* a copy, the cgroup and lock files are read without the chain lock */
+    items = session_get_all(&count);
+
+    for (index = 0; (index < count) && (rv == 0); index++)
+    {
+        rv = mng_add_session(text, items + index, now, index == 0);
+    }
+
+    g_free(items);
+
+    if (rv == 0)
+    {
+        rv = mng_add_counters(text);
+    }
+
+    return rv;
+}
+
+/******************************************************************************/
+static void
+mng_client_done(int sck)
+{
+    int index;
+
+    lock_socket_acquire();
+    index = list_index_of(g_client_scks, sck);
+
+    if (index >= 0)
+    {
+        list_remove_item(g_client_scks, index);
+    }
+
+    g_sck_close(sck);
+    lock_socket_release();
+}
+
+/******************************************************************************/
+static THREAD_RV THREAD_CC
+mng_client_thread(void *arg)
+{
+    struct mng_text text;
+    int sck;
+
+    sck = (int) (tintptr) arg;
+    sig_sesman_thread_block();
+    g_memset(&text, 0, sizeof(text));
+
+    if (mng_snapshot(&text) == 0)
+    {
+        scp_tcp_force_send(sck, text.data, text.used);
+    }
+    else
+    {
+        log_message(LOG_LEVEL_ERROR, "out of memory building the "
+                    "management snapshot");
+    }
+
+    g_free(text.data);
+    mng_client_done(sck);
+    return 0;
+}
+
+/******************************************************************************/
+tbus
+mng_socket_init(void)
+{
+    g_counters_mutex = tc_mutex_create();
+    g_memset(&g_counters, 0, sizeof(g_counters));
+    g_client_scks = list_create();
+
+    if (g_cfg->mng_socket[0] == 0)
+    {
+        return 0;
+    }
+
+    g_strncpy(g_path, g_cfg->mng_socket, 255);
+    g_sck = g_sck_local_socket();
+
+    if (g_sck < 0)
+    {
+        log_message(LOG_LEVEL_ERROR, "cannot create the management socket");
+        return 0;
+    }
+
+    /* left over by a sesman that did not exit cleanly */
+    g_file_delete(g_path);
+
+    if ((g_sck_local_bind(g_sck, g_path) != 0) || (g_sck_listen(g_sck) != 0))
+    {
+        log_message(LOG_LEVEL_ERROR, "cannot listen on %s: %s", g_path,
+                    g_get_strerror());
+        g_sck_close(g_sck);
+        g_sck = -1;
+        return 0;
+    }
+
+    g_chmod_hex(g_path, 0x660);
+    g_sck_set_non_blocking(g_sck);
+    g_sck_obj = g_create_wait_obj_from_socket(g_sck, 0);
+    log_message(LOG_LEVEL_INFO, "management socket %s", g_path);
+    return g_sck_obj;
+}
+
+/******************************************************************************/
+void
+mng_socket_deinit(void)
+{
+    if (g_sck >= 0)
+    {
+        g_delete_wait_obj_from_socket(g_sck_obj);
+        g_sck_close(g_sck);
+        g_sck = -1;
+        g_file_delete(g_path);
+    }
+}
+
+/******************************************************************************/
+void
+mng_socket_accept(void)
+{
+    int sck;
+
+    sck = g_tcp_accept(g_sck);
+
+    if (sck < 0)
+    {
+        return;
+    }
+
+    lock_socket_acquire();
+
+    if (g_client_scks->count >= MNG_SOCKET_MAX_CLIENTS)
+    {
+        g_sck_close(sck);
+        lock_socket_release();
+        return;
+    }
+
+    list_add_item(g_client_scks, sck);
+    lock_socket_release();
+    g_sck_set_non_blocking(sck);
+
+    if (tc_thread_create(mng_client_thread, (void *) (tintptr) sck) != 0)
+    {
+        log_message(LOG_LEVEL_ERROR, "error creating management thread");
+        mng_client_done(sck);
+    }
+}
+
+/******************************************************************************/
+void
+mng_socket_logon(int result, int ms)
+{
+    int index;
+
+    if ((result < 0) || (result > MNG_LOGON_FAILED))
+    {
+        return;
+    }
+
+    for (index = 0; index < MNG_SOCKET_BUCKETS; index++)
+    {
+        if (ms <= g_bounds[index])
+        {
+            break;
+        }
+    }
+
+    tc_mutex_lock(g_counters_mutex);
+    g_counters.logons[result]++;
+
+    /* only logons that got a session count for latency */
+    if (result != MNG_LOGON_FAILED)
+    {
+        g_counters.buckets[index]++;
+        g_counters.sum_ms += ms;
+    }
+
+    tc_mutex_unlock(g_counters_mutex);
+}
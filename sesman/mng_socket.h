@@ -0,0 +1,74 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Copyright (C) Jay Sorg 2004-2014
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ *
+ * @file mng_socket.h
+ * @brief local management socket, session snapshots and logon counters
+ * @author Jay Sorg
+ *
+ */
+
+#ifndef MNG_SOCKET_H
+#define MNG_SOCKET_H
+
+#include "arch.h"
+
+/* outcome of a logon, see mng_socket_logon */
+#define MNG_LOGON_NEW       0
+#define MNG_LOGON_RECONNECT 1
+#define MNG_LOGON_FAILED    2
+
+/**
+ *
+ * @brief opens ManagementSocket, called on the main thread before any
+ *        thread is started
+ * @return wait object for the main loop, 0 when there is no socket
+ *
+ */
+tbus
+mng_socket_init(void);
+
+/**
+ *
+ * @brief closes the socket and removes it
+ *
+ */
+void
+mng_socket_deinit(void);
+
+/**
+ *
+ * @brief accepts a connection and answers it on a thread of its own,
+ *        called by the main loop when the wait object is set
+ *
+ */
+void
+mng_socket_accept(void);
+
+/**
+ *
+ * @brief counts a logon
+ * @param result one of MNG_LOGON_*
+ * @param ms from the scp request till the reply
+ *
+ */
+void
+mng_socket_logon(int result, int ms);
+
+#endif
@@ -40,9 +40,11 @@ scp_v0_process(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
     tbus data;
     struct session_item *s_item;
     int errorcode = 0;
-    bool_t do_auth_end = 1;
+    int start_ms;
+    int logon = MNG_LOGON_NEW;
 
-    data = auth_userpass(s->username, s->password, &errorcode);
+    start_ms = g_time3();
+    data = auth_pool_userpass(s->username, s->password, &errorcode);
 
     if (s->type == SCP_GW_AUTHENTICATION)
     {
@@ -96,7 +98,9 @@ scp_v0_process(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
                             s_item->pid);
             }
 
+            g_free(s_item);
             session_reconnect(display, s->username, data);
+            logon = MNG_LOGON_RECONNECT;
         }
         else
         {
@@ -136,9 +140,6 @@ scp_v0_process(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
                     log_message(LOG_LEVEL_INFO, "starting Xorg session...");
                     display = session_start(data, SESMAN_SESSION_TYPE_XORG, c, s);
                 }
-                /* if the session started up ok, auth_end will be called on
-                   sig child */
-                do_auth_end = display == 0;
             }
             else
             {
@@ -149,18 +150,19 @@ scp_v0_process(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
         if (display == 0)
         {
             scp_v0s_deny_connection(c);
+            logon = MNG_LOGON_FAILED;
         }
         else
         {
             scp_v0s_allow_connection(c, display, s->guid);
         }
+        mng_socket_logon(logon, g_time3() - start_ms);
     }
     else
     {
         scp_v0s_deny_connection(c);
+        mng_socket_logon(MNG_LOGON_FAILED, g_time3() - start_ms);
     }
-    if (do_auth_end)
-    {
-        auth_end(data);
-    }
+    /* a started session kept the login process, this only closes it */
+    auth_pool_end(data);
 }
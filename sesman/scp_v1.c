@@ -50,12 +50,13 @@ scp_v1_process(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
     struct session_item *sitem;
     int scount;
     SCP_SID sid;
-    bool_t do_auth_end = 1;
+    int start_ms;
 
+    start_ms = g_time3();
     retries = g_cfg->sec.login_retry;
     current_try = retries;
 
-    data = auth_userpass(s->username, s->password,NULL);
+    data = auth_pool_userpass(s->username, s->password,NULL);
     /*LOG_DBG("user: %s\npass: %s", s->username, s->password);*/
 
     while ((!data) && ((retries == 0) || (current_try > 0)))
@@ -70,7 +71,7 @@ scp_v1_process(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
         {
             case SCP_SERVER_STATE_OK:
                 /* all ok, we got new username and password */
-                data = auth_userpass(s->username, s->password,NULL);
+                data = auth_pool_userpass(s->username, s->password,NULL);
 
                 /* one try less */
                 if (current_try > 0)
@@ -92,6 +93,7 @@ scp_v1_process(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
         scp_v1s_deny_connection(c, "Login failed");
         log_message( LOG_LEVEL_INFO,
                      "Login failed for user %s. Connection terminated", s->username);
+        mng_socket_logon(MNG_LOGON_FAILED, g_time3() - start_ms);
         return;
     }
 
@@ -101,6 +103,7 @@ scp_v1_process(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
         scp_v1s_deny_connection(c, "Access to Terminal Server not allowed.");
         log_message(LOG_LEVEL_INFO,
                     "User %s not allowed on TS. Connection terminated", s->username);
+        mng_socket_logon(MNG_LOGON_FAILED, g_time3() - start_ms);
         return;
     }
 
@@ -139,10 +142,9 @@ scp_v1_process(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
             log_message(LOG_LEVEL_INFO, "starting Xorg session...");
             display = session_start(data, SESMAN_SESSION_TYPE_XORG, c, s);
         }
-        /* if the session started up ok, auth_end will be called on
-           sig child */
-        do_auth_end = display == 0;
         e = scp_v1s_connect_new_session(c, display);
+        mng_socket_logon(display == 0 ? MNG_LOGON_FAILED : MNG_LOGON_NEW,
+                         g_time3() - start_ms);
         switch (e)
         {
             case SCP_SERVER_STATE_OK:
@@ -180,6 +182,8 @@ scp_v1_process(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
                     display = sitem->display;
                     /*e=scp_v1s_reconnect_session(c, sitem, display);*/
                     e = scp_v1s_reconnect_session(c, display);
+                    mng_socket_logon(MNG_LOGON_RECONNECT,
+                                     g_time3() - start_ms);
 
                     if (0 != s->client_ip)
                     {
@@ -207,11 +211,8 @@ scp_v1_process(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
         /* here goes scp resource sharing code */
     }
 
-    /* cleanup */
-    if (do_auth_end)
-    {
-        auth_end(data);
-    }
+    /* cleanup, a started session kept the login process */
+    auth_pool_end(data);
     g_free(slist);
 }
 
@@ -43,10 +43,11 @@ scp_v1_mng_process(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
     long data;
     enum SCP_SERVER_STATES_E e;
     struct SCP_DISCONNECTED_SESSION *slist = 0;
+    struct SCP_SESSION_USAGE *ulist = 0;
     int scount;
     int end = 0;
 
-    data = auth_userpass(s->username, s->password,NULL);
+    data = auth_pool_userpass(s->username, s->password,NULL);
     /*LOG_DBG("user: %s\npass: %s", s->username, s->password);*/
 
     if (!data)
@@ -54,7 +55,7 @@ scp_v1_mng_process(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
         scp_v1s_mng_deny_connection(c, "Login failed");
         log_message(LOG_LEVEL_INFO,
                     "[MNG] Login failed for user %s. Connection terminated", s->username);
-        auth_end(data);
+        auth_pool_end(data);
         return;
     }
 
@@ -64,7 +65,7 @@ scp_v1_mng_process(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
         scp_v1s_mng_deny_connection(c, "Access to Terminal Server not allowed.");
         log_message(LOG_LEVEL_INFO,
                     "[MNG] User %s not allowed on TS. Connection terminated", s->username);
-        auth_end(data);
+        auth_pool_end(data);
         return;
     }
 
@@ -92,6 +93,13 @@ scp_v1_mng_process(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
                 e = scp_v1s_mng_list_sessions(c, s, scount, slist);
                 g_free(slist);
                 break;
+
+            case SCP_SERVER_STATE_MNG_USAGEREQ:
+                /* cpu and memory use of all sessions */
+                ulist = session_get_usage(&scount);
+                e = scp_v1s_mng_session_usage(c, s, scount, ulist);
+                g_free(ulist);
+                break;
             default:
                 /* we check the other errors */
                 parseCommonStates(e, "scp_v1s_mng_list_sessions()");
@@ -101,7 +109,7 @@ scp_v1_mng_process(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
     }
 
     /* cleanup */
-    auth_end(data);
+    auth_pool_end(data);
 }
 
 static void parseCommonStates(enum SCP_SERVER_STATES_E e, const char *f)
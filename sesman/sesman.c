@@ -36,6 +36,54 @@ unsigned char g_fixedkey[8] = { 23, 82, 107, 6, 35, 78, 88, 7 };
 struct config_sesman *g_cfg; /* defined in config.h */
 
 tintptr g_term_event = 0;
+tintptr g_sync_event = 0; /* an scp thread wants a session started */
+tintptr g_reload_event = 0; /* SIGHUP */
+tintptr g_sigchld_event = 0; /* SIGCHLD */
+static tintptr g_login_done_event = 0; /* an scp thread finished */
+static tintptr g_signal_obj = 0; /* signalfd, 0 when handlers are used */
+static tintptr g_mng_obj = 0; /* ManagementSocket, 0 when there is none */
+static struct list *g_login_scks = 0; /* sockets of the scp threads */
+
+/******************************************************************************/
+static void
+sesman_login_done(int in_sck)
+{
+    int index;
+
+    lock_socket_acquire();
+    index = list_index_of(g_login_scks, in_sck);
+    if (index >= 0)
+    {
+        list_remove_item(g_login_scks, index);
+    }
+    g_sck_close(in_sck);
+    lock_socket_release();
+    g_set_wait_obj(g_login_done_event);
+}
+
+/******************************************************************************/
+/* one scp connection, the session is started by the main thread, see
+   session_sync_start */
+static THREAD_RV THREAD_CC
+sesman_login_thread(void *arg)
+{
+    sig_sesman_thread_block();
+    scp_process_start(arg);
+    sesman_login_done((int)(tintptr)arg);
+    return 0;
+}
+
+/******************************************************************************/
+static int
+sesman_login_count(void)
+{
+    int rv;
+
+    lock_socket_acquire();
+    rv = g_login_scks->count;
+    lock_socket_release();
+    return rv;
+}
 
 /******************************************************************************/
 int sesman_listen_test(struct config_sesman *cfg)
@@ -89,9 +137,12 @@ sesman_main_loop(void)
     int error;
     int robjs_count;
     int cont;
+    int reload;
+    int max_logins;
+    int timeout;
     int rv = 0;
     tbus sck_obj;
-    tbus robjs[8];
+    tbus robjs[16];
 
     g_sck = g_tcp_socket();
     if (g_sck < 0)
@@ -113,27 +164,100 @@ sesman_main_loop(void)
                         g_cfg->listen_port, g_cfg->listen_address);
             sck_obj = g_create_wait_obj_from_socket(g_sck, 0);
             cont = 1;
+            reload = 0;
 
             while (cont)
             {
-                /* build the wait obj list */
+                max_logins = g_cfg->sess.max_logins;
+                if (max_logins < 1)
+                {
+                    max_logins = 1;
+                }
+
+                /* build the wait obj list, stop accepting while all the
+                   login threads are busy */
                 robjs_count = 0;
-                robjs[robjs_count++] = sck_obj;
+                if (sesman_login_count() < max_logins)
+                {
+                    robjs[robjs_count++] = sck_obj;
+                }
                 robjs[robjs_count++] = g_term_event;
+                robjs[robjs_count++] = g_sync_event;
+                robjs[robjs_count++] = g_reload_event;
+                robjs[robjs_count++] = g_sigchld_event;
+                robjs[robjs_count++] = g_login_done_event;
+                if (g_signal_obj != 0)
+                {
+                    robjs[robjs_count++] = g_signal_obj;
+                }
+                if (g_mng_obj != 0)
+                {
+                    robjs[robjs_count++] = g_mng_obj;
+                }
+
+                /* wakes up for the client checks too */
+                timeout = session_check_clients();
 
                 /* wait */
-                if (g_obj_wait(robjs, robjs_count, 0, 0, -1) != 0)
+                if (g_obj_wait(robjs, robjs_count, 0, 0, timeout) != 0)
                 {
                     /* error, should not get here */
                     g_sleep(100);
                 }
 
+                if ((g_signal_obj != 0) && g_is_wait_obj_set(g_signal_obj))
+                {
+                    /* sets the events below, except for SIGCHLD which is
+                       reaped right away */
+                    if (sig_sesman_fd_sync())
+                    {
+                        session_sigkill_all();
+                        break;
+                    }
+                }
+
                 if (g_is_wait_obj_set(g_term_event)) /* term */
                 {
+                    session_sigkill_all();
                     break;
                 }
 
-                if (g_is_wait_obj_set(sck_obj)) /* incoming connection */
+                if (g_is_wait_obj_set(g_sigchld_event)) /* session ended */
+                {
+                    g_reset_wait_obj(g_sigchld_event);
+                    sig_sesman_session_end_sync();
+                }
+
+                if (g_is_wait_obj_set(g_sync_event)) /* session start */
+                {
+                    g_reset_wait_obj(g_sync_event);
+                    session_sync_start();
+                }
+
+                if ((g_mng_obj != 0) && g_is_wait_obj_set(g_mng_obj))
+                {
+                    mng_socket_accept();
+                }
+
+                if (g_is_wait_obj_set(g_login_done_event))
+                {
+                    g_reset_wait_obj(g_login_done_event);
+                }
+
+                if (g_is_wait_obj_set(g_reload_event)) /* SIGHUP */
+                {
+                    g_reset_wait_obj(g_reload_event);
+                    reload = 1;
+                }
+
+                if (reload && (sesman_login_count() == 0))
+                {
+                    reload = 0;
+                    sig_sesman_reload_cfg_sync();
+                }
+
+                if ((robjs[0] == sck_obj) &&
+                    g_is_wait_obj_set(sck_obj)) /* incoming connection */
                 {
                     in_sck = g_tcp_accept(g_sck);
 
@@ -149,10 +273,21 @@ sesman_main_loop(void)
                     }
                     else
                     {
-                        /* we've got a connection, so we pass it to scp code */
+                        /* we've got a connection, so we pass it to scp code
+                           on its own thread */
                         LOG_DBG("new connection");
-                        scp_process_start((void*)(tintptr)in_sck);
-                        g_sck_close(in_sck);
+                        g_tcp_set_non_blocking(in_sck);
+                        lock_socket_acquire();
+                        list_add_item(g_login_scks, in_sck);
+                        lock_socket_release();
+
+                        if (tc_thread_create(sesman_login_thread,
+                                             (void *)(tintptr)in_sck) != 0)
+                        {
+                            log_message(LOG_LEVEL_ERROR, "error creating "
+                                        "login thread");
+                            sesman_login_done(in_sck);
+                        }
                     }
                 }
             }
@@ -198,6 +333,7 @@ main(int argc, char **argv)
     enum logReturns log_error;
     int error;
     int daemon = 1;
+    int login = 0;
     int pid;
     char pid_s[32];
     char text[256];
@@ -276,6 +412,12 @@ main(int argc, char **argv)
         g_deinit();
         g_exit(error);
     }
+    else if ((2 == argc) && (0 == g_strcmp(argv[1], AUTH_POOL_LOGIN_ARG)))
+    {
+        /* started by auth_pool_userpass for one login */
+        daemon = 0;
+        login = 1;
+    }
     else
     {
         /* there's something strange on the command line */
@@ -283,7 +425,7 @@ main(int argc, char **argv)
         print_usage(1);
     }
 
-    if (g_file_exist(pid_file))
+    if (!login && g_file_exist(pid_file))
     {
         g_printf("xrdp-sesman is already running.\n");
         g_printf("if it's not running, try removing ");
@@ -312,7 +454,7 @@ main(int argc, char **argv)
     }
 
     /* not to spit on the console, show config summary only when running in foreground */
-    if (!daemon)
+    if (!daemon && !login)
     {
         config_dump(g_cfg);
     }
@@ -342,6 +484,13 @@ main(int argc, char **argv)
         g_exit(1);
     }
 
+    if (login)
+    {
+        error = auth_pool_login_main(AUTH_POOL_LOGIN_FD);
+        g_deinit();
+        g_exit(error);
+    }
+
     if (daemon)
     {
         /* not to spit on the console, shut up stdout/stderr before anything's logged */
@@ -385,22 +534,17 @@ main(int argc, char **argv)
         }
     }
 
-    /* signal handling */
+    /* signal handling, through the main loop when signalfd is there */
     g_pid = g_getpid();
-    /* old style signal handling is now managed synchronously by a
-     * separate thread. uncomment this block if you need old style
-     * signal handling and comment out thread_sighandler_start()
-     * going back to old style for the time being
-     * problem with the sigaddset functions in sig.c - jts */
-#if 1
-    g_signal_hang_up(sig_sesman_reload_cfg); /* SIGHUP  */
-    g_signal_user_interrupt(sig_sesman_shutdown); /* SIGINT  */
-    g_signal_terminate(sig_sesman_shutdown); /* SIGTERM */
-    g_signal_child_stop(sig_sesman_session_end); /* SIGCHLD */
-#endif
-#if 0
-    thread_sighandler_start();
-#endif
+    g_signal_obj = sig_sesman_fd_init();
+
+    if (g_signal_obj == 0)
+    {
+        g_signal_hang_up(sig_sesman_reload_cfg); /* SIGHUP  */
+        g_signal_user_interrupt(sig_sesman_shutdown); /* SIGINT  */
+        g_signal_terminate(sig_sesman_shutdown); /* SIGTERM */
+        g_signal_child_stop(sig_sesman_session_end); /* SIGCHLD */
+    }
 
     if (daemon)
     {
@@ -442,8 +586,22 @@ main(int argc, char **argv)
 
     g_snprintf(text, 255, "xrdp_sesman_%8.8x_main_term", g_pid);
     g_term_event = g_create_wait_obj(text);
+    g_snprintf(text, 255, "xrdp_sesman_%8.8x_main_sync", g_pid);
+    g_sync_event = g_create_wait_obj(text);
+    g_snprintf(text, 255, "xrdp_sesman_%8.8x_main_reload", g_pid);
+    g_reload_event = g_create_wait_obj(text);
+    g_snprintf(text, 255, "xrdp_sesman_%8.8x_main_sigchld", g_pid);
+    g_sigchld_event = g_create_wait_obj(text);
+    g_snprintf(text, 255, "xrdp_sesman_%8.8x_login_done", g_pid);
+    g_login_done_event = g_create_wait_obj(text);
+    lock_init();
+    auth_pool_init();
+    cgroup_init();
+    g_mng_obj = mng_socket_init();
+    g_login_scks = list_create();
 
     error = sesman_main_loop();
+    mng_socket_deinit();
 
     /* clean up PID file on exit */
     if (daemon)
@@ -452,6 +610,10 @@ main(int argc, char **argv)
     }
 
     g_delete_wait_obj(g_term_event);
+    g_delete_wait_obj(g_sync_event);
+    g_delete_wait_obj(g_reload_event);
+    g_delete_wait_obj(g_sigchld_event);
+    g_delete_wait_obj(g_login_done_event);
 
     if (!daemon)
     {
@@ -33,11 +33,16 @@
 #include "log.h"
 #include "env.h"
 #include "auth.h"
+#include "auth_pool.h"
+#include "cgroup.h"
 #include "config.h"
 #include "sig.h"
 #include "session.h"
 #include "access.h"
 #include "scp.h"
+#include "lock.h"
+#include "mng_socket.h"
+#include "thread_calls.h"
 
 #include "libscp.h"
 
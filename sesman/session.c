@@ -37,6 +37,13 @@
 #include <sys/prctl.h>
 #endif
 
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+#include <sys/wait.h>
+#include <signal.h>
+
 #include "sesman.h"
 #include "libscp_types.h"
 #include "xauth.h"
@@ -46,13 +53,50 @@
 #define PR_SET_NO_NEW_PRIVS 38
 #endif
 
+/* milliseconds an X server gets to create its lock file or socket */
+#define XSERVER_START_TIMEOUT 10000
+
+/* how often the xrdp connections of the sessions are looked at */
+#define SESSION_CHECK_MS 10000
+/* XRDP_X11RDP_STR without the display number */
+#define SESSION_X11RDP_PREFIX XRDP_SOCKET_PATH "/xrdp_display_"
+
 extern unsigned char g_fixedkey[8];
 extern struct config_sesman *g_cfg; /* in sesman.c */
 extern int g_sck; /* in sesman.c */
+extern int g_pid; /* in sesman.c */
 struct session_chain *g_sessions;
 int g_session_count;
 
 extern tbus g_term_event; /* in sesman.c */
+extern tbus g_sync_event; /* in sesman.c */
+
+static int g_check_next = 0; /* g_time3() of the next client check */
+static int g_check_disabled = 0; /* no /proc/net/unix */
+/* a session is being hibernated, guarded by lock_chain_acquire */
+static int g_hibernating = 0;
+
+/* a session start or reconnect handed from an scp thread to the main
+   thread, guarded by lock_sync_acquire */
+static long g_sync_data;
+static tui8 g_sync_type;
+static struct SCP_CONNECTION *g_sync_c;
+static struct SCP_SESSION *g_sync_s;
+static int g_sync_display; /* non zero for a reconnect */
+static char *g_sync_username;
+static int g_sync_result;
+
+/* session list indices, see session_chain_add */
+static struct session_chain *g_pid_hash[SESMAN_SESSION_HASH_SIZE];
+static struct session_chain *g_user_hash[SESMAN_SESSION_HASH_SIZE];
+static int g_session_id = 0;
+
+/* one bit per display number, displays of sessions in g_sessions and
+   displays found taken by something else, only used by the main thread */
+static tui32 *g_display_used = 0;
+static tui32 *g_display_foreign = 0;
+static int g_display_words = 0;
+static int g_display_foreign_count = 0;
 
 /**
  * Creates a string consisting of all parameters that is hosted in the param list
@@ -89,16 +133,195 @@ dumpItemsToString(struct list *self, char *outstr, int len)
 }
 
 
+/******************************************************************************/
+static int
+session_hash_pid(int pid)
+{
+    return pid & (SESMAN_SESSION_HASH_SIZE - 1);
+}
+
+/******************************************************************************/
+/* user names are matched without case by session_get_byuser */
+static int
+session_hash_user(const char *name)
+{
+    tui32 hash;
+    int index;
+    int c;
+
+    hash = 2166136261u;
+
+    for (index = 0; (index < 255) && (name[index] != 0); index++)
+    {
+        c = (unsigned char) (name[index]);
+
+        if ((c >= 'A') && (c <= 'Z'))
+        {
+            c += 'a' - 'A';
+        }
+
+        hash = (hash ^ c) * 16777619u;
+    }
+
+    return hash & (SESMAN_SESSION_HASH_SIZE - 1);
+}
+
+/******************************************************************************/
+/* called with the main thread, chain lock held */
+static void
+session_chain_add(struct session_chain *chain)
+{
+    int index;
+
+    chain->prev = 0;
+    chain->next = g_sessions;
+
+    if (g_sessions != 0)
+    {
+        g_sessions->prev = chain;
+    }
+
+    g_sessions = chain;
+
+    index = session_hash_pid(chain->item->pid);
+    chain->pid_next = g_pid_hash[index];
+    g_pid_hash[index] = chain;
+
+    index = session_hash_user(chain->item->name);
+    chain->user_next = g_user_hash[index];
+    g_user_hash[index] = chain;
+
+    g_session_count++;
+}
+
+/******************************************************************************/
+/* called with the main thread, chain lock held */
+static void
+session_chain_remove(struct session_chain *chain)
+{
+    struct session_chain **pp;
+
+    if (chain->prev == 0)
+    {
+        g_sessions = chain->next;
+    }
+    else
+    {
+        chain->prev->next = chain->next;
+    }
+
+    if (chain->next != 0)
+    {
+        chain->next->prev = chain->prev;
+    }
+
+    pp = g_pid_hash + session_hash_pid(chain->item->pid);
+
+    while (*pp != chain)
+    {
+        pp = &((*pp)->pid_next);
+    }
+
+    *pp = chain->pid_next;
+
+    pp = g_user_hash + session_hash_user(chain->item->name);
+
+    while (*pp != chain)
+    {
+        pp = &((*pp)->user_next);
+    }
+
+    *pp = chain->user_next;
+
+    g_session_count--;
+}
+
+/******************************************************************************/
+/* chain lock held */
+static struct session_chain *
+session_chain_find_pid(int pid)
+{
+    struct session_chain *chain;
+
+    chain = g_pid_hash[session_hash_pid(pid)];
+
+    while (chain != 0)
+    {
+        if (chain->item->pid == pid)
+        {
+            return chain;
+        }
+
+        chain = chain->pid_next;
+    }
+
+    return 0;
+}
+
+/******************************************************************************/
+static void
+session_set_date(struct session_date *date)
+{
+    struct tm stime;
+    time_t ltime;
+
+    ltime = g_time1();
+    localtime_r(&ltime, &stime);
+    date->year = (tui16)(stime.tm_year + 1900);
+    date->month = (tui8)(stime.tm_mon + 1);
+    date->day = (tui8)stime.tm_mday;
+    date->hour = (tui8)stime.tm_hour;
+    date->minute = (tui8)stime.tm_min;
+}
+
+/******************************************************************************/
+/* chain lock held, main thread only */
+static void
+session_set_state(struct session_item *item, int state)
+{
+    static const char *names[] =
+    {
+        "", "starting", "running", "disconnected", "terminating"
+    };
+
+    if (item->state == state)
+    {
+        return;
+    }
+
+    log_message(LOG_LEVEL_DEBUG, "session %d on display :%d %s -> %s",
+                item->id, item->display, names[item->state], names[state]);
+    /* hibernated again after the next disconnect */
+    item->hibernated = 0;
+
+    item->state = state;
+    item->state_time = g_time1();
+
+    switch (state)
+    {
+        case SESMAN_SESSION_STATE_DISCONNECTED:
+            item->status = SESMAN_SESSION_STATUS_DISCONNECTED;
+            session_set_date(&(item->disconnect_time));
+            break;
+        case SESMAN_SESSION_STATE_TERMINATING:
+            /* not offered for reconnection any more */
+            item->status = 0;
+            break;
+        default:
+            item->status = SESMAN_SESSION_STATUS_ACTIVE;
+            break;
+    }
+}
+
 /******************************************************************************/
 struct session_item *
 session_get_bydata(const char *name, int width, int height, int bpp, int type,
                    const char *client_ip)
 {
     struct session_chain *tmp;
+    struct session_item *dummy;
     enum SESMAN_CFG_SESS_POLICY policy = g_cfg->sess.policy;
 
-    tmp = g_sessions;
-
     /* convert from SCP_SESSION_TYPE namespace to SESMAN_SESSION_TYPE namespace */
     switch (type)
     {
@@ -118,12 +341,23 @@ session_get_bydata(const char *name, int width, int height, int bpp, int type,
             return 0;
     }
 
+    dummy = g_new0(struct session_item, 1);
+
+    if (0 == dummy)
+    {
+        log_message(LOG_LEVEL_ERROR, "session_get_bydata: out of memory");
+        return 0;
+    }
+
 #if 0
     log_message(LOG_LEVEL_INFO,
             "session_get_bydata: search policy %d U %s W %d H %d bpp %d T %d IP %s",
             policy, name, width, height, bpp, type, client_ip);
 #endif
 
+    lock_chain_acquire();
+    tmp = g_user_hash[session_hash_user(name)];
+
     while (tmp != 0)
     {
 #if 0
@@ -144,14 +378,19 @@ session_get_bydata(const char *name, int width, int height, int bpp, int type,
             (!(policy & SESMAN_CFG_SESS_POLICY_C) ||
              (g_strncmp(client_ip, tmp->item->client_ip, 255) == 0)) &&
             tmp->item->bpp == bpp &&
-            tmp->item->type == type)
+            tmp->item->type == type &&
+            tmp->item->state != SESMAN_SESSION_STATE_TERMINATING)
         {
-            return tmp->item;
+            g_memcpy(dummy, tmp->item, sizeof(struct session_item));
+            lock_chain_release();
+            return dummy;
         }
 
-        tmp = tmp->next;
+        tmp = tmp->user_next;
     }
 
+    lock_chain_release();
+    g_free(dummy);
     return 0;
 }
 
@@ -269,51 +508,151 @@ x_server_running(int display)
 }
 
 /******************************************************************************/
-/* called with the main thread
-   returns boolean */
+/* returns boolean, true once the X server takes connections on its unix
+   socket, the lock file and the socket file both show up before that */
 static int
-session_is_display_in_chain(int display)
+x_server_listening(int display)
 {
-    struct session_chain *chain;
-    struct session_item *item;
+    char text[256];
+    int sck;
+    int listening;
 
-    chain = g_sessions;
+    g_snprintf(text, sizeof(text), "/tmp/.X11-unix/X%d", display);
+    sck = g_sck_local_socket();
+    if (sck < 0)
+    {
+        return 0;
+    }
+    listening = g_sck_local_connect(sck, text) == 0;
+    g_sck_close(sck);
+    return listening;
+}
 
-    while (chain != 0)
+/******************************************************************************/
+/* makes the display bitmaps big enough for display
+   returns error */
+static int
+session_display_bits_grow(int display)
+{
+    int words;
+    tui32 *used;
+    tui32 *foreign;
+
+    words = (display >> 5) + 1;
+
+    if (words <= g_display_words)
     {
-        item = chain->item;
+        return 0;
+    }
 
-        if (item->display == display)
-        {
-            return 1;
-        }
+    used = g_new0(tui32, words);
+    foreign = g_new0(tui32, words);
+
+    if ((used == 0) || (foreign == 0))
+    {
+        g_free(used);
+        g_free(foreign);
+        return 1;
+    }
 
-        chain = chain->next;
+    if (g_display_words > 0)
+    {
+        g_memcpy(used, g_display_used, g_display_words * 4);
+        g_memcpy(foreign, g_display_foreign, g_display_words * 4);
     }
 
+    g_free(g_display_used);
+    g_free(g_display_foreign);
+    g_display_used = used;
+    g_display_foreign = foreign;
+    g_display_words = words;
     return 0;
 }
 
 /******************************************************************************/
 /* called with the main thread */
+static void
+session_display_set_used(int display, int used)
+{
+    if ((display < 0) || ((display >> 5) >= g_display_words))
+    {
+        return;
+    }
+
+    if (used)
+    {
+        g_display_used[display >> 5] |= (tui32)1 << (display & 31);
+    }
+    else
+    {
+        g_display_used[display >> 5] &= ~((tui32)1 << (display & 31));
+    }
+}
+
+/******************************************************************************/
+/* called with the main thread
+   the bitmaps are consulted first so only the display handed out is
+   checked against the file system and ports, displays taken by something
+   else are remembered and only looked at again when the range is full */
 static int
 session_get_avail_display_from_chain(void)
 {
     int display;
+    int first;
+    int last;
+    int pass;
+    tui32 busy;
+    tui32 bit;
 
-    display = g_cfg->sess.x11_display_offset;
+    first = g_cfg->sess.x11_display_offset;
+    last = first + g_cfg->sess.max_sessions;
 
-    while ((display - g_cfg->sess.x11_display_offset) <= g_cfg->sess.max_sessions)
+    if (session_display_bits_grow(last) != 0)
     {
-        if (!session_is_display_in_chain(display))
+        log_message(LOG_LEVEL_ERROR, "X server -- out of memory");
+        return 0;
+    }
+
+    for (pass = 0; pass < 2; pass++)
+    {
+        display = first;
+
+        while (display <= last)
         {
-            if (!x_server_running_check_ports(display))
+            busy = g_display_used[display >> 5] |
+                   g_display_foreign[display >> 5];
+
+            if (busy == 0xffffffff)
+            {
+                /* skip the whole word */
+                display = (display | 31) + 1;
+                continue;
+            }
+
+            bit = (tui32)1 << (display & 31);
+
+            if ((busy & bit) == 0)
             {
-                return display;
+                if (!x_server_running_check_ports(display))
+                {
+                    return display;
+                }
+
+                g_display_foreign[display >> 5] |= bit;
+                g_display_foreign_count++;
             }
+
+            display++;
+        }
+
+        if (g_display_foreign_count == 0)
+        {
+            break;
         }
 
-        display++;
+        /* what was found taken outside of sesman may be free by now */
+        g_memset(g_display_foreign, 0, g_display_words * 4);
+        g_display_foreign_count = 0;
     }
 
     log_message(LOG_LEVEL_ERROR, "X server -- no display in range is available");
@@ -321,20 +660,60 @@ session_get_avail_display_from_chain(void)
 }
 
 /******************************************************************************/
+/* returns boolean, true if the X server process is gone, it is not reaped
+   so the pid stays valid for the g_sigterm at the end of the session */
+static int
+xserver_exited(int xserver_pid)
+{
+    siginfo_t info;
+
+    if (xserver_pid <= 0)
+    {
+        return 0;
+    }
+
+    g_memset(&info, 0, sizeof(info));
+
+    if (waitid(P_PID, xserver_pid, &info, WEXITED | WNOHANG | WNOWAIT) != 0)
+    {
+        return 0;
+    }
+
+    return info.si_pid == xserver_pid;
+}
+
+/******************************************************************************/
+/* waits till the X server takes connections, woken by inotify on
+   /tmp/.X11-unix where available and polling otherwise
+   xserver_pid can be 0 if the caller does not know it
+   returns error */
 static int
-wait_for_xserver(int display)
+wait_for_xserver(int display, int xserver_pid)
 {
-    int i;
+    int fd;
+    int start;
+    int elapsed;
+    int slice;
+    char buf[1024];
+
+    fd = -1;
+#ifdef HAVE_SYS_INOTIFY_H
+    fd = inotify_init();
+
+    if (fd != -1)
+    {
+        inotify_add_watch(fd, "/tmp/.X11-unix", IN_CREATE | IN_MOVED_TO);
+    }
+#endif
 
-    /* give X a bit to start */
-    /* wait up to 10 secs for x server to start */
-    i = 0;
+    start = g_time3();
 
-    while (!x_server_running(display))
+    /* checked after the watches are added so nothing is missed */
+    while (!x_server_listening(display))
     {
-        i++;
+        elapsed = g_time3() - start;
 
-        if (i > 40)
+        if (elapsed >= XSERVER_START_TIMEOUT)
         {
             log_message(LOG_LEVEL_ERROR,
                         "X server for display %d startup timeout",
@@ -342,15 +721,54 @@ wait_for_xserver(int display)
             break;
         }
 
-        g_sleep(250);
+        if (xserver_exited(xserver_pid))
+        {
+            log_message(LOG_LEVEL_ERROR,
+                        "X server for display %d exited on startup",
+                        display);
+            break;
+        }
+
+        if (fd == -1)
+        {
+            g_sleep(50);
+            continue;
+        }
+
+        /* wake up now and then anyway to see if the server died, and
+           often once the socket is there as listen comes after bind */
+        slice = XSERVER_START_TIMEOUT - elapsed;
+        if (slice > 500)
+        {
+            slice = 500;
+        }
+        if (x_server_running(display) && (slice > 50))
+        {
+            slice = 50;
+        }
+
+        if (g_sck_can_recv(fd, slice))
+        {
+            if (g_file_read(fd, buf, sizeof(buf)) < 0)
+            {
+                /* should not happen, fall back to polling */
+                g_file_close(fd);
+                fd = -1;
+            }
+        }
+    }
+
+    if (fd != -1)
+    {
+        g_file_close(fd);
     }
 
-    return 0;
+    return x_server_listening(display) ? 0 : 1;
 }
 
 /******************************************************************************/
 static int
-session_start_chansrv(char *username, int display)
+session_start_chansrv(const char *username, int display)
 {
     struct list *chansrv_params;
     char exe_path[262];
@@ -385,13 +803,105 @@ session_start_chansrv(char *username, int display)
 }
 
 /******************************************************************************/
-/* called with the main thread */
-static int
-session_start_fork(tbus data, tui8 type, struct SCP_CONNECTION *c,
-                   struct SCP_SESSION *s)
+/* environment every X server gets, after env_set_user */
+static void
+session_set_xserver_env(void)
 {
-    int display = 0;
-    int pid = 0;
+    char text[256];
+
+    g_snprintf(text, 255, "%d", g_cfg->sess.max_idle_time);
+    g_setenv("XRDP_SESMAN_MAX_IDLE_TIME", text, 1);
+    g_snprintf(text, 255, "%d", g_cfg->sess.max_disc_time);
+    g_setenv("XRDP_SESMAN_MAX_DISC_TIME", text, 1);
+    g_snprintf(text, 255, "%d", g_cfg->sess.kill_disconnected);
+    g_setenv("XRDP_SESMAN_KILL_DISCONNECTED", text, 1);
+    g_setenv("XRDP_SOCKET_PATH", XRDP_SOCKET_PATH, 1);
+}
+
+/******************************************************************************/
+/* the user's Xauthority file, after env_set_user */
+static void
+session_get_authfile(char *authfile)
+{
+    if (g_getenv("XAUTHORITY") != NULL)
+    {
+        g_snprintf(authfile, 255, "%s", g_getenv("XAUTHORITY"));
+    }
+    else
+    {
+        g_snprintf(authfile, 255, "%s", ".Xauthority");
+    }
+}
+
+/******************************************************************************/
+/* only returns if Xorg could not be started
+   returns the parameter list for logging */
+static struct list *
+session_exec_xorg(const char *screen, const char *authfile,
+                  int width, int height)
+{
+    char geometry[32];
+    char execvpparams[2048];
+    char *xserver;
+    char **pp1;
+    struct list *xserver_params;
+
+#ifdef HAVE_SYS_PRCTL_H
+    /*
+     * Make sure Xorg doesn't run setuid root. Root access is not
+     * needed. Xorg can fail when run as root and the user has no
+     * console permissions.
+     * PR_SET_NO_NEW_PRIVS requires Linux kernel 3.5 and newer.
+     */
+    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0)
+    {
+        log_message(LOG_LEVEL_WARNING,
+                    "Failed to disable setuid on X server: %s",
+                    g_get_strerror());
+    }
+#endif
+
+    xserver_params = list_create();
+    xserver_params->auto_free = 1;
+
+    /* get path of Xorg from config */
+    xserver = g_strdup((const char *)list_get_item(g_cfg->xorg_params, 0));
+
+    /* these are the must have parameters */
+    list_add_item(xserver_params, (tintptr) g_strdup(xserver));
+    list_add_item(xserver_params, (tintptr) g_strdup(screen));
+    list_add_item(xserver_params, (tintptr) g_strdup("-auth"));
+    list_add_item(xserver_params, (tintptr) g_strdup(authfile));
+
+    /* additional parameters from sesman.ini file */
+    list_append_list_strdup(g_cfg->xorg_params, xserver_params, 1);
+
+    /* make sure it ends with a zero */
+    list_add_item(xserver_params, 0);
+
+    pp1 = (char **) xserver_params->items;
+
+    log_message(LOG_LEVEL_INFO, "%s", dumpItemsToString(xserver_params, execvpparams, 2048));
+
+    /* some args are passed via env vars */
+    g_sprintf(geometry, "%d", width);
+    g_setenv("XRDP_START_WIDTH", geometry, 1);
+
+    g_sprintf(geometry, "%d", height);
+    g_setenv("XRDP_START_HEIGHT", geometry, 1);
+
+    /* fire up Xorg */
+    g_execvp(xserver, pp1);
+    return xserver_params;
+}
+
+/******************************************************************************/
+/* called in the login process once sesman sent AUTH_POOL_CMD_START, forks X
+   and the window manager and waits for the latter, does not return */
+void
+session_run(long data, const struct auth_pool_cmd *cmd)
+{
+    int display;
     int i = 0;
     char geometry[32];
     char depth[32];
@@ -401,462 +911,466 @@ session_start_fork(tbus data, tui8 type, struct SCP_CONNECTION *c,
     char *xserver; /* absolute/relative path to Xorg/X11rdp/Xvnc */
     char *passwd_file;
     char **pp1 = (char **)NULL;
-    struct session_chain *temp = (struct session_chain *)NULL;
     struct list *xserver_params = (struct list *)NULL;
-    struct tm stime;
-    time_t ltime;
     char authfile[256]; /* The filename for storing xauth informations */
     int chansrv_pid;
     int display_pid;
     int window_manager_pid;
+    int ready;
 
     /* initialize (zero out) local variables: */
-    g_memset(&ltime, 0, sizeof(time_t));
-    g_memset(&stime, 0, sizeof(struct tm));
     g_memset(geometry, 0, sizeof(char) * 32);
     g_memset(depth, 0, sizeof(char) * 32);
     g_memset(screen, 0, sizeof(char) * 32);
     g_memset(text, 0, sizeof(char) * 256);
 
     passwd_file = 0;
-
-    /* check to limit concurrent sessions */
-    if (g_session_count >= g_cfg->sess.max_sessions)
+    display = cmd->display;
+    log_message(LOG_LEVEL_INFO, "calling auth_start_session from pid %d",
+                g_getpid());
+    auth_start_session(data, display);
+    g_sprintf(geometry, "%dx%d", cmd->width, cmd->height);
+    g_sprintf(depth, "%d", cmd->bpp);
+    g_sprintf(screen, ":%d", display);
+#if defined(__FreeBSD__) || defined(__FreeBSD_kernel__)
+    /*
+     * FreeBSD bug
+     * ports/157282: effective login name is not set by xrdp-sesman
+     * http://www.freebsd.org/cgi/query-pr.cgi?pr=157282
+     *
+     * from:
+     *  $OpenBSD: session.c,v 1.252 2010/03/07 11:57:13 dtucker Exp $
+     *  with some ideas about BSD process grouping to xrdp
+     */
+    pid_t bsdsespid = g_fork();
+
+    if (bsdsespid == -1)
     {
-        log_message(LOG_LEVEL_INFO, "max concurrent session limit "
-                    "exceeded. login for user %s denied", s->username);
-        return 0;
     }
-
-    temp = (struct session_chain *)g_malloc(sizeof(struct session_chain), 0);
-
-    if (temp == 0)
+    else if (bsdsespid == 0) /* BSD session leader */
     {
-        log_message(LOG_LEVEL_ERROR, "cannot create new chain "
-                    "element - user %s", s->username);
-        return 0;
-    }
-
-    temp->item = (struct session_item *)g_malloc(sizeof(struct session_item), 0);
+        /**
+         * Create a new session and process group since the 4.4BSD
+         * setlogin() affects the entire process group
+         */
+        if (g_setsid() < 0)
+        {
+            log_message(LOG_LEVEL_ERROR,
+                        "setsid failed - pid %d", g_getpid());
+        }
 
-    if (temp->item == 0)
-    {
-        g_free(temp);
-        log_message(LOG_LEVEL_ERROR, "cannot create new session "
-                    "item - user %s", s->username);
-        return 0;
+        if (g_setlogin(cmd->username) < 0)
+        {
+            log_message(LOG_LEVEL_ERROR,
+                        "setlogin failed for user %s - pid %d", cmd->username,
+                        g_getpid());
+        }
     }
 
-    display = session_get_avail_display_from_chain();
+    g_waitpid(bsdsespid);
 
-    if (display == 0)
+    if (bsdsespid > 0)
     {
-        g_free(temp->item);
-        g_free(temp);
-        return 0;
+        g_exit(0);
+        /*
+         * intermediate sesman should exit here after WM exits.
+         * do not execure the following codes.
+         */
     }
-
-    pid = g_fork(); /* parent is fork from tcp accept,
-                       child forks X and wm, then becomes scp */
-
-    if (pid == -1)
+#endif
+    window_manager_pid = g_fork(); /* parent becomes X,
+                         child forks wm, and waits, todo */
+    if (window_manager_pid == -1)
     {
     }
-    else if (pid == 0)
+    else if (window_manager_pid == 0)
     {
-        log_message(LOG_LEVEL_INFO, "calling auth_start_session from pid %d",
-                    g_getpid());
-        auth_start_session(data, display);
-        g_delete_wait_obj(g_term_event);
-        g_tcp_close(g_sck);
-        g_tcp_close(c->in_sck);
-        g_sprintf(geometry, "%dx%d", s->width, s->height);
-        g_sprintf(depth, "%d", s->bpp);
-        g_sprintf(screen, ":%d", display);
-#if defined(__FreeBSD__) || defined(__FreeBSD_kernel__)
-        /*
-         * FreeBSD bug
-         * ports/157282: effective login name is not set by xrdp-sesman
-         * http://www.freebsd.org/cgi/query-pr.cgi?pr=157282
-         *
-         * from:
-         *  $OpenBSD: session.c,v 1.252 2010/03/07 11:57:13 dtucker Exp $
-         *  with some ideas about BSD process grouping to xrdp
-         */
-        pid_t bsdsespid = g_fork();
-
-        if (bsdsespid == -1)
-        {
-        }
-        else if (bsdsespid == 0) /* BSD session leader */
+        ready = wait_for_xserver(display, 0) == 0;
+        env_set_user(cmd->username,
+                     0,
+                     display,
+                     g_cfg->env_names,
+                     g_cfg->env_values);
+        if (ready)
         {
-            /**
-             * Create a new session and process group since the 4.4BSD
-             * setlogin() affects the entire process group
-             */
-            if (g_setsid() < 0)
+            auth_set_env(data);
+            if (cmd->directory[0] != 0)
             {
-                log_message(LOG_LEVEL_ERROR,
-                            "setsid failed - pid %d", g_getpid());
+                g_set_current_dir(cmd->directory);
             }
-
-            if (g_setlogin(s->username) < 0)
+            if (cmd->program[0] != 0)
             {
-                log_message(LOG_LEVEL_ERROR,
-                            "setlogin failed for user %s - pid %d", s->username,
-                            g_getpid());
-            }
-        }
-
-        g_waitpid(bsdsespid);
-
-        if (bsdsespid > 0)
-        {
-            g_exit(0);
-            /*
-             * intermediate sesman should exit here after WM exits.
-             * do not execure the following codes.
-             */
-        }
-#endif
-        window_manager_pid = g_fork(); /* parent becomes X,
-                             child forks wm, and waits, todo */
-        if (window_manager_pid == -1)
-        {
-        }
-        else if (window_manager_pid == 0)
-        {
-            wait_for_xserver(display);
-            env_set_user(s->username,
-                         0,
-                         display,
-                         g_cfg->env_names,
-                         g_cfg->env_values);
-            if (x_server_running(display))
-            {
-                auth_set_env(data);
-                if (s->directory != 0)
-                {
-                    if (s->directory[0] != 0)
-                    {
-                        g_set_current_dir(s->directory);
-                    }
-                }
-                if (s->program != 0)
+                log_message(LOG_LEVEL_DEBUG, 
+                            "starting program with parameters: %s ",
+                            cmd->program);
+                if(g_strchr(cmd->program, ' ') != 0 || g_strchr(cmd->program, '\t') != 0)
                 {
-                    if (s->program[0] != 0)
-                    {
-                        log_message(LOG_LEVEL_DEBUG, 
-                                    "starting program with parameters: %s ",
-                                    s->program);
-                        if(g_strchr(s->program, ' ') != 0 || g_strchr(s->program, '\t') != 0)
-                        {
-                            const char *params[] = {"sh", "-c", s->program, NULL};
-                            g_execvp("/bin/sh", (char **)params);
-                        }
-                        else
-                        {
-                           g_execlp3(s->program, s->program, 0);
-                        }
-                        log_message(LOG_LEVEL_ALWAYS,
-                                    "error starting program %s for user %s - pid %d",
-                                    s->program, s->username, g_getpid());
-                    }
+                    const char *params[] = {"sh", "-c", cmd->program, NULL};
+                    g_execvp("/bin/sh", (char **)params);
                 }
-                /* try to execute user window manager if enabled */
-                if (g_cfg->enable_user_wm)
+                else
                 {
-                    g_sprintf(text, "%s/%s", g_getenv("HOME"), g_cfg->user_wm);
-                    if (g_file_exist(text))
-                    {
-                        g_execlp3(text, g_cfg->user_wm, 0);
-                        log_message(LOG_LEVEL_ALWAYS, "error starting user "
-                                    "wm for user %s - pid %d", s->username, g_getpid());
-                        /* logging parameters */
-                        log_message(LOG_LEVEL_DEBUG, "errno: %d, "
-                                    "description: %s", g_get_errno(), g_get_strerror());
-                        log_message(LOG_LEVEL_DEBUG, "execlp3 parameter "
-                                    "list:");
-                        log_message(LOG_LEVEL_DEBUG, "        argv[0] = %s",
-                                    text);
-                        log_message(LOG_LEVEL_DEBUG, "        argv[1] = %s",
-                                    g_cfg->user_wm);
-                    }
+                   g_execlp3(cmd->program, cmd->program, 0);
                 }
-                /* if we're here something happened to g_execlp3
-                   so we try running the default window manager */
-                g_execlp3(g_cfg->default_wm, g_cfg->default_wm, 0);
-
-                log_message(LOG_LEVEL_ALWAYS, "error starting default "
-                             "wm for user %s - pid %d", s->username, g_getpid());
-                /* logging parameters */
-                log_message(LOG_LEVEL_DEBUG, "errno: %d, description: "
-                            "%s", g_get_errno(), g_get_strerror());
-                log_message(LOG_LEVEL_DEBUG, "execlp3 parameter list:");
-                log_message(LOG_LEVEL_DEBUG, "        argv[0] = %s",
-                            g_cfg->default_wm);
-                log_message(LOG_LEVEL_DEBUG, "        argv[1] = %s",
-                            g_cfg->default_wm);
-
-                /* still a problem starting window manager just start xterm */
-                g_execlp3("xterm", "xterm", 0);
-
-                /* should not get here */
-                log_message(LOG_LEVEL_ALWAYS, "error starting xterm "
-                            "for user %s - pid %d", s->username, g_getpid());
-                /* logging parameters */
-                log_message(LOG_LEVEL_DEBUG, "errno: %d, description: "
-                            "%s", g_get_errno(), g_get_strerror());
+                log_message(LOG_LEVEL_ALWAYS,
+                            "error starting program %s for user %s - pid %d",
+                            cmd->program, cmd->username, g_getpid());
             }
-            else
+            /* try to execute user window manager if enabled */
+            if (g_cfg->enable_user_wm)
             {
-                log_message(LOG_LEVEL_ERROR, "another Xserver might "
-                            "already be active on display %d - see log", display);
+                g_sprintf(text, "%s/%s", g_getenv("HOME"), g_cfg->user_wm);
+                if (g_file_exist(text))
+                {
+                    g_execlp3(text, g_cfg->user_wm, 0);
+                    log_message(LOG_LEVEL_ALWAYS, "error starting user "
+                                "wm for user %s - pid %d", cmd->username, g_getpid());
+                    /* logging parameters */
+                    log_message(LOG_LEVEL_DEBUG, "errno: %d, "
+                                "description: %s", g_get_errno(), g_get_strerror());
+                    log_message(LOG_LEVEL_DEBUG, "execlp3 parameter "
+                                "list:");
+                    log_message(LOG_LEVEL_DEBUG, "        argv[0] = %s",
+                                text);
+                    log_message(LOG_LEVEL_DEBUG, "        argv[1] = %s",
+                                g_cfg->user_wm);
+                }
             }
-
-            log_message(LOG_LEVEL_DEBUG, "aborting connection...");
-            g_exit(0);
+            /* if we're here something happened to g_execlp3
+               so we try running the default window manager */
+            g_execlp3(g_cfg->default_wm, g_cfg->default_wm, 0);
+
+            log_message(LOG_LEVEL_ALWAYS, "error starting default "
+                         "wm for user %s - pid %d", cmd->username, g_getpid());
+            /* logging parameters */
+            log_message(LOG_LEVEL_DEBUG, "errno: %d, description: "
+                        "%s", g_get_errno(), g_get_strerror());
+            log_message(LOG_LEVEL_DEBUG, "execlp3 parameter list:");
+            log_message(LOG_LEVEL_DEBUG, "        argv[0] = %s",
+                        g_cfg->default_wm);
+            log_message(LOG_LEVEL_DEBUG, "        argv[1] = %s",
+                        g_cfg->default_wm);
+
+            /* still a problem starting window manager just start xterm */
+            g_execlp3("xterm", "xterm", 0);
+
+            /* should not get here */
+            log_message(LOG_LEVEL_ALWAYS, "error starting xterm "
+                        "for user %s - pid %d", cmd->username, g_getpid());
+            /* logging parameters */
+            log_message(LOG_LEVEL_DEBUG, "errno: %d, description: "
+                        "%s", g_get_errno(), g_get_strerror());
         }
         else
         {
-            display_pid = g_fork(); /* parent becomes scp,
-                                child becomes X */
-            if (display_pid == -1)
+            log_message(LOG_LEVEL_ERROR, "another Xserver might "
+                        "already be active on display %d - see log", display);
+        }
+
+        log_message(LOG_LEVEL_DEBUG, "aborting connection...");
+        g_exit(0);
+    }
+    else
+    {
+        display_pid = g_fork(); /* parent becomes scp,
+                                   child becomes X */
+        if (display_pid == -1)
+        {
+        }
+        else if (display_pid == 0) /* child */
+        {
+            if (cmd->type == SESMAN_SESSION_TYPE_XVNC)
             {
+                env_set_user(cmd->username,
+                             &passwd_file,
+                             display,
+                             g_cfg->env_names,
+                             g_cfg->env_values);
             }
-            else if (display_pid == 0) /* child */
+            else
             {
-                if (type == SESMAN_SESSION_TYPE_XVNC)
-                {
-                    env_set_user(s->username,
-                                 &passwd_file,
-                                 display,
-                                 g_cfg->env_names,
-                                 g_cfg->env_values);
-                }
-                else
-                {
-                    env_set_user(s->username,
-                                 0,
-                                 display,
-                                 g_cfg->env_names,
-                                 g_cfg->env_values);
-                }
+                env_set_user(cmd->username,
+                             0,
+                             display,
+                             g_cfg->env_names,
+                             g_cfg->env_values);
+            }
 
+            session_set_xserver_env();
 
-                g_snprintf(text, 255, "%d", g_cfg->sess.max_idle_time);
-                g_setenv("XRDP_SESMAN_MAX_IDLE_TIME", text, 1);
-                g_snprintf(text, 255, "%d", g_cfg->sess.max_disc_time);
-                g_setenv("XRDP_SESMAN_MAX_DISC_TIME", text, 1);
-                g_snprintf(text, 255, "%d", g_cfg->sess.kill_disconnected);
-                g_setenv("XRDP_SESMAN_KILL_DISCONNECTED", text, 1);
-                g_setenv("XRDP_SOCKET_PATH", XRDP_SOCKET_PATH, 1);
+            /* prepare the Xauthority stuff */
+            session_get_authfile(authfile);
 
-                /* prepare the Xauthority stuff */
-                if (g_getenv("XAUTHORITY") != NULL)
-                {
-                    g_snprintf(authfile, 255, "%s", g_getenv("XAUTHORITY"));
-                }
-                else
-                {
-                    g_snprintf(authfile, 255, "%s", ".Xauthority");
-                }
+            /* Add the entry in XAUTHORITY file or exit if error */
+            if (add_xauth_cookie(display, authfile) != 0)
+            {
+                g_exit(1);
+            }
 
-                /* Add the entry in XAUTHORITY file or exit if error */
-                if (add_xauth_cookie(display, authfile) != 0)
-                {
-                    g_exit(1);
-                }
+            if (cmd->type == SESMAN_SESSION_TYPE_XORG)
+            {
+                xserver_params = session_exec_xorg(screen, authfile,
+                                                   cmd->width, cmd->height);
+            }
+            else if (cmd->type == SESMAN_SESSION_TYPE_XVNC)
+            {
+                char guid_str[64];
+                g_bytes_to_hexstr(cmd->guid, 16, guid_str, 64);
+                env_check_password_file(passwd_file, guid_str);
+                xserver_params = list_create();
+                xserver_params->auto_free = 1;
+
+                /* get path of Xvnc from config */
+                xserver = g_strdup((const char *)list_get_item(g_cfg->vnc_params, 0));
+
+                /* these are the must have parameters */
+                list_add_item(xserver_params, (tintptr)g_strdup(xserver));
+                list_add_item(xserver_params, (tintptr)g_strdup(screen));
+                list_add_item(xserver_params, (tintptr)g_strdup("-auth"));
+                list_add_item(xserver_params, (tintptr)g_strdup(authfile));
+                list_add_item(xserver_params, (tintptr)g_strdup("-geometry"));
+                list_add_item(xserver_params, (tintptr)g_strdup(geometry));
+                list_add_item(xserver_params, (tintptr)g_strdup("-depth"));
+                list_add_item(xserver_params, (tintptr)g_strdup(depth));
+                list_add_item(xserver_params, (tintptr)g_strdup("-rfbauth"));
+                list_add_item(xserver_params, (tintptr)g_strdup(passwd_file));
+
+                g_free(passwd_file);
+
+                /* additional parameters from sesman.ini file */
+                //config_read_xserver_params(SESMAN_SESSION_TYPE_XVNC,
+                //                           xserver_params);
+                list_append_list_strdup(g_cfg->vnc_params, xserver_params, 1);
+
+                /* make sure it ends with a zero */
+                list_add_item(xserver_params, 0);
+                pp1 = (char **)xserver_params->items;
+                log_message(LOG_LEVEL_INFO, "%s", dumpItemsToString(xserver_params, execvpparams, 2048));
+                g_execvp(xserver, pp1);
+            }
+            else if (cmd->type == SESMAN_SESSION_TYPE_XRDP)
+            {
+                xserver_params = list_create();
+                xserver_params->auto_free = 1;
+
+                /* get path of X11rdp from config */
+                xserver = g_strdup((const char *)list_get_item(g_cfg->rdp_params, 0));
+
+                /* these are the must have parameters */
+                list_add_item(xserver_params, (tintptr)g_strdup(xserver));
+                list_add_item(xserver_params, (tintptr)g_strdup(screen));
+                list_add_item(xserver_params, (tintptr)g_strdup("-auth"));
+                list_add_item(xserver_params, (tintptr)g_strdup(authfile));
+                list_add_item(xserver_params, (tintptr)g_strdup("-geometry"));
+                list_add_item(xserver_params, (tintptr)g_strdup(geometry));
+                list_add_item(xserver_params, (tintptr)g_strdup("-depth"));
+                list_add_item(xserver_params, (tintptr)g_strdup(depth));
+
+                /* additional parameters from sesman.ini file */
+                //config_read_xserver_params(SESMAN_SESSION_TYPE_XRDP,
+                //                           xserver_params);
+                list_append_list_strdup(g_cfg->rdp_params, xserver_params, 1);
+
+                /* make sure it ends with a zero */
+                list_add_item(xserver_params, 0);
+                pp1 = (char **)xserver_params->items;
+                log_message(LOG_LEVEL_INFO, "%s", dumpItemsToString(xserver_params, execvpparams, 2048));
+                g_execvp(xserver, pp1);
+            }
+            else
+            {
+                log_message(LOG_LEVEL_ALWAYS, "bad session type - "
+                            "user %s - pid %d", cmd->username, g_getpid());
+                g_exit(1);
+            }
 
-                if (type == SESMAN_SESSION_TYPE_XORG)
-                {
-#ifdef HAVE_SYS_PRCTL_H
-                    /*
-                     * Make sure Xorg doesn't run setuid root. Root access is not
-                     * needed. Xorg can fail when run as root and the user has no
-                     * console permissions.
-                     * PR_SET_NO_NEW_PRIVS requires Linux kernel 3.5 and newer.
-                     */
-                    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0)
-                    {
-                        log_message(LOG_LEVEL_WARNING,
-                                    "Failed to disable setuid on X server: %s",
-                                    g_get_strerror());
-                    }
-#endif
+            /* should not get here */
+            log_message(LOG_LEVEL_ALWAYS, "error starting X server "
+                        "- user %s - pid %d", cmd->username, g_getpid());
 
-                    xserver_params = list_create();
-                    xserver_params->auto_free = 1;
+            /* logging parameters */
+            log_message(LOG_LEVEL_DEBUG, "errno: %d, description: "
+                        "%s", g_get_errno(), g_get_strerror());
+            log_message(LOG_LEVEL_DEBUG, "execve parameter list size: "
+                        "%d", (xserver_params)->count);
 
-                    /* get path of Xorg from config */
-                    xserver = g_strdup((const char *)list_get_item(g_cfg->xorg_params, 0));
+            for (i = 0; i < (xserver_params->count); i++)
+            {
+                log_message(LOG_LEVEL_DEBUG, "        argv[%d] = %s",
+                            i, (char *)list_get_item(xserver_params, i));
+            }
 
-                    /* these are the must have parameters */
-                    list_add_item(xserver_params, (tintptr) g_strdup(xserver));
-                    list_add_item(xserver_params, (tintptr) g_strdup(screen));
-                    list_add_item(xserver_params, (tintptr) g_strdup("-auth"));
-                    list_add_item(xserver_params, (tintptr) g_strdup(authfile));
+            list_delete(xserver_params);
+            g_exit(1);
+        }
+        else
+        {
+            if ((wait_for_xserver(display, display_pid) == 0) &&
+                cmd->notify)
+            {
+                sig_sesman_x_ready(cmd->sesman_pid);
+            }
+            chansrv_pid = session_start_chansrv(cmd->username, display);
+            log_message(LOG_LEVEL_ALWAYS, "waiting for window manager "
+                        "(pid %d) to exit", window_manager_pid);
+            g_waitpid(window_manager_pid);
+            log_message(LOG_LEVEL_ALWAYS, "window manager (pid %d) did "
+                        "exit, cleaning up session", window_manager_pid);
+            log_message(LOG_LEVEL_INFO, "calling auth_stop_session and "
+                        "auth_end from pid %d", g_getpid());
+            auth_stop_session(data);
+            auth_end(data);
+            g_sigterm(display_pid);
+            g_sigterm(chansrv_pid);
+            cleanup_sockets(display);
+            g_deinit();
+            g_exit(0);
+        }
+    }
+    g_exit(1);
+}
 
-                    /* additional parameters from sesman.ini file */
-                    list_append_list_strdup(g_cfg->xorg_params, xserver_params, 1);
+/******************************************************************************/
+/* called in the login process once sesman sent AUTH_POOL_CMD_RECONNECT,
+   does not return */
+void
+session_run_reconnect(long data, const struct auth_pool_cmd *cmd)
+{
+    env_set_user(cmd->username,
+                 0,
+                 cmd->display,
+                 g_cfg->env_names,
+                 g_cfg->env_values);
+    auth_set_env(data);
+
+    if (g_file_exist(g_cfg->reconnect_sh))
+    {
+        g_execlp3(g_cfg->reconnect_sh, g_cfg->reconnect_sh, 0);
+    }
 
-                    /* make sure it ends with a zero */
-                    list_add_item(xserver_params, 0);
+    g_exit(0);
+}
 
-                    pp1 = (char **) xserver_params->items;
+/******************************************************************************/
+/* called with the main thread, the login process behind data becomes the
+   session process */
+static int
+session_start_login(tbus data, tui8 type, struct SCP_CONNECTION *c,
+                    struct SCP_SESSION *s)
+{
+    int display = 0;
+    int pid = 0;
+    struct session_chain *temp = (struct session_chain *)NULL;
+    struct auth_pool_cmd cmd;
+    int id;
+    int cgroup_id;
+    int notify;
+    int start_ms;
 
-                    log_message(LOG_LEVEL_INFO, "%s", dumpItemsToString(xserver_params, execvpparams, 2048));
+    /* check to limit concurrent sessions */
+    if (g_session_count >= g_cfg->sess.max_sessions)
+    {
+        log_message(LOG_LEVEL_INFO, "max concurrent session limit "
+                    "exceeded. login for user %s denied", s->username);
+        return 0;
+    }
 
-                    /* some args are passed via env vars */
-                    g_sprintf(geometry, "%d", s->width);
-                    g_setenv("XRDP_START_WIDTH", geometry, 1);
+    temp = (struct session_chain *)g_malloc(sizeof(struct session_chain), 0);
 
-                    g_sprintf(geometry, "%d", s->height);
-                    g_setenv("XRDP_START_HEIGHT", geometry, 1);
+    if (temp == 0)
+    {
+        log_message(LOG_LEVEL_ERROR, "cannot create new chain "
+                    "element - user %s", s->username);
+        return 0;
+    }
 
-                    /* fire up Xorg */
-                    g_execvp(xserver, pp1);
-                }
-                else if (type == SESMAN_SESSION_TYPE_XVNC)
-                {
-                    char guid_str[64];
-                    g_bytes_to_hexstr(s->guid, 16, guid_str, 64);
-                    env_check_password_file(passwd_file, guid_str);
-                    xserver_params = list_create();
-                    xserver_params->auto_free = 1;
-
-                    /* get path of Xvnc from config */
-                    xserver = g_strdup((const char *)list_get_item(g_cfg->vnc_params, 0));
-
-                    /* these are the must have parameters */
-                    list_add_item(xserver_params, (tintptr)g_strdup(xserver));
-                    list_add_item(xserver_params, (tintptr)g_strdup(screen));
-                    list_add_item(xserver_params, (tintptr)g_strdup("-auth"));
-                    list_add_item(xserver_params, (tintptr)g_strdup(authfile));
-                    list_add_item(xserver_params, (tintptr)g_strdup("-geometry"));
-                    list_add_item(xserver_params, (tintptr)g_strdup(geometry));
-                    list_add_item(xserver_params, (tintptr)g_strdup("-depth"));
-                    list_add_item(xserver_params, (tintptr)g_strdup(depth));
-                    list_add_item(xserver_params, (tintptr)g_strdup("-rfbauth"));
-                    list_add_item(xserver_params, (tintptr)g_strdup(passwd_file));
-
-                    g_free(passwd_file);
-
-                    /* additional parameters from sesman.ini file */
-                    //config_read_xserver_params(SESMAN_SESSION_TYPE_XVNC,
-                    //                           xserver_params);
-                    list_append_list_strdup(g_cfg->vnc_params, xserver_params, 1);
-
-                    /* make sure it ends with a zero */
-                    list_add_item(xserver_params, 0);
-                    pp1 = (char **)xserver_params->items;
-                    log_message(LOG_LEVEL_INFO, "%s", dumpItemsToString(xserver_params, execvpparams, 2048));
-                    g_execvp(xserver, pp1);
-                }
-                else if (type == SESMAN_SESSION_TYPE_XRDP)
-                {
-                    xserver_params = list_create();
-                    xserver_params->auto_free = 1;
-
-                    /* get path of X11rdp from config */
-                    xserver = g_strdup((const char *)list_get_item(g_cfg->rdp_params, 0));
-
-                    /* these are the must have parameters */
-                    list_add_item(xserver_params, (tintptr)g_strdup(xserver));
-                    list_add_item(xserver_params, (tintptr)g_strdup(screen));
-                    list_add_item(xserver_params, (tintptr)g_strdup("-auth"));
-                    list_add_item(xserver_params, (tintptr)g_strdup(authfile));
-                    list_add_item(xserver_params, (tintptr)g_strdup("-geometry"));
-                    list_add_item(xserver_params, (tintptr)g_strdup(geometry));
-                    list_add_item(xserver_params, (tintptr)g_strdup("-depth"));
-                    list_add_item(xserver_params, (tintptr)g_strdup(depth));
-
-                    /* additional parameters from sesman.ini file */
-                    //config_read_xserver_params(SESMAN_SESSION_TYPE_XRDP,
-                    //                           xserver_params);
-                    list_append_list_strdup(g_cfg->rdp_params, xserver_params, 1);
-
-                    /* make sure it ends with a zero */
-                    list_add_item(xserver_params, 0);
-                    pp1 = (char **)xserver_params->items;
-                    log_message(LOG_LEVEL_INFO, "%s", dumpItemsToString(xserver_params, execvpparams, 2048));
-                    g_execvp(xserver, pp1);
-                }
-                else
-                {
-                    log_message(LOG_LEVEL_ALWAYS, "bad session type - "
-                                "user %s - pid %d", s->username, g_getpid());
-                    g_exit(1);
-                }
+    temp->item = (struct session_item *)g_malloc(sizeof(struct session_item), 0);
 
-                /* should not get here */
-                log_message(LOG_LEVEL_ALWAYS, "error starting X server "
-                            "- user %s - pid %d", s->username, g_getpid());
+    if (temp->item == 0)
+    {
+        g_free(temp);
+        log_message(LOG_LEVEL_ERROR, "cannot create new session "
+                    "item - user %s", s->username);
+        return 0;
+    }
 
-                /* logging parameters */
-                log_message(LOG_LEVEL_DEBUG, "errno: %d, description: "
-                            "%s", g_get_errno(), g_get_strerror());
-                log_message(LOG_LEVEL_DEBUG, "execve parameter list size: "
-                            "%d", (xserver_params)->count);
+    display = session_get_avail_display_from_chain();
 
-                for (i = 0; i < (xserver_params->count); i++)
-                {
-                    log_message(LOG_LEVEL_DEBUG, "        argv[%d] = %s",
-                                i, (char *)list_get_item(xserver_params, i));
-                }
+    if (display == 0)
+    {
+        g_free(temp->item);
+        g_free(temp);
+        return 0;
+    }
 
-                list_delete(xserver_params);
-                g_exit(1);
-            }
-            else
-            {
-                wait_for_xserver(display);
-                chansrv_pid = session_start_chansrv(s->username, display);
-                log_message(LOG_LEVEL_ALWAYS, "waiting for window manager "
-                            "(pid %d) to exit", window_manager_pid);
-                g_waitpid(window_manager_pid);
-                log_message(LOG_LEVEL_ALWAYS, "window manager (pid %d) did "
-                            "exit, cleaning up session", window_manager_pid);
-                log_message(LOG_LEVEL_INFO, "calling auth_stop_session and "
-                            "auth_end from pid %d", g_getpid());
-                auth_stop_session(data);
-                auth_end(data);
-                g_sigterm(display_pid);
-                g_sigterm(chansrv_pid);
-                cleanup_sockets(display);
-                g_deinit();
-                g_exit(0);
-            }
-        }
+    id = ++g_session_id;
+    cgroup_id = cgroup_session_create(id) == 0 ? id : 0;
+    notify = sig_sesman_fd_active();
+    start_ms = g_time3();
+    pid = auth_pool_login_pid(data);
+    /* before pam, pam_systemd moves the login process to the session scope
+       logind tracks and that has to stay where it put it */
+    cgroup_session_attach(cgroup_id, pid);
+
+    g_memset(&cmd, 0, sizeof(cmd));
+    cmd.cmd = AUTH_POOL_CMD_START;
+    cmd.type = type;
+    cmd.display = display;
+    cmd.width = s->width;
+    cmd.height = s->height;
+    cmd.bpp = s->bpp;
+    cmd.notify = notify;
+    cmd.sesman_pid = g_pid;
+    g_memcpy(cmd.guid, s->guid, 16);
+    g_strncpy(cmd.username, s->username, 255);
+    if (s->directory != 0)
+    {
+        g_strncpy(cmd.directory, s->directory, 511);
+    }
+    if (s->program != 0)
+    {
+        g_strncpy(cmd.program, s->program, 511);
+    }
+
+    if (auth_pool_send_cmd(data, &cmd) != 0)
+    {
+        log_message(LOG_LEVEL_ERROR, "login process %d for user %s is gone",
+                    pid, s->username);
+        cgroup_session_remove(cgroup_id);
+        display = 0;
     }
     else
     {
         temp->item->pid = pid;
         temp->item->display = display;
+        temp->item->cgroup_id = cgroup_id;
         temp->item->width = s->width;
         temp->item->height = s->height;
         temp->item->bpp = s->bpp;
-        temp->item->data = data;
         g_strncpy(temp->item->client_ip, s->client_ip, 255);   /* store client ip data */
         g_strncpy(temp->item->name, s->username, 255);
         g_memcpy(temp->item->guid, s->guid, 16);
 
-        ltime = g_time1();
-        localtime_r(&ltime, &stime);
-        temp->item->connect_time.year = (tui16)(stime.tm_year + 1900);
-        temp->item->connect_time.month = (tui8)(stime.tm_mon + 1);
-        temp->item->connect_time.day = (tui8)stime.tm_mday;
-        temp->item->connect_time.hour = (tui8)stime.tm_hour;
-        temp->item->connect_time.minute = (tui8)stime.tm_min;
+        session_set_date(&(temp->item->connect_time));
         zero_time(&(temp->item->disconnect_time));
         zero_time(&(temp->item->idle_time));
 
         temp->item->type = type;
-        temp->item->status = SESMAN_SESSION_STATUS_ACTIVE;
-
-        temp->next = g_sessions;
-        g_sessions = temp;
-        g_session_count++;
+        temp->item->id = id;
+        temp->item->start_ms = start_ms;
+        temp->item->start_latency = -1;
+        temp->item->hibernated = 0;
+        temp->item->state = 0;
+        /* without the signal from the session process there is no telling
+           when X is up */
+        session_set_state(temp->item, notify ?
+                          SESMAN_SESSION_STATE_STARTING :
+                          SESMAN_SESSION_STATE_RUNNING);
+
+        lock_chain_acquire();
+        session_chain_add(temp);
+        lock_chain_release();
+        session_display_set_used(display, 1);
 
         return display;
     }
@@ -867,32 +1381,39 @@ session_start_fork(tbus data, tui8 type, struct SCP_CONNECTION *c,
 }
 
 /******************************************************************************/
-/* called with the main thread */
+/* called with the main thread, the login process behind data runs the
+   reconnect script */
 static int
-session_reconnect_fork(int display, char *username, long data)
+session_reconnect_login(int display, char *username, long data)
 {
-    int pid;
+    struct session_chain *tmp;
+    struct auth_pool_cmd cmd;
 
-    pid = g_fork();
+    g_memset(&cmd, 0, sizeof(cmd));
+    cmd.cmd = AUTH_POOL_CMD_RECONNECT;
+    cmd.display = display;
+    g_strncpy(cmd.username, username, 255);
 
-    if (pid == -1)
+    if (auth_pool_send_cmd(data, &cmd) != 0)
     {
+        log_message(LOG_LEVEL_ERROR, "login process %d for user %s is gone",
+                    auth_pool_login_pid(data), username);
     }
-    else if (pid == 0)
+    else
     {
-        env_set_user(username,
-                     0,
-                     display,
-                     g_cfg->env_names,
-                     g_cfg->env_values);
-        auth_set_env(data);
+        /* back to running without waiting for the next client check */
+        lock_chain_acquire();
 
-        if (g_file_exist(g_cfg->reconnect_sh))
+        for (tmp = g_sessions; tmp != 0; tmp = tmp->next)
         {
-            g_execlp3(g_cfg->reconnect_sh, g_cfg->reconnect_sh, 0);
+            if ((tmp->item->display == display) &&
+                (tmp->item->state == SESMAN_SESSION_STATE_DISCONNECTED))
+            {
+                session_set_state(tmp->item, SESMAN_SESSION_STATE_RUNNING);
+            }
         }
 
-        g_exit(0);
+        lock_chain_release();
     }
 
     return display;
@@ -905,7 +1426,20 @@ int
 session_start(long data, tui8 type, struct SCP_CONNECTION *c,
               struct SCP_SESSION *s)
 {
-    return session_start_fork(data, type, c, s);
+    int display;
+
+    lock_sync_acquire();
+    g_sync_data = data;
+    g_sync_type = type;
+    g_sync_c = c;
+    g_sync_s = s;
+    g_sync_display = 0;
+    g_sync_username = 0;
+    g_set_wait_obj(g_sync_event);
+    lock_sync_sem_acquire();
+    display = g_sync_result;
+    lock_sync_release();
+    return display;
 }
 
 /******************************************************************************/
@@ -914,7 +1448,42 @@ session_start(long data, tui8 type, struct SCP_CONNECTION *c,
 int
 session_reconnect(int display, char *username, long data)
 {
-    return session_reconnect_fork(display, username, data);
+    int rv;
+
+    lock_sync_acquire();
+    g_sync_data = data;
+    g_sync_type = 0;
+    g_sync_c = 0;
+    g_sync_s = 0;
+    g_sync_display = display;
+    g_sync_username = username;
+    g_set_wait_obj(g_sync_event);
+    lock_sync_sem_acquire();
+    rv = g_sync_result;
+    lock_sync_release();
+    return rv;
+}
+
+/******************************************************************************/
+/* called with the main thread when g_sync_event is set, hands the login
+   process of the waiting scp thread its command and wakes the thread up */
+int
+session_sync_start(void)
+{
+    if (g_sync_display == 0)
+    {
+        g_sync_result = session_start_login(g_sync_data, g_sync_type,
+                                            g_sync_c, g_sync_s);
+    }
+    else
+    {
+        g_sync_result = session_reconnect_login(g_sync_display,
+                                                g_sync_username,
+                                                g_sync_data);
+    }
+
+    lock_sync_sem_release();
+    return 0;
 }
 
 /******************************************************************************/
@@ -922,60 +1491,293 @@ int
 session_kill(int pid)
 {
     struct session_chain *tmp;
-    struct session_chain *prev;
 
-    tmp = g_sessions;
-    prev = 0;
+    lock_chain_acquire();
+    tmp = session_chain_find_pid(pid);
 
-    while (tmp != 0)
+    if (tmp == 0)
     {
-        if (tmp->item == 0)
+        lock_chain_release();
+        return SESMAN_SESSION_KILL_NOTFOUND;
+    }
+
+    /* deleting the session */
+    log_message(LOG_LEVEL_INFO, "++ terminated session:  id %d, username %s, display :%d.0, session_pid %d, ip %s", tmp->item->id, tmp->item->name, tmp->item->display, tmp->item->pid, tmp->item->client_ip);
+    session_chain_remove(tmp);
+    lock_chain_release();
+    session_display_set_used(tmp->item->display, 0);
+    cgroup_session_remove(tmp->item->cgroup_id);
+    g_free(tmp->item);
+    g_free(tmp);
+    return SESMAN_SESSION_KILL_OK;
+}
+
+/******************************************************************************/
+void
+session_x_ready(int pid)
+{
+    struct session_chain *tmp;
+
+    lock_chain_acquire();
+    tmp = session_chain_find_pid(pid);
+
+    if ((tmp != 0) && (tmp->item->state == SESMAN_SESSION_STATE_STARTING))
+    {
+        tmp->item->start_latency = g_time3() - tmp->item->start_ms;
+        session_set_state(tmp->item, SESMAN_SESSION_STATE_RUNNING);
+    }
+
+    lock_chain_release();
+}
+
+/******************************************************************************/
+/* one line of /proc/net/unix, an accepted connection shows the path of the
+   listening socket it came from */
+static void
+session_client_line(const char *line, tui32 *connected)
+{
+    const char *fields[8];
+    int count;
+    int display;
+    int len;
+
+    /* Num RefCount Protocol Flags Type St Inode Path */
+    count = 0;
+
+    while (count < 8)
+    {
+        while (*line == ' ')
         {
-            log_message(LOG_LEVEL_ERROR, "session descriptor for "
-                        "pid %d is null!", pid);
+            line++;
+        }
 
-            if (prev == 0)
-            {
-                /* prev does no exist, so it's the first element - so we set
-                   g_sessions */
-                g_sessions = tmp->next;
-            }
-            else
-            {
-                prev->next = tmp->next;
-            }
+        if (*line == 0)
+        {
+            return;
+        }
 
-            return SESMAN_SESSION_KILL_NULLITEM;
+        fields[count++] = line;
+
+        while ((*line != ' ') && (*line != 0))
+        {
+            line++;
         }
+    }
 
-        if (tmp->item->pid == pid)
+    /* St 03 is connected, the listening socket is 01 */
+    if (g_strncmp(fields[5], "03 ", 3) != 0)
+    {
+        return;
+    }
+
+    len = g_strlen(SESSION_X11RDP_PREFIX);
+
+    if (g_strncmp(fields[7], SESSION_X11RDP_PREFIX, len) != 0)
+    {
+        return;
+    }
+
+    display = g_atoi(fields[7] + len);
+
+    if ((display > 0) && (display < g_display_words * 32))
+    {
+        connected[display >> 5] |= (tui32)1 << (display & 31);
+    }
+}
+
+/******************************************************************************/
+/* sets the bit of every display xrdp is connected to
+   returns error */
+static int
+session_read_clients(tui32 *connected)
+{
+    char text[4096];
+    char *line;
+    char *eol;
+    int fd;
+    int len;
+    int have;
+    int index;
+
+    fd = g_file_open_ex("/proc/net/unix", 1, 0, 0, 0);
+
+    if (fd < 0)
+    {
+        return 1;
+    }
+
+    have = 0;
+
+    while ((len = g_file_read(fd, text + have,
+                              sizeof(text) - 1 - have)) > 0)
+    {
+        have += len;
+        text[have] = 0;
+        line = text;
+
+        while ((eol = (char *) g_strchr(line, '\n')) != 0)
         {
-            /* deleting the session */
-            log_message(LOG_LEVEL_INFO, "++ terminated session:  username %s, display :%d.0, session_pid %d, ip %s", tmp->item->name, tmp->item->display, tmp->item->pid, tmp->item->client_ip);
-            g_free(tmp->item);
+            *eol = 0;
+            session_client_line(line, connected);
+            line = eol + 1;
+        }
 
-            if (prev == 0)
-            {
-                /* prev does no exist, so it's the first element - so we set
-                   g_sessions */
-                g_sessions = tmp->next;
-            }
-            else
-            {
-                prev->next = tmp->next;
-            }
+        /* keep the partial last line, the copy can overlap */
+        have -= (int) (line - text);
 
-            g_free(tmp);
-            g_session_count--;
-            return SESMAN_SESSION_KILL_OK;
+        for (index = 0; index < have; index++)
+        {
+            text[index] = line[index];
         }
 
-        /* go on */
-        prev = tmp;
-        tmp = tmp->next;
+        if (have == sizeof(text) - 1)
+        {
+            /* a line that long is not one of ours */
+            have = 0;
+        }
+    }
+
+    g_file_close(fd);
+    return 0;
+}
+
+/******************************************************************************/
+/* reclaims the memory of one session, memory.reclaim takes long enough to
+   hold up logins so not on the main thread, the session may wake up or
+   end meanwhile
+   nothing keeps the memory from growing back, a limit would throttle
+   whatever still runs in the disconnected session */
+static THREAD_RV THREAD_CC
+session_hibernate_thread(void *arg)
+{
+    struct session_chain *tmp;
+    tui64 before;
+    tui64 after;
+    int pid;
+    int id;
+    int rv;
+
+    pid = (int) (tintptr) arg;
+    sig_sesman_thread_block();
+    lock_chain_acquire();
+    tmp = session_chain_find_pid(pid);
+    id = ((tmp != 0) && tmp->item->hibernated) ? tmp->item->cgroup_id : 0;
+    lock_chain_release();
+
+    rv = cgroup_session_reclaim(id, &before, &after);
+
+    lock_chain_acquire();
+    tmp = session_chain_find_pid(pid);
+    if ((rv == 0) && (tmp != 0))
+    {
+        log_message(LOG_LEVEL_INFO, "session %d hibernated, memory %llu KiB "
+                    "-> %llu KiB", tmp->item->id,
+                    (unsigned long long) (before / 1024),
+                    (unsigned long long) (after / 1024));
+    }
+    g_hibernating = 0;
+    lock_chain_release();
+    return 0;
+}
+
+/******************************************************************************/
+int
+session_check_clients(void)
+{
+    struct session_chain *tmp;
+    struct session_item *item;
+    tui32 *connected;
+    int hibernate;
+    int limit;
+    int now;
+    int display;
+    int bit;
+
+    if (g_check_disabled || (g_sessions == 0))
+    {
+        return -1;
+    }
+
+    now = g_time3();
+
+    if (now - g_check_next < 0)
+    {
+        return g_check_next - now;
+    }
+
+    g_check_next = now + SESSION_CHECK_MS;
+    connected = g_new0(tui32, g_display_words);
+
+    if (connected == 0)
+    {
+        return SESSION_CHECK_MS;
     }
 
-    return SESMAN_SESSION_KILL_NOTFOUND;
+    if (session_read_clients(connected) != 0)
+    {
+        log_message(LOG_LEVEL_INFO, "cannot read /proc/net/unix, sessions "
+                    "are not marked disconnected");
+        g_check_disabled = 1;
+        g_free(connected);
+        return -1;
+    }
+
+    now = g_time1();
+    limit = g_cfg->sess.hibernate_time;
+    hibernate = 0;
+    lock_chain_acquire();
+
+    for (tmp = g_sessions; tmp != 0; tmp = tmp->next)
+    {
+        item = tmp->item;
+
+        if ((item->type != SESMAN_SESSION_TYPE_XORG) &&
+            (item->type != SESMAN_SESSION_TYPE_XRDP))
+        {
+            /* only the xorgxrdp and X11rdp X servers have the xrdp_display
+               socket, an Xvnc client is not seen so it stays running */
+            continue;
+        }
+
+        display = item->display;
+        bit = (connected[display >> 5] >> (display & 31)) & 1;
+
+        if ((item->state == SESMAN_SESSION_STATE_RUNNING) && !bit &&
+            (now - item->state_time >= SESSION_CHECK_MS / 1000))
+        {
+            /* given a check interval to connect after X came up */
+            session_set_state(item, SESMAN_SESSION_STATE_DISCONNECTED);
+        }
+        else if ((item->state == SESMAN_SESSION_STATE_DISCONNECTED) && bit)
+        {
+            session_set_state(item, SESMAN_SESSION_STATE_RUNNING);
+        }
+        else if ((item->state == SESMAN_SESSION_STATE_DISCONNECTED) &&
+                 (limit > 0) && !item->hibernated &&
+                 (item->cgroup_id != 0) && !g_hibernating &&
+                 (now - item->state_time >= limit))
+        {
+            /* one at a time, the others wait for a later check */
+            item->hibernated = 1;
+            g_hibernating = 1;
+            hibernate = item->pid;
+        }
+    }
+
+    lock_chain_release();
+    g_free(connected);
+
+    if ((hibernate != 0) &&
+            (tc_thread_create(session_hibernate_thread,
+                              (void *) (tintptr) hibernate) != 0))
+    {
+        log_message(LOG_LEVEL_ERROR, "error creating hibernate thread");
+        lock_chain_acquire();
+        g_hibernating = 0;
+        lock_chain_release();
+    }
+
+    return SESSION_CHECK_MS;
 }
 
 /******************************************************************************/
@@ -984,6 +1786,7 @@ session_sigkill_all(void)
 {
     struct session_chain *tmp;
 
+    lock_chain_acquire();
     tmp = g_sessions;
 
     while (tmp != 0)
@@ -995,12 +1798,15 @@ session_sigkill_all(void)
         }
         else
         {
+            session_set_state(tmp->item, SESMAN_SESSION_STATE_TERMINATING);
             g_sigterm(tmp->item->pid);
         }
 
         /* go on */
         tmp = tmp->next;
     }
+
+    lock_chain_release();
 }
 
 /******************************************************************************/
@@ -1018,28 +1824,17 @@ session_get_bypid(int pid)
         return 0;
     }
 
-    tmp = g_sessions;
+    lock_chain_acquire();
+    tmp = session_chain_find_pid(pid);
 
-    while (tmp != 0)
+    if (tmp != 0)
     {
-        if (tmp->item == 0)
-        {
-            log_message(LOG_LEVEL_ERROR, "session descriptor for "
-                        "pid %d is null!", pid);
-            g_free(dummy);
-            return 0;
-        }
-
-        if (tmp->item->pid == pid)
-        {
-            g_memcpy(dummy, tmp->item, sizeof(struct session_item));
-            return dummy;
-        }
-
-        /* go on */
-        tmp = tmp->next;
+        g_memcpy(dummy, tmp->item, sizeof(struct session_item));
+        lock_chain_release();
+        return dummy;
     }
 
+    lock_chain_release();
     g_free(dummy);
     return 0;
 }
@@ -1055,7 +1850,9 @@ session_get_byuser(const char *user, int *cnt, unsigned char flags)
 
     count = 0;
 
-    tmp = g_sessions;
+    lock_chain_acquire();
+    /* a user's sessions share a bucket, everything else is skipped */
+    tmp = (user == NULL) ? g_sessions : g_user_hash[session_hash_user(user)];
 
     while (tmp != 0)
     {
@@ -1074,11 +1871,12 @@ session_get_byuser(const char *user, int *cnt, unsigned char flags)
         }
 
         /* go on */
-        tmp = tmp->next;
+        tmp = (user == NULL) ? tmp->next : tmp->user_next;
     }
 
     if (count == 0)
     {
+        lock_chain_release();
         (*cnt) = 0;
         return 0;
     }
@@ -1088,11 +1886,12 @@ session_get_byuser(const char *user, int *cnt, unsigned char flags)
 
     if (sess == 0)
     {
+        lock_chain_release();
         (*cnt) = 0;
         return 0;
     }
 
-    tmp = g_sessions;
+    tmp = (user == NULL) ? g_sessions : g_user_hash[session_hash_user(user)];
     index = 0;
 
     while (tmp != 0)
@@ -1137,13 +1936,117 @@ session_get_byuser(const char *user, int *cnt, unsigned char flags)
         }
 
         /* go on */
-        tmp = tmp->next;
+        tmp = (user == NULL) ? tmp->next : tmp->user_next;
     }
 
+    lock_chain_release();
     (*cnt) = count;
     return sess;
 }
 
+/******************************************************************************/
+struct session_item *
+session_get_all(int *cnt)
+{
+    struct session_chain *tmp;
+    struct session_item *items;
+    int count;
+    int index;
+
+    (*cnt) = 0;
+    lock_chain_acquire();
+    count = 0;
+
+    for (tmp = g_sessions; tmp != 0; tmp = tmp->next)
+    {
+        count++;
+    }
+
+    items = 0;
+
+    if (count > 0)
+    {
+        items = g_new(struct session_item, count);
+    }
+
+    if (items == 0)
+    {
+        lock_chain_release();
+        return 0;
+    }
+
+    index = 0;
+
+    for (tmp = g_sessions; tmp != 0; tmp = tmp->next)
+    {
+        g_memcpy(items + index, tmp->item, sizeof(struct session_item));
+        index++;
+    }
+
+    lock_chain_release();
+    (*cnt) = count;
+    return items;
+}
+
+/******************************************************************************/
+struct SCP_SESSION_USAGE *
+session_get_usage(int *cnt)
+{
+    struct session_chain *tmp;
+    struct SCP_SESSION_USAGE *usage;
+    int *ids;
+    int count;
+    int index;
+
+    (*cnt) = 0;
+    lock_chain_acquire();
+    count = 0;
+
+    for (tmp = g_sessions; tmp != 0; tmp = tmp->next)
+    {
+        count++;
+    }
+
+    if (count == 0)
+    {
+        lock_chain_release();
+        return 0;
+    }
+
+    usage = g_new0(struct SCP_SESSION_USAGE, count);
+    ids = g_new0(int, count);
+
+    if ((usage == 0) || (ids == 0))
+    {
+        lock_chain_release();
+        g_free(usage);
+        g_free(ids);
+        return 0;
+    }
+
+    index = 0;
+
+    for (tmp = g_sessions; tmp != 0; tmp = tmp->next)
+    {
+        usage[index].SID = tmp->item->pid;
+        ids[index] = tmp->item->cgroup_id;
+        index++;
+    }
+
+    lock_chain_release();
+
+    /* the cgroup files are read without holding up the session list */
+    for (index = 0; index < count; index++)
+    {
+        cgroup_session_usage(ids[index], &(usage[index].cpu_usec),
+                             &(usage[index].mem_bytes));
+    }
+
+    g_free(ids);
+    (*cnt) = count;
+    return usage;
+}
+
 /******************************************************************************/
 int
 cleanup_sockets(int display)
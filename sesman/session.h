@@ -42,6 +42,12 @@
 */
 #define SESMAN_SESSION_STATUS_ALL           0xFF
 
+/* life of a session, moved along by the sesman main loop only */
+#define SESMAN_SESSION_STATE_STARTING     1 /* started, X server not up yet */
+#define SESMAN_SESSION_STATE_RUNNING      2 /* a client is connected */
+#define SESMAN_SESSION_STATE_DISCONNECTED 3 /* X server up, no client */
+#define SESMAN_SESSION_STATE_TERMINATING  4 /* sent SIGTERM, not reaped */
+
 #define SESMAN_SESSION_KILL_OK        0
 #define SESMAN_SESSION_KILL_NULLITEM  1
 #define SESMAN_SESSION_KILL_NOTFOUND  2
@@ -60,16 +66,22 @@ struct session_date
 struct session_item
 {
   char name[256];
-  int pid; /* pid of sesman waiting for wm to end */
+  int id; /* stays the same for the life of the sesman process */
+  int pid; /* pid of the login process waiting for wm to end */
   int display;
   int width;
   int height;
   int bpp;
-  long data;
 
   /* status info */
-  unsigned char status;
+  unsigned char status; /* follows state, for scp */
   unsigned char type;
+  int state; /* see SESMAN_SESSION_STATE_* */
+  int state_time; /* g_time1() when state was entered */
+  int start_ms; /* g_time3() at the start */
+  int start_latency; /* ms from the start till X was up, -1 till then */
+  int hibernated; /* memory reclaimed, lifted when it leaves disconnected */
+  int cgroup_id; /* id for the cgroup calls, 0 if it has no cgroup */
 
   /* time data  */
   struct session_date connect_time;
@@ -79,16 +91,21 @@ struct session_item
   tui8 guid[16];
 };
 
+#define SESMAN_SESSION_HASH_SIZE 1024 /* must be a power of 2 */
+
 struct session_chain
 {
   struct session_chain* next;
+  struct session_chain* prev;
+  struct session_chain* pid_next; /* same pid hash */
+  struct session_chain* user_next; /* same user name hash */
   struct session_item* item;
 };
 
 /**
  *
  * @brief finds a session matching the supplied parameters
- * @return session data or 0
+ * @return a copy of the session data, to be freed by the caller, or 0
  *
  */
 struct session_item*
@@ -111,6 +128,32 @@ session_start(long data, tui8 type, struct SCP_CONNECTION *c,
 int
 session_reconnect(int display, char *username, long data);
 
+/**
+ *
+ * @brief starts the session an scp thread asked for, called by the main
+ *        thread when g_sync_event is set
+ * @return 0
+ *
+ */
+int
+session_sync_start(void);
+
+/**
+ *
+ * @brief runs the session in the login process, does not return
+ *
+ */
+void
+session_run(long data, const struct auth_pool_cmd *cmd);
+
+/**
+ *
+ * @brief runs the reconnect script in the login process, does not return
+ *
+ */
+void
+session_run_reconnect(long data, const struct auth_pool_cmd *cmd);
+
 /**
  *
  * @brief kills a session
@@ -130,6 +173,27 @@ session_kill(int pid);
 void
 session_sigkill_all(void);
 
+/**
+ *
+ * @brief moves a starting session to running once its X server is up,
+ *        called by the main loop
+ * @param pid the session pid
+ *
+ */
+void
+session_x_ready(int pid);
+
+/**
+ *
+ * @brief looks for the xrdp connection of each Xorg and X11rdp session and
+ *        moves it between running and disconnected, called by the main
+ *        loop, other session types are left alone
+ * @return milliseconds till it wants to be called again, -1 for never
+ *
+ */
+int
+session_check_clients(void);
+
 /**
  *
  * @brief retrieves a session's descriptor
@@ -150,6 +214,26 @@ session_get_bypid(int pid);
 struct SCP_DISCONNECTED_SESSION*
 session_get_byuser(const char *user, int *cnt, unsigned char flags);
 
+/**
+ *
+ * @brief copies every session
+ * @param cnt number of entries returned
+ * @return an array to g_free, NULL when there are no sessions
+ *
+ */
+struct session_item*
+session_get_all(int *cnt);
+
+/**
+ *
+ * @brief retrieves the cpu and memory use of every session
+ * @param cnt number of entries returned
+ * @return an array to g_free, NULL when there are no sessions
+ *
+ */
+struct SCP_SESSION_USAGE*
+session_get_usage(int *cnt);
+
 /**
  *
  * @brief delete socket files
@@ -29,6 +29,9 @@
 #endif
 
 #include <signal.h>
+#if defined(HAVE_SYS_SIGNALFD_H)
+#include <sys/signalfd.h>
+#endif
 
 #include "sesman.h"
 
@@ -36,6 +39,18 @@ extern int g_sck;
 extern int g_pid;
 extern struct config_sesman *g_cfg; /* in sesman.c */
 extern tbus g_term_event;
+extern tbus g_reload_event;
+extern tbus g_sigchld_event;
+
+/* a session process telling its X server is up, queued so that several
+   coming up at once are not merged into one like SIGUSR1 would be */
+#if defined(HAVE_SYS_SIGNALFD_H)
+#define SIG_SESMAN_X_READY SIGRTMIN
+#endif
+
+/* signals come in through this when signalfd is there, -1 otherwise */
+static int g_sig_fd = -1;
+static tbus g_sig_obj = 0;
 
 /******************************************************************************/
 void
@@ -53,10 +68,9 @@ sig_sesman_shutdown(int sig)
 
     LOG_DBG(" - getting signal %d pid %d", sig, g_getpid());
 
+    /* the main loop terminates the sessions, it owns the session list */
     g_set_wait_obj(g_term_event);
 
-    session_sigkill_all();
-
     g_snprintf(pid_file, 255, "%s/xrdp-sesman.pid", XRDP_PID_PATH);
     g_file_delete(pid_file);
 }
@@ -65,10 +79,6 @@ sig_sesman_shutdown(int sig)
 void
 sig_sesman_reload_cfg(int sig)
 {
-    int error;
-    struct config_sesman *cfg;
-    char cfg_file[256];
-
     log_message(LOG_LEVEL_WARNING, "receiving SIGHUP %d", 1);
 
     if (g_getpid() != g_pid)
@@ -77,6 +87,18 @@ sig_sesman_reload_cfg(int sig)
         return;
     }
 
+    /* scp threads read g_cfg, the main loop reloads once they are done */
+    g_set_wait_obj(g_reload_event);
+}
+
+/******************************************************************************/
+void
+sig_sesman_reload_cfg_sync(void)
+{
+    int error;
+    struct config_sesman *cfg;
+    char cfg_file[256];
+
     cfg = g_new0(struct config_sesman, 1);
 
     if (0 == cfg)
@@ -128,78 +150,154 @@ sig_sesman_reload_cfg(int sig)
 void
 sig_sesman_session_end(int sig)
 {
-    int pid;
-
     if (g_getpid() != g_pid)
     {
         return;
     }
 
+    /* session_kill takes the session list lock, leave it to the main loop */
+    g_set_wait_obj(g_sigchld_event);
+}
+
+/******************************************************************************/
+void
+sig_sesman_session_end_sync(void)
+{
+    int pid;
+
+    /* one SIGCHLD can stand for several children */
     pid = g_waitchild();
 
-    if (pid > 0)
+    while (pid > 0)
     {
         session_kill(pid);
+        pid = g_waitchild();
     }
 }
 
 /******************************************************************************/
-void *
-sig_handler_thread(void *arg)
+static void
+sig_sesman_mask(sigset_t *sigmask)
+{
+    sigemptyset(sigmask);
+    sigaddset(sigmask, SIGHUP);
+    sigaddset(sigmask, SIGCHLD);
+    sigaddset(sigmask, SIGTERM);
+    sigaddset(sigmask, SIGINT);
+#if defined(SIG_SESMAN_X_READY)
+    sigaddset(sigmask, SIG_SESMAN_X_READY);
+#endif
+}
+
+/******************************************************************************/
+void
+sig_sesman_thread_block(void)
+{
+    sigset_t sigmask;
+
+    /* so the handlers above always run on the main thread */
+    sig_sesman_mask(&sigmask);
+    pthread_sigmask(SIG_BLOCK, &sigmask, 0);
+}
+
+/******************************************************************************/
+tbus
+sig_sesman_fd_init(void)
 {
-    int recv_signal;
+#if defined(HAVE_SYS_SIGNALFD_H)
     sigset_t sigmask;
-    sigset_t oldmask;
-    sigset_t waitmask;
-
-    /* mask signals to be able to wait for them... */
-    sigfillset(&sigmask);
-    /* it is a good idea not to block SIGILL SIGSEGV */
-    /* SIGFPE -- see sigaction(2) NOTES              */
-    pthread_sigmask(SIG_BLOCK, &sigmask, &oldmask);
-
-    /* building the signal wait mask... */
-    sigemptyset(&waitmask);
-    sigaddset(&waitmask, SIGHUP);
-    sigaddset(&waitmask, SIGCHLD);
-    sigaddset(&waitmask, SIGTERM);
-    sigaddset(&waitmask, SIGINT);
-
-    //  sigaddset(&waitmask, SIGFPE);
-    //  sigaddset(&waitmask, SIGILL);
-    //  sigaddset(&waitmask, SIGSEGV);
-
-    do
+
+    /* called before any thread is started so they all inherit the mask */
+    sig_sesman_mask(&sigmask);
+    sigprocmask(SIG_BLOCK, &sigmask, 0);
+    g_sig_fd = signalfd(-1, &sigmask, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    if (g_sig_fd < 0)
+    {
+        log_message(LOG_LEVEL_WARNING, "signalfd failed, using signal "
+                    "handlers");
+        sigprocmask(SIG_UNBLOCK, &sigmask, 0);
+        return 0;
+    }
+
+    g_sig_obj = g_create_wait_obj_from_socket(g_sig_fd, 0);
+    return g_sig_obj;
+#else
+    return 0;
+#endif
+}
+
+/******************************************************************************/
+int
+sig_sesman_fd_active(void)
+{
+    return g_sig_fd >= 0;
+}
+
+/******************************************************************************/
+void
+sig_sesman_x_ready(int pid)
+{
+#if defined(SIG_SESMAN_X_READY)
+    union sigval value;
+
+    value.sival_int = 0;
+
+    if (sigqueue(pid, SIG_SESMAN_X_READY, value) != 0)
+    {
+        log_message(LOG_LEVEL_WARNING, "cannot tell sesman %d the X server "
+                    "is up: %s", pid, g_get_strerror());
+    }
+#endif
+}
+
+/******************************************************************************/
+int
+sig_sesman_fd_sync(void)
+{
+#if defined(HAVE_SYS_SIGNALFD_H)
+    struct signalfd_siginfo info;
+    int reap;
+    int reload;
+
+    reap = 0;
+    reload = 0;
+
+    while (g_file_read(g_sig_fd, (char *) &info, sizeof(info)) ==
+           sizeof(info))
     {
-        LOG_DBG("calling sigwait()");
-        sigwait(&waitmask, &recv_signal);
+        /* not a constant, cannot be a case */
+        if ((int) info.ssi_signo == SIG_SESMAN_X_READY)
+        {
+            session_x_ready((int) info.ssi_pid);
+            continue;
+        }
 
-        switch (recv_signal)
+        switch (info.ssi_signo)
         {
-            case SIGHUP:
-                //reload cfg
-                //we must stop & restart logging, or copy logging cfg!!!!
-                LOG_DBG("sesman received SIGHUP");
-                //return 0;
-                break;
             case SIGCHLD:
-                /* a session died */
-                LOG_DBG("sesman received SIGCHLD");
-                sig_sesman_session_end(SIGCHLD);
+                /* reaped once below, one SIGCHLD can stand for several */
+                reap = 1;
                 break;
-            case SIGINT:
-                /* we die */
-                LOG_DBG("sesman received SIGINT");
-                sig_sesman_shutdown(recv_signal);
+            case SIGHUP:
+                reload = 1;
                 break;
+            case SIGINT:
             case SIGTERM:
-                /* we die */
-                LOG_DBG("sesman received SIGTERM");
-                sig_sesman_shutdown(recv_signal);
-                break;
+                sig_sesman_shutdown((int) info.ssi_signo);
+                return 1;
         }
     }
-    while (1);
 
+    if (reap)
+    {
+        sig_sesman_session_end_sync();
+    }
+
+    if (reload)
+    {
+        sig_sesman_reload_cfg((int) SIGHUP);
+    }
+#endif
     return 0;
 }
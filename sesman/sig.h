@@ -45,6 +45,15 @@ sig_sesman_shutdown(int sig);
 void
 sig_sesman_reload_cfg(int sig);
 
+/**
+ *
+ * @brief reloads the configuration, called by the main loop after SIGHUP
+ *        once no scp thread is running
+ *
+ */
+void
+sig_sesman_reload_cfg_sync(void);
+
 /**
  *
  * @brief SIGCHLD handling code
@@ -56,10 +65,56 @@ sig_sesman_session_end(int sig);
 
 /**
  *
- * @brief signal handling thread
+ * @brief reaps the sessions that ended, called by the main loop after SIGCHLD
+ *
+ */
+void
+sig_sesman_session_end_sync(void);
+
+/**
+ *
+ * @brief blocks the sesman signals in the calling thread
+ *
+ */
+void
+sig_sesman_thread_block(void);
+
+/**
+ *
+ * @brief blocks the sesman signals and opens a signalfd for them, called
+ *        before any thread is started
+ * @return wait object for the main loop, 0 if the signal handlers must
+ *         be used
+ *
+ */
+tbus
+sig_sesman_fd_init(void);
+
+/**
+ *
+ * @brief tells whether signals come through the signalfd
+ *
+ */
+int
+sig_sesman_fd_active(void);
+
+/**
+ *
+ * @brief called by a session process once its X server is up, seen by
+ *        sig_sesman_fd_sync in sesman
+ *
+ */
+void
+sig_sesman_x_ready(int pid);
+
+/**
+ *
+ * @brief handles the signals read from the signalfd, called by the main
+ *        loop
+ * @return 1 when sesman is shutting down
  *
  */
-void*
-sig_handler_thread(void* arg);
+int
+sig_sesman_fd_sync(void);
 
 #endif
@@ -40,6 +40,7 @@ char port[257];
 struct log_config logging;
 
 void cmndList(struct SCP_CONNECTION *c);
+void cmndUsage(struct SCP_CONNECTION *c);
 void cmndKill(struct SCP_CONNECTION *c, struct SCP_SESSION *s);
 void cmndHelp(void);
 
@@ -164,6 +165,10 @@ int main(int argc, char **argv)
     {
         cmndList(c);
     }
+    else if (0 == g_strncmp(cmnd, "usage", 6))
+    {
+        cmndUsage(c);
+    }
     else if (0 == g_strncmp(cmnd, "kill:", 5))
     {
         cmndKill(c, s);
@@ -188,6 +193,7 @@ void cmndHelp(void)
     fprintf(stderr, "-c=<command> : command to execute on the server [MANDATORY]\n");
     fprintf(stderr, "               it can be one of those:\n");
     fprintf(stderr, "               list\n");
+    fprintf(stderr, "               usage\n");
     fprintf(stderr, "               kill:<sid>\n");
 }
 
@@ -235,6 +241,40 @@ void cmndList(struct SCP_CONNECTION *c)
     g_free(dsl);
 }
 
+void cmndUsage(struct SCP_CONNECTION *c)
+{
+    struct SCP_SESSION_USAGE *ul;
+    enum SCP_CLIENT_STATES_E e;
+    int scnt;
+    int idx;
+
+    e = scp_v1c_mng_get_session_usage(c, &scnt, &ul);
+
+    if (e != SCP_CLIENT_STATE_USAGE_OK)
+    {
+        printf("Error getting session usage.\n");
+        return;
+    }
+
+    if (scnt == 0)
+    {
+        printf("No sessions.\n");
+        return;
+    }
+
+    for (idx = 0; idx < scnt; idx++)
+    {
+        printf("Session ID: %d\n", ul[idx].SID);
+        printf("\tCPU time: %llu.%03llu s\n",
+               (unsigned long long) (ul[idx].cpu_usec / 1000000),
+               (unsigned long long) ((ul[idx].cpu_usec / 1000) % 1000));
+        printf("\tMemory: %llu KiB\n",
+               (unsigned long long) (ul[idx].mem_bytes / 1024));
+    }
+
+    g_free(ul);
+}
+
 void cmndKill(struct SCP_CONNECTION *c, struct SCP_SESSION *s)
 {
 
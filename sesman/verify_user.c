@@ -49,19 +49,26 @@ auth_crypt_pwd(const char *pwd, const char *pln, char *crp);
 static int
 auth_account_disabled(struct spwd *stp);
 
+/* room for the strings of one passwd or shadow entry */
+#define AUTH_PW_BUF_SIZE 16384
+
 /******************************************************************************/
-/* returns boolean */
-long
-auth_userpass(const char *user, const char *pass, int *errorcode)
+/* returns boolean, buf has room for two entries, logins are checked on
+   several threads at once so only the reentrant calls are used here */
+static long
+auth_userpass_r(const char *user, const char *pass, char *buf,
+                struct crypt_data *cdata)
 {
     const char *encr;
     const char *epass;
+    struct passwd pwd;
     struct passwd *spw;
+    struct spwd spd;
     struct spwd *stp;
 
-    spw = getpwnam(user);
-
-    if (spw == 0)
+    spw = 0;
+    if ((getpwnam_r(user, &pwd, buf, AUTH_PW_BUF_SIZE, &spw) != 0) ||
+            (spw == 0))
     {
         return 0;
     }
@@ -69,9 +76,9 @@ auth_userpass(const char *user, const char *pass, int *errorcode)
     if (g_strncmp(spw->pw_passwd, "x", 3) == 0)
     {
         /* the system is using shadow */
-        stp = getspnam(user);
-
-        if (stp == 0)
+        stp = 0;
+        if ((getspnam_r(user, &spd, buf + AUTH_PW_BUF_SIZE,
+                        AUTH_PW_BUF_SIZE, &stp) != 0) || (stp == 0))
         {
             return 0;
         }
@@ -89,7 +96,7 @@ auth_userpass(const char *user, const char *pass, int *errorcode)
         /* old system with only passwd */
         encr = spw->pw_passwd;
     }
-    epass = crypt(pass, encr);
+    epass = crypt_r(pass, encr, cdata);
     if (epass == 0)
     {
         return 0;
@@ -97,6 +104,28 @@ auth_userpass(const char *user, const char *pass, int *errorcode)
     return (strcmp(encr, epass) == 0);
 }
 
+/******************************************************************************/
+/* returns boolean */
+long
+auth_userpass(const char *user, const char *pass, int *errorcode)
+{
+    struct crypt_data *cdata;
+    char *buf;
+    long rv;
+
+    rv = 0;
+    buf = (char *) g_malloc(AUTH_PW_BUF_SIZE * 2, 0);
+    /* crypt_r wants it zeroed */
+    cdata = (struct crypt_data *) g_malloc(sizeof(struct crypt_data), 1);
+    if ((buf != 0) && (cdata != 0))
+    {
+        rv = auth_userpass_r(user, pass, buf, cdata);
+    }
+    g_free(cdata);
+    g_free(buf);
+    return rv;
+}
+
 /******************************************************************************/
 /* returns error */
 int
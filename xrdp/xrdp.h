@@ -69,8 +69,24 @@ xrdp_cache_add_bitmap(struct xrdp_cache* self, struct xrdp_bitmap* bitmap,
 int
 xrdp_cache_add_palette(struct xrdp_cache* self, int* palette);
 int
+xrdp_cache_char_cache_id(struct xrdp_cache* self, int datasize, int count);
+int
 xrdp_cache_add_char(struct xrdp_cache* self,
-                    struct xrdp_font_char* font_item);
+                    struct xrdp_font_char* font_item, int cache_id);
+int
+xrdp_cache_add_mod_char(struct xrdp_cache* self, int font, int character,
+                        struct xrdp_font_char* font_item);
+int
+xrdp_cache_mod_text(struct xrdp_cache* self, int* font, int flags,
+                    char* data, int data_len);
+void
+xrdp_cache_mod_text_as_is(struct xrdp_cache* self, int font, int flags,
+                          const char* data, int data_len);
+int
+xrdp_cache_text_fragment(struct xrdp_cache* self, int cache_id, int flags,
+                         char* data, int data_len, int* frag_add);
+void
+xrdp_cache_text_fragment_sent(struct xrdp_cache* self, int frag_add);
 int
 xrdp_cache_add_pointer(struct xrdp_cache* self,
                        struct xrdp_pointer_item* pointer_item);
@@ -88,6 +104,15 @@ int
 xrdp_cache_remove_os_bitmap(struct xrdp_cache* self, int rdpindex);
 struct xrdp_os_bitmap_item*
 xrdp_cache_get_os_bitmap(struct xrdp_cache* self, int rdpindex);
+int
+xrdp_cache_os_bitmap_created(struct xrdp_cache* self,
+                             struct xrdp_bitmap* bitmap);
+int
+xrdp_cache_os_bitmap_stale(struct xrdp_cache* self,
+                           struct xrdp_bitmap* bitmap);
+int
+xrdp_cache_os_bitmap_set_stale(struct xrdp_cache* self,
+                               struct xrdp_bitmap* bitmap);
 
 /* xrdp_wm.c */
 struct xrdp_wm*
@@ -130,11 +155,15 @@ int
 xrdp_wm_pu(struct xrdp_wm* self, struct xrdp_bitmap* control);
 int
 xrdp_wm_send_pointer(struct xrdp_wm* self, int cache_idx,
-                     char* data, char* mask, int x, int y, int bpp);
+                     char* data, char* mask, int x, int y, int bpp,
+                     int width, int height);
 int
 xrdp_wm_pointer(struct xrdp_wm* self, char* data, char* mask, int x, int y,
                 int bpp);
 int
+xrdp_wm_pointer_large(struct xrdp_wm* self, char* data, char* mask,
+                      int x, int y, int bpp, int width, int height);
+int
 callback(intptr_t id, int msg, intptr_t param1, intptr_t param2,
          intptr_t param3, intptr_t param4);
 int
@@ -284,7 +313,8 @@ xrdp_painter_draw_text2(struct xrdp_painter* self,
                         int clip_right, int clip_bottom,
                         int box_left, int box_top,
                         int box_right, int box_bottom,
-                        int x, int y, char* data, int data_len);
+                        int x, int y, char* data, int data_len,
+                        int frag_add);
 int
 xrdp_painter_copy(struct xrdp_painter* self,
                   struct xrdp_bitmap* src,
@@ -426,6 +456,10 @@ int
 server_set_pointer_ex(struct xrdp_mod* mod, int x, int y,
                       char* data, char* mask, int bpp);
 int
+server_set_pointer_large(struct xrdp_mod* mod, int x, int y,
+                         char* data, char* mask, int bpp,
+                         int width, int height);
+int
 server_palette(struct xrdp_mod* mod, int* palette);
 int
 server_msg(struct xrdp_mod* mod, char* msg, int code);
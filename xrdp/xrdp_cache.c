@@ -37,6 +37,9 @@
   } \
   while (0)
 
+/* shorter glyph runs are not worth a fragment cache entry */
+#define XRDP_MIN_FRAGMENT_BYTES 6
+
 /*****************************************************************************/
 static int
 xrdp_cache_reset_lru(struct xrdp_cache *self)
@@ -90,6 +93,88 @@ xrdp_cache_reset_crc(struct xrdp_cache *self)
     return 0;
 }
 
+/*****************************************************************************/
+static void
+xrdp_cache_pointer_free(struct xrdp_pointer_item *pointer_item)
+{
+    g_free(pointer_item->data);
+    g_free(pointer_item->mask);
+    pointer_item->data = 0;
+    pointer_item->mask = 0;
+}
+
+/*****************************************************************************/
+/* off screen bitmaps live in the client's offscreen cache, keep what we
+   create there within the size and entries it advertised */
+static void
+xrdp_cache_os_bitmap_budget(struct xrdp_cache *self,
+                            struct xrdp_client_info *client_info)
+{
+    self->os_bitmap_Bpp = (client_info->bpp + 7) / 8;
+    self->os_bitmap_Bpp = MAX(self->os_bitmap_Bpp, 1);
+    self->os_bitmap_max_bytes = MAX(client_info->offscreen_cache_size, 0);
+    self->os_bitmap_max_entries = MAX(client_info->offscreen_cache_entries, 0);
+    LLOGLN(10, ("xrdp_cache_os_bitmap_budget: bytes %d entries %d",
+                self->os_bitmap_max_bytes, self->os_bitmap_max_entries));
+}
+
+/*****************************************************************************/
+/* sets up the glyph caches the client advertised, each with its slots in
+   one lru list, clients that sent no glyph caps get the old layout */
+static void
+xrdp_cache_reset_chars(struct xrdp_cache *self,
+                       struct xrdp_client_info *client_info)
+{
+    int index;
+    int jndex;
+    int entries;
+    struct xrdp_lru_item *lru;
+
+    entries = 0;
+    if (client_info->glyph_support_level != GLYPH_SUPPORT_NONE)
+    {
+        for (index = 0; index < 10; index++)
+        {
+            /* glyph indexes 0xfe and 0xff are fragment ops */
+            self->char_entries[index] =
+                MIN(client_info->glyph_cache_entries[index], 254);
+            self->char_cell_bytes[index] =
+                client_info->glyph_cache_cell_size[index];
+            entries += self->char_entries[index];
+        }
+        if (client_info->glyph_support_level >= GLYPH_SUPPORT_FULL)
+        {
+            self->frag_entries = MIN(client_info->frag_cache_entries, 256);
+            self->frag_max_bytes = MIN(client_info->frag_cache_max_bytes,
+                                       256);
+        }
+    }
+    if (entries == 0)
+    {
+        for (index = 0; index < XRDP_MAX_GLYPH_CACHE_ID; index++)
+        {
+            self->char_entries[index] = index < 7 ? 0 : 250;
+            self->char_cell_bytes[index] = 2048;
+        }
+    }
+    for (index = 0; index < XRDP_MAX_GLYPH_CACHE_ID; index++)
+    {
+        entries = self->char_entries[index];
+        for (jndex = 0; jndex < entries; jndex++)
+        {
+            lru = &(self->char_lrus[index][jndex]);
+            lru->prev = jndex - 1;
+            lru->next = jndex + 1 < entries ? jndex + 1 : -1;
+        }
+        self->char_lru_head[index] = 0;
+        self->char_lru_tail[index] = entries - 1;
+    }
+    for (index = 0; index < XRDP_CHAR_HASH_SIZE; index++)
+    {
+        self->char_hash[index] = -1;
+    }
+}
+
 /*****************************************************************************/
 struct xrdp_cache *
 xrdp_cache_create(struct xrdp_wm *owner,
@@ -122,6 +207,8 @@ xrdp_cache_create(struct xrdp_wm *owner,
     self->bitmap_cache_version = client_info->bitmap_cache_version;
     self->pointer_cache_entries = client_info->pointer_cache_entries;
     self->xrdp_os_del_list = list_create();
+    xrdp_cache_os_bitmap_budget(self, client_info);
+    xrdp_cache_reset_chars(self, client_info);
     xrdp_cache_reset_lru(self);
     xrdp_cache_reset_crc(self);
     LLOGLN(10, ("xrdp_cache_create: 0 %d 1 %d 2 %d",
@@ -151,13 +238,21 @@ xrdp_cache_delete(struct xrdp_cache *self)
     }
 
     /* free all the cached font items */
-    for (i = 0; i < 12; i++)
+    for (i = 0; i < XRDP_MAX_GLYPH_CACHE_ID; i++)
     {
         for (j = 0; j < 256; j++)
         {
             g_free(self->char_items[i][j].font_item.data);
         }
     }
+    if (self->mod_chars != 0)
+    {
+        for (i = 0; i < XRDP_MAX_GLYPH_CACHE_ID * 256; i++)
+        {
+            g_free(self->mod_chars[i].data);
+        }
+        g_free(self->mod_chars);
+    }
 
     /* free all the off screen bitmaps */
     for (i = 0; i < 2000; i++)
@@ -165,8 +260,22 @@ xrdp_cache_delete(struct xrdp_cache *self)
         xrdp_bitmap_delete(self->os_bitmap_items[i].bitmap);
     }
 
+    if (self->os_bitmap_evictions > 0)
+    {
+        log_message(LOG_LEVEL_INFO, "xrdp_cache_delete: off screen bitmaps "
+                    "peak %d bytes of %d, %d evicted",
+                    self->os_bitmap_peak_bytes, self->os_bitmap_max_bytes,
+                    self->os_bitmap_evictions);
+    }
+
     list_delete(self->xrdp_os_del_list);
 
+    /* free all the cached pointers */
+    for (i = 0; i < 32; i++)
+    {
+        xrdp_cache_pointer_free(self->pointer_items + i);
+    }
+
     /* free all crc lists */
     for (i = 0; i < XRDP_MAX_BITMAP_CACHE_ID; i++)
     {
@@ -186,6 +295,8 @@ xrdp_cache_reset(struct xrdp_cache *self,
 {
     struct xrdp_wm *wm;
     struct xrdp_session *session;
+    struct list *os_del_list;
+    struct xrdp_font_char *mod_chars;
     int i;
     int j;
 
@@ -199,7 +310,7 @@ xrdp_cache_reset(struct xrdp_cache *self,
     }
 
     /* free all the cached font items */
-    for (i = 0; i < 12; i++)
+    for (i = 0; i < XRDP_MAX_GLYPH_CACHE_ID; i++)
     {
         for (j = 0; j < 256; j++)
         {
@@ -207,14 +318,27 @@ xrdp_cache_reset(struct xrdp_cache *self,
         }
     }
 
+    /* free all the cached pointers */
+    for (i = 0; i < 32; i++)
+    {
+        xrdp_cache_pointer_free(self->pointer_items + i);
+    }
+
     /* save these */
     wm = self->wm;
     session = self->session;
+    os_del_list = self->xrdp_os_del_list;
+    /* the backend still thinks its glyphs are there, they are sent again
+       when used */
+    mod_chars = self->mod_chars;
     /* set whole struct to zero */
     g_memset(self, 0, sizeof(struct xrdp_cache));
     /* set some stuff back */
     self->wm = wm;
     self->session = session;
+    self->xrdp_os_del_list = os_del_list;
+    self->mod_chars = mod_chars;
+    list_clear(self->xrdp_os_del_list);
     self->use_bitmap_comp = client_info->use_bitmap_comp;
     self->cache1_entries = client_info->cache1_entries;
     self->cache1_size = client_info->cache1_size;
@@ -225,6 +349,8 @@ xrdp_cache_reset(struct xrdp_cache *self,
     self->bitmap_cache_persist_enable = client_info->bitmap_cache_persist_enable;
     self->bitmap_cache_version = client_info->bitmap_cache_version;
     self->pointer_cache_entries = client_info->pointer_cache_entries;
+    xrdp_cache_os_bitmap_budget(self, client_info);
+    xrdp_cache_reset_chars(self, client_info);
     xrdp_cache_reset_lru(self);
     xrdp_cache_reset_crc(self);
     return 0;
@@ -553,66 +679,604 @@ xrdp_cache_add_palette(struct xrdp_cache *self, int *palette)
 }
 
 /*****************************************************************************/
-int
-xrdp_cache_add_char(struct xrdp_cache *self,
-                    struct xrdp_font_char *font_item)
+static int
+xrdp_cache_char_datasize(struct xrdp_font_char *font_item)
 {
-    int i;
-    int j;
-    int oldest;
-    int f;
-    int c;
-    int datasize;
-    struct xrdp_font_char *fi;
+    if (font_item->bpp == 8) /* alpha font */
+    {
+        return ((font_item->width + 3) & ~3) * font_item->height;
+    }
+    return FONT_DATASIZE(font_item);
+}
 
-    self->char_stamp++;
+/*****************************************************************************/
+static int
+xrdp_cache_char_hash(struct xrdp_font_char *font_item, int datasize)
+{
+    tui32 hash;
+    int index;
+    int vals[5];
+    const tui8 *p;
+
+    vals[0] = font_item->offset;
+    vals[1] = font_item->baseline;
+    vals[2] = font_item->width;
+    vals[3] = font_item->height;
+    vals[4] = font_item->bpp;
+    /* FNV-1a */
+    hash = 2166136261U;
+    p = (const tui8 *) vals;
+    for (index = 0; index < (int) sizeof(vals); index++)
+    {
+        hash = (hash ^ p[index]) * 16777619U;
+    }
+    p = (const tui8 *) (font_item->data);
+    for (index = 0; index < datasize; index++)
+    {
+        hash = (hash ^ p[index]) * 16777619U;
+    }
+    return (int) hash;
+}
 
-    /* look for match */
-    for (i = 7; i < 12; i++)
+/*****************************************************************************/
+/* makes the slot the most recently used in its glyph cache */
+static void
+xrdp_cache_char_touch(struct xrdp_cache *self, int f, int c)
+{
+    struct xrdp_lru_item *lru;
+    int tail;
+
+    tail = self->char_lru_tail[f];
+    if (tail == c)
     {
-        for (j = 0; j < 250; j++)
+        return;
+    }
+    lru = &(self->char_lrus[f][c]);
+    /* unhook */
+    if (lru->prev == -1)
+    {
+        self->char_lru_head[f] = lru->next;
+    }
+    else
+    {
+        self->char_lrus[f][lru->prev].next = lru->next;
+    }
+    self->char_lrus[f][lru->next].prev = lru->prev;
+    /* hook up at the tail */
+    self->char_lrus[f][tail].next = c;
+    lru->prev = tail;
+    lru->next = -1;
+    self->char_lru_tail[f] = c;
+}
+
+/*****************************************************************************/
+static void
+xrdp_cache_char_unhash(struct xrdp_cache *self, int f, int c)
+{
+    struct xrdp_char_item *ci;
+    int *slot;
+
+    ci = &(self->char_items[f][c]);
+    slot = self->char_hash + (ci->hash & (XRDP_CHAR_HASH_SIZE - 1));
+    while (*slot != -1)
+    {
+        if (*slot == ((f << 8) | c))
         {
-            if (xrdp_font_item_compare(&self->char_items[i][j].font_item, font_item))
-            {
-                self->char_items[i][j].stamp = self->char_stamp;
-                DEBUG(("found font at %d %d", i, j));
-                return MAKELONG(j, i);
-            }
+            *slot = ci->hash_next;
+            return;
         }
+        slot = &(self->char_items[*slot >> 8][*slot & 0xff].hash_next);
     }
+}
 
-    /* look for oldest */
-    f = 0;
-    c = 0;
-    oldest = 0x7fffffff;
+/*****************************************************************************/
+/* returns the glyph cache for a text order with count glyphs of up to
+   datasize bytes each, the one with the smallest cells that fits
+   returns -1 if none does */
+int
+xrdp_cache_char_cache_id(struct xrdp_cache *self, int datasize, int count)
+{
+    int index;
+    int rv;
 
-    for (i = 7; i < 12; i++)
+    rv = -1;
+    for (index = 0; index < XRDP_MAX_GLYPH_CACHE_ID; index++)
     {
-        for (j = 0; j < 250; j++)
+        if ((self->char_entries[index] < count) ||
+            (self->char_cell_bytes[index] < datasize))
         {
-            if (self->char_items[i][j].stamp < oldest)
-            {
-                oldest = self->char_items[i][j].stamp;
-                f = i;
-                c = j;
-            }
+            continue;
+        }
+        if ((rv == -1) ||
+            (self->char_cell_bytes[index] < self->char_cell_bytes[rv]))
+        {
+            rv = index;
         }
     }
+    return rv;
+}
 
-    DEBUG(("adding char at %d %d", f, c));
+/*****************************************************************************/
+/* puts the glyph in glyph cache cache_id, glyphs are found by hash, a new
+   one takes the least recently used slot and is sent to the client
+   all glyphs of one text order must go in the same cache
+   returns the glyph index or -1 on error */
+int
+xrdp_cache_add_char(struct xrdp_cache *self,
+                    struct xrdp_font_char *font_item, int cache_id)
+{
+    struct xrdp_char_item *ci;
+    struct xrdp_font_char *fi;
+    int datasize;
+    int hash;
+    int bucket;
+    int slot;
+    int c;
+
+    if ((cache_id < 0) || (cache_id >= XRDP_MAX_GLYPH_CACHE_ID) ||
+        (self->char_entries[cache_id] < 1))
+    {
+        return -1;
+    }
+    datasize = xrdp_cache_char_datasize(font_item);
+    if (datasize > self->char_cell_bytes[cache_id])
+    {
+        return -1;
+    }
+    hash = xrdp_cache_char_hash(font_item, datasize);
+    bucket = hash & (XRDP_CHAR_HASH_SIZE - 1);
+
+    /* look for match, the glyph is only compared when the hash is equal */
+    slot = self->char_hash[bucket];
+    while (slot != -1)
+    {
+        ci = &(self->char_items[slot >> 8][slot & 0xff]);
+        if (((slot >> 8) == cache_id) && (ci->hash == hash) &&
+            (ci->font_item.bpp == font_item->bpp) &&
+            xrdp_font_item_compare(&ci->font_item, font_item))
+        {
+            c = slot & 0xff;
+            xrdp_cache_char_touch(self, cache_id, c);
+            DEBUG(("found font at %d %d", cache_id, c));
+            return c;
+        }
+        slot = ci->hash_next;
+    }
+
+    /* take the least recently used */
+    c = self->char_lru_head[cache_id];
+    ci = &(self->char_items[cache_id][c]);
+    fi = &(ci->font_item);
+    if (fi->data != 0)
+    {
+        xrdp_cache_char_unhash(self, cache_id, c);
+        /* fragments made with the old glyph are no good now */
+        self->char_generation[cache_id]++;
+    }
+    DEBUG(("adding char at %d %d", cache_id, c));
     /* set, send char and return */
-    fi = &self->char_items[f][c].font_item;
     g_free(fi->data);
-    datasize = FONT_DATASIZE(font_item);
     fi->data = (char *)g_malloc(datasize, 1);
     g_memcpy(fi->data, font_item->data, datasize);
     fi->offset = font_item->offset;
     fi->baseline = font_item->baseline;
     fi->width = font_item->width;
     fi->height = font_item->height;
-    self->char_items[f][c].stamp = self->char_stamp;
-    libxrdp_orders_send_font(self->session, fi, f, c);
-    return MAKELONG(c, f);
+    fi->incby = font_item->incby;
+    fi->bpp = font_item->bpp;
+    ci->hash = hash;
+    ci->hash_next = self->char_hash[bucket];
+    self->char_hash[bucket] = (cache_id << 8) | c;
+    xrdp_cache_char_touch(self, cache_id, c);
+    libxrdp_orders_send_font(self->session, fi, cache_id, c);
+    return c;
+}
+
+/*****************************************************************************/
+/* keeps a copy of a glyph the backend put in its font, character slot,
+   it is sent when a text order uses it, returns error */
+int
+xrdp_cache_add_mod_char(struct xrdp_cache *self, int font, int character,
+                        struct xrdp_font_char *font_item)
+{
+    struct xrdp_font_char *fi;
+    int datasize;
+
+    if ((font < 0) || (font >= XRDP_MAX_GLYPH_CACHE_ID) ||
+        (character < 0) || (character > 255))
+    {
+        return 1;
+    }
+    if (self->mod_chars == 0)
+    {
+        self->mod_chars = g_new0(struct xrdp_font_char,
+                                 XRDP_MAX_GLYPH_CACHE_ID * 256);
+        if (self->mod_chars == 0)
+        {
+            return 1;
+        }
+    }
+    fi = self->mod_chars + font * 256 + character;
+    datasize = xrdp_cache_char_datasize(font_item);
+    g_free(fi->data);
+    *fi = *font_item;
+    fi->data = (char *)g_malloc(datasize, 0);
+    if (fi->data == 0)
+    {
+        return 1;
+    }
+    g_memcpy(fi->data, font_item->data, datasize);
+    return 0;
+}
+
+/*****************************************************************************/
+/* walks backend glyph order data, with cache_id -1 it only measures the
+   glyphs, else it puts them in that glyph cache and rewrites the indexes
+   a delta follows each glyph unless TEXT2_IMPLICIT_X is set, the orders
+   never set ulCharInc
+   returns error, 2 for fragment ops */
+static int
+xrdp_cache_mod_glyphs(struct xrdp_cache *self, int font, int flags,
+                      char *data, int data_len, int cache_id,
+                      int *datasize, int *count)
+{
+    struct xrdp_font_char *fi;
+    int index;
+    int glyph;
+    int c;
+    char seen[256];
+
+    g_memset(seen, 0, sizeof(seen));
+    index = 0;
+    while (index < data_len)
+    {
+        glyph = (tui8) (data[index]);
+        if ((glyph == 0xfe) || (glyph == 0xff))
+        {
+            return 2;
+        }
+        fi = self->mod_chars + font * 256 + glyph;
+        if (fi->data == 0)
+        {
+            return 1;
+        }
+        if (cache_id < 0)
+        {
+            /* a glyph that repeats takes one slot */
+            *datasize = MAX(*datasize, xrdp_cache_char_datasize(fi));
+            if (!seen[glyph])
+            {
+                seen[glyph] = 1;
+                (*count)++;
+            }
+        }
+        else
+        {
+            c = xrdp_cache_add_char(self, fi, cache_id);
+            if (c < 0)
+            {
+                return 1;
+            }
+            data[index] = c;
+        }
+        index++;
+        if (!(flags & TEXT2_IMPLICIT_X))
+        {
+            if ((index < data_len) && (((tui8) (data[index])) == 0x80))
+            {
+                index += 2;
+            }
+            index++;
+        }
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+/* a text order from the backend that can not be rewritten goes with its own
+   indexes, so its glyphs are sent to the backend's slots, what this cache
+   had in those slots is dropped
+   fragment ops are skipped, the glyphs they add are in the data too */
+void
+xrdp_cache_mod_text_as_is(struct xrdp_cache *self, int font, int flags,
+                          const char *data, int data_len)
+{
+    struct xrdp_font_char *fi;
+    struct xrdp_char_item *ci;
+    int index;
+    int glyph;
+
+    if ((self->mod_chars == 0) || (font < 0) ||
+            (font >= XRDP_MAX_GLYPH_CACHE_ID))
+    {
+        return;
+    }
+    index = 0;
+    while (index < data_len)
+    {
+        glyph = (tui8) (data[index]);
+        if (glyph == 0xff)
+        {
+            /* ADD_FRAGMENT, id and size */
+            index += 3;
+            continue;
+        }
+        if (glyph == 0xfe)
+        {
+            /* USE_FRAGMENT, id then the delta like a glyph */
+            index++;
+        }
+        else
+        {
+            fi = self->mod_chars + font * 256 + glyph;
+            if ((fi->data != 0) && (glyph < self->char_entries[font]) &&
+                (xrdp_cache_char_datasize(fi) <= self->char_cell_bytes[font]))
+            {
+                ci = &(self->char_items[font][glyph]);
+                if (ci->font_item.data != 0)
+                {
+                    xrdp_cache_char_unhash(self, font, glyph);
+                    g_free(ci->font_item.data);
+                    ci->font_item.data = 0;
+                    self->char_generation[font]++;
+                }
+                libxrdp_orders_send_font(self->session, fi, font, glyph);
+            }
+        }
+        index++;
+        if (!(flags & TEXT2_IMPLICIT_X))
+        {
+            if ((index < data_len) && (((tui8) (data[index])) == 0x80))
+            {
+                index += 2;
+            }
+            index++;
+        }
+    }
+}
+
+/*****************************************************************************/
+/* rewrites a text order from the backend so it uses glyphs this cache
+   manages, *font is the backend's font on entry, the glyph cache to use on
+   return, data is changed in place
+   returns error, then the order should go as it is, see
+   xrdp_cache_mod_text_as_is */
+int
+xrdp_cache_mod_text(struct xrdp_cache *self, int *font, int flags,
+                    char *data, int data_len)
+{
+    int datasize;
+    int count;
+    int cache_id;
+    int error;
+
+    if ((self->mod_chars == 0) || (*font < 0) ||
+        (*font >= XRDP_MAX_GLYPH_CACHE_ID))
+    {
+        return 1;
+    }
+    datasize = 0;
+    count = 0;
+    error = xrdp_cache_mod_glyphs(self, *font, flags, data, data_len, -1,
+                                  &datasize, &count);
+    if ((error == 2) && !self->frag_disabled)
+    {
+        /* the backend's fragment ids would clash with ours */
+        LLOGLN(0, ("xrdp_cache_mod_text: backend uses fragments, not "
+               "adding any"));
+        self->frag_disabled = 1;
+    }
+    if (error != 0)
+    {
+        return 1;
+    }
+    cache_id = xrdp_cache_char_cache_id(self, datasize, count);
+    if (cache_id < 0)
+    {
+        return 1;
+    }
+    if (xrdp_cache_mod_glyphs(self, *font, flags, data, data_len, cache_id,
+                              &datasize, &count) != 0)
+    {
+        return 1;
+    }
+    *font = cache_id;
+    return 0;
+}
+
+/*****************************************************************************/
+/* text that was drawn before goes out as a use of the fragment that holds
+   it, other text is added to the fragment cache as it is drawn, *frag_add
+   is then the fragment id, else -1, it is only used once an order carrying
+   it was sent, see xrdp_cache_text_fragment_sent
+   data must have room for 3 more bytes, returns the new data_len */
+int
+xrdp_cache_text_fragment(struct xrdp_cache *self, int cache_id, int flags,
+                         char *data, int data_len, int *frag_add)
+{
+    struct xrdp_frag_item *frag;
+    tui32 hash;
+    int index;
+    int found;
+    int oldest;
+
+    *frag_add = -1;
+    if (self->frag_disabled || (self->frag_entries < 1) ||
+        (data_len < XRDP_MIN_FRAGMENT_BYTES) ||
+        (data_len > self->frag_max_bytes) || (data_len + 3 > 255))
+    {
+        return data_len;
+    }
+    hash = 2166136261U;
+    for (index = 0; index < data_len; index++)
+    {
+        hash = (hash ^ ((tui8) (data[index]))) * 16777619U;
+    }
+    self->frag_stamp++;
+    found = -1;
+    oldest = 0;
+    for (index = 0; index < self->frag_entries; index++)
+    {
+        frag = self->frag_items + index;
+        if ((frag->stamp != 0) && (frag->hash == (int) hash) &&
+            (frag->cache_id == cache_id) && (frag->size == data_len) &&
+            (g_memcmp(frag->data, data, data_len) == 0))
+        {
+            found = index;
+            break;
+        }
+        if (frag->stamp < self->frag_items[oldest].stamp)
+        {
+            oldest = index;
+        }
+    }
+    if ((found != -1) &&
+        (self->frag_items[found].generation ==
+         self->char_generation[cache_id]))
+    {
+        /* USE_FRAGMENT, with a zero delta when deltas are in the data */
+        self->frag_items[found].stamp = self->frag_stamp;
+        data[0] = 0xfe;
+        data[1] = found;
+        if (flags & TEXT2_IMPLICIT_X)
+        {
+            return 2;
+        }
+        data[2] = 0;
+        return 3;
+    }
+    if (found != -1)
+    {
+        /* stale, a glyph in it was replaced */
+        oldest = found;
+    }
+    frag = self->frag_items + oldest;
+    frag->stamp = 0;
+    frag->hash = (int) hash;
+    frag->cache_id = cache_id;
+    frag->generation = self->char_generation[cache_id];
+    frag->size = data_len;
+    g_memcpy(frag->data, data, data_len);
+    /* ADD_FRAGMENT, the data before it is the fragment */
+    data[data_len] = 0xff;
+    data[data_len + 1] = oldest;
+    data[data_len + 2] = data_len;
+    *frag_add = oldest;
+    return data_len + 3;
+}
+
+/*****************************************************************************/
+/* an order carrying the ADD_FRAGMENT from xrdp_cache_text_fragment went
+   out, from now on the same text can use the fragment */
+void
+xrdp_cache_text_fragment_sent(struct xrdp_cache *self, int frag_add)
+{
+    struct xrdp_frag_item *frag;
+
+    if ((frag_add < 0) || (frag_add >= self->frag_entries))
+    {
+        return;
+    }
+    frag = self->frag_items + frag_add;
+    if (frag->stamp == 0)
+    {
+        self->frag_stamp++;
+        frag->stamp = self->frag_stamp;
+    }
+}
+
+/*****************************************************************************/
+static void
+xrdp_cache_pointer_sizes(struct xrdp_pointer_item *pointer_item,
+                         int *data_bytes, int *mask_bytes)
+{
+    int bpp;
+
+    bpp = pointer_item->bpp == 0 ? 24 : pointer_item->bpp;
+    *data_bytes = ((bpp + 7) / 8) * pointer_item->width *
+                  pointer_item->height;
+    *mask_bytes = ((pointer_item->width + 15) / 16) * 2 *
+                  pointer_item->height;
+}
+
+/*****************************************************************************/
+/* FNV-1a over the hotspot, format and pixels */
+static int
+xrdp_cache_pointer_hash(struct xrdp_pointer_item *pointer_item)
+{
+    tui32 hash;
+    int data_bytes;
+    int mask_bytes;
+    int index;
+    int head[5];
+    const tui8 *p;
+
+    head[0] = pointer_item->x;
+    head[1] = pointer_item->y;
+    head[2] = pointer_item->bpp;
+    head[3] = pointer_item->width;
+    head[4] = pointer_item->height;
+    xrdp_cache_pointer_sizes(pointer_item, &data_bytes, &mask_bytes);
+    hash = 2166136261U;
+    p = (const tui8 *) head;
+    for (index = 0; index < (int) sizeof(head); index++)
+    {
+        hash = (hash ^ p[index]) * 16777619U;
+    }
+    p = (const tui8 *) (pointer_item->data);
+    for (index = 0; index < data_bytes; index++)
+    {
+        hash = (hash ^ p[index]) * 16777619U;
+    }
+    p = (const tui8 *) (pointer_item->mask);
+    for (index = 0; index < mask_bytes; index++)
+    {
+        hash = (hash ^ p[index]) * 16777619U;
+    }
+    return (int) hash;
+}
+
+/*****************************************************************************/
+/* copies pointer_item into the cache slot and sends it to the client
+   returns error */
+static int
+xrdp_cache_pointer_set(struct xrdp_cache *self, int index,
+                       struct xrdp_pointer_item *pointer_item, int hash)
+{
+    struct xrdp_pointer_item *pi;
+    int data_bytes;
+    int mask_bytes;
+    int old_data_bytes;
+    int old_mask_bytes;
+
+    pi = self->pointer_items + index;
+    xrdp_cache_pointer_sizes(pointer_item, &data_bytes, &mask_bytes);
+    xrdp_cache_pointer_sizes(pi, &old_data_bytes, &old_mask_bytes);
+    if (pi->data == 0 || data_bytes != old_data_bytes ||
+        mask_bytes != old_mask_bytes)
+    {
+        xrdp_cache_pointer_free(pi);
+        pi->data = (char *) g_malloc(data_bytes, 0);
+        pi->mask = (char *) g_malloc(mask_bytes, 0);
+        if (pi->data == 0 || pi->mask == 0)
+        {
+            xrdp_cache_pointer_free(pi);
+            return 1;
+        }
+    }
+    g_memcpy(pi->data, pointer_item->data, data_bytes);
+    g_memcpy(pi->mask, pointer_item->mask, mask_bytes);
+    pi->x = pointer_item->x;
+    pi->y = pointer_item->y;
+    pi->bpp = pointer_item->bpp;
+    pi->width = pointer_item->width;
+    pi->height = pointer_item->height;
+    pi->hash = hash;
+    pi->stamp = self->pointer_stamp;
+    xrdp_wm_send_pointer(self->wm, index, pi->data, pi->mask,
+                         pi->x, pi->y, pi->bpp, pi->width, pi->height);
+    self->wm->current_pointer = index;
+    return 0;
 }
 
 /*****************************************************************************/
@@ -624,9 +1288,13 @@ int
 xrdp_cache_add_pointer(struct xrdp_cache *self,
                        struct xrdp_pointer_item *pointer_item)
 {
+    struct xrdp_pointer_item *pi;
     int i;
     int oldest;
     int index;
+    int hash;
+    int data_bytes;
+    int mask_bytes;
 
     if (self == 0)
     {
@@ -635,18 +1303,22 @@ xrdp_cache_add_pointer(struct xrdp_cache *self,
 
     self->pointer_stamp++;
 
-    /* look for match */
+    /* look for match, the pixels are only compared when the hash is equal */
+    hash = xrdp_cache_pointer_hash(pointer_item);
+    xrdp_cache_pointer_sizes(pointer_item, &data_bytes, &mask_bytes);
     for (i = 2; i < self->pointer_cache_entries; i++)
     {
-        if (self->pointer_items[i].x == pointer_item->x &&
-                self->pointer_items[i].y == pointer_item->y &&
-                g_memcmp(self->pointer_items[i].data,
-                         pointer_item->data, 32 * 32 * 4) == 0 &&
-                g_memcmp(self->pointer_items[i].mask,
-                         pointer_item->mask, 32 * 32 / 8) == 0 &&
-                self->pointer_items[i].bpp == pointer_item->bpp)
+        pi = self->pointer_items + i;
+        if (pi->data != 0 && pi->hash == hash &&
+                pi->x == pointer_item->x &&
+                pi->y == pointer_item->y &&
+                pi->bpp == pointer_item->bpp &&
+                pi->width == pointer_item->width &&
+                pi->height == pointer_item->height &&
+                g_memcmp(pi->data, pointer_item->data, data_bytes) == 0 &&
+                g_memcmp(pi->mask, pointer_item->mask, mask_bytes) == 0)
         {
-            self->pointer_items[i].stamp = self->pointer_stamp;
+            pi->stamp = self->pointer_stamp;
             xrdp_wm_set_pointer(self->wm, i);
             self->wm->current_pointer = i;
             DEBUG(("found pointer at %d", i));
@@ -667,21 +1339,7 @@ xrdp_cache_add_pointer(struct xrdp_cache *self,
         }
     }
 
-    self->pointer_items[index].x = pointer_item->x;
-    self->pointer_items[index].y = pointer_item->y;
-    g_memcpy(self->pointer_items[index].data,
-             pointer_item->data, 32 * 32 * 4);
-    g_memcpy(self->pointer_items[index].mask,
-             pointer_item->mask, 32 * 32 / 8);
-    self->pointer_items[index].stamp = self->pointer_stamp;
-    self->pointer_items[index].bpp = pointer_item->bpp;
-    xrdp_wm_send_pointer(self->wm, index,
-                         self->pointer_items[index].data,
-                         self->pointer_items[index].mask,
-                         self->pointer_items[index].x,
-                         self->pointer_items[index].y,
-                         self->pointer_items[index].bpp);
-    self->wm->current_pointer = index;
+    xrdp_cache_pointer_set(self, index, pointer_item, hash);
     DEBUG(("adding pointer at %d", index));
     return index;
 }
@@ -699,21 +1357,8 @@ xrdp_cache_add_pointer_static(struct xrdp_cache *self,
         return 0;
     }
 
-    self->pointer_items[index].x = pointer_item->x;
-    self->pointer_items[index].y = pointer_item->y;
-    g_memcpy(self->pointer_items[index].data,
-             pointer_item->data, 32 * 32 * 4);
-    g_memcpy(self->pointer_items[index].mask,
-             pointer_item->mask, 32 * 32 / 8);
-    self->pointer_items[index].stamp = self->pointer_stamp;
-    self->pointer_items[index].bpp = pointer_item->bpp;
-    xrdp_wm_send_pointer(self->wm, index,
-                         self->pointer_items[index].data,
-                         self->pointer_items[index].mask,
-                         self->pointer_items[index].x,
-                         self->pointer_items[index].y,
-                         self->pointer_items[index].bpp);
-    self->wm->current_pointer = index;
+    xrdp_cache_pointer_set(self, index, pointer_item,
+                           xrdp_cache_pointer_hash(pointer_item));
     DEBUG(("adding pointer at %d", index));
     return index;
 }
@@ -783,7 +1428,23 @@ xrdp_cache_add_os_bitmap(struct xrdp_cache *self, struct xrdp_bitmap *bitmap,
     }
 
     bi = self->os_bitmap_items + rdpindex;
+
+    if (bi->bitmap != 0)
+    {
+        /* id reused without a delete, drop the old one */
+        if (self->wm->target_surface == bi->bitmap)
+        {
+            self->wm->target_surface = self->wm->screen;
+        }
+
+        xrdp_cache_remove_os_bitmap(self, rdpindex);
+    }
+
+    self->os_bitmap_stamp++;
     bi->bitmap = bitmap;
+    bi->stamp = self->os_bitmap_stamp;
+    bi->bytes = 0;
+    bi->stale = 0;
     return 0;
 }
 
@@ -802,6 +1463,11 @@ xrdp_cache_remove_os_bitmap(struct xrdp_cache *self, int rdpindex)
 
     bi = self->os_bitmap_items + rdpindex;
 
+    if (bi->bitmap == 0)
+    {
+        return 1;
+    }
+
     if (bi->bitmap->tab_stop)
     {
         index = list_index_of(self->xrdp_os_del_list, rdpindex);
@@ -810,6 +1476,9 @@ xrdp_cache_remove_os_bitmap(struct xrdp_cache *self, int rdpindex)
         {
             list_add_item(self->xrdp_os_del_list, rdpindex);
         }
+
+        self->os_bitmap_bytes -= bi->bytes;
+        self->os_bitmap_count--;
     }
 
     xrdp_bitmap_delete(bi->bitmap);
@@ -817,6 +1486,162 @@ xrdp_cache_remove_os_bitmap(struct xrdp_cache *self, int rdpindex)
     return 0;
 }
 
+/*****************************************************************************/
+/* drop the least recently used off screen bitmap created on the client,
+   it stays known here but is marked stale, the module is asked to paint
+   again whatever gets copied from it, see xrdp_painter_copy
+   returns error if there is nothing that can go */
+static int
+xrdp_cache_evict_os_bitmap(struct xrdp_cache *self,
+                           struct xrdp_bitmap *keep)
+{
+    struct xrdp_os_bitmap_item *bi;
+    struct xrdp_bitmap *target;
+    int index;
+    int oldest;
+
+    target = self->wm->target_surface;
+    oldest = -1;
+
+    for (index = 0; index < 2000; index++)
+    {
+        bi = self->os_bitmap_items + index;
+
+        if ((bi->bitmap == 0) || (bi->bitmap->tab_stop == 0) ||
+                (bi->bitmap == keep) || (bi->bitmap == target))
+        {
+            continue;
+        }
+
+        if ((oldest == -1) ||
+                (bi->stamp < self->os_bitmap_items[oldest].stamp))
+        {
+            oldest = index;
+        }
+    }
+
+    if (oldest == -1)
+    {
+        return 1;
+    }
+
+    bi = self->os_bitmap_items + oldest;
+    LLOGLN(10, ("xrdp_cache_evict_os_bitmap: evicting %d bytes %d",
+                oldest, bi->bytes));
+
+    if (list_index_of(self->xrdp_os_del_list, oldest) == -1)
+    {
+        list_add_item(self->xrdp_os_del_list, oldest);
+    }
+
+    bi->bitmap->tab_stop = 0;
+    bi->stale = 1;
+    self->os_bitmap_bytes -= bi->bytes;
+    self->os_bitmap_count--;
+    self->os_bitmap_evictions++;
+    bi->bytes = 0;
+    return 0;
+}
+
+/*****************************************************************************/
+/* called before an off screen bitmap is created on the client, makes room
+   for it within the client's offscreen cache by evicting
+   returns error */
+int
+xrdp_cache_os_bitmap_created(struct xrdp_cache *self,
+                             struct xrdp_bitmap *bitmap)
+{
+    struct xrdp_os_bitmap_item *bi;
+    int bytes;
+
+    if ((bitmap->item_index < 0) || (bitmap->item_index >= 2000))
+    {
+        return 1;
+    }
+
+    bi = self->os_bitmap_items + bitmap->item_index;
+
+    if (bi->bitmap != bitmap)
+    {
+        return 1;
+    }
+
+    bytes = bitmap->width * bitmap->height * self->os_bitmap_Bpp;
+
+    if (self->os_bitmap_max_bytes > 0)
+    {
+        while (self->os_bitmap_bytes + bytes > self->os_bitmap_max_bytes)
+        {
+            if (xrdp_cache_evict_os_bitmap(self, bitmap) != 0)
+            {
+                break;
+            }
+        }
+    }
+
+    if (self->os_bitmap_max_entries > 0)
+    {
+        while (self->os_bitmap_count + 1 > self->os_bitmap_max_entries)
+        {
+            if (xrdp_cache_evict_os_bitmap(self, bitmap) != 0)
+            {
+                break;
+            }
+        }
+    }
+
+    bi->bytes = bytes;
+    self->os_bitmap_bytes += bytes;
+    self->os_bitmap_count++;
+    self->os_bitmap_peak_bytes = MAX(self->os_bitmap_peak_bytes,
+                                     self->os_bitmap_bytes);
+    return 0;
+}
+
+/*****************************************************************************/
+/* returns boolean, true if the bitmap was evicted and what the module drew
+   in it is gone from the client */
+int
+xrdp_cache_os_bitmap_stale(struct xrdp_cache *self,
+                           struct xrdp_bitmap *bitmap)
+{
+    struct xrdp_os_bitmap_item *bi;
+
+    if ((bitmap->item_index < 0) || (bitmap->item_index >= 2000))
+    {
+        return 0;
+    }
+
+    bi = self->os_bitmap_items + bitmap->item_index;
+    return (bi->bitmap == bitmap) && bi->stale;
+}
+
+/*****************************************************************************/
+/* a stale bitmap stays stale until the module deletes it, it only ever
+   gets partial draws after that
+   returns error */
+int
+xrdp_cache_os_bitmap_set_stale(struct xrdp_cache *self,
+                               struct xrdp_bitmap *bitmap)
+{
+    struct xrdp_os_bitmap_item *bi;
+
+    if ((bitmap->item_index < 0) || (bitmap->item_index >= 2000))
+    {
+        return 1;
+    }
+
+    bi = self->os_bitmap_items + bitmap->item_index;
+
+    if (bi->bitmap != bitmap)
+    {
+        return 1;
+    }
+
+    bi->stale = 1;
+    return 0;
+}
+
 /*****************************************************************************/
 struct xrdp_os_bitmap_item *
 xrdp_cache_get_os_bitmap(struct xrdp_cache *self, int rdpindex)
@@ -829,5 +1654,12 @@ xrdp_cache_get_os_bitmap(struct xrdp_cache *self, int rdpindex)
     }
 
     bi = self->os_bitmap_items + rdpindex;
+
+    if (bi->bitmap != 0)
+    {
+        self->os_bitmap_stamp++;
+        bi->stamp = self->os_bitmap_stamp;
+    }
+
     return bi;
 }
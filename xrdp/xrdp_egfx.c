@@ -0,0 +1,798 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Copyright (C) Jay Sorg 2004-2014
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Graphics Pipeline Extension, MS-RDPEGFX
+ * server side of the Microsoft::Windows::RDS::Graphics dynamic channel
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include <config_ac.h>
+#endif
+
+#include "xrdp.h"
+#include "xrdp_egfx.h"
+#include "log.h"
+
+#define LLOG_LEVEL 1
+#define LLOGLN(_level, _args) \
+  do \
+  { \
+    if (_level < LLOG_LEVEL) \
+    { \
+        g_write("xrdp:xrdp_egfx [%10.10u]: ", g_time3()); \
+        g_writeln _args ; \
+    } \
+  } \
+  while (0)
+
+/* biggest dvc data we can send in one static channel pdu */
+#define XRDP_EGFX_DVC_BYTES 1590
+/* biggest RDP_SEGMENTED_DATA segment */
+#define XRDP_EGFX_SEGMENT_BYTES 65535
+/* RDP8_BULK_ENCODED_DATA header, PACKET_COMPR_TYPE_RDP8, not compressed */
+#define XRDP_EGFX_BULK_HEADER 0x04
+/* RDPGFX_RESET_GRAPHICS_PDU is always this size */
+#define XRDP_EGFX_RESET_GRAPHICS_BYTES 340
+
+/*****************************************************************************/
+static struct xrdp_egfx *
+xrdp_egfx_from_id(intptr_t id, int chan_id)
+{
+    struct xrdp_process *pro;
+    struct xrdp_egfx *egfx;
+
+    pro = (struct xrdp_process *) id;
+    if ((pro == NULL) || (pro->wm == NULL) || (pro->wm->mm == NULL))
+    {
+        return NULL;
+    }
+    egfx = pro->wm->mm->egfx;
+    if ((egfx == NULL) || (egfx->chan_id != chan_id))
+    {
+        return NULL;
+    }
+    return egfx;
+}
+
+/*****************************************************************************/
+/* returns error */
+static int
+xrdp_egfx_send_dvc(struct xrdp_egfx *self, const char *data, int bytes)
+{
+    int chunk;
+
+    if (bytes <= XRDP_EGFX_DVC_BYTES)
+    {
+        return libxrdp_drdynvc_data(self->session, self->chan_id,
+                                    data, bytes);
+    }
+    if (libxrdp_drdynvc_data_first(self->session, self->chan_id, data,
+                                   XRDP_EGFX_DVC_BYTES, bytes) != 0)
+    {
+        return 1;
+    }
+    data += XRDP_EGFX_DVC_BYTES;
+    bytes -= XRDP_EGFX_DVC_BYTES;
+    while (bytes > 0)
+    {
+        chunk = MIN(bytes, XRDP_EGFX_DVC_BYTES);
+        if (libxrdp_drdynvc_data(self->session, self->chan_id,
+                                 data, chunk) != 0)
+        {
+            return 1;
+        }
+        data += chunk;
+        bytes -= chunk;
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+/* starts a pdu in pdu_s with room for bytes past the RDPGFX_HEADER */
+static struct stream *
+xrdp_egfx_pdu_begin(struct xrdp_egfx *self, int cmd_id, int bytes)
+{
+    struct stream *s;
+
+    s = self->pdu_s;
+    init_stream(s, 8 + bytes);
+    out_uint16_le(s, cmd_id);
+    out_uint16_le(s, 0); /* flags */
+    out_uint8s(s, 4); /* pduLength, set in xrdp_egfx_pdu_send */
+    return s;
+}
+
+/*****************************************************************************/
+/* server to client pdus always go in RDP_SEGMENTED_DATA, sent here
+   uncompressed
+   returns error */
+static int
+xrdp_egfx_pdu_send(struct xrdp_egfx *self)
+{
+    struct stream *pdu;
+    struct stream *s;
+    char *data;
+    int bytes;
+    int count;
+    int seg;
+
+    pdu = self->pdu_s;
+    s_mark_end(pdu);
+    bytes = (int) (pdu->end - pdu->data);
+    pdu->p = pdu->data + 4;
+    out_uint32_le(pdu, bytes);
+
+    s = self->seg_s;
+    if (bytes <= XRDP_EGFX_SEGMENT_BYTES)
+    {
+        init_stream(s, 2 + bytes);
+        out_uint8(s, 0xE0); /* SEGMENTED_SINGLE */
+        out_uint8(s, XRDP_EGFX_BULK_HEADER);
+        out_uint8a(s, pdu->data, bytes);
+    }
+    else
+    {
+        count = (bytes + XRDP_EGFX_SEGMENT_BYTES - 1) /
+                XRDP_EGFX_SEGMENT_BYTES;
+        init_stream(s, 7 + count * 5 + bytes);
+        out_uint8(s, 0xE1); /* SEGMENTED_MULTIPART */
+        out_uint16_le(s, count);
+        out_uint32_le(s, bytes); /* uncompressedSize */
+        data = pdu->data;
+        while (bytes > 0)
+        {
+            seg = MIN(bytes, XRDP_EGFX_SEGMENT_BYTES);
+            out_uint32_le(s, seg + 1);
+            out_uint8(s, XRDP_EGFX_BULK_HEADER);
+            out_uint8a(s, data, seg);
+            data += seg;
+            bytes -= seg;
+        }
+    }
+    s_mark_end(s);
+    return xrdp_egfx_send_dvc(self, s->data, (int) (s->end - s->data));
+}
+
+/*****************************************************************************/
+static void
+xrdp_egfx_out_rect16(struct stream *s, const short *rect)
+{
+    out_uint16_le(s, rect[0]); /* left */
+    out_uint16_le(s, rect[1]); /* top */
+    out_uint16_le(s, rect[0] + rect[2]); /* right, exclusive */
+    out_uint16_le(s, rect[1] + rect[3]); /* bottom, exclusive */
+}
+
+/*****************************************************************************/
+/* returns error */
+int
+xrdp_egfx_send_create_surface(struct xrdp_egfx *self, int surface_id,
+                              int width, int height, int pixel_format)
+{
+    struct stream *s;
+
+    s = xrdp_egfx_pdu_begin(self, XR_RDPGFX_CMDID_CREATESURFACE, 7);
+    out_uint16_le(s, surface_id);
+    out_uint16_le(s, width);
+    out_uint16_le(s, height);
+    out_uint8(s, pixel_format);
+    return xrdp_egfx_pdu_send(self);
+}
+
+/*****************************************************************************/
+/* returns error */
+int
+xrdp_egfx_send_delete_surface(struct xrdp_egfx *self, int surface_id)
+{
+    struct stream *s;
+
+    s = xrdp_egfx_pdu_begin(self, XR_RDPGFX_CMDID_DELETESURFACE, 2);
+    out_uint16_le(s, surface_id);
+    return xrdp_egfx_pdu_send(self);
+}
+
+/*****************************************************************************/
+/* returns error */
+int
+xrdp_egfx_send_map_surface(struct xrdp_egfx *self, int surface_id,
+                           int x, int y)
+{
+    struct stream *s;
+
+    s = xrdp_egfx_pdu_begin(self, XR_RDPGFX_CMDID_MAPSURFACETOOUTPUT, 12);
+    out_uint16_le(s, surface_id);
+    out_uint16_le(s, 0); /* reserved */
+    out_uint32_le(s, x);
+    out_uint32_le(s, y);
+    return xrdp_egfx_pdu_send(self);
+}
+
+/*****************************************************************************/
+/* pixel is 0xRRGGBB, rects are x, y, cx, cy
+   returns error */
+int
+xrdp_egfx_send_solidfill(struct xrdp_egfx *self, int surface_id,
+                         int pixel, int num_rects, const short *rects)
+{
+    struct stream *s;
+    int index;
+
+    s = xrdp_egfx_pdu_begin(self, XR_RDPGFX_CMDID_SOLIDFILL,
+                            8 + num_rects * 8);
+    out_uint16_le(s, surface_id);
+    out_uint8(s, pixel); /* B */
+    out_uint8(s, pixel >> 8); /* G */
+    out_uint8(s, pixel >> 16); /* R */
+    out_uint8(s, 0xff); /* XA */
+    out_uint16_le(s, num_rects);
+    for (index = 0; index < num_rects; index++)
+    {
+        xrdp_egfx_out_rect16(s, rects + index * 4);
+    }
+    return xrdp_egfx_pdu_send(self);
+}
+
+/*****************************************************************************/
+/* src_rect is x, y, cx, cy, pts are x, y pairs
+   returns error */
+int
+xrdp_egfx_send_surface_to_surface(struct xrdp_egfx *self, int src_surface_id,
+                                  int dst_surface_id, const short *src_rect,
+                                  int num_pts, const short *pts)
+{
+    struct stream *s;
+    int index;
+
+    s = xrdp_egfx_pdu_begin(self, XR_RDPGFX_CMDID_SURFACETOSURFACE,
+                            14 + num_pts * 4);
+    out_uint16_le(s, src_surface_id);
+    out_uint16_le(s, dst_surface_id);
+    xrdp_egfx_out_rect16(s, src_rect);
+    out_uint16_le(s, num_pts);
+    for (index = 0; index < num_pts; index++)
+    {
+        out_uint16_le(s, pts[index * 2 + 0]);
+        out_uint16_le(s, pts[index * 2 + 1]);
+    }
+    return xrdp_egfx_pdu_send(self);
+}
+
+/*****************************************************************************/
+/* the 64 bit cacheKey is sent as two 32 bit halves, low first
+   returns error */
+int
+xrdp_egfx_send_surface_to_cache(struct xrdp_egfx *self, int surface_id,
+                                int cache_key1, int cache_key2,
+                                int cache_slot, const short *src_rect)
+{
+    struct stream *s;
+
+    s = xrdp_egfx_pdu_begin(self, XR_RDPGFX_CMDID_SURFACETOCACHE, 20);
+    out_uint16_le(s, surface_id);
+    out_uint32_le(s, cache_key1);
+    out_uint32_le(s, cache_key2);
+    out_uint16_le(s, cache_slot);
+    xrdp_egfx_out_rect16(s, src_rect);
+    return xrdp_egfx_pdu_send(self);
+}
+
+/*****************************************************************************/
+/* returns error */
+int
+xrdp_egfx_send_cache_to_surface(struct xrdp_egfx *self, int cache_slot,
+                                int surface_id, int num_pts,
+                                const short *pts)
+{
+    struct stream *s;
+    int index;
+
+    s = xrdp_egfx_pdu_begin(self, XR_RDPGFX_CMDID_CACHETOSURFACE,
+                            6 + num_pts * 4);
+    out_uint16_le(s, cache_slot);
+    out_uint16_le(s, surface_id);
+    out_uint16_le(s, num_pts);
+    for (index = 0; index < num_pts; index++)
+    {
+        out_uint16_le(s, pts[index * 2 + 0]);
+        out_uint16_le(s, pts[index * 2 + 1]);
+    }
+    return xrdp_egfx_pdu_send(self);
+}
+
+/*****************************************************************************/
+/* returns error */
+int
+xrdp_egfx_send_evict_cache(struct xrdp_egfx *self, int cache_slot)
+{
+    struct stream *s;
+
+    s = xrdp_egfx_pdu_begin(self, XR_RDPGFX_CMDID_EVICTCACHEENTRY, 2);
+    out_uint16_le(s, cache_slot);
+    return xrdp_egfx_pdu_send(self);
+}
+
+/*****************************************************************************/
+/* returns error */
+int
+xrdp_egfx_send_frame_start(struct xrdp_egfx *self, int frame_id)
+{
+    struct stream *s;
+    int now;
+    int timestamp;
+
+    /* hours, minutes, seconds and milliseconds packed in 10:6:6:10 */
+    now = g_time3();
+    timestamp = ((now / 3600000) & 0x3ff) << 22;
+    timestamp |= ((now / 60000) % 60) << 16;
+    timestamp |= ((now / 1000) % 60) << 10;
+    timestamp |= now % 1000;
+    s = xrdp_egfx_pdu_begin(self, XR_RDPGFX_CMDID_STARTFRAME, 8);
+    out_uint32_le(s, timestamp);
+    out_uint32_le(s, frame_id);
+    return xrdp_egfx_pdu_send(self);
+}
+
+/*****************************************************************************/
+/* returns error */
+int
+xrdp_egfx_send_frame_end(struct xrdp_egfx *self, int frame_id)
+{
+    struct stream *s;
+
+    s = xrdp_egfx_pdu_begin(self, XR_RDPGFX_CMDID_ENDFRAME, 4);
+    out_uint32_le(s, frame_id);
+    return xrdp_egfx_pdu_send(self);
+}
+
+/*****************************************************************************/
+/* data is whatever codec_id says, it is not looked at here
+   returns error */
+int
+xrdp_egfx_send_wire_to_surface1(struct xrdp_egfx *self, int surface_id,
+                                int codec_id, int pixel_format,
+                                int x, int y, int cx, int cy,
+                                const char *data, int data_bytes)
+{
+    struct stream *s;
+    short rect[4];
+
+    s = xrdp_egfx_pdu_begin(self, XR_RDPGFX_CMDID_WIRETOSURFACE_1,
+                            17 + data_bytes);
+    out_uint16_le(s, surface_id);
+    out_uint16_le(s, codec_id);
+    out_uint8(s, pixel_format);
+    rect[0] = x;
+    rect[1] = y;
+    rect[2] = cx;
+    rect[3] = cy;
+    xrdp_egfx_out_rect16(s, rect);
+    out_uint32_le(s, data_bytes);
+    out_uint8a(s, data, data_bytes);
+    return xrdp_egfx_pdu_send(self);
+}
+
+/*****************************************************************************/
+/* returns error */
+static int
+xrdp_egfx_send_caps_confirm(struct xrdp_egfx *self)
+{
+    struct stream *s;
+
+    s = xrdp_egfx_pdu_begin(self, XR_RDPGFX_CMDID_CAPSCONFIRM, 12);
+    out_uint32_le(s, self->cap_version);
+    out_uint32_le(s, 4); /* capsDataLength */
+    out_uint32_le(s, self->cap_flags);
+    return xrdp_egfx_pdu_send(self);
+}
+
+/*****************************************************************************/
+/* returns error */
+static int
+xrdp_egfx_send_reset_graphics(struct xrdp_egfx *self)
+{
+    struct stream *s;
+    struct xrdp_client_info *ci;
+    struct monitor_info *mi;
+    int count;
+    int index;
+
+    ci = self->mm->wm->client_info;
+    count = MIN(ci->monitorCount, 16);
+    s = xrdp_egfx_pdu_begin(self, XR_RDPGFX_CMDID_RESETGRAPHICS,
+                            XRDP_EGFX_RESET_GRAPHICS_BYTES - 8);
+    out_uint32_le(s, self->width);
+    out_uint32_le(s, self->height);
+    if (count < 1)
+    {
+        out_uint32_le(s, 1);
+        out_uint32_le(s, 0);
+        out_uint32_le(s, 0);
+        out_uint32_le(s, self->width - 1);
+        out_uint32_le(s, self->height - 1);
+        out_uint32_le(s, 1); /* TS_MONITOR_PRIMARY */
+        count = 1;
+    }
+    else
+    {
+        out_uint32_le(s, count);
+        for (index = 0; index < count; index++)
+        {
+            mi = ci->minfo_wm + index;
+            out_uint32_le(s, mi->left);
+            out_uint32_le(s, mi->top);
+            out_uint32_le(s, mi->right);
+            out_uint32_le(s, mi->bottom);
+            out_uint32_le(s, mi->is_primary ? 1 : 0);
+        }
+    }
+    /* pad */
+    out_uint8s(s, XRDP_EGFX_RESET_GRAPHICS_BYTES - 20 - count * 20);
+    return xrdp_egfx_pdu_send(self);
+}
+
+/*****************************************************************************/
+/* returns error */
+static int
+xrdp_egfx_send_cache_import_reply(struct xrdp_egfx *self)
+{
+    struct stream *s;
+
+    /* nothing is kept across connections */
+    s = xrdp_egfx_pdu_begin(self, XR_RDPGFX_CMDID_CACHEIMPORTREPLY, 2);
+    out_uint16_le(s, 0); /* importedEntriesCount */
+    return xrdp_egfx_pdu_send(self);
+}
+
+/*****************************************************************************/
+/* picks the caps we can confirm, brings up the screen surface
+   returns error */
+static int
+xrdp_egfx_process_caps_advertise(struct xrdp_egfx *self, struct stream *s)
+{
+    int count;
+    int index;
+    int version;
+    int bytes;
+    int flags;
+    struct xrdp_rect rect;
+
+    if (!s_check_rem(s, 2))
+    {
+        return 1;
+    }
+    in_uint16_le(s, count);
+    self->cap_version = 0;
+    for (index = 0; index < count; index++)
+    {
+        if (!s_check_rem(s, 8))
+        {
+            return 1;
+        }
+        in_uint32_le(s, version);
+        in_uint32_le(s, bytes);
+        if ((bytes < 0) || !s_check_rem(s, bytes))
+        {
+            return 1;
+        }
+        flags = 0;
+        if (bytes >= 4)
+        {
+            in_uint32_le(s, flags);
+            bytes -= 4;
+        }
+        in_uint8s(s, bytes);
+        LLOGLN(0, ("xrdp_egfx_process_caps_advertise: version 0x%8.8x "
+               "flags 0x%8.8x", version, flags));
+        /* RemoteFX in wire to surface is a version 8 thing, prefer 8.1 */
+        if ((version == XR_RDPGFX_CAPVERSION_81) ||
+            ((version == XR_RDPGFX_CAPVERSION_8) &&
+             (self->cap_version != XR_RDPGFX_CAPVERSION_81)))
+        {
+            self->cap_version = version;
+            self->cap_flags = flags & (XR_RDPGFX_CAPS_FLAG_THINCLIENT |
+                                       XR_RDPGFX_CAPS_FLAG_SMALL_CACHE);
+        }
+    }
+    if (self->cap_version == 0)
+    {
+        log_message(LOG_LEVEL_INFO, "xrdp_egfx_process_caps_advertise: "
+                    "no usable caps version, not using the graphics "
+                    "pipeline");
+        libxrdp_drdynvc_close(self->session, self->chan_id);
+        self->state = XRDP_EGFX_STATE_CLOSED;
+        return 0;
+    }
+    self->width = self->mm->wm->screen->width;
+    self->height = self->mm->wm->screen->height;
+    if ((xrdp_egfx_send_caps_confirm(self) != 0) ||
+        (xrdp_egfx_send_reset_graphics(self) != 0) ||
+        (xrdp_egfx_send_create_surface(self, XRDP_EGFX_SCREEN_SURFACE,
+                                       self->width, self->height,
+                                       XR_PIXEL_FORMAT_XRGB_8888) != 0) ||
+        (xrdp_egfx_send_map_surface(self, XRDP_EGFX_SCREEN_SURFACE,
+                                    0, 0) != 0))
+    {
+        return 1;
+    }
+    log_message(LOG_LEVEL_INFO, "xrdp_egfx_process_caps_advertise: "
+                "graphics pipeline up, caps version 0x%8.8x",
+                self->cap_version);
+    self->state = XRDP_EGFX_STATE_READY;
+    self->frame_acks = 1;
+    /* the new surface is blank, get it all painted */
+    MAKERECT(rect, 0, 0, self->width, self->height);
+    return xrdp_bitmap_invalidate(self->mm->wm->screen, &rect);
+}
+
+/*****************************************************************************/
+/* returns error */
+static int
+xrdp_egfx_process_frame_ack(struct xrdp_egfx *self, struct stream *s)
+{
+    unsigned int queue_depth;
+    int frame_id;
+
+    if (!s_check_rem(s, 12))
+    {
+        return 1;
+    }
+    in_uint32_le(s, queue_depth);
+    in_uint32_le(s, frame_id);
+    in_uint8s(s, 4); /* totalFramesDecoded */
+    if (self->frame_acks == 0)
+    {
+        return 0;
+    }
+    if (queue_depth == XR_SUSPEND_FRAME_ACKNOWLEDGEMENT)
+    {
+        /* no more acks will come, let everything go */
+        xrdp_mm_frame_ack(self->mm, -1);
+        self->frame_acks = 0;
+        return 0;
+    }
+    return xrdp_mm_frame_ack(self->mm, frame_id);
+}
+
+/*****************************************************************************/
+/* one or more client pdus
+   returns error */
+static int
+xrdp_egfx_process(struct xrdp_egfx *self, struct stream *s)
+{
+    struct stream ls;
+    int cmd_id;
+    int pdu_bytes;
+    int rv;
+
+    rv = 0;
+    while ((rv == 0) && s_check_rem(s, 8))
+    {
+        g_memset(&ls, 0, sizeof(ls));
+        ls.data = s->p;
+        in_uint16_le(s, cmd_id);
+        in_uint8s(s, 2); /* flags */
+        in_uint32_le(s, pdu_bytes);
+        if ((pdu_bytes < 8) || !s_check_rem(s, pdu_bytes - 8))
+        {
+            return 1;
+        }
+        ls.p = s->p;
+        ls.end = ls.data + pdu_bytes;
+        s->p = ls.end;
+        LLOGLN(10, ("xrdp_egfx_process: cmd_id %d bytes %d",
+               cmd_id, pdu_bytes));
+        switch (cmd_id)
+        {
+            case XR_RDPGFX_CMDID_CAPSADVERTISE:
+                rv = xrdp_egfx_process_caps_advertise(self, &ls);
+                break;
+            case XR_RDPGFX_CMDID_FRAMEACKNOWLEDGE:
+                rv = xrdp_egfx_process_frame_ack(self, &ls);
+                break;
+            case XR_RDPGFX_CMDID_CACHEIMPORTOFFER:
+                rv = xrdp_egfx_send_cache_import_reply(self);
+                break;
+            case XR_RDPGFX_CMDID_QOEFRAMEACKNOWLEDGE:
+                break;
+            default:
+                LLOGLN(0, ("xrdp_egfx_process: unknown cmd_id %d", cmd_id));
+                break;
+        }
+    }
+    return rv;
+}
+
+/*****************************************************************************/
+static int
+xrdp_egfx_open_response(intptr_t id, int chan_id, int creation_status)
+{
+    struct xrdp_egfx *self;
+
+    self = xrdp_egfx_from_id(id, chan_id);
+    if (self == NULL)
+    {
+        return 0;
+    }
+    LLOGLN(0, ("xrdp_egfx_open_response: creation_status %d",
+           creation_status));
+    if (creation_status != 0)
+    {
+        self->state = XRDP_EGFX_STATE_CLOSED;
+        return 0;
+    }
+    self->state = XRDP_EGFX_STATE_CAPS;
+    return 0;
+}
+
+/*****************************************************************************/
+static int
+xrdp_egfx_close_response(intptr_t id, int chan_id)
+{
+    struct xrdp_egfx *self;
+
+    self = xrdp_egfx_from_id(id, chan_id);
+    if (self == NULL)
+    {
+        return 0;
+    }
+    LLOGLN(0, ("xrdp_egfx_close_response:"));
+    if ((self->state == XRDP_EGFX_STATE_READY) && self->frame_acks)
+    {
+        /* nothing will ack the frames in flight now */
+        xrdp_mm_frame_ack(self->mm, -1);
+    }
+    self->state = XRDP_EGFX_STATE_CLOSED;
+    return 0;
+}
+
+/*****************************************************************************/
+static int
+xrdp_egfx_data_first(intptr_t id, int chan_id, char *data, int bytes,
+                     int total_bytes)
+{
+    struct xrdp_egfx *self;
+
+    self = xrdp_egfx_from_id(id, chan_id);
+    if (self == NULL)
+    {
+        return 0;
+    }
+    if ((bytes < 0) || (total_bytes < bytes) ||
+        (total_bytes > 16 * 1024 * 1024))
+    {
+        return 1;
+    }
+    init_stream(self->in_s, total_bytes);
+    self->in_total = total_bytes;
+    out_uint8a(self->in_s, data, bytes);
+    if (bytes == total_bytes)
+    {
+        self->in_total = 0;
+        s_mark_end(self->in_s);
+        self->in_s->p = self->in_s->data;
+        return xrdp_egfx_process(self, self->in_s);
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+static int
+xrdp_egfx_data(intptr_t id, int chan_id, char *data, int bytes)
+{
+    struct xrdp_egfx *self;
+    struct stream ls;
+    struct stream *s;
+
+    self = xrdp_egfx_from_id(id, chan_id);
+    if (self == NULL)
+    {
+        return 0;
+    }
+    if (self->in_total == 0)
+    {
+        /* not fragmented */
+        g_memset(&ls, 0, sizeof(ls));
+        ls.data = data;
+        ls.p = data;
+        ls.end = data + bytes;
+        return xrdp_egfx_process(self, &ls);
+    }
+    s = self->in_s;
+    if (!s_check_rem_out(s, bytes))
+    {
+        self->in_total = 0;
+        return 1;
+    }
+    out_uint8a(s, data, bytes);
+    if ((int) (s->p - s->data) < self->in_total)
+    {
+        return 0;
+    }
+    self->in_total = 0;
+    s_mark_end(s);
+    s->p = s->data;
+    return xrdp_egfx_process(self, s);
+}
+
+/*****************************************************************************/
+/* opens the graphics channel, the rest happens as the client answers
+   returns nil on error */
+struct xrdp_egfx *
+xrdp_egfx_create(struct xrdp_mm *mm, struct xrdp_session *session)
+{
+    struct xrdp_egfx *self;
+    struct xrdp_drdynvc_procs procs;
+    int chan_id;
+
+    g_memset(&procs, 0, sizeof(procs));
+    procs.open_response = xrdp_egfx_open_response;
+    procs.close_response = xrdp_egfx_close_response;
+    procs.data_first = xrdp_egfx_data_first;
+    procs.data = xrdp_egfx_data;
+    if (libxrdp_drdynvc_open(session, XR_RDPGFX_CHANNEL_NAME, 0, &procs,
+                             &chan_id) != 0)
+    {
+        log_message(LOG_LEVEL_ERROR, "xrdp_egfx_create: "
+                    "libxrdp_drdynvc_open failed");
+        return NULL;
+    }
+    self = g_new0(struct xrdp_egfx, 1);
+    if (self == NULL)
+    {
+        libxrdp_drdynvc_close(session, chan_id);
+        return NULL;
+    }
+    self->mm = mm;
+    self->session = session;
+    self->chan_id = chan_id;
+    self->state = XRDP_EGFX_STATE_OPENING;
+    make_stream(self->in_s);
+    make_stream(self->pdu_s);
+    make_stream(self->seg_s);
+    LLOGLN(0, ("xrdp_egfx_create: chan_id %d", chan_id));
+    return self;
+}
+
+/*****************************************************************************/
+void
+xrdp_egfx_delete(struct xrdp_egfx *self)
+{
+    if (self == NULL)
+    {
+        return;
+    }
+    if (self->state == XRDP_EGFX_STATE_READY)
+    {
+        xrdp_egfx_send_delete_surface(self, XRDP_EGFX_SCREEN_SURFACE);
+    }
+    if (self->state != XRDP_EGFX_STATE_CLOSED)
+    {
+        libxrdp_drdynvc_close(self->session, self->chan_id);
+    }
+    free_stream(self->in_s);
+    free_stream(self->pdu_s);
+    free_stream(self->seg_s);
+    g_free(self);
+}
+
+/*****************************************************************************/
+/* true once the screen surface is there to draw to */
+int
+xrdp_egfx_ready(struct xrdp_egfx *self)
+{
+    return (self != NULL) && (self->state == XRDP_EGFX_STATE_READY);
+}
@@ -0,0 +1,93 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Copyright (C) Jay Sorg 2004-2014
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Graphics Pipeline Extension, MS-RDPEGFX
+ */
+
+#ifndef _XRDP_EGFX_H
+#define _XRDP_EGFX_H
+
+#include "arch.h"
+#include "parse.h"
+
+#define XRDP_EGFX_STATE_CLOSED  0
+#define XRDP_EGFX_STATE_OPENING 1 /* waiting for the dvc open response */
+#define XRDP_EGFX_STATE_CAPS    2 /* waiting for caps advertise */
+#define XRDP_EGFX_STATE_READY   3 /* screen surface created and mapped */
+
+/* the surface that is mapped to the whole output */
+#define XRDP_EGFX_SCREEN_SURFACE 0
+
+struct xrdp_egfx
+{
+    struct xrdp_mm *mm;
+    struct xrdp_session *session;
+    int chan_id;
+    int state; /* see XRDP_EGFX_STATE_* */
+    int cap_version;
+    int cap_flags;
+    int frame_acks; /* false once the client suspends frame acks */
+    int width; /* of the screen surface */
+    int height;
+    struct stream *in_s; /* client pdu reassembly */
+    int in_total; /* bytes expected in in_s */
+    struct stream *pdu_s; /* pdu being built */
+    struct stream *seg_s; /* pdu wrapped in RDP_SEGMENTED_DATA */
+};
+
+struct xrdp_egfx *
+xrdp_egfx_create(struct xrdp_mm *mm, struct xrdp_session *session);
+void
+xrdp_egfx_delete(struct xrdp_egfx *self);
+int
+xrdp_egfx_ready(struct xrdp_egfx *self);
+int
+xrdp_egfx_send_create_surface(struct xrdp_egfx *self, int surface_id,
+                              int width, int height, int pixel_format);
+int
+xrdp_egfx_send_delete_surface(struct xrdp_egfx *self, int surface_id);
+int
+xrdp_egfx_send_map_surface(struct xrdp_egfx *self, int surface_id,
+                           int x, int y);
+int
+xrdp_egfx_send_solidfill(struct xrdp_egfx *self, int surface_id,
+                         int pixel, int num_rects, const short *rects);
+int
+xrdp_egfx_send_surface_to_surface(struct xrdp_egfx *self, int src_surface_id,
+                                  int dst_surface_id, const short *src_rect,
+                                  int num_pts, const short *pts);
+int
+xrdp_egfx_send_surface_to_cache(struct xrdp_egfx *self, int surface_id,
+                                int cache_key1, int cache_key2,
+                                int cache_slot, const short *src_rect);
+int
+xrdp_egfx_send_cache_to_surface(struct xrdp_egfx *self, int cache_slot,
+                                int surface_id, int num_pts,
+                                const short *pts);
+int
+xrdp_egfx_send_evict_cache(struct xrdp_egfx *self, int cache_slot);
+int
+xrdp_egfx_send_frame_start(struct xrdp_egfx *self, int frame_id);
+int
+xrdp_egfx_send_frame_end(struct xrdp_egfx *self, int frame_id);
+int
+xrdp_egfx_send_wire_to_surface1(struct xrdp_egfx *self, int surface_id,
+                                int codec_id, int pixel_format,
+                                int x, int y, int cx, int cy,
+                                const char *data, int data_bytes);
+
+#endif
@@ -47,13 +47,84 @@
 
 /*****************************************************************************/
 static int
-process_enc_jpg(struct xrdp_encoder *self, XRDP_ENC_DATA *enc);
+process_enc_jpg(struct xrdp_enc_worker *worker, XRDP_ENC_DATA *enc);
 #ifdef XRDP_RFXCODEC
 static int
-process_enc_rfx(struct xrdp_encoder *self, XRDP_ENC_DATA *enc);
+process_enc_rfx(struct xrdp_enc_worker *worker, XRDP_ENC_DATA *enc);
 #endif
 static int
-process_enc_h264(struct xrdp_encoder *self, XRDP_ENC_DATA *enc);
+process_enc_h264(struct xrdp_enc_worker *worker, XRDP_ENC_DATA *enc);
+static int
+process_enc_nsc(struct xrdp_enc_worker *worker, XRDP_ENC_DATA *enc);
+
+/*****************************************************************************/
+/* one worker per monitor for the codecs that keep no state between rects,
+   the area of a worker is where xrdp_encoder_queue sends its rects */
+static void
+xrdp_encoder_create_workers(struct xrdp_encoder *self)
+{
+    struct xrdp_client_info *client_info;
+    struct xrdp_enc_worker *worker;
+    struct monitor_info *mi;
+    char buf[1024];
+    int pid;
+    int index;
+    int width;
+    int height;
+    int split;
+
+    client_info = self->mm->wm->client_info;
+    width = self->mm->wm->screen->width;
+    height = self->mm->wm->screen->height;
+    /* jpeg compresses through the session and h264 is one stream */
+    split = (self->process_enc == process_enc_nsc);
+#ifdef XRDP_RFXCODEC
+    split |= (self->process_enc == process_enc_rfx);
+#endif
+    self->num_workers = 1;
+    if (split && (client_info->monitorCount > 1))
+    {
+        self->num_workers = MIN(client_info->monitorCount,
+                                XRDP_ENC_MAX_WORKERS);
+    }
+    pid = g_getpid();
+    for (index = 0; index < self->num_workers; index++)
+    {
+        worker = self->workers + index;
+        worker->encoder = self;
+        worker->index = index;
+        if (self->num_workers > 1)
+        {
+            mi = client_info->minfo_wm + index;
+            worker->left = mi->left;
+            worker->top = mi->top;
+            worker->right = mi->right + 1;
+            worker->bottom = mi->bottom + 1;
+        }
+        else
+        {
+            worker->right = width;
+            worker->bottom = height;
+        }
+        worker->fifo_to_proc = fifo_create();
+        g_snprintf(buf, 1024, "xrdp_%8.8x_encoder_event_to_proc_%d",
+                   pid, index);
+        worker->xrdp_encoder_event_to_proc = g_create_wait_obj(buf);
+#ifdef XRDP_RFXCODEC
+        if (self->process_enc == process_enc_rfx)
+        {
+            worker->codec_handle = rfxcodec_encode_create(width, height,
+                                                          RFX_FORMAT_YUV, 0);
+        }
+#endif
+        if (self->process_enc == process_enc_nsc)
+        {
+            worker->codec_handle = libxrdp_codec_nsc_create();
+        }
+    }
+    LLOGLN(0, ("xrdp_encoder_create_workers: %d encoder threads",
+           self->num_workers));
+}
 
 /*****************************************************************************/
 struct xrdp_encoder *
@@ -63,10 +134,20 @@ xrdp_encoder_create(struct xrdp_mm *mm)
     struct xrdp_client_info *client_info;
     char buf[1024];
     int pid;
+    int index;
 
     client_info = mm->wm->client_info;
 
-    if (client_info->mcs_connection_type != CONNECTION_TYPE_LAN)
+    /* net_connection_type is what network auto-detect measured, if the
+       client let us, that wins over what the client declared */
+    if (client_info->net_bw_count > 0)
+    {
+        if (client_info->net_connection_type != CONNECTION_TYPE_LAN)
+        {
+            return 0;
+        }
+    }
+    else if (client_info->mcs_connection_type != CONNECTION_TYPE_LAN)
     {
         return 0;
     }
@@ -77,6 +158,7 @@ xrdp_encoder_create(struct xrdp_mm *mm)
 
     self = (struct xrdp_encoder *)g_malloc(sizeof(struct xrdp_encoder), 1);
     self->mm = mm;
+    self->gfx_codec_id = -1;
 
     if (client_info->jpeg_codec_id != 0)
     {
@@ -98,9 +180,9 @@ xrdp_encoder_create(struct xrdp_mm *mm)
         self->in_codec_mode = 1;
         client_info->capture_code = 2;
         self->process_enc = process_enc_rfx;
-        self->codec_handle = rfxcodec_encode_create(mm->wm->screen->width,
-                                                    mm->wm->screen->height,
-                                                    RFX_FORMAT_YUV, 0);
+        self->gfx_codec_id = XR_RDPGFX_CODECID_CAVIDEO;
+        /* crects are the codec's 64x64 tiles */
+        self->whole_tiles = 1;
     }
 #endif
     else if (client_info->h264_codec_id != 0)
@@ -114,6 +196,26 @@ xrdp_encoder_create(struct xrdp_mm *mm)
             (12 << 24) | (64 << 16) | (0 << 12) | (0 << 8) | (0 << 4) | 0;
         self->process_enc = process_enc_h264;
     }
+    else if (client_info->ns_codec_id != 0)
+    {
+        LLOGLN(0, ("xrdp_encoder_create: starting nscodec session"));
+        self->codec_id = client_info->ns_codec_id;
+        self->in_codec_mode = 1;
+        /* TS_NSCODEC_CAPABILITYSET, fAllowDynamicFidelity,
+           fAllowSubsampling, colorLossLevel */
+        self->codec_color_loss = 3;
+        self->codec_subsampling = 1;
+        if (client_info->ns_prop_len >= 3)
+        {
+            self->codec_subsampling = client_info->ns_prop[1] != 0;
+            self->codec_color_loss = client_info->ns_prop[2];
+        }
+        client_info->capture_code = 0;
+        client_info->capture_format =
+            /* XRDP_a8r8g8b8 */
+            (32 << 24) | (2 << 16) | (8 << 12) | (8 << 8) | (8 << 4) | 8;
+        self->process_enc = process_enc_nsc;
+    }
     else
     {
         g_free(self);
@@ -123,36 +225,52 @@ xrdp_encoder_create(struct xrdp_mm *mm)
     LLOGLN(0, ("init_xrdp_encoder: initializing encoder codec_id %d", self->codec_id));
 
     /* setup required FIFOs */
-    self->fifo_to_proc = fifo_create();
     self->fifo_processed = fifo_create();
     self->mutex = tc_mutex_create();
 
     pid = g_getpid();
     /* setup wait objects for signalling */
-    g_snprintf(buf, 1024, "xrdp_%8.8x_encoder_event_to_proc", pid);
-    self->xrdp_encoder_event_to_proc = g_create_wait_obj(buf);
     g_snprintf(buf, 1024, "xrdp_%8.8x_encoder_event_processed", pid);
     self->xrdp_encoder_event_processed = g_create_wait_obj(buf);
     g_snprintf(buf, 1024, "xrdp_%8.8x_encoder_term", pid);
     self->xrdp_encoder_term = g_create_wait_obj(buf);
     self->max_compressed_bytes = client_info->max_fastpath_frag_bytes & ~15;
+    self->damage_grid = mm->wm->xrdp_config->cfg_globals.damage_grid;
+    self->damage_merge_percent =
+        mm->wm->xrdp_config->cfg_globals.damage_merge_percent;
+    self->damage_max_rects = mm->wm->xrdp_config->cfg_globals.damage_max_rects;
     self->frames_in_flight = client_info->max_unacknowledged_frame_count;
     /* make sure frames_in_flight is at least 1 */
     self->frames_in_flight = MAX(self->frames_in_flight, 1);
 
-    /* create thread to process messages */
-    tc_thread_create(proc_enc_msg, self);
+    xrdp_encoder_create_workers(self);
+    /* create threads to process messages */
+    for (index = 0; index < self->num_workers; index++)
+    {
+        tc_thread_create(proc_enc_msg, self->workers + index);
+    }
 
     return self;
 }
 
+/*****************************************************************************/
+static void
+xrdp_encoder_job_free(XRDP_ENC_DATA *enc)
+{
+    g_free(enc->drects);
+    g_free(enc->crects);
+    g_free(enc);
+}
+
 /*****************************************************************************/
 void
 xrdp_encoder_delete(struct xrdp_encoder *self)
 {
     XRDP_ENC_DATA *enc;
     XRDP_ENC_DATA_DONE *enc_done;
+    struct xrdp_enc_worker *worker;
     FIFO *fifo;
+    int index;
 
     LLOGLN(0, ("xrdp_encoder_delete:"));
     if (self == 0)
@@ -167,39 +285,47 @@ xrdp_encoder_delete(struct xrdp_encoder *self)
     g_set_wait_obj(self->xrdp_encoder_term);
     g_sleep(1000);
 
-    /* todo delete specific encoder */
-
-    if (self->process_enc == process_enc_jpg)
+    for (index = 0; index < self->num_workers; index++)
     {
-    }
+        worker = self->workers + index;
 #ifdef XRDP_RFXCODEC
-    else if (self->process_enc == process_enc_rfx)
-    {
-        rfxcodec_encode_destroy(self->codec_handle);
-    }
+        if (self->process_enc == process_enc_rfx)
+        {
+            rfxcodec_encode_destroy(worker->codec_handle);
+        }
 #endif
+        if (self->process_enc == process_enc_nsc)
+        {
+            libxrdp_codec_nsc_delete(worker->codec_handle);
+        }
+        g_delete_wait_obj(worker->xrdp_encoder_event_to_proc);
+
+        /* cleanup fifo_to_proc, whole frames are also on the frames list */
+        fifo = worker->fifo_to_proc;
+        if (fifo)
+        {
+            while (!fifo_is_empty(fifo))
+            {
+                enc = (XRDP_ENC_DATA *) fifo_remove_item(fifo);
+                if ((enc == 0) || (enc->parent == enc))
+                {
+                    continue;
+                }
+                xrdp_encoder_job_free(enc);
+            }
+            fifo_delete(fifo);
+        }
+    }
 
     /* destroy wait objects used for signalling */
-    g_delete_wait_obj(self->xrdp_encoder_event_to_proc);
     g_delete_wait_obj(self->xrdp_encoder_event_processed);
     g_delete_wait_obj(self->xrdp_encoder_term);
 
-    /* cleanup fifo_to_proc */
-    fifo = self->fifo_to_proc;
-    if (fifo)
+    while (self->free_jobs != 0)
     {
-        while (!fifo_is_empty(fifo))
-        {
-            enc = (XRDP_ENC_DATA *) fifo_remove_item(fifo);
-            if (enc == 0)
-            {
-                continue;
-            }
-            g_free(enc->drects);
-            g_free(enc->crects);
-            g_free(enc);
-        }
-        fifo_delete(fifo);
+        enc = self->free_jobs;
+        self->free_jobs = enc->next;
+        xrdp_encoder_job_free(enc);
     }
 
     /* cleanup fifo_processed */
@@ -213,20 +339,548 @@ xrdp_encoder_delete(struct xrdp_encoder *self)
             {
                 continue;
             }
+            enc = enc_done->enc;
+            if ((enc_done->last) && (enc != 0) && (enc->parent != enc))
+            {
+                xrdp_encoder_job_free(enc);
+            }
             g_free(enc_done->comp_pad_data);
             g_free(enc_done);
         }
         fifo_delete(fifo);
     }
+    while (self->frames_head != 0)
+    {
+        enc = self->frames_head;
+        self->frames_head = enc->next;
+        while (enc->held_head != 0)
+        {
+            enc_done = enc->held_head;
+            enc->held_head = enc_done->next;
+            if ((enc_done->last) && (enc_done->enc != enc))
+            {
+                xrdp_encoder_job_free(enc_done->enc);
+            }
+            g_free(enc_done->comp_pad_data);
+            g_free(enc_done);
+        }
+        xrdp_encoder_job_free(enc);
+    }
     tc_mutex_delete(self->mutex);
+    g_free(self->damage_rects);
     g_free(self);
 }
 
+/*****************************************************************************/
+/* returns a job with room for the rects, taken from the pool when one is
+   free, so the paint to encoder handoff does not allocate once warmed up
+   main thread only, returns nil on error */
+XRDP_ENC_DATA *
+xrdp_encoder_job_get(struct xrdp_encoder *self, int num_drects,
+                     int num_crects)
+{
+    XRDP_ENC_DATA *enc;
+    short *rects;
+
+    enc = self->free_jobs;
+    if (enc != 0)
+    {
+        self->free_jobs = enc->next;
+        self->num_free_jobs--;
+        enc->next = 0;
+    }
+    else
+    {
+        enc = (XRDP_ENC_DATA *) g_malloc(sizeof(XRDP_ENC_DATA), 1);
+        if (enc == 0)
+        {
+            return 0;
+        }
+    }
+    if (num_drects > enc->max_drects)
+    {
+        rects = (short *) g_malloc(sizeof(short) * num_drects * 4, 0);
+        if (rects == 0)
+        {
+            xrdp_encoder_job_put(self, enc);
+            return 0;
+        }
+        g_free(enc->drects);
+        enc->drects = rects;
+        enc->max_drects = num_drects;
+    }
+    if (num_crects > enc->max_crects)
+    {
+        rects = (short *) g_malloc(sizeof(short) * num_crects * 4, 0);
+        if (rects == 0)
+        {
+            xrdp_encoder_job_put(self, enc);
+            return 0;
+        }
+        g_free(enc->crects);
+        enc->crects = rects;
+        enc->max_crects = num_crects;
+    }
+    enc->num_drects = num_drects;
+    enc->num_crects = num_crects;
+    return enc;
+}
+
+/*****************************************************************************/
+/* gives a job back after its last XRDP_ENC_DATA_DONE, main thread only */
+void
+xrdp_encoder_job_put(struct xrdp_encoder *self, XRDP_ENC_DATA *enc)
+{
+    if (self->num_free_jobs >= XRDP_ENC_JOB_POOL)
+    {
+        xrdp_encoder_job_free(enc);
+        return;
+    }
+    enc->next = self->free_jobs;
+    self->free_jobs = enc;
+    self->num_free_jobs++;
+}
+
+/*****************************************************************************/
+static int
+xrdp_encoder_dispatch(struct xrdp_enc_worker *worker, XRDP_ENC_DATA *enc)
+{
+    /* insert into fifo for encoder thread to process */
+    tc_mutex_lock(worker->encoder->mutex);
+    fifo_add_item(worker->fifo_to_proc, enc);
+    tc_mutex_unlock(worker->encoder->mutex);
+    /* signal xrdp_encoder thread */
+    g_set_wait_obj(worker->xrdp_encoder_event_to_proc);
+    return 0;
+}
+
+/*****************************************************************************/
+/* copies the rects of rects that fall in area to out, clipped to it,
+   returns the count */
+static int
+xrdp_encoder_clip_rects(const struct xrdp_rect *area,
+                        const short *rects, int num_rects, short *out)
+{
+    int index;
+    int count;
+    int x1;
+    int y1;
+    int x2;
+    int y2;
+
+    count = 0;
+    for (index = 0; index < num_rects; index++)
+    {
+        x1 = MAX(rects[index * 4 + 0], area->left);
+        y1 = MAX(rects[index * 4 + 1], area->top);
+        x2 = MIN(rects[index * 4 + 0] + rects[index * 4 + 2], area->right);
+        y2 = MIN(rects[index * 4 + 1] + rects[index * 4 + 3], area->bottom);
+        if ((x2 <= x1) || (y2 <= y1))
+        {
+            continue;
+        }
+        out[count * 4 + 0] = x1;
+        out[count * 4 + 1] = y1;
+        out[count * 4 + 2] = x2 - x1;
+        out[count * 4 + 3] = y2 - y1;
+        count++;
+    }
+    return count;
+}
+
+/*****************************************************************************/
+/* true if the point is in the worker's area */
+static int
+xrdp_encoder_worker_has(const struct xrdp_enc_worker *worker, int x, int y)
+{
+    return (x >= worker->left) && (x < worker->right) &&
+           (y >= worker->top) && (y < worker->bottom);
+}
+
+/*****************************************************************************/
+/* copies the codec tiles that belong to worker to out, whole, and sets
+   bounds to the area they cover, a tile crossing a monitor edge belongs
+   to the worker that has its origin, or the first one it touches when its
+   origin is off every monitor, so it is only encoded once
+   returns the count */
+static int
+xrdp_encoder_own_tiles(struct xrdp_encoder *self,
+                       const struct xrdp_enc_worker *worker,
+                       const short *tiles, int num_tiles, short *out,
+                       struct xrdp_rect *bounds)
+{
+    const struct xrdp_enc_worker *owner;
+    int index;
+    int jndex;
+    int count;
+    int x1;
+    int y1;
+    int x2;
+    int y2;
+
+    count = 0;
+    bounds->left = worker->right;
+    bounds->top = worker->bottom;
+    bounds->right = worker->left;
+    bounds->bottom = worker->top;
+    for (index = 0; index < num_tiles; index++)
+    {
+        x1 = tiles[index * 4 + 0];
+        y1 = tiles[index * 4 + 1];
+        x2 = x1 + tiles[index * 4 + 2];
+        y2 = y1 + tiles[index * 4 + 3];
+        owner = 0;
+        for (jndex = 0; jndex < self->num_workers; jndex++)
+        {
+            if (xrdp_encoder_worker_has(self->workers + jndex, x1, y1))
+            {
+                owner = self->workers + jndex;
+                break;
+            }
+        }
+        for (jndex = 0; (owner == 0) && (jndex < self->num_workers); jndex++)
+        {
+            owner = self->workers + jndex;
+            if ((x2 <= owner->left) || (x1 >= owner->right) ||
+                (y2 <= owner->top) || (y1 >= owner->bottom))
+            {
+                owner = 0;
+            }
+        }
+        if (owner != worker)
+        {
+            continue;
+        }
+        bounds->left = MIN(bounds->left, x1);
+        bounds->top = MIN(bounds->top, y1);
+        bounds->right = MAX(bounds->right, x2);
+        bounds->bottom = MAX(bounds->bottom, y2);
+        out[count * 4 + 0] = x1;
+        out[count * 4 + 1] = y1;
+        out[count * 4 + 2] = x2 - x1;
+        out[count * 4 + 3] = y2 - y1;
+        count++;
+    }
+    return count;
+}
+
+/*****************************************************************************/
+/* merges rect b into a when the bounding rect adds at most percent of its
+   area that is in neither, covered is the area a is made of
+   returns true if merged */
+static int
+xrdp_encoder_merge_rect(struct xrdp_rect *a, int *covered,
+                        const struct xrdp_rect *b, int percent)
+{
+    struct xrdp_rect m;
+    int area;
+    int b_area;
+
+    m.left = MIN(a->left, b->left);
+    m.top = MIN(a->top, b->top);
+    m.right = MAX(a->right, b->right);
+    m.bottom = MAX(a->bottom, b->bottom);
+    area = (m.right - m.left) * (m.bottom - m.top);
+    b_area = (b->right - b->left) * (b->bottom - b->top);
+    if ((area - *covered - b_area) * 100 > area * percent)
+    {
+        return 0;
+    }
+    *a = m;
+    *covered += b_area;
+    return 1;
+}
+
+/*****************************************************************************/
+/* the damage stage, run before a frame is split for the workers
+   codec tiles become the update rects, joined, other codecs get their
+   rects snapped to damage_grid, joined, merged where little is added and
+   capped at damage_max_rects, main thread only, returns error */
+static int
+xrdp_encoder_simplify(struct xrdp_encoder *self, XRDP_ENC_DATA *enc)
+{
+    struct xrdp_region *reg;
+    struct xrdp_rect rect;
+    struct xrdp_rect *rects;
+    short *out;
+    int grid;
+    int index;
+    int count;
+    int merged;
+    int covered;
+    int num_out;
+
+    if ((self->damage_grid < 1) && (self->damage_merge_percent < 1) &&
+        (self->damage_max_rects < 1))
+    {
+        return 0;
+    }
+    if (enc->num_crects < 2)
+    {
+        return 0;
+    }
+    grid = MAX(self->damage_grid, 1);
+    reg = xrdp_region_create(self->mm->wm);
+    for (index = 0; index < enc->num_crects; index++)
+    {
+        rect.left = enc->crects[index * 4 + 0];
+        rect.top = enc->crects[index * 4 + 1];
+        rect.right = rect.left + enc->crects[index * 4 + 2];
+        rect.bottom = rect.top + enc->crects[index * 4 + 3];
+        if (!self->whole_tiles)
+        {
+            rect.left -= rect.left % grid;
+            rect.top -= rect.top % grid;
+            rect.right += (grid - rect.right % grid) % grid;
+            rect.bottom += (grid - rect.bottom % grid) % grid;
+        }
+        /* edge tiles can hang off the screen */
+        rect.left = MAX(rect.left, 0);
+        rect.top = MAX(rect.top, 0);
+        rect.right = MIN(rect.right, enc->width);
+        rect.bottom = MIN(rect.bottom, enc->height);
+        if ((rect.right > rect.left) && (rect.bottom > rect.top))
+        {
+            xrdp_region_add_rect(reg, &rect);
+        }
+    }
+    count = 0;
+    while (xrdp_region_get_rect(reg, count, &rect) == 0)
+    {
+        count++;
+    }
+    if (count > self->max_damage_rects)
+    {
+        g_free(self->damage_rects);
+        self->damage_rects = g_new(struct xrdp_rect, count);
+        self->max_damage_rects = self->damage_rects == 0 ? 0 : count;
+    }
+    if ((count < 1) || (count > self->max_damage_rects))
+    {
+        xrdp_region_delete(reg);
+        return 1;
+    }
+    rects = self->damage_rects;
+    for (index = 0; index < count; index++)
+    {
+        xrdp_region_get_rect(reg, index, rects + index);
+    }
+    xrdp_region_delete(reg);
+
+    if (!self->whole_tiles)
+    {
+        /* the region is in bands, top to bottom then left to right, so
+           neighbours are mostly next to each other */
+        merged = 0;
+        covered = (rects[0].right - rects[0].left) *
+                  (rects[0].bottom - rects[0].top);
+        for (index = 1; index < count; index++)
+        {
+            if (!xrdp_encoder_merge_rect(rects + merged, &covered,
+                                         rects + index,
+                                         self->damage_merge_percent))
+            {
+                merged++;
+                rects[merged] = rects[index];
+                covered = (rects[merged].right - rects[merged].left) *
+                          (rects[merged].bottom - rects[merged].top);
+            }
+        }
+        count = merged + 1;
+        /* still too many, merge pairs whatever it adds */
+        while ((self->damage_max_rects > 0) &&
+               (count > self->damage_max_rects))
+        {
+            merged = 0;
+            for (index = 0; index < count; index += 2)
+            {
+                rects[merged] = rects[index];
+                if (index + 1 < count)
+                {
+                    covered = 0;
+                    xrdp_encoder_merge_rect(rects + merged, &covered,
+                                            rects + index + 1, 100);
+                }
+                merged++;
+            }
+            count = merged;
+        }
+    }
+
+    /* tiles keep their crects, the update rects are the joined tiles */
+    num_out = self->whole_tiles ? enc->max_drects : enc->max_crects;
+    if (count > num_out)
+    {
+        out = (short *) g_malloc(sizeof(short) * count * 4, 0);
+        if (out == 0)
+        {
+            return 1;
+        }
+        if (self->whole_tiles)
+        {
+            g_free(enc->drects);
+            enc->drects = out;
+            enc->max_drects = count;
+        }
+        else
+        {
+            g_free(enc->crects);
+            enc->crects = out;
+            enc->max_crects = count;
+        }
+    }
+    out = self->whole_tiles ? enc->drects : enc->crects;
+    for (index = 0; index < count; index++)
+    {
+        out[index * 4 + 0] = rects[index].left;
+        out[index * 4 + 1] = rects[index].top;
+        out[index * 4 + 2] = rects[index].right - rects[index].left;
+        out[index * 4 + 3] = rects[index].bottom - rects[index].top;
+    }
+    if (self->whole_tiles)
+    {
+        enc->num_drects = count;
+    }
+    else
+    {
+        enc->num_crects = count;
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+/* hands a frame from the module to the encoder threads, with more than one
+   worker it is split into a part per monitor it touches, main thread only
+   returns error */
+int
+xrdp_encoder_queue(struct xrdp_encoder *self, XRDP_ENC_DATA *enc)
+{
+    struct xrdp_enc_worker *worker;
+    XRDP_ENC_DATA *part;
+    struct xrdp_rect area;
+    int index;
+
+    xrdp_encoder_simplify(self, enc);
+    enc->parent = enc;
+    enc->pending = 0;
+    enc->started = 0;
+    enc->held_head = 0;
+    enc->held_tail = 0;
+    enc->next = 0;
+    if (self->frames_tail == 0)
+    {
+        self->frames_head = enc;
+    }
+    else
+    {
+        self->frames_tail->next = enc;
+    }
+    self->frames_tail = enc;
+
+    if (self->num_workers > 1)
+    {
+        for (index = 0; index < self->num_workers; index++)
+        {
+            worker = self->workers + index;
+            part = xrdp_encoder_job_get(self, enc->num_drects,
+                                        enc->num_crects);
+            if (part == 0)
+            {
+                continue;
+            }
+            MAKERECT(area, worker->left, worker->top,
+                     worker->right - worker->left,
+                     worker->bottom - worker->top);
+            if (self->whole_tiles)
+            {
+                /* the damage goes with the tiles, past the monitor edge */
+                part->num_crects = xrdp_encoder_own_tiles(self, worker,
+                                                          enc->crects,
+                                                          enc->num_crects,
+                                                          part->crects,
+                                                          &area);
+            }
+            else
+            {
+                part->num_crects = xrdp_encoder_clip_rects(&area,
+                                                           enc->crects,
+                                                           enc->num_crects,
+                                                           part->crects);
+            }
+            part->num_drects = xrdp_encoder_clip_rects(&area,
+                                                       enc->drects,
+                                                       enc->num_drects,
+                                                       part->drects);
+            if ((part->num_drects < 1) || (part->num_crects < 1))
+            {
+                xrdp_encoder_job_put(self, part);
+                continue;
+            }
+            part->mod = enc->mod;
+            part->data = enc->data;
+            part->width = enc->width;
+            part->height = enc->height;
+            part->flags = enc->flags;
+            part->frame_id = enc->frame_id;
+            part->parent = enc;
+            enc->pending++;
+            xrdp_encoder_dispatch(worker, part);
+        }
+    }
+    if (enc->pending == 0)
+    {
+        /* one worker, or nothing on any monitor but it still needs an ack */
+        enc->pending = 1;
+        xrdp_encoder_dispatch(self->workers, enc);
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+/* called with the job of a last XRDP_ENC_DATA_DONE, main thread only */
+void
+xrdp_encoder_part_done(struct xrdp_encoder *self, XRDP_ENC_DATA *enc)
+{
+    XRDP_ENC_DATA *parent;
+
+    parent = enc->parent;
+    if (parent != enc)
+    {
+        xrdp_encoder_job_put(self, enc);
+    }
+    parent->pending--;
+}
+
+/*****************************************************************************/
+/* returns the oldest frame once all its parts are done, in the order they
+   were queued so frames are acked in order, nil if there is none
+   the caller acks the frame and gives it back with xrdp_encoder_job_put
+   main thread only */
+XRDP_ENC_DATA *
+xrdp_encoder_frame_done(struct xrdp_encoder *self)
+{
+    XRDP_ENC_DATA *enc;
+
+    enc = self->frames_head;
+    if ((enc == 0) || (enc->pending > 0))
+    {
+        return 0;
+    }
+    self->frames_head = enc->next;
+    if (self->frames_head == 0)
+    {
+        self->frames_tail = 0;
+    }
+    enc->next = 0;
+    return enc;
+}
+
 /*****************************************************************************/
 /* called from encoder thread */
 static int
-process_enc_jpg(struct xrdp_encoder *self, XRDP_ENC_DATA *enc)
+process_enc_jpg(struct xrdp_enc_worker *worker, XRDP_ENC_DATA *enc)
 {
+    struct xrdp_encoder *self;
     int index;
     int x;
     int y;
@@ -242,6 +896,7 @@ process_enc_jpg(struct xrdp_encoder *self, XRDP_ENC_DATA *enc)
     tbus mutex;
     tbus event_processed;
 
+    self = worker->encoder;
     LLOGLN(10, ("process_enc_jpg:"));
     quality = self->codec_quality;
     fifo_processed = self->fifo_processed;
@@ -316,8 +971,9 @@ process_enc_jpg(struct xrdp_encoder *self, XRDP_ENC_DATA *enc)
 /*****************************************************************************/
 /* called from encoder thread */
 static int
-process_enc_rfx(struct xrdp_encoder *self, XRDP_ENC_DATA *enc)
+process_enc_rfx(struct xrdp_enc_worker *worker, XRDP_ENC_DATA *enc)
 {
+    struct xrdp_encoder *self;
     int index;
     int x;
     int y;
@@ -335,6 +991,7 @@ process_enc_rfx(struct xrdp_encoder *self, XRDP_ENC_DATA *enc)
     struct rfx_rect *rfxrects;
     int alloc_bytes;
 
+    self = worker->encoder;
     LLOGLN(10, ("process_enc_rfx:"));
     LLOGLN(10, ("process_enc_rfx: num_crects %d num_drects %d",
            enc->num_crects, enc->num_drects));
@@ -346,7 +1003,21 @@ process_enc_rfx(struct xrdp_encoder *self, XRDP_ENC_DATA *enc)
     out_data = NULL;
     out_data_bytes = 0;
 
-    if ((enc->num_crects > 0) && (enc->num_drects > 0))
+    /* the sync and context blocks only go out with the first message of a
+       codec handle and the client needs them again when the output moves
+       to the graphics pipeline, a new handle starts over */
+    if (enc->parent->gfx != worker->codec_gfx)
+    {
+        rfxcodec_encode_destroy(worker->codec_handle);
+        worker->codec_handle =
+            rfxcodec_encode_create(self->mm->wm->screen->width,
+                                   self->mm->wm->screen->height,
+                                   RFX_FORMAT_YUV, 0);
+        worker->codec_gfx = enc->parent->gfx;
+    }
+
+    if ((enc->num_crects > 0) && (enc->num_drects > 0) &&
+        (worker->codec_handle != NULL))
     {
         alloc_bytes = XRDP_SURCMD_PREFIX_BYTES;
         alloc_bytes += self->max_compressed_bytes;
@@ -390,7 +1061,7 @@ process_enc_rfx(struct xrdp_encoder *self, XRDP_ENC_DATA *enc)
             }
 
             out_data_bytes = self->max_compressed_bytes;
-            error = rfxcodec_encode(self->codec_handle,
+            error = rfxcodec_encode(worker->codec_handle,
                                     out_data + XRDP_SURCMD_PREFIX_BYTES,
                                     &out_data_bytes, enc->data,
                                     enc->width, enc->height, enc->width * 4,
@@ -431,7 +1102,125 @@ process_enc_rfx(struct xrdp_encoder *self, XRDP_ENC_DATA *enc)
 /*****************************************************************************/
 /* called from encoder thread */
 static int
-process_enc_h264(struct xrdp_encoder *self, XRDP_ENC_DATA *enc)
+process_enc_nsc_send(struct xrdp_encoder *self, XRDP_ENC_DATA_DONE *enc_done)
+{
+    tc_mutex_lock(self->mutex);
+    fifo_add_item(self->fifo_processed, enc_done);
+    tc_mutex_unlock(self->mutex);
+    /* signal completion for main thread */
+    g_set_wait_obj(self->xrdp_encoder_event_processed);
+    return 0;
+}
+
+/*****************************************************************************/
+/* called from encoder thread
+   each crect goes out as NSC_TILE sized surface bits so any one always
+   fits in a fastpath fragment */
+#define NSC_TILE 64
+static int
+process_enc_nsc(struct xrdp_enc_worker *worker, XRDP_ENC_DATA *enc)
+{
+    struct xrdp_encoder *self;
+    int index;
+    int x;
+    int y;
+    int cx;
+    int cy;
+    int tx;
+    int ty;
+    int tcx;
+    int tcy;
+    int error;
+    int out_data_bytes;
+    char *out_data;
+    XRDP_ENC_DATA_DONE *enc_done;
+    XRDP_ENC_DATA_DONE *pending;
+
+    self = worker->encoder;
+    LLOGLN(10, ("process_enc_nsc:"));
+    /* hold back one so the last one sent can be marked last */
+    pending = NULL;
+    for (index = 0; index < enc->num_crects; index++)
+    {
+        x = enc->crects[index * 4 + 0];
+        y = enc->crects[index * 4 + 1];
+        cx = enc->crects[index * 4 + 2];
+        cy = enc->crects[index * 4 + 3];
+        if ((cx < 1) || (cy < 1) || (x < 0) || (y < 0) ||
+            (x + cx > enc->width) || (y + cy > enc->height))
+        {
+            LLOGLN(0, ("process_enc_nsc: bad rect"));
+            continue;
+        }
+        for (ty = y; ty < y + cy; ty += NSC_TILE)
+        {
+            tcy = MIN(NSC_TILE, y + cy - ty);
+            for (tx = x; tx < x + cx; tx += NSC_TILE)
+            {
+                tcx = MIN(NSC_TILE, x + cx - tx);
+                out_data_bytes = 20 + NSC_TILE * NSC_TILE * 4;
+                out_data = g_new(char, XRDP_SURCMD_PREFIX_BYTES +
+                                 out_data_bytes);
+                if (out_data == NULL)
+                {
+                    continue;
+                }
+                error = libxrdp_codec_nsc_compress(worker->codec_handle,
+                                                   enc->data,
+                                                   enc->width * 4,
+                                                   tx, ty, tcx, tcy,
+                                                   self->codec_color_loss,
+                                                   self->codec_subsampling,
+                                                   out_data +
+                                                   XRDP_SURCMD_PREFIX_BYTES,
+                                                   &out_data_bytes);
+                if (error != 0)
+                {
+                    LLOGLN(0, ("process_enc_nsc: nsc error %d", error));
+                    g_free(out_data);
+                    continue;
+                }
+                enc_done = g_new0(XRDP_ENC_DATA_DONE, 1);
+                if (enc_done == NULL)
+                {
+                    g_free(out_data);
+                    continue;
+                }
+                enc_done->comp_bytes = out_data_bytes;
+                enc_done->pad_bytes = XRDP_SURCMD_PREFIX_BYTES;
+                enc_done->comp_pad_data = out_data;
+                enc_done->enc = enc;
+                enc_done->x = tx;
+                enc_done->y = ty;
+                enc_done->cx = tcx;
+                enc_done->cy = tcy;
+                if (pending != NULL)
+                {
+                    process_enc_nsc_send(self, pending);
+                }
+                pending = enc_done;
+            }
+        }
+    }
+    if (pending == NULL)
+    {
+        /* nothing to send but Xorg still needs its ack */
+        pending = g_new0(XRDP_ENC_DATA_DONE, 1);
+        if (pending == NULL)
+        {
+            return 1;
+        }
+        pending->enc = enc;
+    }
+    pending->last = 1;
+    process_enc_nsc_send(self, pending);
+    return 0;
+}
+
+/*****************************************************************************/
+/* called from encoder thread */
+static int
+process_enc_h264(struct xrdp_enc_worker *worker, XRDP_ENC_DATA *enc)
 {
     LLOGLN(0, ("process_enc_x264:"));
     return 0;
@@ -456,19 +1245,20 @@ proc_enc_msg(void *arg)
     tbus robjs[32];
     tbus wobjs[32];
     struct xrdp_encoder *self;
+    struct xrdp_enc_worker *worker;
 
-    LLOGLN(0, ("proc_enc_msg: thread is running"));
-
-    self = (struct xrdp_encoder *) arg;
-    if (self == 0)
+    worker = (struct xrdp_enc_worker *) arg;
+    if (worker == 0)
     {
-        LLOGLN(0, ("proc_enc_msg: self nil"));
+        LLOGLN(0, ("proc_enc_msg: worker nil"));
         return 0;
     }
+    LLOGLN(0, ("proc_enc_msg: thread %d is running", worker->index));
+    self = worker->encoder;
 
-    fifo_to_proc = self->fifo_to_proc;
+    fifo_to_proc = worker->fifo_to_proc;
     mutex = self->mutex;
-    event_to_proc = self->xrdp_encoder_event_to_proc;
+    event_to_proc = worker->xrdp_encoder_event_to_proc;
 
     term_obj = g_get_term_event();
     lterm_obj = self->xrdp_encoder_term;
@@ -512,7 +1302,7 @@ proc_enc_msg(void *arg)
             while (enc != 0)
             {
                 /* do work */
-                self->process_enc(self, enc);
+                self->process_enc(worker, enc);
                 /* get next msg */
                 tc_mutex_lock(mutex);
                 enc = (XRDP_ENC_DATA *) fifo_remove_item(fifo_to_proc);
@@ -6,6 +6,26 @@
 #include "fifo.h"
 
 struct xrdp_enc_data;
+struct xrdp_enc_data_done;
+struct xrdp_encoder;
+
+/* one encoder thread, with multiple monitors there is one per monitor so
+   damage on one does not wait behind another */
+struct xrdp_enc_worker
+{
+    struct xrdp_encoder *encoder;
+    int index;
+    int left; /* monitor area, right and bottom exclusive */
+    int top;
+    int right;
+    int bottom;
+    tbus xrdp_encoder_event_to_proc;
+    FIFO *fifo_to_proc;
+    void *codec_handle;
+    int codec_gfx; /* codec_handle output is going over egfx */
+};
+
+#define XRDP_ENC_MAX_WORKERS 16
 
 /* for codec mode operations */
 struct xrdp_encoder
@@ -14,21 +34,37 @@ struct xrdp_encoder
     int in_codec_mode;
     int codec_id;
     int codec_quality;
+    int codec_color_loss; /* nscodec ColorLossLevel */
+    int codec_subsampling; /* nscodec ChromaSubsamplingLevel */
+    int gfx_codec_id; /* RDPGFX codecId for this output, -1 if none */
     int max_compressed_bytes;
-    tbus xrdp_encoder_event_to_proc;
     tbus xrdp_encoder_event_processed;
     tbus xrdp_encoder_term;
-    FIFO *fifo_to_proc;
     FIFO *fifo_processed;
     tbus mutex;
-    int (*process_enc)(struct xrdp_encoder *self, struct xrdp_enc_data *enc);
-    void *codec_handle;
+    int (*process_enc)(struct xrdp_enc_worker *worker,
+                       struct xrdp_enc_data *enc);
+    struct xrdp_enc_worker workers[XRDP_ENC_MAX_WORKERS];
+    int num_workers;
+    int whole_tiles; /* crects are codec tiles, do not clip them */
+    int damage_grid; /* see xrdp_encoder_simplify */
+    int damage_merge_percent;
+    int damage_max_rects;
+    struct xrdp_rect *damage_rects; /* scratch for xrdp_encoder_simplify */
+    int max_damage_rects;
+    struct xrdp_enc_data *frames_head; /* frames in flight, in order */
+    struct xrdp_enc_data *frames_tail;
     int frame_id_client; /* last frame id received from client */
     int frame_id_server; /* last frame id received from Xorg */
     int frame_id_server_sent;
     int frames_in_flight;
+    struct xrdp_enc_data *free_jobs; /* see xrdp_encoder_job_get */
+    int num_free_jobs;
 };
 
+/* finished jobs kept for reuse, main thread only */
+#define XRDP_ENC_JOB_POOL 8
+
 /* used when scheduling tasks in xrdp_encoder.c */
 struct xrdp_enc_data
 {
@@ -42,6 +78,15 @@ struct xrdp_enc_data
     int height;
     int flags;
     int frame_id;
+    int gfx; /* send over egfx, set before queueing */
+    int max_drects; /* allocated size of drects */
+    int max_crects; /* allocated size of crects */
+    struct xrdp_enc_data *next; /* free list or frames in flight */
+    struct xrdp_enc_data *parent; /* the whole frame, self if not split */
+    int pending; /* parts of this frame not done yet */
+    int started; /* frame start sent, see xrdp_mm_process_enc_done */
+    struct xrdp_enc_data_done *held_head; /* parts back before the frames */
+    struct xrdp_enc_data_done *held_tail; /* ahead of this one are ended */
 };
 
 typedef struct xrdp_enc_data XRDP_ENC_DATA;
@@ -58,6 +103,7 @@ struct xrdp_enc_data_done
     int y;
     int cx;
     int cy;
+    struct xrdp_enc_data_done *next; /* see held_head */
 };
 
 typedef struct xrdp_enc_data_done XRDP_ENC_DATA_DONE;
@@ -66,6 +112,17 @@ struct xrdp_encoder *
 xrdp_encoder_create(struct xrdp_mm *mm);
 void
 xrdp_encoder_delete(struct xrdp_encoder *self);
+XRDP_ENC_DATA *
+xrdp_encoder_job_get(struct xrdp_encoder *self, int num_drects,
+                     int num_crects);
+void
+xrdp_encoder_job_put(struct xrdp_encoder *self, XRDP_ENC_DATA *enc);
+int
+xrdp_encoder_queue(struct xrdp_encoder *self, XRDP_ENC_DATA *enc);
+void
+xrdp_encoder_part_done(struct xrdp_encoder *self, XRDP_ENC_DATA *enc);
+XRDP_ENC_DATA *
+xrdp_encoder_frame_done(struct xrdp_encoder *self);
 THREAD_RV THREAD_CC
 proc_enc_msg(void *arg);
 
@@ -249,6 +249,12 @@ xrdp_listen_get_port_address(char *port, int port_bytes,
                         val = (char *)list_get_item(values, index);
                         startup_param->recv_buffer_bytes = g_atoi(val);
                     }
+
+                    if (g_strcasecmp(val, "tls_ticket_key_lifetime") == 0)
+                    {
+                        val = (char *)list_get_item(values, index);
+                        startup_param->tls_ticket_key_lifetime = g_atoi(val);
+                    }
                 }
             }
         }
@@ -306,6 +312,37 @@ xrdp_listen_fork(struct xrdp_listen *self, struct trans *server_trans)
     return 0;
 }
 
+/*****************************************************************************/
+/* rotate the shared tls session ticket key when it is due
+   returns the number of milliseconds until the next rotation, -1 if none */
+static int
+xrdp_listen_check_ticket_key(struct xrdp_listen *self)
+{
+    int lifetime;
+    int now;
+    int elapsed;
+
+    lifetime = self->startup_params->tls_ticket_key_lifetime;
+    if (lifetime < 1)
+    {
+        return -1;
+    }
+    now = g_time1();
+    elapsed = now - self->ticket_key_time;
+    if (self->ticket_key_time == 0 || elapsed >= lifetime || elapsed < 0)
+    {
+        if (ssl_tls_ticket_keys_rotate(lifetime) != 0)
+        {
+            /* keep going with the old key, retry later */
+            return 60 * 1000;
+        }
+        self->ticket_key_time = now;
+        elapsed = 0;
+    }
+    /* wake up at least hourly, a long lifetime in ms does not fit an int */
+    return MIN(lifetime - elapsed, 3600) * 1000;
+}
+
 /*****************************************************************************/
 /* a new connection is coming in */
 int
@@ -474,7 +511,7 @@ xrdp_listen_main_loop(struct xrdp_listen *self)
             robjs[robjs_count++] = term_obj;
             robjs[robjs_count++] = sync_obj;
             robjs[robjs_count++] = done_obj;
-            timeout = -1;
+            timeout = xrdp_listen_check_ticket_key(self);
 
             if (trans_get_wait_objs(self->listen_trans, robjs,
                                     &robjs_count) != 0)
@@ -482,7 +519,8 @@ xrdp_listen_main_loop(struct xrdp_listen *self)
                 break;
             }
 
-            /* wait - timeout -1 means wait indefinitely*/
+            /* wait - timeout -1 means wait indefinitely, otherwise until the
+               next ticket key rotation */
             if (g_obj_wait(robjs, robjs_count, 0, 0, timeout) != 0)
             {
                 /* error, should not get here */
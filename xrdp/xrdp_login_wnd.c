@@ -1001,6 +1001,21 @@ load_xrdp_config(struct xrdp_config *config, int bpp)
         else if (g_strncmp(n, "allow_multimon", 64) == 0)
             globals->allow_multimon = g_text2bool(v);
 
+        else if (g_strncmp(n, "input_coalesce_ms", 64) == 0)
+            globals->input_coalesce_ms = g_atoi(v);
+
+        else if (g_strncmp(n, "use_gfx", 64) == 0)
+            globals->use_gfx = g_text2bool(v);
+
+        else if (g_strncmp(n, "damage_grid", 64) == 0)
+            globals->damage_grid = g_atoi(v);
+
+        else if (g_strncmp(n, "damage_merge_percent", 64) == 0)
+            globals->damage_merge_percent = g_atoi(v);
+
+        else if (g_strncmp(n, "damage_max_rects", 64) == 0)
+            globals->damage_max_rects = g_atoi(v);
+
         /* login screen values */
         else if (g_strncmp(n, "ls_top_window_bg_color", 64) == 0)
             globals->ls_top_window_bg_color = HCOLOR(bpp, xrdp_wm_htoi(v));
@@ -1109,6 +1124,11 @@ load_xrdp_config(struct xrdp_config *config, int bpp)
     g_writeln("new_cursors:             %d", globals->new_cursors);
     g_writeln("nego_sec_layer:          %d", globals->nego_sec_layer);
     g_writeln("allow_multimon:          %d", globals->allow_multimon);
+    g_writeln("input_coalesce_ms:       %d", globals->input_coalesce_ms);
+    g_writeln("use_gfx:                 %d", globals->use_gfx);
+    g_writeln("damage_grid:             %d", globals->damage_grid);
+    g_writeln("damage_merge_percent:    %d", globals->damage_merge_percent);
+    g_writeln("damage_max_rects:        %d", globals->damage_max_rects);
 
     g_writeln("ls_top_window_bg_color:  %x", globals->ls_top_window_bg_color);
     g_writeln("ls_width:                %d", globals->ls_width);
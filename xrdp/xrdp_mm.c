@@ -35,6 +35,7 @@
 #endif /* USE_NOPAM */
 
 #include "xrdp_encoder.h"
+#include "xrdp_egfx.h"
 #include "xrdp_sockets.h"
 
 #define LLOG_LEVEL 1
@@ -148,6 +149,8 @@ xrdp_mm_delete(struct xrdp_mm *self)
     /* free any module stuff */
     xrdp_mm_module_cleanup(self);
 
+    xrdp_egfx_delete(self->egfx);
+
     /* shutdown thread */
     xrdp_encoder_delete(self->encoder);
 
@@ -435,6 +438,7 @@ xrdp_mm_setup_mod1(struct xrdp_mm *self)
             self->mod->server_paint_rect = server_paint_rect;
             self->mod->server_set_pointer = server_set_pointer;
             self->mod->server_set_pointer_ex = server_set_pointer_ex;
+            self->mod->server_set_pointer_large = server_set_pointer_large;
             self->mod->server_palette = server_palette;
             self->mod->server_msg = server_msg;
             self->mod->server_is_term = server_is_term;
@@ -995,7 +999,22 @@ xrdp_mm_process_rail_drawing_orders(struct xrdp_mm* self, struct stream *s)
 int
 xrdp_mm_drdynvc_up(struct xrdp_mm* self)
 {
+    struct xrdp_client_info *ci;
+
     LLOGLN(0, ("xrdp_mm_drdynvc_up:"));
+    ci = self->wm->client_info;
+    /* the graphics pipeline only carries encoder output the client can
+       take there, once it is up the client stops showing the orders the
+       login window is drawn with so wait for a module that paints through
+       the encoder, see server_paint_rects */
+    if (self->wm->xrdp_config->cfg_globals.use_gfx &&
+        (ci->mcs_early_capability_flags &
+         RNS_UD_CS_SUPPORT_DYNVC_GFX_PROTOCOL) &&
+        (self->encoder != 0) && (self->encoder->gfx_codec_id >= 0) &&
+        (self->egfx == 0))
+    {
+        self->egfx_pending = 1;
+    }
     return 0;
 }
 
@@ -1959,6 +1978,8 @@ getPAMError(const int pamError, char *text, int text_bytes)
             return "Error connecting to PAM";
         case 32 + 3:
             return "Username okey but group problem";
+        case 32 + 4:
+            return "Authentication timed out";
         default:
             g_snprintf(text, text_bytes, "Not defined PAM error:%d", pamError);
             return text;
@@ -2484,15 +2505,114 @@ xrdp_mm_update_module_frame_ack(struct xrdp_mm *self)
 }
 
 /*****************************************************************************/
+/* frame acks come from the graphics pipeline once it is up, else from
+   the frame acknowledge PDU if the client does that */
 static int
-xrdp_mm_process_enc_done(struct xrdp_mm *self)
+xrdp_mm_use_frame_acks(struct xrdp_mm *self)
 {
-    XRDP_ENC_DATA_DONE *enc_done;
+    if (xrdp_egfx_ready(self->egfx))
+    {
+        return self->egfx->frame_acks;
+    }
+    return self->wm->client_info->use_frame_acks;
+}
+
+/*****************************************************************************/
+/* sends one encoded part, the frame is started with its first part that has
+   data and ended once all its parts are done, see xrdp_mm_end_enc_frame */
+static void
+xrdp_mm_send_enc_part(struct xrdp_mm *self, XRDP_ENC_DATA_DONE *enc_done)
+{
+    XRDP_ENC_DATA *frame;
     int x;
     int y;
     int cx;
     int cy;
 
+    frame = enc_done->enc->parent;
+    x = enc_done->x;
+    y = enc_done->y;
+    cx = enc_done->cx;
+    cy = enc_done->cy;
+    if ((enc_done->comp_bytes > 0) && frame->gfx &&
+        xrdp_egfx_ready(self->egfx))
+    {
+        if (frame->started == 0)
+        {
+            xrdp_egfx_send_frame_start(self->egfx, frame->frame_id);
+            frame->started = 1;
+        }
+        xrdp_egfx_send_wire_to_surface1(self->egfx,
+                                        XRDP_EGFX_SCREEN_SURFACE,
+                                        self->encoder->gfx_codec_id,
+                                        XR_PIXEL_FORMAT_XRGB_8888,
+                                        x, y, cx, cy,
+                                        enc_done->comp_pad_data +
+                                        enc_done->pad_bytes,
+                                        enc_done->comp_bytes);
+    }
+    else if (enc_done->comp_bytes > 0)
+    {
+        if (frame->started == 0)
+        {
+            libxrdp_fastpath_send_frame_marker(self->wm->session, 0,
+                                               frame->frame_id);
+            frame->started = 2;
+        }
+        libxrdp_fastpath_send_surface(self->wm->session,
+                                      enc_done->comp_pad_data,
+                                      enc_done->pad_bytes,
+                                      enc_done->comp_bytes,
+                                      x, y, x + cx, y + cy,
+                                      32, self->encoder->codec_id,
+                                      cx, cy);
+    }
+    if (enc_done->last)
+    {
+        LLOGLN(10, ("xrdp_mm_send_enc_part: last set"));
+        xrdp_encoder_part_done(self->encoder, enc_done->enc);
+    }
+    g_free(enc_done->comp_pad_data);
+    g_free(enc_done);
+}
+
+/*****************************************************************************/
+/* ends, acks and releases a frame all of whose parts are done */
+static void
+xrdp_mm_end_enc_frame(struct xrdp_mm *self, XRDP_ENC_DATA *frame)
+{
+    if (frame->started == 1)
+    {
+        xrdp_egfx_send_frame_end(self->egfx, frame->frame_id);
+    }
+    else if (frame->started == 2)
+    {
+        libxrdp_fastpath_send_frame_marker(self->wm->session, 1,
+                                           frame->frame_id);
+    }
+    if (xrdp_mm_use_frame_acks(self) == 0)
+    {
+        self->mod->mod_frame_ack(self->mod, frame->flags, frame->frame_id);
+    }
+    else
+    {
+        self->encoder->frame_id_server = frame->frame_id;
+        xrdp_mm_update_module_frame_ack(self);
+    }
+    if (self->mod->mod_release_data != 0)
+    {
+        self->mod->mod_release_data(self->mod, frame->data);
+    }
+    xrdp_encoder_job_put(self->encoder, frame);
+}
+
+/*****************************************************************************/
+static int
+xrdp_mm_process_enc_done(struct xrdp_mm *self)
+{
+    XRDP_ENC_DATA_DONE *enc_done;
+    XRDP_ENC_DATA *frame;
+
     while (1)
     {
         tc_mutex_lock(self->encoder->mutex);
@@ -2503,48 +2623,42 @@ xrdp_mm_process_enc_done(struct xrdp_mm *self)
         {
             break;
         }
-        /* do something with msg */
         LLOGLN(10, ("xrdp_mm_process_enc_done: message back bytes %d",
                enc_done->comp_bytes));
-        x = enc_done->x;
-        y = enc_done->y;
-        cx = enc_done->cx;
-        cy = enc_done->cy;
-        if (enc_done->comp_bytes > 0)
-        {
-            libxrdp_fastpath_send_frame_marker(self->wm->session, 0,
-                                               enc_done->enc->frame_id);
-            libxrdp_fastpath_send_surface(self->wm->session,
-                                          enc_done->comp_pad_data,
-                                          enc_done->pad_bytes,
-                                          enc_done->comp_bytes,
-                                          x, y, x + cx, y + cy,
-                                          32, self->encoder->codec_id,
-                                          cx, cy);
-            libxrdp_fastpath_send_frame_marker(self->wm->session, 1,
-                                               enc_done->enc->frame_id);
-        }
-        /* free enc_done */
-        if (enc_done->last)
-        {
-            LLOGLN(10, ("xrdp_mm_process_enc_done: last set"));
-            if (self->wm->client_info->use_frame_acks == 0)
+        frame = enc_done->enc->parent;
+        if (frame != self->encoder->frames_head)
+        {
+            /* parts of a frame from different monitors finish in any
+               order, hold the ones of a later frame so frames go out
+               one after another, each between one start and one end */
+            enc_done->next = NULL;
+            if (frame->held_tail == NULL)
             {
-                self->mod->mod_frame_ack(self->mod,
-                                         enc_done->enc->flags,
-                                         enc_done->enc->frame_id);
+                frame->held_head = enc_done;
             }
             else
             {
-                self->encoder->frame_id_server = enc_done->enc->frame_id;
-                xrdp_mm_update_module_frame_ack(self);
+                frame->held_tail->next = enc_done;
+            }
+            frame->held_tail = enc_done;
+            continue;
+        }
+        xrdp_mm_send_enc_part(self, enc_done);
+        while ((frame = xrdp_encoder_frame_done(self->encoder)) != NULL)
+        {
+            xrdp_mm_end_enc_frame(self, frame);
+            frame = self->encoder->frames_head;
+            if (frame == NULL)
+            {
+                break;
+            }
+            while ((enc_done = frame->held_head) != NULL)
+            {
+                frame->held_head = enc_done->next;
+                xrdp_mm_send_enc_part(self, enc_done);
             }
-            g_free(enc_done->enc->drects);
-            g_free(enc_done->enc->crects);
-            g_free(enc_done->enc);
+            frame->held_tail = NULL;
         }
-        g_free(enc_done->comp_pad_data);
-        g_free(enc_done);
     }
     return 0;
 }
@@ -2626,7 +2740,7 @@ xrdp_mm_frame_ack(struct xrdp_mm *self, int frame_id)
     struct xrdp_encoder *encoder;
 
     LLOGLN(10, ("xrdp_mm_frame_ack:"));
-    if (self->wm->client_info->use_frame_acks == 0)
+    if (xrdp_mm_use_frame_acks(self) == 0)
     {
         return 1;
     }
@@ -2875,27 +2989,15 @@ server_paint_rects(struct xrdp_mod* mod, int num_drects, short *drects,
 
     if (mm->encoder != 0)
     {
-        /* copy formal params to XRDP_ENC_DATA */
-        enc_data = (XRDP_ENC_DATA *) g_malloc(sizeof(XRDP_ENC_DATA), 1);
-        if (enc_data == 0)
+        if (mm->egfx_pending)
         {
-            return 1;
-        }
-
-        enc_data->drects = (short *)
-                           g_malloc(sizeof(short) * num_drects * 4, 0);
-        if (enc_data->drects == 0)
-        {
-            g_free(enc_data);
-            return 1;
+            mm->egfx_pending = 0;
+            mm->egfx = xrdp_egfx_create(mm, wm->session);
         }
-
-        enc_data->crects = (short *)
-                           g_malloc(sizeof(short) * num_crects * 4, 0);
-        if (enc_data->crects == 0)
+        /* copy formal params to a pooled XRDP_ENC_DATA */
+        enc_data = xrdp_encoder_job_get(mm->encoder, num_drects, num_crects);
+        if (enc_data == 0)
         {
-            g_free(enc_data->drects);
-            g_free(enc_data);
             return 1;
         }
 
@@ -2903,27 +3005,19 @@ server_paint_rects(struct xrdp_mod* mod, int num_drects, short *drects,
         g_memcpy(enc_data->crects, crects, sizeof(short) * num_crects * 4);
 
         enc_data->mod = mod;
-        enc_data->num_drects = num_drects;
-        enc_data->num_crects = num_crects;
         enc_data->data = data;
         enc_data->width = width;
         enc_data->height = height;
         enc_data->flags = flags;
         enc_data->frame_id = frame_id;
+        /* frames queued before the pipeline is up go out the old way */
+        enc_data->gfx = xrdp_egfx_ready(mm->egfx);
         if (width == 0 || height == 0)
         {
             LLOGLN(10, ("server_paint_rects: error"));
         }
 
-        /* insert into fifo for encoder thread to process */
-        tc_mutex_lock(mm->encoder->mutex);
-        fifo_add_item(mm->encoder->fifo_to_proc, (void *) enc_data);
-        tc_mutex_unlock(mm->encoder->mutex);
-
-        /* signal xrdp_encoder thread */
-        g_set_wait_obj(mm->encoder->xrdp_encoder_event_to_proc);
-
-        return 0;
+        return xrdp_encoder_queue(mm->encoder, enc_data);
     }
 
     //g_writeln("server_paint_rects:");
@@ -2931,6 +3025,10 @@ server_paint_rects(struct xrdp_mod* mod, int num_drects, short *drects,
     p = (struct xrdp_painter*)(mod->painter);
     if (p == 0)
     {
+        if (mm->mod->mod_release_data != 0)
+        {
+            mm->mod->mod_release_data(mm->mod, data);
+        }
         return 0;
     }
     b = xrdp_bitmap_create_with_data(width, height, wm->screen->bpp,
@@ -2943,6 +3041,10 @@ server_paint_rects(struct xrdp_mod* mod, int num_drects, short *drects,
         s += 4;
     }
     xrdp_bitmap_delete(b);
+    if (mm->mod->mod_release_data != 0)
+    {
+        mm->mod->mod_release_data(mm->mod, data);
+    }
     mm->mod->mod_frame_ack(mm->mod, flags, frame_id);
     return 0;
 }
@@ -2982,6 +3084,19 @@ server_set_pointer_ex(struct xrdp_mod *mod, int x, int y,
     return 0;
 }
 
+/*****************************************************************************/
+int
+server_set_pointer_large(struct xrdp_mod *mod, int x, int y,
+                         char *data, char *mask, int bpp,
+                         int width, int height)
+{
+    struct xrdp_wm *wm;
+
+    wm = (struct xrdp_wm *)(mod->wm);
+    xrdp_wm_pointer_large(wm, data, mask, x, y, bpp, width, height);
+    return 0;
+}
+
 /*****************************************************************************/
 int
 server_palette(struct xrdp_mod *mod, int *palette)
@@ -3195,8 +3310,9 @@ server_add_char(struct xrdp_mod *mod, int font, int character,
     fi.incby = 0;
     fi.data = data;
     fi.bpp = 1;
-    return libxrdp_orders_send_font(((struct xrdp_wm *)mod->wm)->session,
-                                    &fi, font, character);
+    /* sent to the client when a text order uses it, see server_draw_text */
+    return xrdp_cache_add_mod_char(((struct xrdp_wm *)mod->wm)->cache,
+                                   font, character, &fi);
 }
 
 /*****************************************************************************/
@@ -3210,6 +3326,9 @@ server_draw_text(struct xrdp_mod *mod, int font,
 {
     struct xrdp_wm *wm;
     struct xrdp_painter *p;
+    char text[256 + 4];
+    int frag_add;
+    int error;
 
     p = (struct xrdp_painter *)(mod->painter);
 
@@ -3219,12 +3338,33 @@ server_draw_text(struct xrdp_mod *mod, int font,
     }
 
     wm = (struct xrdp_wm *)(mod->wm);
+    /* put the backend's glyphs in the glyph caches xrdp manages, then
+       use a fragment if this text was drawn before, if they do not fit
+       the order goes as it is with the glyphs in the backend's slots */
+    frag_add = -1;
+    error = 1;
+    if ((data_len > 0) && (data_len <= 255))
+    {
+        g_memcpy(text, data, data_len);
+        error = xrdp_cache_mod_text(wm->cache, &font, flags,
+                                    text, data_len);
+    }
+    if (error == 0)
+    {
+        data_len = xrdp_cache_text_fragment(wm->cache, font, flags,
+                                            text, data_len, &frag_add);
+        data = text;
+    }
+    else
+    {
+        xrdp_cache_mod_text_as_is(wm->cache, font, flags, data, data_len);
+    }
     return xrdp_painter_draw_text2(p, wm->target_surface, font, flags,
                                    mixmode, clip_left, clip_top,
                                    clip_right, clip_bottom,
                                    box_left, box_top,
                                    box_right, box_bottom,
-                                   x, y, data, data_len);
+                                   x, y, data, data_len, frag_add);
 }
 
 /*****************************************************************************/
@@ -3348,6 +3488,7 @@ server_create_os_surface(struct xrdp_mod *mod, int rdpindex,
     if (error != 0)
     {
         log_message(LOG_LEVEL_ERROR,"server_create_os_surface: xrdp_cache_add_os_bitmap failed");
+        xrdp_bitmap_delete(bitmap);
         return 1;
     }
 
@@ -3372,6 +3513,7 @@ server_create_os_surface_bpp(struct xrdp_mod* mod, int rdpindex,
     if (error != 0)
     {
         g_writeln("server_create_os_surface_bpp: xrdp_cache_add_os_bitmap failed");
+        xrdp_bitmap_delete(bitmap);
         return 1;
     }
     bitmap->item_index = rdpindex;
@@ -3614,6 +3756,6 @@ server_add_char_alpha(struct xrdp_mod* mod, int font, int character,
     fi.incby = 0;
     fi.data = data;
     fi.bpp = 8;
-    return libxrdp_orders_send_font(((struct xrdp_wm*)mod->wm)->session,
-                                    &fi, font, character);
+    return xrdp_cache_add_mod_char(((struct xrdp_wm*)mod->wm)->cache,
+                                   font, character, &fi);
 }
@@ -222,6 +222,8 @@ wm_painter_set_target(struct xrdp_painter *self)
         {
             if (self->wm->target_surface->tab_stop == 0) /* tab_stop is hack */
             {
+                xrdp_cache_os_bitmap_created(self->wm->cache,
+                                             self->wm->target_surface);
                 del_list = self->wm->cache->xrdp_os_del_list;
                 index = list_index_of(del_list, surface_index);
                 list_remove_item(del_list, index);
@@ -818,7 +820,11 @@ xrdp_painter_draw_text(struct xrdp_painter *self,
     int y1;
     int flags;
     int len;
+    int data_len;
+    int frag_add;
     int index;
+    int count;
+    int j;
     int total_width;
     int total_height;
     int dx;
@@ -947,24 +953,53 @@ xrdp_painter_draw_text(struct xrdp_painter *self,
     wstr = (twchar *)g_malloc((len + 2) * sizeof(twchar), 0);
     g_mbstowcs(wstr, text, len + 1);
     font = self->font;
-    f = 0;
     k = 0;
     total_width = 0;
     total_height = 0;
-    data = (char *)g_malloc(len * 4, 1);
+    data = (char *)g_malloc(len * 4 + 4, 1);
+
+    /* all the glyphs of one order are in the same glyph cache */
+    i = 0;
+    count = 0;
+    for (index = 0; index < len; index++)
+    {
+        font_item = font->font_items + wstr[index];
+        c = FONT_DATASIZE(font_item);
+        i = MAX(i, c);
+        /* a glyph that repeats takes one slot */
+        for (j = 0; j < index; j++)
+        {
+            if (wstr[j] == wstr[index])
+            {
+                break;
+            }
+        }
+        if (j == index)
+        {
+            count++;
+        }
+    }
+    f = xrdp_cache_char_cache_id(self->wm->cache, i, count);
+    if (f < 0)
+    {
+        g_free(data);
+        g_free(wstr);
+        return 0;
+    }
 
     for (index = 0; index < len; index++)
     {
         font_item = font->font_items + wstr[index];
-        i = xrdp_cache_add_char(self->wm->cache, font_item);
-        f = HIWORD(i);
-        c = LOWORD(i);
+        c = xrdp_cache_add_char(self->wm->cache, font_item, f);
         data[index * 2] = c;
         data[index * 2 + 1] = k;
         k = font_item->incby;
         total_width += k;
         total_height = MAX(total_height, font_item->height);
     }
+    flags = 0x03; /* 0x03 0x73; TEXT2_IMPLICIT_X and something else */
+    data_len = xrdp_cache_text_fragment(self->wm->cache, f, flags,
+                                        data, len * 2, &frag_add);
 
     xrdp_bitmap_get_screen_clip(dst, self, &clip_rect, &dx, &dy);
     region = xrdp_region_create(self->wm);
@@ -989,12 +1024,12 @@ xrdp_painter_draw_text(struct xrdp_painter *self,
         {
             x1 = x;
             y1 = y + total_height;
-            flags = 0x03; /* 0x03 0x73; TEXT2_IMPLICIT_X and something else */
             libxrdp_orders_text(self->session, f, flags, 0,
                                 self->fg_color, 0,
                                 x - 1, y - 1, x + total_width, y + total_height,
                                 0, 0, 0, 0,
-                                x1, y1, data, len * 2, &draw_rect);
+                                x1, y1, data, data_len, &draw_rect);
+            xrdp_cache_text_fragment_sent(self->wm->cache, frag_add);
         }
 
         k++;
@@ -1007,6 +1042,8 @@ xrdp_painter_draw_text(struct xrdp_painter *self,
 }
 
 /*****************************************************************************/
+/* frag_add is the fragment the data adds, -1 if none, see
+   xrdp_cache_text_fragment */
 int
 xrdp_painter_draw_text2(struct xrdp_painter *self,
                         struct xrdp_bitmap *dst,
@@ -1015,7 +1052,8 @@ xrdp_painter_draw_text2(struct xrdp_painter *self,
                         int clip_right, int clip_bottom,
                         int box_left, int box_top,
                         int box_right, int box_bottom,
-                        int x, int y, char *data, int data_len)
+                        int x, int y, char *data, int data_len,
+                        int frag_add)
 {
     struct xrdp_rect clip_rect;
     struct xrdp_rect draw_rect;
@@ -1088,6 +1126,7 @@ xrdp_painter_draw_text2(struct xrdp_painter *self,
                                 clip_left, clip_top, clip_right, clip_bottom,
                                 box_left, box_top, box_right, box_bottom,
                                 x, y, data, data_len, &draw_rect);
+            xrdp_cache_text_fragment_sent(self->wm->cache, frag_add);
         }
 
         k++;
@@ -1264,9 +1303,51 @@ xrdp_painter_copy(struct xrdp_painter *self,
         cache_id = 255; // todo
         cache_idx = src->item_index; // todo
 
+        if (xrdp_cache_os_bitmap_stale(self->wm->cache, src))
+        {
+            /* src was evicted from the client, what the module drew in it
+               is gone there, an off screen dst goes stale with it, on
+               screen the module paints the area again from its own copy */
+            LLOGLN(10, ("xrdp_painter_copy: src %d is stale", cache_idx));
+
+            if (dst->type == WND_TYPE_OFFSCREEN)
+            {
+                xrdp_cache_os_bitmap_set_stale(self->wm->cache, dst);
+            }
+            else if ((self->wm->mm->mod != 0) &&
+                     (self->wm->mm->mod->mod_event != 0))
+            {
+                k = 0;
+
+                while (xrdp_region_get_rect(region, k, &rect1) == 0)
+                {
+                    if (rect_intersect(&rect1, &clip_rect, &rect2))
+                    {
+                        MAKERECT(rect1, x, y, cx, cy);
+
+                        if (rect_intersect(&rect2, &rect1, &draw_rect))
+                        {
+                            self->wm->mm->mod->mod_event(self->wm->mm->mod,
+                                    WM_INVALIDATE,
+                                    MAKELONG(draw_rect.top, draw_rect.left),
+                                    MAKELONG(draw_rect.bottom - draw_rect.top,
+                                             draw_rect.right - draw_rect.left),
+                                    0, 0);
+                        }
+                    }
+
+                    k++;
+                }
+            }
+
+            xrdp_region_delete(region);
+            return 0;
+        }
+
         if (src->tab_stop == 0)
         {
             g_writeln("xrdp_painter_copy: warning src not created");
+            xrdp_cache_os_bitmap_created(self->wm->cache, src);
             del_list = self->wm->cache->xrdp_os_del_list;
             index = list_index_of(del_list, cache_idx);
             list_remove_item(del_list, index);
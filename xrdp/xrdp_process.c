@@ -262,6 +262,7 @@ xrdp_process_main_loop(struct xrdp_process *self)
                                   wobjs, &wobjs_count, &timeout);
             trans_get_wait_objs_rw(self->server_trans, robjs, &robjs_count,
                                    wobjs, &wobjs_count, &timeout);
+            libxrdp_autodetect_get_timeout(self->session, &timeout);
             /* wait */
             if (g_obj_wait(robjs, robjs_count, wobjs, wobjs_count, timeout) != 0)
             {
@@ -288,6 +289,11 @@ xrdp_process_main_loop(struct xrdp_process *self)
             {
                 break;
             }
+
+            if (libxrdp_autodetect_check(self->session) != 0)
+            {
+                break;
+            }
         }
         /* send disconnect message if possible */
         libxrdp_disconnect(self->session);
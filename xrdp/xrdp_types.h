@@ -48,7 +48,8 @@ struct xrdp_mod
                            tbus* write_objs, int* wcount, int* timeout);
   int (*mod_check_wait_objs)(struct xrdp_mod* v);
   int (*mod_frame_ack)(struct xrdp_mod* v, int flags, int frame_id);
-  tintptr mod_dumby[100 - 10]; /* align, 100 minus the number of mod
+  int (*mod_release_data)(struct xrdp_mod* v, char* data);
+  tintptr mod_dumby[100 - 11]; /* align, 100 minus the number of mod
                                   functions above */
   /* server functions */
   int (*server_begin_update)(struct xrdp_mod* v);
@@ -148,7 +149,10 @@ struct xrdp_mod
                             int flags, int frame_id);
   int (*server_session_info)(struct xrdp_mod* v, const char *data,
                              int data_bytes);
-  tintptr server_dumby[100 - 44]; /* align, 100 minus the number of server
+  int (*server_set_pointer_large)(struct xrdp_mod* v, int x, int y,
+                                  char* data, char* mask, int bpp,
+                                  int width, int height);
+  tintptr server_dumby[100 - 45]; /* align, 100 minus the number of server
                                      functions above */
   /* common */
   tintptr handle; /* pointer to self as int */
@@ -196,22 +200,43 @@ struct xrdp_os_bitmap_item
 {
   int id;
   struct xrdp_bitmap* bitmap;
+  int stamp; /* last use, for eviction */
+  int bytes; /* client side size while created there, else 0 */
+  int stale; /* evicted, the client copy lost what the module drew */
 };
 
 struct xrdp_char_item
 {
-  int stamp;
+  int hash; /* see xrdp_cache_add_char */
+  int hash_next; /* next slot, font << 8 | char, in the bucket, -1 ends */
   struct xrdp_font_char font_item;
 };
 
+/* a run of glyph order data kept in the client's fragment cache */
+struct xrdp_frag_item
+{
+  int stamp; /* last use, 0 if free or not sent yet */
+  int hash;
+  int cache_id; /* glyph cache the glyph indexes refer to */
+  int generation; /* char_generation of that cache when added */
+  int size;
+  char data[256];
+};
+
+#define XRDP_MAX_GLYPH_CACHE_ID 12
+#define XRDP_CHAR_HASH_SIZE 1024
+
 struct xrdp_pointer_item
 {
   int stamp;
   int x; /* hotspot */
   int y;
-  char data[32 * 32 * 4];
-  char mask[32 * 32 / 8];
+  char* data; /* width * height pixels, bottom up, 0 bpp is 24 */
+  char* mask; /* rows of ((width + 15) / 16) * 2 bytes, bottom up */
   int bpp;
+  int width;
+  int height;
+  int hash; /* see xrdp_cache_add_pointer */
 };
 
 struct xrdp_brush_item
@@ -257,9 +282,21 @@ struct xrdp_cache
   int cache3_size;
   int bitmap_cache_persist_enable;
   int bitmap_cache_version;
-  /* font */
-  int char_stamp;
-  struct xrdp_char_item char_items[12][256];
+  /* font, slots handed out least recently used first per glyph cache */
+  struct xrdp_char_item char_items[XRDP_MAX_GLYPH_CACHE_ID][256];
+  struct xrdp_lru_item char_lrus[XRDP_MAX_GLYPH_CACHE_ID][256];
+  int char_lru_head[XRDP_MAX_GLYPH_CACHE_ID]; /* least recently used */
+  int char_lru_tail[XRDP_MAX_GLYPH_CACHE_ID];
+  int char_entries[XRDP_MAX_GLYPH_CACHE_ID]; /* 0 if the client has none */
+  int char_cell_bytes[XRDP_MAX_GLYPH_CACHE_ID];
+  int char_generation[XRDP_MAX_GLYPH_CACHE_ID]; /* bumped on replace */
+  int char_hash[XRDP_CHAR_HASH_SIZE]; /* first slot in each bucket */
+  struct xrdp_font_char *mod_chars; /* backend glyphs, font * 256 + char */
+  int frag_stamp;
+  int frag_entries;
+  int frag_max_bytes;
+  int frag_disabled; /* the backend sends its own fragments */
+  struct xrdp_frag_item frag_items[256];
   /* pointer */
   int pointer_stamp;
   struct xrdp_pointer_item pointer_items[32];
@@ -268,10 +305,21 @@ struct xrdp_cache
   struct xrdp_brush_item brush_items[64];
   struct xrdp_os_bitmap_item os_bitmap_items[2000];
   struct list* xrdp_os_del_list;
+  /* off screen bitmaps created on the client, budgeted by its
+     offscreen cache caps, 0 means no limit */
+  int os_bitmap_stamp;
+  int os_bitmap_Bpp;
+  int os_bitmap_max_bytes;
+  int os_bitmap_max_entries;
+  int os_bitmap_bytes;
+  int os_bitmap_count;
+  int os_bitmap_peak_bytes;
+  int os_bitmap_evictions;
 };
 
 /* defined later */
 struct xrdp_enc_data;
+struct xrdp_egfx;
 
 struct xrdp_mm
 {
@@ -295,6 +343,8 @@ struct xrdp_mm
   int delete_chan_trans; /* boolean set when done with channel connection */
   int usechansrv; /* true if chansrvport is set in xrdp.ini or using sesman */
   struct xrdp_encoder *encoder;
+  struct xrdp_egfx *egfx; /* graphics pipeline, once a codec paints */
+  int egfx_pending; /* drdynvc is up, open egfx with the first codec paint */
   int cs2xr_cid_map[256];
   int xr2cr_cid_map[256];
 };
@@ -382,6 +432,14 @@ struct xrdp_wm
 
   /* configuration derived from xrdp.ini */
   struct xrdp_config *xrdp_config;
+
+  /* input merging, see xrdp_wm_input_begin */
+  int input_batch; /* inc for every input PDU being processed */
+  struct xrdp_mod *input_batch_mod; /* mod that got WM_INPUT_BEGIN */
+  int mouse_pending; /* boolean, motion not sent to the mod yet */
+  int mouse_pending_x;
+  int mouse_pending_y;
+  int mouse_sent_time; /* g_time3 of the last motion sent */
 };
 
 /* rdp process */
@@ -407,6 +465,7 @@ struct xrdp_listen
   struct list* process_list;
   tbus pro_done_event;
   struct xrdp_startup_params* startup_params;
+  int ticket_key_time; /* when the current tls ticket key was made */
 };
 
 /* region */
@@ -533,6 +592,7 @@ struct xrdp_startup_params
   int fork;
   int send_buffer_bytes;
   int recv_buffer_bytes;
+  int tls_ticket_key_lifetime; /* seconds, 0 = no shared ticket keys */
 };
 
 /*
@@ -560,6 +620,11 @@ struct xrdp_cfg_globals
     int  new_cursors;
     int  nego_sec_layer;
     int  allow_multimon;
+    int  input_coalesce_ms;      /* send mouse motion at most this often */
+    int  use_gfx;                /* offer the graphics pipeline channel */
+    int  damage_grid;            /* snap encoder rects to this grid */
+    int  damage_merge_percent;   /* merge rects if this much is added */
+    int  damage_max_rects;       /* most encoder rects per frame */
 
     /* colors */
 
@@ -209,20 +209,104 @@ int
 xrdp_wm_pointer(struct xrdp_wm *self, char *data, char *mask, int x, int y,
                 int bpp)
 {
-    int bytes;
+    return xrdp_wm_pointer_large(self, data, mask, x, y, bpp, 32, 32);
+}
+
+/*****************************************************************************/
+/* largest pointer the client takes, 32 if it has no large pointer support */
+static int
+xrdp_wm_max_pointer_size(struct xrdp_wm *self)
+{
+    struct xrdp_client_info *ci;
+
+    ci = self->client_info;
+    if ((ci->use_fast_path & 1) == 0 || (ci->pointer_flags & 1) == 0)
+    {
+        return 32;
+    }
+    if (ci->large_pointer_flags & LARGE_POINTER_FLAG_384x384)
+    {
+        return 384;
+    }
+    if (ci->large_pointer_flags & LARGE_POINTER_FLAG_96x96)
+    {
+        return 96;
+    }
+    return 32;
+}
+
+/*****************************************************************************/
+/* data and mask are bottom up like xrdp_pointer_item, pointers the client
+   can not take are cut down to the 32x32 around the hotspot and small
+   ones are padded to 32x32 */
+int
+xrdp_wm_pointer_large(struct xrdp_wm *self, char *data, char *mask,
+                      int x, int y, int bpp, int width, int height)
+{
     struct xrdp_pointer_item pointer_item;
+    char crop_data[32 * 32 * 4];
+    char crop_mask[32 * 32 / 8];
+    int Bpp;
+    int max_size;
+    int left;
+    int top;
+    int row;
+    int col;
+    int src_row;
+    int src_col;
+    int mask_line_bytes;
 
     if (bpp == 0)
     {
         bpp = 24;
     }
-    bytes = ((bpp + 7) / 8) * 32 * 32;
+    if (width < 1 || height < 1)
+    {
+        return 1;
+    }
     g_memset(&pointer_item, 0, sizeof(struct xrdp_pointer_item));
     pointer_item.x = x;
     pointer_item.y = y;
     pointer_item.bpp = bpp;
-    g_memcpy(pointer_item.data, data, bytes);
-    g_memcpy(pointer_item.mask, mask, 32 * 32 / 8);
+    pointer_item.width = width;
+    pointer_item.height = height;
+    pointer_item.data = data;
+    pointer_item.mask = mask;
+    max_size = xrdp_wm_max_pointer_size(self);
+    if (width > max_size || height > max_size ||
+        (width <= 32 && height <= 32 && (width != 32 || height != 32)))
+    {
+        Bpp = (bpp + 7) / 8;
+        mask_line_bytes = ((width + 15) / 16) * 2;
+        left = MIN(MAX(x - 16, 0), MAX(width - 32, 0));
+        top = MIN(MAX(y - 16, 0), MAX(height - 32, 0));
+        g_memset(crop_data, 0, sizeof(crop_data));
+        /* transparent outside the source */
+        g_memset(crop_mask, 0xff, sizeof(crop_mask));
+        for (row = 0; row < 32 && top + row < height; row++)
+        {
+            /* rows are bottom up */
+            src_row = height - 1 - (top + row);
+            for (col = 0; col < 32 && left + col < width; col++)
+            {
+                src_col = left + col;
+                g_memcpy(crop_data + ((31 - row) * 32 + col) * Bpp,
+                         data + (src_row * width + src_col) * Bpp, Bpp);
+                if ((mask[src_row * mask_line_bytes + src_col / 8] &
+                     (0x80 >> (src_col & 7))) == 0)
+                {
+                    crop_mask[(31 - row) * 4 + col / 8] &=
+                        ~(0x80 >> (col & 7));
+                }
+            }
+        }
+        pointer_item.x = MIN(x - left, 31);
+        pointer_item.y = MIN(y - top, 31);
+        pointer_item.width = 32;
+        pointer_item.height = 32;
+        pointer_item.data = crop_data;
+        pointer_item.mask = crop_mask;
+    }
     self->screen->pointer = xrdp_cache_add_pointer(self->cache, &pointer_item);
     return 0;
 }
@@ -333,10 +417,11 @@ xrdp_wm_load_pointer(struct xrdp_wm *self, char *file_name, char *data,
 /*****************************************************************************/
 int
 xrdp_wm_send_pointer(struct xrdp_wm *self, int cache_idx,
-                     char *data, char *mask, int x, int y, int bpp)
+                     char *data, char *mask, int x, int y, int bpp,
+                     int width, int height)
 {
-    return libxrdp_send_pointer(self->session, cache_idx, data, mask,
-                                x, y, bpp);
+    return libxrdp_send_pointer_large(self->session, cache_idx, data, mask,
+                                      x, y, bpp, width, height);
 }
 
 /*****************************************************************************/
@@ -539,16 +624,30 @@ xrdp_wm_load_static_pointers(struct xrdp_wm *self)
 {
     struct xrdp_pointer_item pointer_item;
     char file_path[256];
+    char data[32 * 32 * 4];
+    char mask[32 * 32 / 8];
 
     DEBUG(("sending cursor"));
     g_snprintf(file_path, 255, "%s/cursor1.cur", XRDP_SHARE_PATH);
     g_memset(&pointer_item, 0, sizeof(pointer_item));
+    g_memset(data, 0, sizeof(data));
+    g_memset(mask, 0, sizeof(mask));
+    pointer_item.data = data;
+    pointer_item.mask = mask;
+    pointer_item.width = 32;
+    pointer_item.height = 32;
     xrdp_wm_load_pointer(self, file_path, pointer_item.data,
                          pointer_item.mask, &pointer_item.x, &pointer_item.y);
     xrdp_cache_add_pointer_static(self->cache, &pointer_item, 1);
     DEBUG(("sending cursor"));
     g_snprintf(file_path, 255, "%s/cursor0.cur", XRDP_SHARE_PATH);
     g_memset(&pointer_item, 0, sizeof(pointer_item));
+    g_memset(data, 0, sizeof(data));
+    g_memset(mask, 0, sizeof(mask));
+    pointer_item.data = data;
+    pointer_item.mask = mask;
+    pointer_item.width = 32;
+    pointer_item.height = 32;
     xrdp_wm_load_pointer(self, file_path, pointer_item.data,
                          pointer_item.mask, &pointer_item.x, &pointer_item.y);
     xrdp_cache_add_pointer_static(self->cache, &pointer_item, 0);
@@ -1822,6 +1921,85 @@ xrdp_wm_process_input_mousex(struct xrdp_wm* self, int device_flags,
     return 0;
 }
 
+/******************************************************************************/
+/* sends the motion held back in callback */
+static int
+xrdp_wm_flush_mouse(struct xrdp_wm *self)
+{
+    if (self->mouse_pending == 0)
+    {
+        return 0;
+    }
+    self->mouse_pending = 0;
+    self->mouse_sent_time = g_time3();
+    return xrdp_wm_process_input_mouse(self, PTRFLAGS_MOVE,
+                                       self->mouse_pending_x,
+                                       self->mouse_pending_y);
+}
+
+/******************************************************************************/
+/* an input PDU starts, until xrdp_wm_input_end motion only mouse events
+   are merged to the last position and everything for the mod goes out
+   in one write */
+static int
+xrdp_wm_input_begin(struct xrdp_wm *self)
+{
+    struct xrdp_mod *mod;
+
+    if (self->input_batch == 0)
+    {
+        mod = self->mm->mod;
+        if (mod != 0 && mod->mod_event != 0)
+        {
+            mod->mod_event(mod, WM_INPUT_BEGIN, 0, 0, 0, 0);
+            self->input_batch_mod = mod;
+        }
+    }
+    self->input_batch++;
+    return 0;
+}
+
+/******************************************************************************/
+static int
+xrdp_wm_input_end(struct xrdp_wm *self)
+{
+    int coalesce_ms;
+    int rv;
+
+    if (self->input_batch < 1)
+    {
+        return 0;
+    }
+    self->input_batch--;
+    if (self->input_batch > 0)
+    {
+        return 0;
+    }
+    rv = 0;
+    if (self->mouse_pending)
+    {
+        /* with input_coalesce_ms set, motion that comes too soon after the
+           last one waits in xrdp_wm_check_wait_objs */
+        coalesce_ms = self->xrdp_config->cfg_globals.input_coalesce_ms;
+        if (coalesce_ms < 1 ||
+            g_time3() - self->mouse_sent_time >= coalesce_ms)
+        {
+            rv = xrdp_wm_flush_mouse(self);
+        }
+    }
+    if (self->input_batch_mod != 0)
+    {
+        /* the mod can change while handling a login screen key */
+        if (self->input_batch_mod == self->mm->mod)
+        {
+            self->input_batch_mod->mod_event(self->input_batch_mod,
+                                             WM_INPUT_END, 0, 0, 0, 0);
+        }
+        self->input_batch_mod = 0;
+    }
+    return rv;
+}
+
 /******************************************************************************/
 /* param1 = MAKELONG(channel_id, flags)
    param2 = size
@@ -1879,6 +2057,27 @@ callback(intptr_t id, int msg, intptr_t param1, intptr_t param2,
 
     rv = 0;
 
+    if (wm->mouse_pending)
+    {
+        /* keep the order of motion against keys and buttons */
+        switch (msg)
+        {
+            case RDP_INPUT_MOUSE:
+                if (param3 == PTRFLAGS_MOVE)
+                {
+                    break;
+                }
+                xrdp_wm_flush_mouse(wm);
+                break;
+            case RDP_INPUT_SYNCHRONIZE:
+            case RDP_INPUT_SCANCODE:
+            case RDP_INPUT_UNICODE:
+            case RDP_INPUT_MOUSEX:
+                xrdp_wm_flush_mouse(wm);
+                break;
+        }
+    }
+
     switch (msg)
     {
         case RDP_INPUT_SYNCHRONIZE:
@@ -1891,6 +2090,14 @@ callback(intptr_t id, int msg, intptr_t param1, intptr_t param2,
             rv = xrdp_wm_key_unicode(wm, param3, param1);
             break;
         case RDP_INPUT_MOUSE:
+            if (wm->input_batch > 0 && param3 == PTRFLAGS_MOVE)
+            {
+                /* only the last position matters */
+                wm->mouse_pending = 1;
+                wm->mouse_pending_x = param1;
+                wm->mouse_pending_y = param2;
+                break;
+            }
             rv = xrdp_wm_process_input_mouse(wm, param3, param1, param2);
             break;
         case RDP_INPUT_MOUSEX:
@@ -1916,6 +2123,12 @@ callback(intptr_t id, int msg, intptr_t param1, intptr_t param2,
         case 0x5558:
             xrdp_mm_drdynvc_up(wm->mm);
             break;
+        case 0x5559: /* input PDU starts */
+            rv = xrdp_wm_input_begin(wm);
+            break;
+        case 0x555a: /* input PDU done */
+            rv = xrdp_wm_input_end(wm);
+            break;
     }
     return rv;
 }
@@ -2161,6 +2374,7 @@ xrdp_wm_get_wait_objs(struct xrdp_wm *self, tbus *robjs, int *rc,
                       tbus *wobjs, int *wc, int *timeout)
 {
     int i;
+    int left;
 
     if (self == 0)
     {
@@ -2170,6 +2384,20 @@ xrdp_wm_get_wait_objs(struct xrdp_wm *self, tbus *robjs, int *rc,
     i = *rc;
     robjs[i++] = self->login_mode_event;
     *rc = i;
+    if (self->mouse_pending && self->input_batch == 0)
+    {
+        /* held back motion, see xrdp_wm_input_end */
+        left = self->xrdp_config->cfg_globals.input_coalesce_ms -
+               (g_time3() - self->mouse_sent_time);
+        if (left < 0)
+        {
+            left = 0;
+        }
+        if (*timeout < 0 || *timeout > left)
+        {
+            *timeout = left;
+        }
+    }
     return xrdp_mm_get_wait_objs(self->mm, robjs, rc, wobjs, wc, timeout);
 }
 
@@ -2192,6 +2420,15 @@ xrdp_wm_check_wait_objs(struct xrdp_wm *self)
         xrdp_wm_login_mode_changed(self);
     }
 
+    if (self->mouse_pending && self->input_batch == 0)
+    {
+        if (g_time3() - self->mouse_sent_time >=
+            self->xrdp_config->cfg_globals.input_coalesce_ms)
+        {
+            rv = xrdp_wm_flush_mouse(self);
+        }
+    }
+
     if (rv == 0)
     {
         rv = xrdp_mm_check_wait_objs(self->mm);
@@ -25,6 +25,7 @@
 #include "xup.h"
 #include "log.h"
 #include "trans.h"
+#include "xrdp_constants.h"
 
 #define LOG_LEVEL 1
 #define LLOG(_level, _args) \
@@ -34,6 +35,8 @@
 
 static int
 lib_mod_process_message(struct mod *mod, struct stream *s);
+int
+lib_mod_release_data(struct mod *amod, char *data);
 
 /******************************************************************************/
 static int
@@ -89,6 +92,7 @@ lib_data_in(struct trans *trans)
     struct mod *self;
     struct stream *s;
     int len;
+    char header[8];
 
     LLOGLN(10, ("lib_data_in:"));
     if (trans == 0)
@@ -110,11 +114,20 @@ lib_data_in(struct trans *trans)
             s->p = s->data;
             in_uint8s(s, 4); /* processed later in lib_mod_process_message */
             in_uint32_le(s, len);
-            if (len < 0 || len > 128 * 1024)
+            if (len < 0 || len > 1024 * 1024)
             {
                 g_writeln("lib_data_in: bad size");
                 return 1;
             }
+            if (len + 8 > s->size)
+            {
+                /* large pointers do not fit in the default size, keep
+                   the header */
+                g_memcpy(header, s->data, 8);
+                init_stream(s, len + 8);
+                out_uint8a(s, header, 8);
+                s->end = s->p;
+            }
             if (len > 0)
             {
                 trans->header_size = len + 8;
@@ -192,6 +205,7 @@ lib_mod_connect(struct mod *mod)
             free_stream(s);
             return 1;
         }
+        mod->ring_fd_recv = trans_enable_fd_recv(mod->trans) == 0;
     }
     else
     {
@@ -339,6 +353,17 @@ lib_mod_event(struct mod *mod, int msg, tbus param1, tbus param2,
     int rv;
 
     LIB_DEBUG(mod, "in lib_mod_event");
+
+    /* gather the input events in between into one write */
+    if (msg == WM_INPUT_BEGIN)
+    {
+        return trans_cork(mod->trans);
+    }
+    if (msg == WM_INPUT_END)
+    {
+        return trans_uncork(mod->trans);
+    }
+
     make_stream(s);
 
     if ((msg >= 15) && (msg <= 16)) /* key events */
@@ -1027,6 +1052,56 @@ process_server_set_pointer_ex(struct mod *mod, struct stream *s)
     return rv;
 }
 
+/******************************************************************************/
+/* pointer of any size up to 384x384, the mask rows are padded to 2 bytes
+   return error */
+static int
+process_server_set_pointer_large(struct mod *mod, struct stream *s)
+{
+    int rv;
+    int x;
+    int y;
+    int bpp;
+    int Bpp;
+    int width;
+    int height;
+    int data_bytes;
+    int mask_bytes;
+    char *cur_data;
+    char *cur_mask;
+
+    in_sint16_le(s, x);
+    in_sint16_le(s, y);
+    in_uint16_le(s, bpp);
+    in_uint16_le(s, width);
+    in_uint16_le(s, height);
+    Bpp = (bpp == 0) ? 3 : (bpp + 7) / 8;
+    if (width < 1 || width > 384 || height < 1 || height > 384)
+    {
+        g_writeln("process_server_set_pointer_large: bad size %dx%d",
+                  width, height);
+        return 1;
+    }
+    data_bytes = width * height * Bpp;
+    mask_bytes = ((width + 15) / 16) * 2 * height;
+    if (!s_check_rem(s, data_bytes + mask_bytes))
+    {
+        return 1;
+    }
+    /* used in place, xrdp copies what it keeps */
+    cur_data = s->p;
+    in_uint8s(s, data_bytes);
+    cur_mask = s->p;
+    in_uint8s(s, mask_bytes);
+    if (mod->server_set_pointer_large == 0)
+    {
+        return 0;
+    }
+    rv = mod->server_set_pointer_large(mod, x, y, cur_data, cur_mask, bpp,
+                                       width, height);
+    return rv;
+}
+
 /******************************************************************************/
 /* return error */
 static int
@@ -1120,6 +1195,54 @@ process_server_paint_rect_shmem(struct mod *amod, struct stream *s)
     return rv;
 }
 
+/******************************************************************************/
+/* the rects are little endian x, y, cx, cy int16s on the wire, use them
+   in place when the host layout matches, otherwise unpack them into a
+   buffer that is kept for the next message
+   returns nil if num_rects is zero or on error */
+static tsi16 *
+lib_read_rects(struct stream *s, int num_rects, tsi16 **rects,
+               int *max_rects)
+{
+    tsi16 *lrects;
+#if !(defined(L_ENDIAN) && defined(NO_NEED_ALIGN))
+    tsi16 *lrects1;
+    int index;
+#endif
+
+    if (num_rects < 1)
+    {
+        return 0;
+    }
+#if defined(L_ENDIAN) && defined(NO_NEED_ALIGN)
+    lrects = (tsi16 *) (s->p);
+    in_uint8s(s, num_rects * 8);
+#else
+    if (num_rects > *max_rects)
+    {
+        g_free(*rects);
+        *rects = (tsi16 *) g_malloc(2 * 4 * num_rects, 0);
+        *max_rects = *rects == 0 ? 0 : num_rects;
+    }
+    lrects = *rects;
+    if (lrects == 0)
+    {
+        in_uint8s(s, num_rects * 8);
+        return 0;
+    }
+    lrects1 = lrects;
+    for (index = 0; index < num_rects; index++)
+    {
+        in_sint16_le(s, lrects1[0]);
+        in_sint16_le(s, lrects1[1]);
+        in_sint16_le(s, lrects1[2]);
+        in_sint16_le(s, lrects1[3]);
+        lrects1 += 4;
+    }
+#endif
+    return lrects;
+}
+
 /******************************************************************************/
 /* return error */
 static int
@@ -1156,39 +1279,20 @@ process_server_paint_rect_shmem_ex(struct mod *amod, struct stream *s)
     int shmem_offset;
     int width;
     int height;
-    int index;
     int rv;
     tsi16 *ldrects;
-    tsi16 *ldrects1;
     tsi16 *lcrects;
-    tsi16 *lcrects1;
     char *bmpdata;
 
     /* dirty pixels */
     in_uint16_le(s, num_drects);
-    ldrects = (tsi16 *) g_malloc(2 * 4 * num_drects, 0);
-    ldrects1 = ldrects;
-    for (index = 0; index < num_drects; index++)
-    {
-        in_sint16_le(s, ldrects1[0]);
-        in_sint16_le(s, ldrects1[1]);
-        in_sint16_le(s, ldrects1[2]);
-        in_sint16_le(s, ldrects1[3]);
-        ldrects1 += 4;
-    }
+    ldrects = lib_read_rects(s, num_drects, &(amod->drects),
+                             &(amod->max_drects));
 
     /* copied pixels */
     in_uint16_le(s, num_crects);
-    lcrects = (tsi16 *) g_malloc(2 * 4 * num_crects, 0);
-    lcrects1 = lcrects;
-    for (index = 0; index < num_crects; index++)
-    {
-        in_sint16_le(s, lcrects1[0]);
-        in_sint16_le(s, lcrects1[1]);
-        in_sint16_le(s, lcrects1[2]);
-        in_sint16_le(s, lcrects1[3]);
-        lcrects1 += 4;
-    }
+    lcrects = lib_read_rects(s, num_crects, &(amod->crects),
+                             &(amod->max_crects));
 
     in_uint32_le(s, flags);
     in_uint32_le(s, frame_id);
@@ -1238,8 +1342,201 @@ process_server_paint_rect_shmem_ex(struct mod *amod, struct stream *s)
     //g_writeln("frame_id %d", frame_id);
     //send_paint_rect_ex_ack(amod, flags, frame_id);
 
-    g_free(lcrects);
-    g_free(ldrects);
+    return rv;
+}
+
+/******************************************************************************/
+/* return error */
+static int
+lib_ring_unmap(struct mod *amod, int index)
+{
+    struct xup_ring_buffer *rb;
+
+    rb = amod->ring + index;
+    if (rb->pixels != 0)
+    {
+        if (rb->kind == XUP_RING_MEMFD)
+        {
+            g_munmap(rb->pixels, rb->bytes);
+        }
+        else
+        {
+            g_shmdt(rb->pixels);
+        }
+    }
+    g_memset(rb, 0, sizeof(struct xup_ring_buffer));
+    return 0;
+}
+
+/******************************************************************************/
+/* the backend adds or replaces a ring buffer, for memfd the fd was sent
+   along with this order
+   return error */
+static int
+process_server_shmem_buffer(struct mod *amod, struct stream *s)
+{
+    int index;
+    int kind;
+    int shmem_id;
+    int bytes;
+    int fd;
+    char *pixels;
+    struct xup_ring_buffer *rb;
+
+    in_uint16_le(s, index);
+    in_uint16_le(s, kind);
+    in_uint32_le(s, shmem_id);
+    in_uint32_le(s, bytes);
+    fd = -1;
+    if (kind == XUP_RING_MEMFD)
+    {
+        fd = trans_get_recv_fd(amod->trans);
+        if (fd == -1)
+        {
+            LLOGLN(0, ("process_server_shmem_buffer: no fd for buffer %d",
+                   index));
+            return 1;
+        }
+    }
+    if (index < 0 || index >= XUP_RING_MAX || bytes < 1)
+    {
+        LLOGLN(0, ("process_server_shmem_buffer: bad buffer %d bytes %d",
+               index, bytes));
+        if (fd != -1)
+        {
+            g_file_close(fd);
+        }
+        return 1;
+    }
+    rb = amod->ring + index;
+    if (rb->busy > 0)
+    {
+        /* the encoder still reads from it, the backend should have waited
+           for the release, keep the old mapping alive */
+        LLOGLN(0, ("process_server_shmem_buffer: buffer %d busy", index));
+        if (fd != -1)
+        {
+            g_file_close(fd);
+        }
+        return 1;
+    }
+    lib_ring_unmap(amod, index);
+    if (kind == XUP_RING_MEMFD)
+    {
+        pixels = (char *) g_mmap_fd(fd, bytes);
+        /* the mapping keeps the memory alive */
+        g_file_close(fd);
+    }
+    else
+    {
+        pixels = (char *) g_shmat(shmem_id);
+        if (pixels == (void *) -1)
+        {
+            pixels = 0;
+        }
+    }
+    if (pixels == 0)
+    {
+        LLOGLN(0, ("process_server_shmem_buffer: map buffer %d failed",
+               index));
+        return 1;
+    }
+    rb->kind = kind;
+    rb->bytes = bytes;
+    rb->pixels = pixels;
+    LLOGLN(10, ("process_server_shmem_buffer: index %d kind %d bytes %d",
+           index, kind, bytes));
+    return 0;
+}
+
+/******************************************************************************/
+/* return error */
+static int
+send_buffer_release(struct mod *mod, int index)
+{
+    int len;
+    struct stream *s;
+
+    make_stream(s);
+    init_stream(s, 8192);
+    s_push_layer(s, iso_hdr, 4);
+    out_uint16_le(s, 108);
+    out_uint32_le(s, index);
+    s_mark_end(s);
+    len = (int)(s->end - s->data);
+    s_pop_layer(s, iso_hdr);
+    out_uint32_le(s, len);
+    lib_send_copy(mod, s);
+    free_stream(s);
+    return 0;
+}
+
+/******************************************************************************/
+/* like process_server_paint_rect_shmem_ex but the pixels are in one of the
+   ring buffers, the buffer stays busy until xrdp calls mod_release_data
+   return error */
+static int
+process_server_paint_rect_shmem_ring(struct mod *amod, struct stream *s)
+{
+    int num_drects;
+    int num_crects;
+    int flags;
+    int frame_id;
+    int buffer;
+    int shmem_offset;
+    int width;
+    int height;
+    int rv;
+    tsi16 *ldrects;
+    tsi16 *lcrects;
+    struct xup_ring_buffer *rb;
+
+    /* dirty pixels */
+    in_uint16_le(s, num_drects);
+    ldrects = lib_read_rects(s, num_drects, &(amod->drects),
+                             &(amod->max_drects));
+
+    /* copied pixels */
+    in_uint16_le(s, num_crects);
+    lcrects = lib_read_rects(s, num_crects, &(amod->crects),
+                             &(amod->max_crects));
+
+    in_uint32_le(s, flags);
+    in_uint32_le(s, frame_id);
+    in_uint16_le(s, buffer);
+    in_uint32_le(s, shmem_offset);
+
+    in_uint16_le(s, width);
+    in_uint16_le(s, height);
+
+    rv = 1;
+    rb = 0;
+    if (buffer >= 0 && buffer < XUP_RING_MAX)
+    {
+        rb = amod->ring + buffer;
+    }
+    /* all from the backend, 64 bit so it can not wrap */
+    if (rb != 0 && rb->pixels != 0 && shmem_offset >= 0 &&
+        (tui64) shmem_offset + (tui64) width * height * 4 <=
+        (tui64) rb->bytes)
+    {
+        rb->busy++;
+        rv = amod->server_paint_rects(amod, num_drects, ldrects,
+                                      num_crects, lcrects,
+                                      rb->pixels + shmem_offset,
+                                      width, height,
+                                      flags, frame_id);
+        if (rv != 0)
+        {
+            /* not queued, nothing will release it */
+            lib_mod_release_data(amod, rb->pixels + shmem_offset);
+        }
+    }
+    else
+    {
+        LLOGLN(0, ("process_server_paint_rect_shmem_ring: bad buffer %d",
+               buffer));
+    }
 
     return rv;
 }
@@ -1339,12 +1636,21 @@ lib_mod_process_orders(struct mod *mod, int type, struct stream *s)
         case 51: /* server_set_pointer_ex */
             rv = process_server_set_pointer_ex(mod, s);
             break;
+        case 52: /* server_set_pointer_large */
+            rv = process_server_set_pointer_large(mod, s);
+            break;
         case 60: /* server_paint_rect_shmem */
             rv = process_server_paint_rect_shmem(mod, s);
             break;
         case 61: /* server_paint_rect_shmem_ex */
             rv = process_server_paint_rect_shmem_ex(mod, s);
             break;
+        case 62: /* server_shmem_buffer */
+            rv = process_server_shmem_buffer(mod, s);
+            break;
+        case 63: /* server_paint_rect_shmem_ring */
+            rv = process_server_paint_rect_shmem_ring(mod, s);
+            break;
         default:
             g_writeln("lib_mod_process_orders: unknown order type %d", type);
             rv = 0;
@@ -1377,6 +1683,38 @@ lib_send_client_info(struct mod *mod)
     return 0;
 }
 
+/******************************************************************************/
+/* tell the backend it can render into a ring of buffers, flags bit 0 is
+   SysV and bit 1 memfd over this socket, a memfd must be sealed with
+   F_SEAL_SHRINK and hold the whole buffer, see g_mmap_fd
+   return error */
+static int
+lib_send_ring_caps(struct mod *mod)
+{
+    struct stream *s;
+    int len;
+    int flags;
+
+    flags = 1;
+    if (mod->ring_fd_recv)
+    {
+        flags |= 2;
+    }
+    make_stream(s);
+    init_stream(s, 8192);
+    s_push_layer(s, iso_hdr, 4);
+    out_uint16_le(s, 107);
+    out_uint32_le(s, XUP_RING_MAX);
+    out_uint32_le(s, flags);
+    s_mark_end(s);
+    len = (int)(s->end - s->data);
+    s_pop_layer(s, iso_hdr);
+    out_uint32_le(s, len);
+    lib_send_copy(mod, s);
+    free_stream(s);
+    return 0;
+}
+
 /******************************************************************************/
 /* return error */
 static int
@@ -1432,6 +1770,7 @@ lib_mod_process_message(struct mod *mod, struct stream *s)
             }
 
             lib_send_client_info(mod);
+            lib_send_ring_caps(mod);
         }
         else if (type == 3) /* order list with len after type */
         {
@@ -1473,11 +1812,23 @@ lib_mod_signal(struct mod *mod)
 int
 lib_mod_end(struct mod *mod)
 {
+    int index;
+
     if (mod->screen_shmem_pixels != 0)
     {
         g_shmdt(mod->screen_shmem_pixels);
         mod->screen_shmem_pixels = 0;
     }
+    for (index = 0; index < XUP_RING_MAX; index++)
+    {
+        lib_ring_unmap(mod, index);
+    }
+    g_free(mod->drects);
+    mod->drects = 0;
+    mod->max_drects = 0;
+    g_free(mod->crects);
+    mod->crects = 0;
+    mod->max_crects = 0;
     return 0;
 }
 
@@ -1556,6 +1907,34 @@ lib_mod_frame_ack(struct mod *amod, int flags, int frame_id)
     return 0;
 }
 
+/******************************************************************************/
+/* xrdp is done reading data, if it points into a ring buffer give that
+   buffer back to the backend
+   return error */
+int
+lib_mod_release_data(struct mod *amod, char *data)
+{
+    int index;
+    struct xup_ring_buffer *rb;
+
+    for (index = 0; index < XUP_RING_MAX; index++)
+    {
+        rb = amod->ring + index;
+        if (rb->busy > 0 && data >= rb->pixels &&
+            data < rb->pixels + rb->bytes)
+        {
+            rb->busy--;
+            if (rb->busy == 0)
+            {
+                LLOGLN(10, ("lib_mod_release_data: buffer %d", index));
+                send_buffer_release(amod, index);
+            }
+            return 0;
+        }
+    }
+    return 0;
+}
+
 /******************************************************************************/
 tintptr EXPORT_CC
 mod_init(void)
@@ -1575,6 +1954,7 @@ mod_init(void)
     mod->mod_get_wait_objs = lib_mod_get_wait_objs;
     mod->mod_check_wait_objs = lib_mod_check_wait_objs;
     mod->mod_frame_ack = lib_mod_frame_ack;
+    mod->mod_release_data = lib_mod_release_data;
     return (tintptr) mod;
 }
 
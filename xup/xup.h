@@ -28,6 +28,21 @@
 
 #define CURRENT_MOD_VER 3
 
+/* framebuffer ring shared with the X server, the backend renders into a
+   free buffer while the encoder still reads the previous ones */
+#define XUP_RING_MAX 3
+
+#define XUP_RING_SYSV  0 /* SysV shared memory, id sent in the order */
+#define XUP_RING_MEMFD 1 /* memfd, fd passed with SCM_RIGHTS */
+
+struct xup_ring_buffer
+{
+  int kind;
+  int bytes;
+  int busy; /* frames the encoder has not released yet */
+  char *pixels;
+};
+
 struct mod
 {
   int size; /* size of this struct */
@@ -45,7 +60,8 @@ struct mod
                            tbus* write_objs, int* wcount, int* timeout);
   int (*mod_check_wait_objs)(struct mod* v);
   int (*mod_frame_ack)(struct mod* v, int flags, int frame_id);
-  tintptr mod_dumby[100 - 10]; /* align, 100 minus the number of mod
+  int (*mod_release_data)(struct mod* v, char* data);
+  tintptr mod_dumby[100 - 11]; /* align, 100 minus the number of mod
                                  functions above */
   /* server functions */
   int (*server_begin_update)(struct mod* v);
@@ -139,8 +155,13 @@ struct mod
                             int num_crects, short *crects,
                             char *data, int width, int height,
                             int flags, int frame_id);
+  int (*server_session_info)(struct mod* v, const char *data,
+                             int data_bytes);
+  int (*server_set_pointer_large)(struct mod* v, int x, int y,
+                                  char* data, char* mask, int bpp,
+                                  int width, int height);
 
-  tintptr server_dumby[100 - 43]; /* align, 100 minus the number of server
+  tintptr server_dumby[100 - 45]; /* align, 100 minus the number of server
                                      functions above */
   /* common */
   tintptr handle; /* pointer to self as long */
@@ -162,4 +183,10 @@ struct mod
   int screen_shmem_id_mapped; /* boolean */
   char *screen_shmem_pixels;
   struct trans *trans;
+  struct xup_ring_buffer ring[XUP_RING_MAX];
+  int ring_fd_recv; /* boolean, memfd buffers can be passed */
+  tsi16 *drects; /* reused by the paint_rect_shmem orders */
+  int max_drects;
+  tsi16 *crects;
+  int max_crects;
 };